@@ -1,5 +1,7 @@
+#include <stdio.h>
 #include <errno.h>
 #include <signal.h>
+#include <poll.h>
 #include <sys/types.h>
 
 #include <Eina.h>
@@ -7,7 +9,6 @@
 #include <eupnp_ssdp.h>
 #include <eupnp_control_point.h>
 
-int sock;
 int exit_req = 0;
 
 void terminate(int p)
@@ -15,22 +16,36 @@ void terminate(int p)
    exit_req = 1;
 }
 
+void on_event(void *data, const Eupnp_SSDP_Event *ev)
+{
+   (void)data;
+
+   printf("%s %s (%s)\n",
+	  ev->type == EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE ? "-" : "+",
+	  ev->usn, ev->target);
+}
+
 /*
  * Sends a test search and listens for datagrams. Tests MSearch and SSDP
  * server.
  *
+ * Device or service type patterns given on the command line are added to the
+ * control point filter, e.g.
+ * "./eupnp_basic_control_point urn:schemas-upnp-org:device:MediaRenderer:1+"
+ *
  * Run with "EINA_ERROR_LEVEL=3 ./eupnp_basic_control_point" for watching debug
  * messages.
  */
-int main(void)
+int main(int argc, char **argv)
 {
    signal(SIGTERM, terminate);
    signal(SIGINT, terminate);
    eupnp_init();
 
-   int ret;
-   fd_set r, w, ex;
+   int ret, i;
+   struct pollfd pfd;
    Eupnp_Control_Point *c;
+   double timeout;
 
    c = eupnp_control_point_new();
 
@@ -40,42 +55,44 @@ int main(void)
 	return -1;
      }
 
-   /* Send a test search */
-   if (!eupnp_control_point_discovery_request_send(c, 5, "ssdp:all"))
+   for (i = 1; i < argc; i++)
+      if (!eupnp_control_point_filter_add(c, argv[i]))
+	 EINA_ERROR_PWARN("Invalid filter pattern %s\n", argv[i]);
+
+   eupnp_control_point_event_callback_set(c, on_event, NULL);
+
+   /* Search now, then rescan periodically */
+   if (!eupnp_control_point_discovery_start(c, "ssdp:all"))
      {
 	EINA_ERROR_PWARN("Failed to perform MSearch.\n");
      }
     else
 	EINA_ERROR_PDBG("MSearch sent sucessfully.\n");
 
-   sock = c->ssdp_server->udp_sock->socket;
+   /* This is all an event loop needs, see eupnp_ecore.h and eupnp_glib.h for
+    * adapters running the control point from Ecore or GLib instead.
+    */
+   pfd.fd = eupnp_control_point_fd_get(c);
+   pfd.events = POLLIN;
 
    while (!exit_req)
      {
-	FD_ZERO(&r);
-	FD_ZERO(&w);
-	FD_ZERO(&ex);
-	FD_SET(sock, &r);
-	ret = select(sock+1, &r, NULL, NULL, NULL);
+	/* Wake up for the control point timers (expiry, revalidation) */
+	timeout = eupnp_control_point_timeout_get(c);
+
+	ret = poll(&pfd, 1, timeout < 0 ? -1 : (int)(timeout * 1000 + 0.999));
 
-	if (ret < 0)
+	if (ret < 0 && errno != EINTR)
 	  {
-	     perror("Select error");
+	     perror("Poll error");
 	     break;
 	  }
 
 	if (exit_req)
 	   break;
 
-	if (FD_ISSET(sock, &r))
-	  { 
-	       /* This is the event handler that will be added to the event loop.
-	       * For example, when integrating eupnp+ecore, this socket will
-	       * internally be added with ecore_fd_handler_add and the handler
-	       * passed will be a wrapper of _eupnp_ssdp_on_datagram_available.
-	       */
-	      _eupnp_ssdp_on_datagram_available(c->ssdp_server);
-          }
+	/* Datagrams and due timers, all on a single wakeup */
+	eupnp_control_point_dispatch(c);
      }
 
    eupnp_control_point_free(c);
@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <Eina.h>
+#include <eupnp.h>
+#include <eupnp_http_message.h>
+
+#define FUZZ_INPUT_MAX (1 << 20)
+
+#define FUZZ_CHECK(cond)						\
+   do {									\
+	if (!(cond))							\
+	  {								\
+	     fprintf(stderr, "Parser and oracle disagree: %s\n", #cond); \
+	     abort();							\
+	  }								\
+   } while (0)
+
+typedef struct _Oracle_Header Oracle_Header;
+typedef struct _Oracle_Message Oracle_Message;
+
+struct _Oracle_Header {
+   const char *key;
+   const char *value;
+};
+
+/*
+ * A message split by the oracle: start line parts and headers point into buf.
+ */
+struct _Oracle_Message {
+   char *buf;
+   const char *first;
+   const char *second;
+   const char *third;
+   Oracle_Header *headers;
+   unsigned int count;
+};
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static Eina_Bool
+str_equal(const char *a, const char *b)
+{
+   if (!a || !b) return a == b;
+   return !strcmp(a, b);
+}
+
+/*
+ * Reference parser the library parsers are checked against. It implements
+ * the same grammar written the straightforward way, splitting a copy of the
+ * message in place with strstr() and strchr():
+ *
+ * - The start line ends at the first CRLF and holds three parts separated by
+ *   the first two spaces. The first two must not be empty, the third may be
+ *   and may contain spaces.
+ * - Each following line up to a CRLF is a header, its key up to the first
+ *   ':' (not empty, lowercased) and its value without surrounding spaces and
+ *   tabs. Headers end at a blank line, an unterminated line or a line
+ *   without key, leaving the message valid with the headers found so far.
+ *
+ * @return EINA_FALSE if the start line is invalid.
+ */
+static Eina_Bool
+oracle_parse(Oracle_Message *m, const char *msg)
+{
+   char *line, *next, *sp, *colon, *v, *e, *k;
+   const char *p;
+   unsigned int lines = 1;
+
+   memset(m, 0, sizeof(Oracle_Message));
+
+   for (p = msg; (p = strstr(p, "\r\n")); p += 2)
+      lines++;
+
+   m->buf = strdup(msg);
+   m->headers = malloc(lines * sizeof(Oracle_Header));
+
+   if (!m->buf || !m->headers)
+     {
+	fprintf(stderr, "Out of memory\n");
+	abort();
+     }
+
+   line = m->buf;
+   if (!(next = strstr(line, "\r\n"))) return EINA_FALSE;
+   *next = '\0';
+   next += 2;
+
+   if (!(sp = strchr(line, ' ')) || sp == line) return EINA_FALSE;
+   *sp = '\0';
+   m->first = line;
+   line = sp + 1;
+
+   if (!(sp = strchr(line, ' ')) || sp == line) return EINA_FALSE;
+   *sp = '\0';
+   m->second = line;
+   m->third = sp + 1;
+
+   for (line = next; (next = strstr(line, "\r\n")); line = next)
+     {
+	*next = '\0';
+	next += 2;
+
+	if (!(colon = strchr(line, ':')) || colon == line) break;
+	*colon = '\0';
+
+	for (v = colon + 1; *v == ' ' || *v == '\t'; v++) ;
+	for (e = v + strlen(v); e > v && (e[-1] == ' ' || e[-1] == '\t'); e--) ;
+	*e = '\0';
+
+	for (k = line; *k; k++)
+	   *k = tolower((unsigned char)*k);
+
+	m->headers[m->count].key = line;
+	m->headers[m->count].value = v;
+	m->count++;
+     }
+
+   return EINA_TRUE;
+}
+
+static void
+oracle_free(Oracle_Message *m)
+{
+   free(m->buf);
+   free(m->headers);
+}
+
+/*
+ * Headers must come out the same and in the same order.
+ */
+static Eina_Bool
+headers_equal(Eina_Array *a, const Oracle_Message *m)
+{
+   Eupnp_HTTP_Header *h;
+   unsigned int i;
+
+   if (eina_array_count_get(a) != m->count)
+      return EINA_FALSE;
+
+   for (i = 0; i < m->count; i++)
+     {
+	h = eina_array_data_get(a, i);
+
+	if (!str_equal(h->key, m->headers[i].key) ||
+	    !str_equal(h->value, m->headers[i].value))
+	   return EINA_FALSE;
+     }
+
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+status_code_valid(const char *s)
+{
+   return strlen(s) == 3 && s[0] >= '1' && s[0] <= '5' &&
+	  isdigit((unsigned char)s[1]) && isdigit((unsigned char)s[2]);
+}
+
+static void
+request_compare(Eupnp_HTTP_Request *r, Eina_Bool valid, const Oracle_Message *m)
+{
+   FUZZ_CHECK(valid == !!r);
+
+   if (!r) return;
+
+   FUZZ_CHECK(str_equal(r->method, m->first));
+   FUZZ_CHECK(str_equal(r->uri, m->second));
+   FUZZ_CHECK(str_equal(r->http_version, m->third));
+   FUZZ_CHECK(headers_equal(r->headers, m));
+   eupnp_http_request_free(r);
+}
+
+static void
+response_compare(Eupnp_HTTP_Response *r, Eina_Bool valid, const Oracle_Message *m)
+{
+   FUZZ_CHECK(valid == !!r);
+
+   if (!r) return;
+
+   FUZZ_CHECK(str_equal(r->http_version, m->first));
+   FUZZ_CHECK(r->status_code == atoi(m->second));
+   FUZZ_CHECK(str_equal(r->reason_phrase, m->third));
+   FUZZ_CHECK(headers_equal(r->headers, m));
+   eupnp_http_response_free(r);
+}
+
+/*
+ * Checks both entry points of each parser against the oracle: the NULL
+ * terminated one on msg, the length-bounded one on the same len bytes left
+ * unterminated in data.
+ */
+static void
+message_check(const char *msg, const char *data, size_t len)
+{
+   Oracle_Message m;
+   Eina_Bool valid;
+
+   valid = oracle_parse(&m, msg);
+   request_compare(eupnp_http_request_parse(msg), valid, &m);
+   request_compare(eupnp_http_request_parse_length(data, len), valid, &m);
+
+   valid = valid && status_code_valid(m.second);
+   response_compare(eupnp_http_response_parse(msg), valid, &m);
+   response_compare(eupnp_http_response_parse_length(data, len), valid, &m);
+
+   oracle_free(&m);
+}
+
+int
+LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+   (void)argc;
+   (void)argv;
+
+   eupnp_init();
+   return 0;
+}
+
+/*
+ * Runs one input through both request and response parsers.
+ *
+ * The length-bounded entry points first get the whole input, NULL bytes
+ * included, in a buffer of exactly size bytes so that ASan catches any read
+ * past it. Then the input up to its first NULL byte, which the oracle can
+ * handle, goes through all entry points and is checked with message_check().
+ */
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+   const char *in = (const char *)data;
+   Eupnp_HTTP_Request *request;
+   Eupnp_HTTP_Response *response;
+   size_t len;
+   char *msg;
+
+   if ((request = eupnp_http_request_parse_length(in, size)))
+      eupnp_http_request_free(request);
+   if ((response = eupnp_http_response_parse_length(in, size)))
+      eupnp_http_response_free(response);
+
+   len = strnlen(in, size);
+   msg = malloc(len + 1);
+   if (!msg) return 0;
+
+   memcpy(msg, in, len);
+   msg[len] = '\0';
+
+   FUZZ_CHECK(eupnp_http_message_is_response(msg) ==
+	      !strncmp(msg, "HTTP/1.1", 8));
+   FUZZ_CHECK(eupnp_http_message_is_request(msg) ==
+	      !eupnp_http_message_is_response(msg));
+   FUZZ_CHECK(eupnp_http_message_is_response_length(in, len) ==
+	      eupnp_http_message_is_response(msg));
+   FUZZ_CHECK(eupnp_http_message_is_request_length(in, len) ==
+	      eupnp_http_message_is_request(msg));
+
+   message_check(msg, in, len);
+
+   free(msg);
+   return 0;
+}
+
+#ifndef EUPNP_LIBFUZZER
+
+static int
+fuzz_file(FILE *f, const char *name)
+{
+   char *buf, *data;
+   size_t len;
+
+   buf = malloc(FUZZ_INPUT_MAX);
+   if (!buf) return -1;
+
+   len = fread(buf, 1, FUZZ_INPUT_MAX, f);
+
+   if (ferror(f))
+     {
+	fprintf(stderr, "Could not read %s\n", name);
+	free(buf);
+	return -1;
+     }
+
+   // Exactly sized, so reads past the input are caught
+   data = malloc(len ? len : 1);
+   if (data)
+     {
+	memcpy(data, buf, len);
+	LLVMFuzzerTestOneInput((const uint8_t *)data, len);
+	free(data);
+     }
+
+   free(buf);
+   return 0;
+}
+
+/*
+ * Fuzz harness for the HTTP message parsers.
+ *
+ * Built with configure --enable-fuzzer this is a libFuzzer target:
+ *
+ *   ./eupnp_http_fuzz -close_fd_mask=2 corpus/http
+ *
+ * Otherwise it runs each file given (stdin if none) once, which serves AFL
+ * (afl-fuzz -i corpus/http -o findings ./eupnp_http_fuzz @@) and replaying
+ * crashes. Use --enable-sanitizers in both cases.
+ */
+int main(int argc, char **argv)
+{
+   FILE *f;
+   int i, ret = 0;
+
+   LLVMFuzzerInitialize(&argc, &argv);
+
+   if (argc < 2)
+      ret = fuzz_file(stdin, "stdin");
+
+   for (i = 1; i < argc; i++)
+     {
+	f = fopen(argv[i], "rb");
+
+	if (!f)
+	  {
+	     fprintf(stderr, "Could not open %s\n", argv[i]);
+	     ret = -1;
+	     continue;
+	  }
+
+	if (fuzz_file(f, argv[i]) < 0) ret = -1;
+	fclose(f);
+     }
+
+   eupnp_shutdown();
+   return ret;
+}
+
+#endif /* EUPNP_LIBFUZZER */
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <Eina.h>
+#include <eupnp.h>
+#include <eupnp_http_message.h>
+
+#define BENCH_MESSAGES_MAX 4096
+#define BENCH_MESSAGE_LEN_MAX (1 << 20)
+#define BENCH_ROUNDS 5
+
+typedef struct _Message Message;
+
+struct _Message {
+   char *data;
+   size_t len;
+   Eina_Bool response;
+};
+
+static Message messages[BENCH_MESSAGES_MAX];
+static unsigned int message_count;
+
+static int
+message_load(const char *path)
+{
+   struct stat st;
+   Message *m;
+   FILE *f;
+
+   if (message_count == BENCH_MESSAGES_MAX)
+     {
+	fprintf(stderr, "Too many messages, %s skipped\n", path);
+	return 0;
+     }
+
+   if (stat(path, &st) < 0 || !st.st_size || st.st_size > BENCH_MESSAGE_LEN_MAX)
+     {
+	fprintf(stderr, "Skipping %s\n", path);
+	return 0;
+     }
+
+   m = &messages[message_count];
+   m->len = st.st_size;
+   m->data = malloc(m->len);
+   f = fopen(path, "rb");
+
+   if (!m->data || !f || fread(m->data, 1, m->len, f) != m->len)
+     {
+	fprintf(stderr, "Could not read %s\n", path);
+	if (f) fclose(f);
+	free(m->data);
+	return -1;
+     }
+
+   fclose(f);
+   m->response = eupnp_http_message_is_response_length(m->data, m->len);
+   message_count++;
+
+   return 0;
+}
+
+/*
+ * Loads a message file, or every regular file of a directory.
+ */
+static int
+corpus_load(const char *path)
+{
+   struct dirent *e;
+   struct stat st;
+   char file[4096];
+   DIR *dir;
+   int ret = 0;
+
+   if (stat(path, &st) < 0)
+     {
+	fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+	return -1;
+     }
+
+   if (!S_ISDIR(st.st_mode))
+      return message_load(path);
+
+   if (!(dir = opendir(path)))
+     {
+	fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+	return -1;
+     }
+
+   while ((e = readdir(dir)) && !ret)
+     {
+	if (e->d_name[0] == '.') continue;
+
+	snprintf(file, sizeof(file), "%s/%s", path, e->d_name);
+
+	if (!stat(file, &st) && S_ISREG(st.st_mode))
+	   ret = message_load(file);
+     }
+
+   closedir(dir);
+   return ret;
+}
+
+/*
+ * Parses the whole corpus over and over for about duration seconds.
+ *
+ * @return messages parsed per second.
+ */
+static double
+bench(double duration, unsigned long *failed)
+{
+   Eupnp_HTTP_Request *request;
+   Eupnp_HTTP_Response *response;
+   unsigned long parsed = 0;
+   double start, elapsed;
+   unsigned int i;
+
+   *failed = 0;
+   start = eupnp_time_now();
+
+   do
+     {
+	for (i = 0; i < message_count; i++)
+	  {
+	     Message *m = &messages[i];
+
+	     if (m->response)
+	       {
+		  if ((response = eupnp_http_response_parse_length(m->data, m->len)))
+		     eupnp_http_response_free(response);
+		  else
+		     (*failed)++;
+	       }
+	     else
+	       {
+		  if ((request = eupnp_http_request_parse_length(m->data, m->len)))
+		     eupnp_http_request_free(request);
+		  else
+		     (*failed)++;
+	       }
+	  }
+
+	parsed += message_count;
+	elapsed = eupnp_time_now() - start;
+     }
+   while (elapsed < duration);
+
+   return parsed / elapsed;
+}
+
+static int
+baseline_read(const char *path, double *rate)
+{
+   FILE *f = fopen(path, "r");
+   int ok;
+
+   if (!f) return -1;
+   ok = fscanf(f, "%lf", rate) == 1 && *rate > 0;
+   fclose(f);
+
+   return ok ? 0 : -1;
+}
+
+static int
+baseline_write(const char *path, double rate)
+{
+   FILE *f = fopen(path, "w");
+
+   if (!f || fprintf(f, "%.0f\n", rate) < 0)
+     {
+	fprintf(stderr, "Could not write %s\n", path);
+	if (f) fclose(f);
+	return -1;
+     }
+
+   return fclose(f);
+}
+
+/*
+ * Measures HTTP message parsing throughput over a corpus of messages, one per
+ * file, e.g. corpus/http, and optionally compares it to a baseline.
+ *
+ * The best of BENCH_ROUNDS rounds of -d seconds (1 by default) is kept. With
+ * -b, it is compared to the rate stored in the baseline file and the program
+ * fails if it is more than -t percent (5 by default) below it; -s stores the
+ * rate measured as the new baseline instead.
+ *
+ * A baseline only means something for the machine and build it was measured
+ * on, so it is never committed: store one from a build of the reference
+ * revision, then compare a build of the change on the same, otherwise idle,
+ * machine ("make parse-bench-baseline", "make parse-bench-compare"). It is a
+ * tool for checking parser changes locally, not a CI gate, as shared runners
+ * vary far more than the tolerance.
+ *
+ * Usage: ./eupnp_parse_bench [-d seconds] [-b baseline [-s] [-t percent]] corpus...
+ */
+int main(int argc, char **argv)
+{
+   const char *baseline_path = NULL;
+   double duration = 1, tolerance = 5;
+   double rate, best = 0, baseline;
+   unsigned long failed;
+   size_t bytes = 0;
+   Eina_Bool save = EINA_FALSE;
+   unsigned int i;
+   int opt, ret = 0;
+
+   while ((opt = getopt(argc, argv, "d:b:st:")) != -1)
+     {
+	switch (opt)
+	  {
+	   case 'd':
+	      duration = atof(optarg);
+	      break;
+	   case 'b':
+	      baseline_path = optarg;
+	      break;
+	   case 's':
+	      save = EINA_TRUE;
+	      break;
+	   case 't':
+	      tolerance = atof(optarg);
+	      break;
+	   default:
+	      optind = argc;
+	  }
+     }
+
+   if (optind >= argc || duration <= 0 || (save && !baseline_path))
+     {
+	fprintf(stderr, "Usage: %s [-d seconds] [-b baseline [-s] [-t percent]] corpus...\n", argv[0]);
+	return -1;
+     }
+
+   eupnp_init();
+
+   for (; optind < argc; optind++)
+      if (corpus_load(argv[optind]) < 0)
+	{
+	   ret = -1;
+	   goto end;
+	}
+
+   if (!message_count)
+     {
+	fprintf(stderr, "Empty corpus\n");
+	ret = -1;
+	goto end;
+     }
+
+   for (i = 0; i < message_count; i++)
+      bytes += messages[i].len;
+
+   for (i = 0; i < BENCH_ROUNDS; i++)
+     {
+	rate = bench(duration, &failed);
+	if (rate > best) best = rate;
+     }
+
+   printf("%u messages, %lu rejected: %10.0f messages/s %8.1f MB/s\n",
+	  message_count, failed, best, best * bytes / message_count / 1e6);
+
+   if (!baseline_path) goto end;
+
+   if (save)
+     {
+	if (baseline_write(baseline_path, best) < 0) ret = -1;
+	else printf("Baseline %s set to %.0f messages/s\n", baseline_path, best);
+     }
+   else if (baseline_read(baseline_path, &baseline) < 0)
+     {
+	fprintf(stderr, "Could not read baseline %s, store one with -s\n", baseline_path);
+	ret = -1;
+     }
+   else
+     {
+	printf("Baseline %.0f messages/s, %+.1f%%\n",
+	       baseline, (best / baseline - 1) * 100);
+
+	if (best < baseline * (1 - tolerance / 100))
+	  {
+	     fprintf(stderr, "Throughput regression: more than %.1f%% below baseline\n", tolerance);
+	     ret = 1;
+	  }
+     }
+
+end:
+   for (i = 0; i < message_count; i++)
+      free(messages[i].data);
+
+   eupnp_shutdown();
+   return ret;
+}
@@ -0,0 +1,574 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <Eina.h>
+#include <eupnp.h>
+#include <eupnp_ssdp.h>
+#include <eupnp_udp_transport.h>
+#include <eupnp_control_point.h>
+#include <eupnp_device_registry.h>
+
+#define PCAP_MAGIC_USEC   0xa1b2c3d4
+#define PCAP_MAGIC_NSEC   0xa1b23c4d
+#define PCAPNG_SHB        0x0a0d0d0a
+#define PCAPNG_IDB        0x00000001
+#define PCAPNG_SPB        0x00000003
+#define PCAPNG_EPB        0x00000006
+#define PCAPNG_BYTE_ORDER 0x1a2b3c4d
+#define PCAPNG_IF_TSRESOL 9
+
+#define LINKTYPE_NULL        0
+#define LINKTYPE_ETHERNET    1
+#define LINKTYPE_RAW         101
+#define LINKTYPE_LINUX_SLL   113
+#define LINKTYPE_IPV4        228
+#define LINKTYPE_LINUX_SLL2  276
+
+#define REPLAY_INTERFACES 64
+
+typedef struct _Replay Replay;
+
+/*
+ * Replay state. Interfaces only matter for pcapng, a pcap file has a single
+ * one described by its header.
+ */
+struct _Replay {
+   const uint8_t *map;
+   size_t size;
+   Eina_Bool swap;
+   int port;
+
+   struct {
+      unsigned int linktype;
+      uint64_t tsdiv;      /* timestamp units per second */
+   } iface[REPLAY_INTERFACES];
+   unsigned int ifaces;
+
+   /* Pacing, speed 0 replays as fast as possible */
+   double speed;
+   double first_ts;
+   double last_ts;
+   double start;
+
+   Eupnp_Control_Point *cp;
+   Eupnp_UDP_Datagram *d;
+
+   /* Stage counters */
+   unsigned long packets;
+   unsigned long skipped;
+   unsigned long truncated;
+   unsigned long fragments;
+   unsigned long extracted;
+   unsigned long accepted;
+   unsigned long long bytes;
+   double extract_time;
+   double feed_time;
+};
+
+static uint16_t
+rd16(const Replay *r, const uint8_t *p)
+{
+   uint16_t v;
+
+   memcpy(&v, p, sizeof(v));
+   return r->swap ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t
+rd32(const Replay *r, const uint8_t *p)
+{
+   uint32_t v;
+
+   memcpy(&v, p, sizeof(v));
+   return r->swap ? __builtin_bswap32(v) : v;
+}
+
+/* Network byte order fields */
+static uint16_t
+be16(const uint8_t *p)
+{
+   return (p[0] << 8) | p[1];
+}
+
+/*
+ * Sleeps until the packet captured at ts is due, when pacing.
+ */
+static void
+pace(Replay *r, double ts)
+{
+   struct timespec t;
+   double wait;
+
+   if (r->speed <= 0) return;
+
+   if (!r->packets)
+     {
+	r->first_ts = ts;
+	r->start = eupnp_time_now();
+	return;
+     }
+
+   wait = r->start + (ts - r->first_ts) / r->speed - eupnp_time_now();
+   if (wait <= 0) return;
+
+   t.tv_sec = wait;
+   t.tv_nsec = (wait - t.tv_sec) * 1e9;
+   while (nanosleep(&t, &t) < 0 && errno == EINTR);
+}
+
+/*
+ * Strips the link layer header.
+ *
+ * @return IPv4 header or NULL if the frame does not carry IPv4.
+ */
+static const uint8_t *
+link_strip(unsigned int linktype, const uint8_t *p, size_t *len)
+{
+   size_t hdr;
+   uint32_t family;
+   uint16_t proto;
+
+   switch (linktype)
+     {
+      case LINKTYPE_NULL:
+	 /* Address family in the byte order of the capturing host */
+	 if (*len < 4) return NULL;
+	 memcpy(&family, p, sizeof(family));
+	 if (family != AF_INET && __builtin_bswap32(family) != AF_INET)
+	    return NULL;
+	 hdr = 4;
+	 break;
+
+      case LINKTYPE_ETHERNET:
+	 if (*len < 14) return NULL;
+	 hdr = 14;
+	 proto = be16(p + 12);
+	 while ((proto == 0x8100 || proto == 0x88a8) && *len >= hdr + 4)
+	   {
+	      proto = be16(p + hdr + 2);
+	      hdr += 4;
+	   }
+	 if (proto != 0x0800) return NULL;
+	 break;
+
+      case LINKTYPE_LINUX_SLL:
+	 if (*len < 16 || be16(p + 14) != 0x0800) return NULL;
+	 hdr = 16;
+	 break;
+
+      case LINKTYPE_LINUX_SLL2:
+	 if (*len < 20 || be16(p) != 0x0800) return NULL;
+	 hdr = 20;
+	 break;
+
+      case LINKTYPE_RAW:
+      case LINKTYPE_IPV4:
+	 hdr = 0;
+	 break;
+
+      default:
+	 return NULL;
+     }
+
+   *len -= hdr;
+   return p + hdr;
+}
+
+/*
+ * Extracts the SSDP payload of a captured frame into the datagram.
+ *
+ * @return EINA_TRUE if the frame carries a UDP datagram from or to the SSDP
+ *         port.
+ */
+static Eina_Bool
+extract(Replay *r, unsigned int linktype, const uint8_t *p, size_t len, double ts)
+{
+   Eupnp_UDP_Datagram *d = r->d;
+   const uint8_t *udp;
+   size_t ihl, ip_len, udp_len;
+
+   p = link_strip(linktype, p, &len);
+
+   if (!p || len < 20 || (p[0] >> 4) != 4 || p[9] != IPPROTO_UDP)
+     {
+	r->skipped++;
+	return EINA_FALSE;
+     }
+
+   ihl = (p[0] & 0x0f) * 4;
+   ip_len = be16(p + 2);
+
+   if (ihl < 20 || ip_len < ihl + 8 || ip_len > len)
+     {
+	r->truncated++;
+	return EINA_FALSE;
+     }
+
+   /* More fragments or non-zero offset, SSDP fits in a single datagram */
+   if (be16(p + 6) & 0x3fff)
+     {
+	r->fragments++;
+	return EINA_FALSE;
+     }
+
+   udp = p + ihl;
+
+   if (be16(udp) != r->port && be16(udp + 2) != r->port)
+     {
+	r->skipped++;
+	return EINA_FALSE;
+     }
+
+   udp_len = be16(udp + 4);
+
+   if (udp_len < 8 || udp_len > ip_len - ihl)
+     {
+	r->truncated++;
+	return EINA_FALSE;
+     }
+
+   udp_len -= 8;
+
+   /* Would not have fit in a receive buffer either */
+   if (udp_len > d->size)
+     {
+	r->truncated++;
+	return EINA_FALSE;
+     }
+
+   memcpy(d->data, udp + 8, udp_len);
+   d->data[udp_len] = '\0';
+   d->len = udp_len;
+
+   memset(&d->addr, 0, sizeof(d->addr));
+   d->addr.sin_family = AF_INET;
+   memcpy(&d->addr.sin_addr, p + 12, 4);
+   d->addr.sin_port = htons(be16(udp));
+   d->host[0] = '\0';
+   d->ifindex = 0;
+   d->timestamp.tv_sec = ts;
+   d->timestamp.tv_nsec = (ts - d->timestamp.tv_sec) * 1e9;
+
+   r->extracted++;
+   r->bytes += udp_len;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Runs a captured frame through extraction and the control point.
+ */
+static void
+frame_handle(Replay *r, unsigned int linktype, const uint8_t *p, size_t len, double ts)
+{
+   double t0, t1, t2;
+   Eina_Bool ok;
+
+   pace(r, ts);
+   r->last_ts = ts;
+   r->packets++;
+
+   t0 = eupnp_time_now();
+   ok = extract(r, linktype, p, len, ts);
+   t1 = eupnp_time_now();
+   r->extract_time += t1 - t0;
+
+   if (!ok) return;
+
+   if (eupnp_ssdp_server_datagram_feed(r->cp->ssdp_server, r->d))
+      r->accepted++;
+
+   t2 = eupnp_time_now();
+   r->feed_time += t2 - t1;
+}
+
+static int
+pcap_replay(Replay *r, uint32_t magic)
+{
+   const uint8_t *p = r->map + 24;
+   const uint8_t *end = r->map + r->size;
+   uint64_t tsdiv = (magic == PCAP_MAGIC_NSEC) ? 1000000000 : 1000000;
+   unsigned int linktype;
+   uint32_t caplen;
+   double ts;
+
+   if (r->size < 24) return -1;
+
+   linktype = rd32(r, r->map + 20) & 0xffff;
+
+   while ((size_t)(end - p) >= 16)
+     {
+	caplen = rd32(r, p + 8);
+	if (caplen > (size_t)(end - p) - 16)
+	  {
+	     fprintf(stderr, "Truncated capture after %lu packets\n", r->packets);
+	     break;
+	  }
+
+	ts = rd32(r, p) + (double)rd32(r, p + 4) / tsdiv;
+	frame_handle(r, linktype, p + 16, caplen, ts);
+	p += 16 + caplen;
+     }
+
+   return 0;
+}
+
+/*
+ * Reads the timestamp resolution option of an interface description block.
+ */
+static uint64_t
+pcapng_tsdiv_get(const Replay *r, const uint8_t *opt, const uint8_t *end)
+{
+   uint16_t code, len;
+   uint64_t div = 1;
+   unsigned int i;
+
+   while (end - opt >= 4)
+     {
+	code = rd16(r, opt);
+	len = rd16(r, opt + 2);
+	if (!code || (size_t)(end - opt - 4) < len) break;
+
+	if (code == PCAPNG_IF_TSRESOL && len >= 1)
+	  {
+	     if (opt[4] & 0x80)
+		return (opt[4] & 0x7f) < 64 ? (uint64_t)1 << (opt[4] & 0x7f) : 1000000;
+
+	     for (i = 0; i < opt[4] && i < 19; i++)
+		div *= 10;
+	     return div;
+	  }
+
+	opt += 4 + ((len + 3) & ~3);
+     }
+
+   return 1000000;
+}
+
+static int
+pcapng_replay(Replay *r)
+{
+   const uint8_t *p = r->map;
+   const uint8_t *end = r->map + r->size;
+   uint32_t type, len, caplen, id, order;
+   uint64_t tsraw;
+   double ts;
+
+   while ((size_t)(end - p) >= 12)
+     {
+	type = rd32(r, p);
+
+	if (type == PCAPNG_SHB)
+	  {
+	     /* Each section may have its own byte order and interfaces */
+	     memcpy(&order, p + 8, sizeof(order));
+	     if (order == PCAPNG_BYTE_ORDER)
+		r->swap = EINA_FALSE;
+	     else if (__builtin_bswap32(order) == PCAPNG_BYTE_ORDER)
+		r->swap = EINA_TRUE;
+	     else
+		return -1;
+	     r->ifaces = 0;
+	  }
+
+	len = rd32(r, p + 4);
+	if (len < 12 || len > (size_t)(end - p) || (len & 3))
+	  {
+	     fprintf(stderr, "Truncated capture after %lu packets\n", r->packets);
+	     break;
+	  }
+
+	switch (type)
+	  {
+	   case PCAPNG_IDB:
+	      if (len < 20 || r->ifaces >= REPLAY_INTERFACES) break;
+	      r->iface[r->ifaces].linktype = rd16(r, p + 8);
+	      r->iface[r->ifaces].tsdiv = pcapng_tsdiv_get(r, p + 16, p + len - 4);
+	      r->ifaces++;
+	      break;
+
+	   case PCAPNG_EPB:
+	      if (len < 32) break;
+	      id = rd32(r, p + 8);
+	      caplen = rd32(r, p + 20);
+	      if (id >= r->ifaces || caplen > len - 32) break;
+
+	      tsraw = ((uint64_t)rd32(r, p + 12) << 32) | rd32(r, p + 16);
+	      ts = (double)(tsraw / r->iface[id].tsdiv) +
+		   (double)(tsraw % r->iface[id].tsdiv) / r->iface[id].tsdiv;
+	      frame_handle(r, r->iface[id].linktype, p + 28, caplen, ts);
+	      break;
+
+	   case PCAPNG_SPB:
+	      /* No timestamp, replayed back to back */
+	      if (len < 16 || !r->ifaces) break;
+	      caplen = rd32(r, p + 8);
+	      if (caplen > len - 16) caplen = len - 16;
+	      frame_handle(r, r->iface[0].linktype, p + 12, caplen, r->last_ts);
+	      break;
+	  }
+
+	p += len;
+     }
+
+   return 0;
+}
+
+static void
+report(const Replay *r)
+{
+   const Eupnp_Metrics *m = eupnp_ssdp_server_metrics_get(r->cp->ssdp_server);
+   Eupnp_Device_Registry *reg = eupnp_control_point_registry_get(r->cp);
+   Eupnp_Device_Info info;
+   double now = eupnp_time_now();
+   unsigned int i;
+
+   printf("Packets:    %lu (%lu not UDP/%d, %lu truncated, %lu fragments)\n",
+	  r->packets, r->skipped, r->port, r->truncated, r->fragments);
+   printf("Extract:    %lu datagrams, %llu bytes in %.3fs, %.0f packets/s, %.1f MB/s\n",
+	  r->extracted, r->bytes, r->extract_time,
+	  r->extract_time > 0 ? r->packets / r->extract_time : 0,
+	  r->extract_time > 0 ? r->bytes / r->extract_time / 1e6 : 0);
+   printf("Parse/cache: %lu datagrams in %.3fs, %.0f datagrams/s, p50 %.1fus p99 %.1fus\n",
+	  r->extracted, r->feed_time,
+	  r->feed_time > 0 ? r->extracted / r->feed_time : 0,
+	  eupnp_histogram_percentile_get(&m->process_delay, 50),
+	  eupnp_histogram_percentile_get(&m->process_delay, 99));
+   printf("Rate limited: %lu, filtered: %lu, duplicates: %lu\n",
+	  m->rate_limited, m->filtered, r->cp->duplicates);
+
+   for (i = 0; i < EUPNP_SSDP_MESSAGE_CLASSES; i++)
+      printf("  %-9s %lu\n", eupnp_metrics_class_name_get(i), m->received[i]);
+
+   printf("Registry:   %u entries\n", eupnp_device_registry_count_get(reg));
+
+   for (i = 0; eupnp_device_registry_info_get(reg, i, &info); i++)
+      printf("  %s %s %s expires in %.0fs\n", info.usn,
+	     inet_ntoa(info.addr.sin_addr),
+	     info.location ? info.location : "-", info.expire - now);
+}
+
+/*
+ * Replays the SSDP traffic of a pcap or pcapng capture through a control
+ * point without sockets and reports the throughput of each stage and the
+ * resulting registry.
+ *
+ * Frames are replayed as fast as possible, or paced as captured with -r
+ * (-s scales the pacing). Announcement lifetimes start when replayed.
+ *
+ * Usage: ./eupnp_pcap_replay [-r] [-s speed] [-p port] [-f target]... capture
+ */
+int main(int argc, char **argv)
+{
+   Replay r;
+   struct stat st;
+   uint32_t magic;
+   int fd, opt, ret;
+
+   memset(&r, 0, sizeof(r));
+   r.port = EUPNP_SSDP_PORT;
+
+   eupnp_init();
+
+   if (!eupnp_control_point_init())
+     {
+	fprintf(stderr, "Could not initialize control point module\n");
+	eupnp_shutdown();
+	return -1;
+     }
+
+   r.cp = eupnp_control_point_offline_new();
+   r.d = eupnp_udp_transport_datagram_new(EUPNP_UDP_PACKET_LEN);
+
+   if (!r.cp || !r.d)
+     {
+	fprintf(stderr, "Could not create control point\n");
+	return -1;
+     }
+
+   while ((opt = getopt(argc, argv, "rs:p:f:")) != -1)
+     {
+	switch (opt)
+	  {
+	   case 'r':
+	      if (!r.speed) r.speed = 1;
+	      break;
+	   case 's':
+	      r.speed = atof(optarg);
+	      break;
+	   case 'p':
+	      r.port = atoi(optarg);
+	      break;
+	   case 'f':
+	      eupnp_control_point_filter_add(r.cp, optarg);
+	      break;
+	   default:
+	      optind = argc;
+	  }
+     }
+
+   if (optind != argc - 1)
+     {
+	fprintf(stderr, "Usage: %s [-r] [-s speed] [-p port] [-f target]... capture\n", argv[0]);
+	return -1;
+     }
+
+   fd = open(argv[optind], O_RDONLY);
+
+   if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < 24)
+     {
+	fprintf(stderr, "Could not open %s\n", argv[optind]);
+	return -1;
+     }
+
+   r.size = st.st_size;
+   r.map = mmap(NULL, r.size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (r.map == MAP_FAILED)
+     {
+	fprintf(stderr, "Could not map %s: %s\n", argv[optind], strerror(errno));
+	return -1;
+     }
+
+   madvise((void *)r.map, r.size, MADV_SEQUENTIAL);
+
+   memcpy(&magic, r.map, sizeof(magic));
+
+   if (magic == PCAPNG_SHB)
+      ret = pcapng_replay(&r);
+   else if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC)
+      ret = pcap_replay(&r, magic);
+   else if (__builtin_bswap32(magic) == PCAP_MAGIC_USEC ||
+	    __builtin_bswap32(magic) == PCAP_MAGIC_NSEC)
+     {
+	r.swap = EINA_TRUE;
+	ret = pcap_replay(&r, __builtin_bswap32(magic));
+     }
+   else
+      ret = -1;
+
+   if (ret < 0)
+      fprintf(stderr, "%s is not a pcap or pcapng capture\n", argv[optind]);
+   else
+      report(&r);
+
+   munmap((void *)r.map, r.size);
+   eupnp_udp_transport_datagram_free(r.d);
+   eupnp_control_point_free(r.cp);
+   eupnp_control_point_shutdown();
+   eupnp_shutdown();
+
+   return ret;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <Eina.h>
+#include <eupnp.h>
+#include <eupnp_ssdp.h>
+#include <eupnp_udp_transport.h>
+#include <eupnp_uring.h>
+
+#define BENCH_PORT 19900
+
+static const char notify[] = "NOTIFY * HTTP/1.1\r\n"
+			     "HOST: 239.255.255.250:1900\r\n"
+			     "CACHE-CONTROL: max-age=1800\r\n"
+			     "LOCATION: http://127.0.0.1:80/description.xml\r\n"
+			     "NT: upnp:rootdevice\r\n"
+			     "NTS: ssdp:alive\r\n"
+			     "USN: uuid:bench::upnp:rootdevice\r\n\r\n";
+
+/*
+ * Receives count datagrams sent to the transport over loopback in bursts of
+ * batch, waiting with poll() between bursts, and reports the system calls
+ * spent receiving them.
+ *
+ * With recvmsg() every datagram costs one call, plus one to find the socket
+ * empty. With io_uring a burst costs one io_uring_enter().
+ */
+static int
+bench(const char *backend, unsigned int count, unsigned int batch)
+{
+   Eupnp_UDP_Transport *s;
+   Eupnp_UDP_Datagram *d;
+   Eupnp_Uring_Stats stats;
+   struct sockaddr_in dest;
+   struct pollfd pfd;
+   unsigned long calls = 0, received = 0, sent = 0;
+   double start, elapsed;
+   unsigned int i;
+   int out;
+
+   setenv("EUPNP_IO_URING", strcmp(backend, "io_uring") ? "0" : "1", 1);
+
+   s = eupnp_udp_transport_new(EUPNP_SSDP_ADDR, BENCH_PORT, EUPNP_SSDP_LOCAL_IFACE);
+   d = eupnp_udp_transport_datagram_new(EUPNP_UDP_PACKET_LEN);
+   out = socket(AF_INET, SOCK_DGRAM, 0);
+
+   if (!s || !d || out < 0)
+     {
+	EINA_ERROR_PERR("Could not set up %s benchmark.\n", backend);
+	return -1;
+     }
+
+   if (!strcmp(backend, "io_uring") && !eupnp_udp_transport_uring_get(s))
+     {
+	printf("%-8s not available\n", backend);
+	goto end;
+     }
+
+   memset(&dest, 0, sizeof(dest));
+   dest.sin_family = AF_INET;
+   dest.sin_port = htons(BENCH_PORT);
+   dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   pfd.fd = eupnp_udp_transport_fd_get(s);
+   pfd.events = POLLIN;
+
+   start = eupnp_time_now();
+
+   while (received < count)
+     {
+	for (i = 0; i < batch && sent < count; i++, sent++)
+	   sendto(out, notify, sizeof(notify) - 1, 0,
+		  (struct sockaddr *)&dest, sizeof(dest));
+
+	if (poll(&pfd, 1, 1000) <= 0)
+	  {
+	     EINA_ERROR_PERR("Datagrams lost, %lu of %lu received.\n", received, sent);
+	     break;
+	  }
+
+	for (;;)
+	  {
+	     calls++;
+	     if (!eupnp_udp_transport_recvfrom_into(s, d)) break;
+
+	     if (d->len != sizeof(notify) - 1 || memcmp(d->data, notify, d->len))
+		EINA_ERROR_PERR("Corrupt datagram received.\n");
+
+	     received++;
+	  }
+     }
+
+   elapsed = eupnp_time_now() - start;
+
+   if (eupnp_udp_transport_uring_get(s))
+     {
+	eupnp_uring_stats_get(eupnp_udp_transport_uring_get(s), &stats);
+	calls = stats.enters;
+     }
+
+   printf("%-8s %8lu datagrams %8lu syscalls %6.3f syscalls/datagram %10.0f datagrams/s\n",
+	  backend, received, calls, received ? (double)calls / received : 0,
+	  elapsed > 0 ? received / elapsed : 0);
+
+end:
+   close(out);
+   eupnp_udp_transport_datagram_free(d);
+   eupnp_udp_transport_close(s);
+   eupnp_udp_transport_free(s);
+
+   return 0;
+}
+
+/*
+ * Compares receiving SSDP datagrams with recvmsg() and with io_uring
+ * (configure --enable-io-uring).
+ *
+ * Usage: ./eupnp_udp_bench [datagrams] [burst]
+ */
+int main(int argc, char **argv)
+{
+   unsigned int count = 100000;
+   unsigned int batch = 32;
+
+   if (argc > 1) count = atoi(argv[1]);
+   if (argc > 2) batch = atoi(argv[2]);
+   if (!count || !batch)
+     {
+	fprintf(stderr, "Usage: %s [datagrams] [burst]\n", argv[0]);
+	return -1;
+     }
+
+   eupnp_init();
+
+   bench("recvmsg", count, batch);
+   bench("io_uring", count, batch);
+
+   eupnp_shutdown();
+   return 0;
+}
@@ -20,6 +20,7 @@
  */
 
 #include <stdio.h>
+#include <time.h>
 #include <eupnp.h>
 
 
@@ -67,3 +68,20 @@ eupnp_shutdown(void)
    return --_eupnp_main_count;
 }
 
+
+/*
+ * Retrieves the current time of the library clock
+ *
+ * The clock is monotonic and its origin is unspecified, use it only for
+ * computing intervals and deadlines.
+ *
+ * @return current time in seconds.
+ */
+double
+eupnp_time_now(void)
+{
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec / 1e9;
+}
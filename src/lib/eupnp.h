@@ -25,5 +25,7 @@
 int eupnp_init(void);
 int eupnp_shutdown(void);
 
+double eupnp_time_now(void);
+
 
 #endif /* _EUPNP_CORE_H */
@@ -20,7 +20,15 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <Eina.h>
+#include <eupnp.h>
 #include <eupnp_ssdp.h>
 #include <eupnp_error.h>
 #include "eupnp_control_point.h"
@@ -29,6 +37,353 @@
 static int _eupnp_control_point_main_count = 0;
 
 
+static Eina_Bool
+_eupnp_control_point_target_filter(void *data, const char *target, size_t len)
+{
+   Eupnp_Control_Point *c = data;
+
+   return eupnp_search_filter_match(c->filter, target, len);
+}
+
+/*
+ * Hands an event to the application, through the event ring in I/O thread
+ * mode.
+ */
+static void
+_eupnp_control_point_event_emit(Eupnp_Control_Point *c, const Eupnp_SSDP_Event *ev)
+{
+   if (c->events)
+     {
+	if (!eupnp_event_ring_push(c->events, ev))
+	   DEBUG("Dropped event for %s\n", ev->usn);
+	return;
+     }
+
+   if (c->event_cb)
+      c->event_cb(c->event_cb_data, ev);
+}
+
+/*
+ * Reports an expired announcement as a byebye.
+ */
+static void
+_eupnp_control_point_expired(void *data, const Eupnp_Device_Info *info)
+{
+   Eupnp_Control_Point *c = data;
+   Eupnp_SSDP_Event ev;
+   char target[512];
+
+   DEBUG("Announcement for %s expired\n", info->usn);
+
+   // Stale entries were restored from a snapshot and never reported
+   if (info->flags & EUPNP_DEVICE_STALE)
+      return;
+
+   // In I/O thread mode event_cb belongs to the application thread, the ring
+   // takes the event either way
+   if (!c->events && !c->event_cb)
+      return;
+
+   if (info->version)
+     {
+	snprintf(target, sizeof(target), "%s:%u", info->type, info->version);
+	ev.target = target;
+     }
+   else
+      ev.target = info->type;
+
+   ev.type = EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE;
+   ev.usn = info->usn;
+   ev.location = NULL;
+   ev.max_age = 0;
+   ev.datagram = NULL;
+
+   _eupnp_control_point_event_emit(c, &ev);
+}
+
+static void
+_eupnp_control_point_ssdp_event(void *data, const Eupnp_SSDP_Event *ev)
+{
+   Eupnp_Control_Point *c = data;
+   Eupnp_Device_Registry_Result result;
+   double now = eupnp_time_now();
+
+   DEBUG("SSDP event %d for %s\n", ev->type, ev->usn);
+
+   // Devices send each NOTIFY several times and also answer searches, most
+   // of what arrives repeats a still valid announcement
+   result = eupnp_device_registry_update(c->registry, ev, now);
+
+   if (ev->type == EUPNP_SSDP_MESSAGE_RESPONSE)
+      eupnp_discovery_scheduler_response_add(c->discovery,
+					     result == EUPNP_DEVICE_REGISTRY_ADDED,
+					     now);
+
+   if (result == EUPNP_DEVICE_REGISTRY_REFRESHED)
+     {
+	DEBUG("Duplicate announcement for %s\n", ev->usn);
+	c->duplicates++;
+	return;
+     }
+
+   _eupnp_control_point_event_emit(c, ev);
+}
+
+/*
+ * Expires announcements and revalidates those about to expire, then
+ * schedules the next round.
+ */
+static void
+_eupnp_control_point_maintenance(void *data)
+{
+   Eupnp_Control_Point *c = data;
+   double now = eupnp_time_now();
+
+   eupnp_device_registry_expire(c->registry, now,
+				_eupnp_control_point_expired, c);
+   eupnp_revalidator_run(c->revalidator, now);
+
+   if (!eupnp_timer_add(c->timers, now + EUPNP_CONTROL_POINT_MAINTENANCE_INTERVAL,
+			_eupnp_control_point_maintenance, c))
+      ERROR("Could not schedule control point maintenance.\n");
+}
+
+static double
+_eupnp_control_point_timers_timeout_get(const Eupnp_Control_Point *c)
+{
+   double deadline, timeout;
+
+   deadline = eupnp_timer_wheel_next_deadline_get(c->timers);
+   if (!deadline) return -1;
+
+   timeout = deadline - eupnp_time_now();
+
+   return (timeout > 0) ? timeout : 0;
+}
+
+/*
+ * Reads waiting datagrams and runs due timers.
+ */
+static unsigned int
+_eupnp_control_point_io_dispatch(Eupnp_Control_Point *c)
+{
+   unsigned int n;
+
+   n = eupnp_ssdp_server_dispatch(c->ssdp_server, EUPNP_CONTROL_POINT_DISPATCH_MAX);
+   n += eupnp_timer_wheel_run(c->timers, eupnp_time_now());
+
+   return n;
+}
+
+static void
+_eupnp_control_point_event_deliver(void *data, const Eupnp_SSDP_Event *ev)
+{
+   Eupnp_Control_Point *c = data;
+
+   if (c->event_cb)
+      c->event_cb(c->event_cb_data, ev);
+}
+
+static void
+_eupnp_control_point_thread_wake(Eupnp_Control_Point *c)
+{
+   uint64_t one = 1;
+
+   if (write(c->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      ERROR("Could not wake up control point thread: %s\n", strerror(errno));
+}
+
+/*
+ * I/O thread: sleeps until a datagram arrives, a timer is due or the
+ * application wakes it up, then handles everything ready while holding the
+ * lock and signals the events produced in one go.
+ */
+static void *
+_eupnp_control_point_thread_main(void *data)
+{
+   Eupnp_Control_Point *c = data;
+   struct pollfd pfd[2];
+   double timeout;
+   uint64_t count;
+
+   pfd[0].fd = eupnp_udp_transport_fd_get(c->ssdp_server->udp_sock);
+   pfd[0].events = POLLIN;
+   pfd[1].fd = c->wake_fd;
+   pfd[1].events = POLLIN;
+
+   pthread_mutex_lock(&c->lock);
+
+   while (!c->stop)
+     {
+	timeout = _eupnp_control_point_timers_timeout_get(c);
+	pthread_mutex_unlock(&c->lock);
+
+	if (poll(pfd, 2, timeout < 0 ? -1 : (int)(timeout * 1000 + 0.999)) < 0 &&
+	    errno != EINTR)
+	   ERROR("Control point thread could not poll: %s\n", strerror(errno));
+
+	if (pfd[1].revents & POLLIN)
+	   if (read(c->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+	      ERROR("Could not read control point wakeup: %s\n", strerror(errno));
+
+	pthread_mutex_lock(&c->lock);
+	if (c->stop) break;
+
+	_eupnp_control_point_io_dispatch(c);
+	eupnp_event_ring_signal(c->events);
+     }
+
+   pthread_mutex_unlock(&c->lock);
+
+   return NULL;
+}
+
+/*
+ * Moves network I/O, parsing and cache maintenance to a new thread.
+ */
+static Eina_Bool
+_eupnp_control_point_thread_start(Eupnp_Control_Point *c)
+{
+   sigset_t all, old;
+   int err;
+
+   c->events = eupnp_event_ring_new(EUPNP_EVENT_RING_SIZE);
+   if (!c->events) return EINA_FALSE;
+
+   c->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+   if (c->wake_fd < 0)
+     {
+	ERROR("Could not create control point wakeup: %s\n", strerror(errno));
+	eupnp_event_ring_free(c->events);
+	c->events = NULL;
+	return EINA_FALSE;
+     }
+
+   pthread_mutex_init(&c->lock, NULL);
+
+   // Signals stay with the application threads
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK, &all, &old);
+   err = pthread_create(&c->thread, NULL, _eupnp_control_point_thread_main, c);
+   pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+   if (err)
+     {
+	ERROR("Could not start control point thread: %s\n", strerror(err));
+	pthread_mutex_destroy(&c->lock);
+	close(c->wake_fd);
+	eupnp_event_ring_free(c->events);
+	c->events = NULL;
+	return EINA_FALSE;
+     }
+
+   c->threaded = EINA_TRUE;
+
+   return EINA_TRUE;
+}
+
+static void
+_eupnp_control_point_thread_stop(Eupnp_Control_Point *c)
+{
+   pthread_mutex_lock(&c->lock);
+   c->stop = EINA_TRUE;
+   pthread_mutex_unlock(&c->lock);
+
+   _eupnp_control_point_thread_wake(c);
+   pthread_join(c->thread, NULL);
+
+   pthread_mutex_destroy(&c->lock);
+   close(c->wake_fd);
+   eupnp_event_ring_free(c->events);
+   c->events = NULL;
+   c->threaded = EINA_FALSE;
+}
+
+static Eupnp_Control_Point *
+_eupnp_control_point_new(Eina_Bool offline)
+{
+   Eupnp_Control_Point *c;
+   double now = eupnp_time_now();
+
+   c = calloc(1, sizeof(Eupnp_Control_Point));
+
+   if (!c)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create control point.\n");
+	return NULL;
+     }
+
+   c->filter = eupnp_search_filter_new();
+
+   if (!c->filter)
+     {
+	ERROR("Could not create control point.\n");
+	free(c);
+	return NULL;
+     }
+
+   c->intern = eupnp_intern_new();
+
+   if (!c->intern)
+     {
+	ERROR("Could not create control point.\n");
+	eupnp_search_filter_free(c->filter);
+	free(c);
+	return NULL;
+     }
+
+   c->registry = eupnp_device_registry_new(c->intern);
+
+   if (!c->registry)
+     {
+	ERROR("Could not create control point.\n");
+	eupnp_intern_free(c->intern);
+	eupnp_search_filter_free(c->filter);
+	free(c);
+	return NULL;
+     }
+
+   if (offline)
+      c->ssdp_server = eupnp_ssdp_server_offline_new();
+   else
+      c->ssdp_server = eupnp_ssdp_server_new();
+
+   if (!c->ssdp_server)
+     {
+	ERROR("Could not create control point.\n");
+	eupnp_device_registry_free(c->registry);
+	eupnp_intern_free(c->intern);
+	eupnp_search_filter_free(c->filter);
+	free(c);
+	return NULL;
+     }
+
+   c->revalidator = eupnp_revalidator_new(c->ssdp_server, c->registry,
+					  c->intern, now);
+   c->timers = eupnp_timer_wheel_new(EUPNP_TIMER_WHEEL_RESOLUTION, now);
+   if (c->timers)
+      c->discovery = eupnp_discovery_scheduler_new(c->ssdp_server, c->timers);
+
+   if (!c->revalidator || !c->discovery ||
+       !eupnp_timer_add(c->timers, now + EUPNP_CONTROL_POINT_MAINTENANCE_INTERVAL,
+			_eupnp_control_point_maintenance, c))
+     {
+	ERROR("Could not create control point.\n");
+	eupnp_control_point_free(c);
+	return NULL;
+     }
+
+   eupnp_ssdp_server_filter_set(c->ssdp_server,
+				_eupnp_control_point_target_filter, c);
+   eupnp_ssdp_server_event_callback_set(c->ssdp_server,
+					_eupnp_control_point_ssdp_event, c);
+
+   return c;
+}
+
+
 int
 eupnp_control_point_init(void)
 {
@@ -68,23 +423,56 @@ eupnp_control_point_shutdown(void)
 Eupnp_Control_Point *
 eupnp_control_point_new(void)
 {
-   Eupnp_Control_Point *c;
+   return _eupnp_control_point_new(EINA_FALSE);
+}
 
-   c = calloc(1, sizeof(Eupnp_Control_Point));
+/*
+ * Creates a control point whose SSDP server has no socket
+ *
+ * Datagrams are handed to it with eupnp_ssdp_server_datagram_feed() on its
+ * ssdp_server, e.g. to replay captured traffic through the registry. Searches
+ * and revalidations cannot be sent.
+ *
+ * @return Eupnp_Control_Point instance or NULL on error.
+ */
+Eupnp_Control_Point *
+eupnp_control_point_offline_new(void)
+{
+   return _eupnp_control_point_new(EINA_TRUE);
+}
 
-   if (!c)
-     {
-	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
-	ERROR("Could not create control point.\n");
-	return NULL;
-     }
+/*
+ * Creates a control point that runs on its own thread
+ *
+ * Network I/O, parsing, the registry and timers all live on a library thread,
+ * so bursts of datagrams do not delay the application. Events reach the
+ * application through a wait-free ring: eupnp_control_point_fd_get() becomes
+ * readable (once per burst) when there are events, and
+ * eupnp_control_point_dispatch() calls the event callback for them on the
+ * calling thread. eupnp_control_point_timeout_get() is always -1. Events are
+ * dropped if the application falls more than EUPNP_EVENT_RING_SIZE behind,
+ * the registry stays accurate. The datagram of these events is always NULL,
+ * it is gone by the time the application gets them.
+ *
+ * Everything else touching the control point (filters, discovery, registry
+ * queries, snapshots...) must be called between eupnp_control_point_lock()
+ * and eupnp_control_point_unlock(). The event callback may be set at any
+ * time from the application thread.
+ *
+ * @return Eupnp_Control_Point instance or NULL on error.
+ */
+Eupnp_Control_Point *
+eupnp_control_point_threaded_new(void)
+{
+   Eupnp_Control_Point *c;
 
-   c->ssdp_server = eupnp_ssdp_server_new();
+   c = _eupnp_control_point_new(EINA_FALSE);
+   if (!c) return NULL;
 
-   if (!c->ssdp_server)
+   if (!_eupnp_control_point_thread_start(c))
      {
 	ERROR("Could not create control point.\n");
-	free(c);
+	eupnp_control_point_free(c);
 	return NULL;
      }
 
@@ -97,7 +485,14 @@ eupnp_control_point_free(Eupnp_Control_Point *c)
    if (!c)
       return;
 
+   if (c->threaded) _eupnp_control_point_thread_stop(c);
+   if (c->discovery) eupnp_discovery_scheduler_free(c->discovery);
+   if (c->timers) eupnp_timer_wheel_free(c->timers);
+   if (c->revalidator) eupnp_revalidator_free(c->revalidator);
    if (c->ssdp_server) eupnp_ssdp_server_free(c->ssdp_server);
+   if (c->filter) eupnp_search_filter_free(c->filter);
+   if (c->registry) eupnp_device_registry_free(c->registry);
+   if (c->intern) eupnp_intern_free(c->intern);
    free(c);
 }
 
@@ -107,3 +502,281 @@ eupnp_control_point_discovery_request_send(Eupnp_Control_Point *c, int mx, char
     return eupnp_ssdp_discovery_request_send(c->ssdp_server, mx, search_target);
 }
 
+/*
+ * Starts discovering devices, replacing any discovery in progress
+ *
+ * Unlike eupnp_control_point_discovery_request_send(), which sends a single
+ * search, searches are retransmitted while new devices keep answering and
+ * repeated periodically with exponential backoff. MX is adapted to the
+ * number of devices answering. Searches are sent from the control point
+ * timers, see eupnp_control_point_timers_get().
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @param search_target target for the search, e.g. "ssdp:all".
+ * @return On success EINA_TRUE, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_control_point_discovery_start(Eupnp_Control_Point *c, const char *search_target)
+{
+   return eupnp_discovery_scheduler_start(c->discovery, search_target,
+					  eupnp_time_now());
+}
+
+/*
+ * Stops the discovery started with eupnp_control_point_discovery_start()
+ *
+ * @param c Eupnp_Control_Point instance.
+ */
+void
+eupnp_control_point_discovery_stop(Eupnp_Control_Point *c)
+{
+   eupnp_discovery_scheduler_stop(c->discovery);
+}
+
+/*
+ * Retrieves the discovery scheduler, e.g. for changing its policy
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return scheduler, owned by the control point.
+ */
+Eupnp_Discovery_Scheduler *
+eupnp_control_point_discovery_scheduler_get(const Eupnp_Control_Point *c)
+{
+   return c->discovery;
+}
+
+/*
+ * Subscribes the control point to a device or service type
+ *
+ * Once a pattern is added, only NOTIFY messages and search responses matching
+ * one of the patterns are handled, everything else is discarded before being
+ * parsed. Patterns may carry version ranges, e.g.
+ * "urn:schemas-upnp-org:device:MediaRenderer:1+" matches MediaRenderer
+ * version 1 or later. Refer to eupnp_search_filter.c for the syntax.
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @param pattern search target pattern.
+ * @return On success EINA_TRUE, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_control_point_filter_add(Eupnp_Control_Point *c, const char *pattern)
+{
+   return eupnp_search_filter_add(c->filter, pattern);
+}
+
+/*
+ * Removes all subscriptions, accepting every target again
+ *
+ * @param c Eupnp_Control_Point instance.
+ */
+void
+eupnp_control_point_filter_clear(Eupnp_Control_Point *c)
+{
+   eupnp_search_filter_clear(c->filter);
+}
+
+/*
+ * Retrieves the table of strings (USNs, UUIDs, types, locations) seen by the
+ * control point
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return intern table, owned by the control point.
+ */
+Eupnp_Intern *
+eupnp_control_point_intern_get(const Eupnp_Control_Point *c)
+{
+   return c->intern;
+}
+
+/*
+ * Retrieves the devices and services currently announced on the network
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return registry, owned by the control point.
+ */
+Eupnp_Device_Registry *
+eupnp_control_point_registry_get(const Eupnp_Control_Point *c)
+{
+   return c->registry;
+}
+
+/*
+ * Removes announcements past their max-age, reporting each one as a byebye
+ * event
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return number of announcements removed.
+ */
+unsigned int
+eupnp_control_point_expire(Eupnp_Control_Point *c)
+{
+   return eupnp_device_registry_expire(c->registry, eupnp_time_now(),
+				       _eupnp_control_point_expired, c);
+}
+
+/*
+ * Retrieves the timers of the control point
+ *
+ * Announcements are expired and revalidated from timers. Applications run
+ * them from their main loop: wait at most until
+ * eupnp_timer_wheel_next_deadline_get() and call eupnp_timer_wheel_run(), or
+ * let eupnp_control_point_dispatch() do it.
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return timer wheel, owned by the control point.
+ */
+Eupnp_Timer_Wheel *
+eupnp_control_point_timers_get(const Eupnp_Control_Point *c)
+{
+   return c->timers;
+}
+
+/*
+ * Retrieves the file descriptor to watch for the control point
+ *
+ * When it becomes readable, call eupnp_control_point_dispatch(). Together with
+ * eupnp_control_point_timeout_get() this is all an external main loop needs,
+ * see eupnp_ecore.h and eupnp_glib.h for ready made adapters.
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return file descriptor, or -1 for an offline control point. In I/O thread
+ *         mode, the file descriptor of the event ring.
+ */
+int
+eupnp_control_point_fd_get(const Eupnp_Control_Point *c)
+{
+   if (c->threaded) return eupnp_event_ring_fd_get(c->events);
+   if (!c->ssdp_server->udp_sock) return -1;
+
+   return eupnp_udp_transport_fd_get(c->ssdp_server->udp_sock);
+}
+
+/*
+ * Retrieves how long the main loop may sleep before calling
+ * eupnp_control_point_dispatch() for the control point timers
+ *
+ * Changes whenever the control point is used (e.g. a discovery is started),
+ * so it should be checked before each sleep.
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return timeout in seconds, 0 if a timer is due and -1 if there are no
+ *         timers.
+ */
+double
+eupnp_control_point_timeout_get(const Eupnp_Control_Point *c)
+{
+   if (c->threaded) return -1;
+
+   return _eupnp_control_point_timers_timeout_get(c);
+}
+
+/*
+ * Handles everything that is ready: datagrams waiting on the socket, up to
+ * EUPNP_CONTROL_POINT_DISPATCH_MAX, and due timers. In I/O thread mode, calls
+ * the event callback for up to EUPNP_CONTROL_POINT_DISPATCH_MAX events handed
+ * over by the thread.
+ *
+ * Never blocks. Safe to call on spurious wakeups.
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return number of datagrams and timers (events in I/O thread mode) handled.
+ */
+unsigned int
+eupnp_control_point_dispatch(Eupnp_Control_Point *c)
+{
+   if (c->threaded)
+      return eupnp_event_ring_drain(c->events, _eupnp_control_point_event_deliver,
+				    c, EUPNP_CONTROL_POINT_DISPATCH_MAX);
+
+   return _eupnp_control_point_io_dispatch(c);
+}
+
+/*
+ * Takes the control point from its I/O thread, see
+ * eupnp_control_point_threaded_new(). Does nothing for other control points.
+ *
+ * The thread only holds the lock while handling datagrams and timers, never
+ * while waiting for them.
+ *
+ * @param c Eupnp_Control_Point instance.
+ */
+void
+eupnp_control_point_lock(Eupnp_Control_Point *c)
+{
+   if (c->threaded) pthread_mutex_lock(&c->lock);
+}
+
+/*
+ * Gives the control point back to its I/O thread, which wakes up to look at
+ * its timers again (e.g. after a discovery was started).
+ *
+ * @param c Eupnp_Control_Point instance.
+ */
+void
+eupnp_control_point_unlock(Eupnp_Control_Point *c)
+{
+   if (!c->threaded) return;
+
+   pthread_mutex_unlock(&c->lock);
+   _eupnp_control_point_thread_wake(c);
+}
+
+/*
+ * Retrieves the engine probing known devices with unicast searches before
+ * their announcements expire, e.g. for changing its policy
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @return revalidator, owned by the control point.
+ */
+Eupnp_Revalidator *
+eupnp_control_point_revalidator_get(const Eupnp_Control_Point *c)
+{
+   return c->revalidator;
+}
+
+/*
+ * Saves the devices and services currently known, e.g. on shutdown
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @param path snapshot file, replaced atomically.
+ * @return On success EINA_TRUE, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_control_point_snapshot_save(const Eupnp_Control_Point *c, const char *path)
+{
+   return eupnp_device_registry_snapshot_save(c->registry, path, eupnp_time_now());
+}
+
+/*
+ * Restores devices and services saved with eupnp_control_point_snapshot_save()
+ *
+ * Restored entries are flagged EUPNP_DEVICE_STALE on the registry and no
+ * events are emitted for them. They are revalidated with unicast searches;
+ * the first answer or announcement for each one is reported as usual and
+ * entries nobody confirms expire silently.
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @param path snapshot file.
+ * @return number of entries restored or -1 on error.
+ */
+int
+eupnp_control_point_snapshot_load(Eupnp_Control_Point *c, const char *path)
+{
+   return eupnp_device_registry_snapshot_load(c->registry, path, eupnp_time_now());
+}
+
+/*
+ * Sets the function called for NOTIFY messages and search responses that pass
+ * the filter and are not repetitions of announcements already seen. Expired
+ * announcements are reported as byebyes without a datagram.
+ *
+ * @param c Eupnp_Control_Point instance.
+ * @param cb callback, NULL for unsetting.
+ * @param data data passed to the callback.
+ */
+void
+eupnp_control_point_event_callback_set(Eupnp_Control_Point *c, Eupnp_SSDP_Event_Cb cb, void *data)
+{
+   c->event_cb = cb;
+   c->event_cb_data = data;
+}
@@ -22,14 +22,55 @@
 #ifndef _EUPNP_CONTROL_POINT_H
 #define _EUPNP_CONTROL_POINT_H
 
+#include <pthread.h>
 #include <Eina.h>
 #include <eupnp_ssdp.h>
+#include <eupnp_search_filter.h>
+#include <eupnp_intern.h>
+#include <eupnp_device_registry.h>
+#include <eupnp_timer.h>
+#include <eupnp_revalidator.h>
+#include <eupnp_discovery_scheduler.h>
+#include <eupnp_event_ring.h>
 
-typedef struct _Eupnp_Control_Point Eupnp_Control_Point;
+/*
+ * Seconds between expiry sweeps and revalidation rounds.
+ */
+#define EUPNP_CONTROL_POINT_MAINTENANCE_INTERVAL 1
 
+/*
+ * Datagrams handled per eupnp_control_point_dispatch() call, so a flood does
+ * not starve the rest of the main loop.
+ */
+#define EUPNP_CONTROL_POINT_DISPATCH_MAX 256
+
+typedef struct _Eupnp_Control_Point Eupnp_Control_Point;
 
 struct _Eupnp_Control_Point {
    Eupnp_SSDP_Server *ssdp_server;
+   Eupnp_Search_Filter *filter;
+   Eupnp_SSDP_Event_Cb event_cb;
+   void *event_cb_data;
+
+   /* Strings seen on the network, see eupnp_control_point_intern_get() */
+   Eupnp_Intern *intern;
+
+   /* Announcements currently valid, see eupnp_control_point_registry_get() */
+   Eupnp_Device_Registry *registry;
+   Eupnp_Revalidator *revalidator;
+   Eupnp_Discovery_Scheduler *discovery;
+   unsigned long duplicates;
+
+   /* See eupnp_control_point_timers_get() */
+   Eupnp_Timer_Wheel *timers;
+
+   /* I/O thread mode, see eupnp_control_point_threaded_new() */
+   Eina_Bool threaded;
+   Eina_Bool stop;
+   pthread_t thread;
+   pthread_mutex_t lock;
+   int wake_fd;
+   Eupnp_Event_Ring *events;
 };
 
 
@@ -37,8 +78,28 @@ int                  eupnp_control_point_init(void);
 int                  eupnp_control_point_shutdown(void);
 
 Eupnp_Control_Point *eupnp_control_point_new(void);
+Eupnp_Control_Point *eupnp_control_point_offline_new(void);
+Eupnp_Control_Point *eupnp_control_point_threaded_new(void);
 void                 eupnp_control_point_free(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
 Eina_Bool            eupnp_control_point_discovery_request_send(Eupnp_Control_Point *c, int mx, char *search_target) EINA_ARG_NONNULL(1,2,3);
+Eina_Bool            eupnp_control_point_discovery_start(Eupnp_Control_Point *c, const char *search_target) EINA_ARG_NONNULL(1,2);
+void                 eupnp_control_point_discovery_stop(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eupnp_Discovery_Scheduler *eupnp_control_point_discovery_scheduler_get(const Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_control_point_filter_add(Eupnp_Control_Point *c, const char *pattern) EINA_ARG_NONNULL(1,2);
+void                 eupnp_control_point_filter_clear(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eupnp_Intern        *eupnp_control_point_intern_get(const Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eupnp_Device_Registry *eupnp_control_point_registry_get(const Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+unsigned int         eupnp_control_point_expire(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eupnp_Timer_Wheel   *eupnp_control_point_timers_get(const Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+int                  eupnp_control_point_fd_get(const Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+double               eupnp_control_point_timeout_get(const Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+unsigned int         eupnp_control_point_dispatch(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+void                 eupnp_control_point_lock(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+void                 eupnp_control_point_unlock(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eupnp_Revalidator   *eupnp_control_point_revalidator_get(const Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_control_point_snapshot_save(const Eupnp_Control_Point *c, const char *path) EINA_ARG_NONNULL(1,2);
+int                  eupnp_control_point_snapshot_load(Eupnp_Control_Point *c, const char *path) EINA_ARG_NONNULL(1,2);
+void                 eupnp_control_point_event_callback_set(Eupnp_Control_Point *c, Eupnp_SSDP_Event_Cb cb, void *data) EINA_ARG_NONNULL(1);
 
 
 #endif /* _EUPNP_CONTROL_POINT_H */
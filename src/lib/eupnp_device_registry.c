@@ -0,0 +1,899 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_search_filter.h"
+#include "eupnp_device_registry.h"
+#include "eupnp_probes.h"
+
+/*
+ * The registry is a structure of arrays: fields used for filtering and
+ * expiry (USN, type, expiry, interface, version and flags) each live on their
+ * own contiguous array, while fields only needed when reporting an entry are
+ * kept out of line. Scans touch only the arrays they filter on and are written
+ * as plain branch-free loops over fixed size chunks, which compilers turn into
+ * SIMD code.
+ *
+ * Slots are kept dense: removing an entry moves the last one into its place.
+ * The slot of each USN is found through an array indexed by USN ID.
+ */
+
+#define EUPNP_DEVICE_REGISTRY_NIL 0xffffffff
+#define EUPNP_DEVICE_REGISTRY_CHUNK 256
+
+/*
+ * Snapshot format, native byte order:
+ *
+ *   header
+ *   count records
+ *   string table: NUL-terminated strings referenced by offset
+ *
+ * Strings are written once no matter how many records use them. Lifetimes
+ * are stored as seconds left when the snapshot was written, together with
+ * the wall clock time, as the library clock does not survive reboots.
+ */
+#define EUPNP_DEVICE_REGISTRY_SNAPSHOT_MAGIC "EUPNPREG"
+#define EUPNP_DEVICE_REGISTRY_SNAPSHOT_VERSION 1
+
+typedef struct _Eupnp_Device_Registry_Cold Eupnp_Device_Registry_Cold;
+typedef struct _Eupnp_Device_Registry_Snapshot_Header Eupnp_Device_Registry_Snapshot_Header;
+typedef struct _Eupnp_Device_Registry_Snapshot_Record Eupnp_Device_Registry_Snapshot_Record;
+
+struct _Eupnp_Device_Registry_Snapshot_Header {
+   char magic[8];
+   uint32_t version;
+   uint32_t count;
+   uint32_t strings_size;
+   uint32_t reserved;
+   int64_t saved;             /* wall clock, seconds since the epoch */
+};
+
+struct _Eupnp_Device_Registry_Snapshot_Record {
+   uint32_t usn;              /* string table offsets */
+   uint32_t type;
+   uint32_t uuid;
+   uint32_t location;         /* EUPNP_DEVICE_REGISTRY_NIL if unknown */
+   uint32_t lifetime;         /* seconds left */
+   uint32_t ifindex;
+   uint32_t addr;             /* network byte order */
+   uint16_t port;             /* network byte order */
+   uint16_t version;
+};
+
+struct _Eupnp_Device_Registry_Cold {
+   Eupnp_Id uuid;
+   Eupnp_Id location;
+   struct sockaddr_in addr;
+};
+
+struct _Eupnp_Device_Registry {
+   Eupnp_Intern *intern;
+
+   /* Hot fields */
+   Eupnp_Id *usn;
+   Eupnp_Id *type;
+   uint32_t *expire;   /* library clock, whole seconds */
+   uint32_t *ifindex;
+   uint16_t *version;
+   uint8_t *flags;
+
+   /* Cold fields */
+   Eupnp_Device_Registry_Cold *cold;
+
+   unsigned int count;
+   unsigned int size;
+
+   /* Slot of each USN, indexed by USN ID */
+   uint32_t *slot_of;
+   Eupnp_Id slot_of_size;
+};
+
+
+/*
+ * Private API
+ */
+
+#define EUPNP_DEVICE_REGISTRY_ARRAY_GROW(array, size)			\
+   do {									\
+	void *tmp = realloc(array, (size) * sizeof(*(array)));		\
+	if (!tmp) goto error;						\
+	array = tmp;							\
+   } while (0)
+
+static Eina_Bool
+eupnp_device_registry_grow(Eupnp_Device_Registry *reg)
+{
+   unsigned int size = reg->size ? reg->size * 2 : 64;
+
+   EUPNP_DEVICE_REGISTRY_ARRAY_GROW(reg->usn, size);
+   EUPNP_DEVICE_REGISTRY_ARRAY_GROW(reg->type, size);
+   EUPNP_DEVICE_REGISTRY_ARRAY_GROW(reg->expire, size);
+   EUPNP_DEVICE_REGISTRY_ARRAY_GROW(reg->ifindex, size);
+   EUPNP_DEVICE_REGISTRY_ARRAY_GROW(reg->version, size);
+   EUPNP_DEVICE_REGISTRY_ARRAY_GROW(reg->flags, size);
+   EUPNP_DEVICE_REGISTRY_ARRAY_GROW(reg->cold, size);
+
+   reg->size = size;
+   return EINA_TRUE;
+
+error:
+   // Arrays already grown are kept, size only changes when all succeed
+   eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+   ERROR("Could not grow device registry.\n");
+   return EINA_FALSE;
+}
+
+static Eina_Bool
+eupnp_device_registry_slot_of_grow(Eupnp_Device_Registry *reg)
+{
+   uint32_t *slot_of;
+   Eupnp_Id size = eupnp_intern_id_max_get(reg->intern) + 1;
+
+   if (size <= reg->slot_of_size) return EINA_TRUE;
+   if (size < reg->slot_of_size * 2) size = reg->slot_of_size * 2;
+
+   slot_of = realloc(reg->slot_of, size * sizeof(uint32_t));
+
+   if (!slot_of)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not grow device registry index.\n");
+	return EINA_FALSE;
+     }
+
+   memset(slot_of + reg->slot_of_size, 0xff,
+	  (size - reg->slot_of_size) * sizeof(uint32_t));
+   reg->slot_of = slot_of;
+   reg->slot_of_size = size;
+
+   return EINA_TRUE;
+}
+
+static uint32_t
+eupnp_device_registry_time(double t)
+{
+   uint32_t u;
+
+   if (t <= 0) return 0;
+   if (t >= 4294967295.0) return 0xffffffff;
+
+   // Rounded up, entries never expire early
+   u = (uint32_t)t;
+   return (u < t) ? u + 1 : u;
+}
+
+static void
+eupnp_device_registry_remove(Eupnp_Device_Registry *reg, unsigned int slot)
+{
+   unsigned int last = reg->count - 1;
+   Eupnp_Id usn = reg->usn[slot];
+
+   reg->slot_of[usn] = EUPNP_DEVICE_REGISTRY_NIL;
+   eupnp_intern_unref(reg->intern, usn);
+   eupnp_intern_unref(reg->intern, reg->type[slot]);
+   eupnp_intern_unref(reg->intern, reg->cold[slot].uuid);
+   eupnp_intern_unref(reg->intern, reg->cold[slot].location);
+
+   if (slot != last)
+     {
+	reg->usn[slot] = reg->usn[last];
+	reg->type[slot] = reg->type[last];
+	reg->expire[slot] = reg->expire[last];
+	reg->ifindex[slot] = reg->ifindex[last];
+	reg->version[slot] = reg->version[last];
+	reg->flags[slot] = reg->flags[last];
+	reg->cold[slot] = reg->cold[last];
+	reg->slot_of[reg->usn[slot]] = slot;
+     }
+
+   reg->count--;
+}
+
+static Eupnp_Device_Registry_Result
+eupnp_device_registry_add(Eupnp_Device_Registry *reg, Eupnp_Id usn, Eupnp_Id location, const Eupnp_SSDP_Event *ev, uint32_t expire)
+{
+   unsigned int slot, version;
+   const char *sep;
+   size_t len;
+
+   if (reg->count == reg->size && !eupnp_device_registry_grow(reg))
+      return EUPNP_DEVICE_REGISTRY_IGNORED;
+
+   slot = reg->count++;
+
+   eupnp_search_target_split(ev->target, strlen(ev->target), &len, &version);
+   reg->type[slot] = eupnp_intern_add(reg->intern, ev->target, len);
+   reg->version[slot] = (version > 0xffff) ? 0xffff : version;
+
+   // USN is uuid:<device UUID>[::<type>]
+   sep = strstr(ev->usn, "::");
+   len = sep ? (size_t)(sep - ev->usn) : strlen(ev->usn);
+   reg->cold[slot].uuid = eupnp_intern_add(reg->intern, ev->usn, len);
+
+   reg->usn[slot] = usn;
+   reg->expire[slot] = expire;
+   reg->flags[slot] = EUPNP_DEVICE_ALIVE;
+   reg->cold[slot].location = location;
+
+   if (ev->datagram)
+     {
+	reg->ifindex[slot] = ev->datagram->ifindex;
+	reg->cold[slot].addr = ev->datagram->addr;
+     }
+   else
+     {
+	reg->ifindex[slot] = 0;
+	memset(&reg->cold[slot].addr, 0, sizeof(struct sockaddr_in));
+     }
+
+   reg->slot_of[usn] = slot;
+
+   return EUPNP_DEVICE_REGISTRY_ADDED;
+}
+
+/*
+ * Appends a string to the snapshot string table, once per ID.
+ *
+ * @return offset of the string.
+ */
+static uint32_t
+eupnp_device_registry_snapshot_string(const Eupnp_Device_Registry *reg, Eupnp_Id id, uint32_t *offsets, char *strings, uint32_t *strings_size)
+{
+   size_t len;
+
+   if (id == EUPNP_ID_NONE)
+      return EUPNP_DEVICE_REGISTRY_NIL;
+
+   if (offsets[id] != EUPNP_DEVICE_REGISTRY_NIL)
+      return offsets[id];
+
+   len = eupnp_intern_len_get(reg->intern, id);
+   memcpy(strings + *strings_size, eupnp_intern_str_get(reg->intern, id), len);
+   strings[*strings_size + len] = '\0';
+
+   offsets[id] = *strings_size;
+   *strings_size += len + 1;
+
+   return offsets[id];
+}
+
+static Eupnp_Id
+eupnp_device_registry_snapshot_intern(Eupnp_Device_Registry *reg, const char *strings, uint32_t strings_size, uint32_t offset)
+{
+   if (offset == EUPNP_DEVICE_REGISTRY_NIL || offset >= strings_size)
+      return EUPNP_ID_NONE;
+
+   return eupnp_intern_add(reg->intern, strings + offset, strlen(strings + offset));
+}
+
+/*
+ * Adds a snapshot record as a stale entry. USNs already on the registry are
+ * left alone, they are more recent than the snapshot.
+ */
+static Eina_Bool
+eupnp_device_registry_snapshot_restore(Eupnp_Device_Registry *reg, const Eupnp_Device_Registry_Snapshot_Record *r, const char *strings, uint32_t strings_size, uint32_t expire)
+{
+   unsigned int slot;
+   Eupnp_Id usn;
+
+   if (r->usn >= strings_size || r->type >= strings_size || r->uuid >= strings_size)
+      return EINA_FALSE;
+
+   usn = eupnp_device_registry_snapshot_intern(reg, strings, strings_size, r->usn);
+
+   if (usn == EUPNP_ID_NONE || !eupnp_device_registry_slot_of_grow(reg) ||
+       reg->slot_of[usn] != EUPNP_DEVICE_REGISTRY_NIL ||
+       (reg->count == reg->size && !eupnp_device_registry_grow(reg)))
+     {
+	eupnp_intern_unref(reg->intern, usn);
+	return EINA_FALSE;
+     }
+
+   slot = reg->count++;
+
+   reg->usn[slot] = usn;
+   reg->type[slot] = eupnp_device_registry_snapshot_intern(reg, strings, strings_size, r->type);
+   reg->expire[slot] = expire;
+   reg->ifindex[slot] = r->ifindex;
+   reg->version[slot] = r->version;
+   reg->flags[slot] = EUPNP_DEVICE_STALE;
+   reg->cold[slot].uuid = eupnp_device_registry_snapshot_intern(reg, strings, strings_size, r->uuid);
+   reg->cold[slot].location = eupnp_device_registry_snapshot_intern(reg, strings, strings_size, r->location);
+
+   memset(&reg->cold[slot].addr, 0, sizeof(struct sockaddr_in));
+   reg->cold[slot].addr.sin_family = AF_INET;
+   reg->cold[slot].addr.sin_addr.s_addr = r->addr;
+   reg->cold[slot].addr.sin_port = r->port;
+
+   reg->slot_of[usn] = slot;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Device_Registry structure
+ *
+ * @param intern table where USNs, UUIDs, types and locations are interned.
+ *        Must outlive the registry.
+ *
+ * @return Eupnp_Device_Registry instance or NULL on error.
+ */
+Eupnp_Device_Registry *
+eupnp_device_registry_new(Eupnp_Intern *intern)
+{
+   Eupnp_Device_Registry *reg;
+
+   reg = calloc(1, sizeof(Eupnp_Device_Registry));
+
+   if (!reg)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create device registry.\n");
+	return NULL;
+     }
+
+   reg->intern = intern;
+
+   return reg;
+}
+
+void
+eupnp_device_registry_free(Eupnp_Device_Registry *reg)
+{
+   if (!reg) return;
+
+   while (reg->count)
+      eupnp_device_registry_remove(reg, reg->count - 1);
+
+   free(reg->usn);
+   free(reg->type);
+   free(reg->expire);
+   free(reg->ifindex);
+   free(reg->version);
+   free(reg->flags);
+   free(reg->cold);
+   free(reg->slot_of);
+   free(reg);
+}
+
+/*
+ * Applies an SSDP event to the registry
+ *
+ * @param reg registry
+ * @param ev NOTIFY or search response event
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return EUPNP_DEVICE_REGISTRY_ADDED for new USNs,
+ *         EUPNP_DEVICE_REGISTRY_CHANGED when the location changed or a stale
+ *         entry got confirmed, EUPNP_DEVICE_REGISTRY_REFRESHED when the event
+ *         only repeats what is known (its expiry is extended),
+ *         EUPNP_DEVICE_REGISTRY_REMOVED for byebyes of known USNs and
+ *         EUPNP_DEVICE_REGISTRY_IGNORED otherwise.
+ */
+Eupnp_Device_Registry_Result
+eupnp_device_registry_update(Eupnp_Device_Registry *reg, const Eupnp_SSDP_Event *ev, double now)
+{
+   Eupnp_Id usn, location = EUPNP_ID_NONE;
+   uint32_t slot, expire;
+   int found;
+
+   if (!ev->usn || !ev->target)
+      return EUPNP_DEVICE_REGISTRY_IGNORED;
+
+   if (ev->type == EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE)
+     {
+	found = eupnp_device_registry_find(reg, eupnp_intern_find(reg->intern, ev->usn, strlen(ev->usn)));
+
+	if (found < 0)
+	   return EUPNP_DEVICE_REGISTRY_IGNORED;
+
+	eupnp_device_registry_remove(reg, found);
+	return EUPNP_DEVICE_REGISTRY_REMOVED;
+     }
+
+   usn = eupnp_intern_add(reg->intern, ev->usn, strlen(ev->usn));
+
+   if (usn == EUPNP_ID_NONE || !eupnp_device_registry_slot_of_grow(reg))
+     {
+	eupnp_intern_unref(reg->intern, usn);
+	return EUPNP_DEVICE_REGISTRY_IGNORED;
+     }
+
+   if (ev->location)
+      location = eupnp_intern_add(reg->intern, ev->location, strlen(ev->location));
+
+   expire = eupnp_device_registry_time(now + (ev->max_age ? ev->max_age : EUPNP_DEVICE_REGISTRY_DEFAULT_MAX_AGE));
+   slot = reg->slot_of[usn];
+
+   if (slot == EUPNP_DEVICE_REGISTRY_NIL)
+     {
+	if (eupnp_device_registry_add(reg, usn, location, ev, expire) == EUPNP_DEVICE_REGISTRY_IGNORED)
+	  {
+	     eupnp_intern_unref(reg->intern, location);
+	     eupnp_intern_unref(reg->intern, usn);
+	     return EUPNP_DEVICE_REGISTRY_IGNORED;
+	  }
+
+	EUPNP_PROBE2(cache_insert, ev->usn, ev->location);
+	return EUPNP_DEVICE_REGISTRY_ADDED;
+     }
+
+   // Entry already holds a reference on its USN
+   eupnp_intern_unref(reg->intern, usn);
+   reg->expire[slot] = expire;
+
+   if (reg->cold[slot].location == location &&
+       reg->flags[slot] == EUPNP_DEVICE_ALIVE)
+     {
+	eupnp_intern_unref(reg->intern, location);
+	return EUPNP_DEVICE_REGISTRY_REFRESHED;
+     }
+
+   eupnp_intern_unref(reg->intern, reg->cold[slot].location);
+   reg->cold[slot].location = location;
+   reg->flags[slot] = EUPNP_DEVICE_ALIVE;
+
+   if (ev->datagram)
+     {
+	reg->ifindex[slot] = ev->datagram->ifindex;
+	reg->cold[slot].addr = ev->datagram->addr;
+     }
+
+   return EUPNP_DEVICE_REGISTRY_CHANGED;
+}
+
+/*
+ * Retrieves the number of entries
+ */
+unsigned int
+eupnp_device_registry_count_get(const Eupnp_Device_Registry *reg)
+{
+   return reg->count;
+}
+
+/*
+ * Retrieves the slot of an USN
+ *
+ * @return slot or -1 if the USN is not on the registry.
+ */
+int
+eupnp_device_registry_find(const Eupnp_Device_Registry *reg, Eupnp_Id usn)
+{
+   if (usn == EUPNP_ID_NONE || usn >= reg->slot_of_size ||
+       reg->slot_of[usn] == EUPNP_DEVICE_REGISTRY_NIL)
+      return -1;
+
+   return (int)reg->slot_of[usn];
+}
+
+/*
+ * Retrieves the ID of a type (target without version), for use with
+ * eupnp_device_registry_query()
+ *
+ * @return type ID or EUPNP_ID_NONE if no entry has that type.
+ */
+Eupnp_Id
+eupnp_device_registry_type_find(const Eupnp_Device_Registry *reg, const char *type)
+{
+   return eupnp_intern_find(reg->intern, type, strlen(type));
+}
+
+/*
+ * Finds the entries matching the given criteria
+ *
+ * @param reg registry
+ * @param type type ID (see eupnp_device_registry_type_find()), EUPNP_ID_NONE
+ *        for any
+ * @param ifindex interface index, 0 for any
+ * @param flags_mask flags to check
+ * @param flags value the flags on flags_mask must have
+ * @param slots array to fill with the matching slots. Slots are valid until
+ *        the registry is modified.
+ * @param max size of @p slots
+ *
+ * @return number of slots filled.
+ */
+unsigned int
+eupnp_device_registry_query(const Eupnp_Device_Registry *reg, Eupnp_Id type, unsigned int ifindex, unsigned int flags_mask, unsigned int flags, unsigned int *slots, unsigned int max)
+{
+   uint8_t match[EUPNP_DEVICE_REGISTRY_CHUNK];
+   unsigned int base, i, n, found = 0;
+   uint8_t any_type = (type == EUPNP_ID_NONE);
+   uint8_t any_iface = (ifindex == 0);
+
+   for (base = 0; base < reg->count && found < max; base += n)
+     {
+	n = reg->count - base;
+	if (n > EUPNP_DEVICE_REGISTRY_CHUNK) n = EUPNP_DEVICE_REGISTRY_CHUNK;
+
+	for (i = 0; i < n; i++)
+	   match[i] = (any_type | (reg->type[base + i] == type)) &
+		      (any_iface | (reg->ifindex[base + i] == ifindex)) &
+		      ((reg->flags[base + i] & flags_mask) == flags);
+
+	for (i = 0; i < n && found < max; i++)
+	   if (match[i])
+	      slots[found++] = base + i;
+     }
+
+   return found;
+}
+
+/*
+ * Finds the entries that need revalidation: those expiring before the given
+ * time and those restored from a snapshot
+ *
+ * @param reg registry
+ * @param before time on the library clock
+ * @param slots array to fill with the matching slots
+ * @param max size of @p slots
+ *
+ * @return number of slots filled.
+ */
+unsigned int
+eupnp_device_registry_expiring_query(const Eupnp_Device_Registry *reg, double before, unsigned int *slots, unsigned int max)
+{
+   uint8_t match[EUPNP_DEVICE_REGISTRY_CHUNK];
+   uint32_t t = eupnp_device_registry_time(before);
+   unsigned int base, i, n, found = 0;
+
+   for (base = 0; base < reg->count && found < max; base += n)
+     {
+	n = reg->count - base;
+	if (n > EUPNP_DEVICE_REGISTRY_CHUNK) n = EUPNP_DEVICE_REGISTRY_CHUNK;
+
+	for (i = 0; i < n; i++)
+	   match[i] = (reg->expire[base + i] < t) |
+		      ((reg->flags[base + i] & EUPNP_DEVICE_STALE) != 0);
+
+	for (i = 0; i < n && found < max; i++)
+	   if (match[i])
+	      slots[found++] = base + i;
+     }
+
+   return found;
+}
+
+/*
+ * Removes the entries past their expiry time
+ *
+ * @param reg registry
+ * @param now current time, see eupnp_time_now()
+ * @param cb function called for each entry before it is removed, may be NULL
+ * @param data data passed to @p cb
+ *
+ * @return number of entries removed.
+ */
+unsigned int
+eupnp_device_registry_expire(Eupnp_Device_Registry *reg, double now, Eupnp_Device_Registry_Cb cb, void *data)
+{
+   Eupnp_Device_Info info;
+   uint32_t t = eupnp_device_registry_time(now);
+   unsigned int i, expired = 0;
+
+   // Cheap pass first, most sweeps find nothing to do
+   for (i = 0; i < reg->count; i++)
+      expired += (reg->expire[i] <= t);
+
+   if (!expired)
+      return 0;
+
+   // Backwards, so entries moved into removed slots were already checked
+   for (i = reg->count; i-- > 0;)
+     {
+	if (reg->expire[i] > t) continue;
+
+	if (cb && eupnp_device_registry_info_get(reg, i, &info))
+	   cb(data, &info);
+
+	EUPNP_PROBE1(cache_expire, eupnp_intern_str_get(reg->intern, reg->usn[i]));
+	eupnp_device_registry_remove(reg, i);
+     }
+
+   return expired;
+}
+
+/*
+ * Retrieves when the next entry expires
+ *
+ * @return expiry time on the library clock or 0 if the registry is empty.
+ */
+double
+eupnp_device_registry_next_expire_get(const Eupnp_Device_Registry *reg)
+{
+   uint32_t next = 0xffffffff;
+   unsigned int i;
+
+   if (!reg->count) return 0;
+
+   for (i = 0; i < reg->count; i++)
+      next = (reg->expire[i] < next) ? reg->expire[i] : next;
+
+   return next;
+}
+
+/*
+ * Retrieves an entry
+ *
+ * @param reg registry
+ * @param slot slot of the entry
+ * @param info structure to fill
+ *
+ * @return EINA_TRUE on success, EINA_FALSE if slot is out of range.
+ */
+Eina_Bool
+eupnp_device_registry_info_get(const Eupnp_Device_Registry *reg, unsigned int slot, Eupnp_Device_Info *info)
+{
+   if (slot >= reg->count) return EINA_FALSE;
+
+   info->usn_id = reg->usn[slot];
+   info->type_id = reg->type[slot];
+   info->usn = eupnp_intern_str_get(reg->intern, reg->usn[slot]);
+   info->uuid = eupnp_intern_str_get(reg->intern, reg->cold[slot].uuid);
+   info->type = eupnp_intern_str_get(reg->intern, reg->type[slot]);
+   info->location = eupnp_intern_str_get(reg->intern, reg->cold[slot].location);
+   info->version = reg->version[slot];
+   info->ifindex = reg->ifindex[slot];
+   info->flags = reg->flags[slot];
+   info->expire = reg->expire[slot];
+   info->addr = reg->cold[slot].addr;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Writes the registry to a file
+ *
+ * The snapshot is written to a temporary file which is then renamed over
+ * @p path, so readers see either the previous snapshot or the new one.
+ *
+ * @param reg registry
+ * @param path snapshot file
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_device_registry_snapshot_save(const Eupnp_Device_Registry *reg, const char *path, double now)
+{
+   Eupnp_Device_Registry_Snapshot_Header *header;
+   Eupnp_Device_Registry_Snapshot_Record *records;
+   uint32_t *offsets = NULL;
+   Eupnp_Id id_max = eupnp_intern_id_max_get(reg->intern);
+   uint32_t strings_size = 0, t = eupnp_device_registry_time(now);
+   size_t size, strings_max = 0, done;
+   char *buf = NULL, *tmp = NULL;
+   unsigned int i;
+   ssize_t n;
+   int fd;
+
+   // Upper bound for the string table, every string of every entry
+   for (i = 0; i < reg->count; i++)
+      strings_max += eupnp_intern_len_get(reg->intern, reg->usn[i]) +
+		     eupnp_intern_len_get(reg->intern, reg->type[i]) +
+		     eupnp_intern_len_get(reg->intern, reg->cold[i].uuid) +
+		     eupnp_intern_len_get(reg->intern, reg->cold[i].location) + 4;
+
+   size = sizeof(Eupnp_Device_Registry_Snapshot_Header) +
+	  reg->count * sizeof(Eupnp_Device_Registry_Snapshot_Record) +
+	  strings_max;
+
+   buf = calloc(1, size);
+   offsets = malloc((id_max + 1) * sizeof(uint32_t));
+   tmp = malloc(strlen(path) + 8);
+
+   if (!buf || !offsets || !tmp)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not allocate registry snapshot.\n");
+	goto error;
+     }
+
+   memset(offsets, 0xff, (id_max + 1) * sizeof(uint32_t));
+
+   header = (Eupnp_Device_Registry_Snapshot_Header *)buf;
+   records = (Eupnp_Device_Registry_Snapshot_Record *)(header + 1);
+
+   for (i = 0; i < reg->count; i++)
+     {
+	char *strings = (char *)(records + reg->count);
+
+	records[i].usn = eupnp_device_registry_snapshot_string(reg, reg->usn[i], offsets, strings, &strings_size);
+	records[i].type = eupnp_device_registry_snapshot_string(reg, reg->type[i], offsets, strings, &strings_size);
+	records[i].uuid = eupnp_device_registry_snapshot_string(reg, reg->cold[i].uuid, offsets, strings, &strings_size);
+	records[i].location = eupnp_device_registry_snapshot_string(reg, reg->cold[i].location, offsets, strings, &strings_size);
+	records[i].lifetime = (reg->expire[i] > t) ? reg->expire[i] - t : 0;
+	records[i].ifindex = reg->ifindex[i];
+	records[i].addr = reg->cold[i].addr.sin_addr.s_addr;
+	records[i].port = reg->cold[i].addr.sin_port;
+	records[i].version = reg->version[i];
+     }
+
+   memcpy(header->magic, EUPNP_DEVICE_REGISTRY_SNAPSHOT_MAGIC, sizeof(header->magic));
+   header->version = EUPNP_DEVICE_REGISTRY_SNAPSHOT_VERSION;
+   header->count = reg->count;
+   header->strings_size = strings_size;
+   header->saved = time(NULL);
+
+   size = sizeof(Eupnp_Device_Registry_Snapshot_Header) +
+	  reg->count * sizeof(Eupnp_Device_Registry_Snapshot_Record) +
+	  strings_size;
+
+   sprintf(tmp, "%s.XXXXXX", path);
+   fd = mkstemp(tmp);
+
+   if (fd < 0)
+     {
+	ERROR("Could not create %s: %s\n", tmp, strerror(errno));
+	goto error;
+     }
+
+   for (done = 0; done < size; done += n)
+     {
+	n = write(fd, buf + done, size - done);
+
+	if (n < 0 && errno == EINTR)
+	  {
+	     n = 0;
+	     continue;
+	  }
+
+	if (n < 0)
+	  {
+	     ERROR("Could not write %s: %s\n", tmp, strerror(errno));
+	     goto error_unlink;
+	  }
+     }
+
+   if (fsync(fd) < 0)
+     {
+	ERROR("Could not write %s: %s\n", tmp, strerror(errno));
+	goto error_unlink;
+     }
+
+   close(fd);
+
+   if (rename(tmp, path) < 0)
+     {
+	ERROR("Could not rename %s to %s: %s\n", tmp, path, strerror(errno));
+	unlink(tmp);
+	goto error;
+     }
+
+   DEBUG("Saved %u registry entries to %s (%zu bytes)\n", reg->count, path, size);
+
+   free(tmp);
+   free(offsets);
+   free(buf);
+   return EINA_TRUE;
+
+error_unlink:
+   close(fd);
+   unlink(tmp);
+error:
+   free(tmp);
+   free(offsets);
+   free(buf);
+   return EINA_FALSE;
+}
+
+/*
+ * Restores entries from a snapshot written by
+ * eupnp_device_registry_snapshot_save()
+ *
+ * Restored entries are flagged EUPNP_DEVICE_STALE instead of
+ * EUPNP_DEVICE_ALIVE until an announcement for them arrives. Entries whose
+ * lifetime ran out while the snapshot sat on disk are skipped, as are USNs
+ * already on the registry.
+ *
+ * @param reg registry
+ * @param path snapshot file
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return number of entries restored or -1 if the snapshot is missing or
+ *         invalid.
+ */
+int
+eupnp_device_registry_snapshot_load(Eupnp_Device_Registry *reg, const char *path, double now)
+{
+   const Eupnp_Device_Registry_Snapshot_Header *header;
+   const Eupnp_Device_Registry_Snapshot_Record *records;
+   const char *strings;
+   struct stat st;
+   int64_t elapsed;
+   uint32_t i, lifetime;
+   void *map;
+   int fd, restored = 0;
+
+   fd = open(path, O_RDONLY);
+
+   if (fd < 0)
+     {
+	DEBUG("No registry snapshot at %s: %s\n", path, strerror(errno));
+	return -1;
+     }
+
+   if (fstat(fd, &st) < 0 ||
+       (size_t)st.st_size < sizeof(Eupnp_Device_Registry_Snapshot_Header))
+     {
+	WARN("Invalid registry snapshot %s\n", path);
+	close(fd);
+	return -1;
+     }
+
+   map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+
+   if (map == MAP_FAILED)
+     {
+	ERROR("Could not map %s: %s\n", path, strerror(errno));
+	return -1;
+     }
+
+   header = map;
+   records = (const Eupnp_Device_Registry_Snapshot_Record *)(header + 1);
+   strings = (const char *)(records + header->count);
+
+   if (memcmp(header->magic, EUPNP_DEVICE_REGISTRY_SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+       header->version != EUPNP_DEVICE_REGISTRY_SNAPSHOT_VERSION ||
+       header->count > (st.st_size - sizeof(Eupnp_Device_Registry_Snapshot_Header)) / sizeof(Eupnp_Device_Registry_Snapshot_Record) ||
+       (size_t)st.st_size != sizeof(Eupnp_Device_Registry_Snapshot_Header) + header->count * sizeof(Eupnp_Device_Registry_Snapshot_Record) + header->strings_size ||
+       (header->strings_size && strings[header->strings_size - 1] != '\0'))
+     {
+	WARN("Invalid registry snapshot %s\n", path);
+	munmap(map, st.st_size);
+	return -1;
+     }
+
+   elapsed = (int64_t)time(NULL) - header->saved;
+   if (elapsed < 0) elapsed = 0;
+
+   for (i = 0; i < header->count; i++)
+     {
+	if (records[i].lifetime <= elapsed) continue;
+
+	lifetime = records[i].lifetime - elapsed;
+
+	if (eupnp_device_registry_snapshot_restore(reg, records + i, strings, header->strings_size,
+						   eupnp_device_registry_time(now + lifetime)))
+	   restored++;
+     }
+
+   DEBUG("Restored %d of %u registry entries from %s\n", restored, header->count, path);
+
+   munmap(map, st.st_size);
+   return restored;
+}
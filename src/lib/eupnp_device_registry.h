@@ -0,0 +1,90 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_DEVICE_REGISTRY_H
+#define _EUPNP_DEVICE_REGISTRY_H
+
+#include <stdint.h>
+#include <Eina.h>
+#include <netinet/in.h>
+#include <eupnp_intern.h>
+#include <eupnp_ssdp.h>
+
+/*
+ * Lifetime assumed for announcements without a max-age, in seconds
+ */
+#define EUPNP_DEVICE_REGISTRY_DEFAULT_MAX_AGE 1800
+
+/*
+ * Entry flags
+ */
+#define EUPNP_DEVICE_ALIVE 1  /* announced and not expired */
+#define EUPNP_DEVICE_STALE 2  /* restored from a snapshot, not yet revalidated */
+
+typedef struct _Eupnp_Device_Registry Eupnp_Device_Registry;
+typedef struct _Eupnp_Device_Info Eupnp_Device_Info;
+
+typedef enum {
+   EUPNP_DEVICE_REGISTRY_IGNORED,
+   EUPNP_DEVICE_REGISTRY_ADDED,
+   EUPNP_DEVICE_REGISTRY_CHANGED,
+   EUPNP_DEVICE_REGISTRY_REFRESHED,
+   EUPNP_DEVICE_REGISTRY_REMOVED
+} Eupnp_Device_Registry_Result;
+
+/*
+ * Everything known about a registry entry (a device or service announced
+ * under one USN). Strings belong to the intern table and are valid while the
+ * entry exists.
+ */
+struct _Eupnp_Device_Info {
+   Eupnp_Id usn_id;
+   Eupnp_Id type_id;
+   const char *usn;
+   const char *uuid;
+   const char *type;        /* target without version */
+   const char *location;
+   unsigned int version;    /* 0 if the target has no version */
+   unsigned int ifindex;
+   unsigned int flags;
+   double expire;
+   struct sockaddr_in addr;
+};
+
+typedef void (*Eupnp_Device_Registry_Cb) (void *data, const Eupnp_Device_Info *info);
+
+
+Eupnp_Device_Registry *eupnp_device_registry_new(Eupnp_Intern *intern) EINA_ARG_NONNULL(1);
+void                   eupnp_device_registry_free(Eupnp_Device_Registry *reg) EINA_ARG_NONNULL(1);
+Eupnp_Device_Registry_Result eupnp_device_registry_update(Eupnp_Device_Registry *reg, const Eupnp_SSDP_Event *ev, double now) EINA_ARG_NONNULL(1,2);
+unsigned int           eupnp_device_registry_count_get(const Eupnp_Device_Registry *reg) EINA_ARG_NONNULL(1);
+int                    eupnp_device_registry_find(const Eupnp_Device_Registry *reg, Eupnp_Id usn) EINA_ARG_NONNULL(1);
+unsigned int           eupnp_device_registry_query(const Eupnp_Device_Registry *reg, Eupnp_Id type, unsigned int ifindex, unsigned int flags_mask, unsigned int flags, unsigned int *slots, unsigned int max) EINA_ARG_NONNULL(1,6);
+unsigned int           eupnp_device_registry_expiring_query(const Eupnp_Device_Registry *reg, double before, unsigned int *slots, unsigned int max) EINA_ARG_NONNULL(1,3);
+unsigned int           eupnp_device_registry_expire(Eupnp_Device_Registry *reg, double now, Eupnp_Device_Registry_Cb cb, void *data) EINA_ARG_NONNULL(1);
+double                 eupnp_device_registry_next_expire_get(const Eupnp_Device_Registry *reg) EINA_ARG_NONNULL(1);
+Eina_Bool              eupnp_device_registry_info_get(const Eupnp_Device_Registry *reg, unsigned int slot, Eupnp_Device_Info *info) EINA_ARG_NONNULL(1,3);
+Eupnp_Id               eupnp_device_registry_type_find(const Eupnp_Device_Registry *reg, const char *type) EINA_ARG_NONNULL(1,2);
+Eina_Bool              eupnp_device_registry_snapshot_save(const Eupnp_Device_Registry *reg, const char *path, double now) EINA_ARG_NONNULL(1,2);
+int                    eupnp_device_registry_snapshot_load(Eupnp_Device_Registry *reg, const char *path, double now) EINA_ARG_NONNULL(1,2);
+
+
+#endif /* _EUPNP_DEVICE_REGISTRY_H */
@@ -0,0 +1,356 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <Eina.h>
+
+#include "eupnp.h"
+#include "eupnp_error.h"
+#include "eupnp_discovery_scheduler.h"
+
+/*
+ * Discovery is done in scans. A scan sends a search and waits for the
+ * answers; while a round brings in devices not seen before, the search is
+ * retransmitted (up to the policy limit), otherwise the scan has converged.
+ *
+ * MX is picked from the number of responses the previous scan got, so that
+ * devices spread their answers enough for them to arrive at the target rate.
+ * How long to wait for a round comes from the observed response delays: when
+ * devices answer well before MX runs out there is no point in waiting for
+ * all of it.
+ *
+ * Scans repeat with exponential backoff, going back to the shortest interval
+ * whenever a scan finds something new.
+ */
+
+/*
+ * Margin added to the waiting time of a round, in seconds, and number of
+ * delays observed before trusting their distribution.
+ */
+#define EUPNP_DISCOVERY_SLACK 0.5
+#define EUPNP_DISCOVERY_MIN_SAMPLES 20
+
+struct _Eupnp_Discovery_Scheduler {
+   Eupnp_SSDP_Server *ssdp;
+   Eupnp_Timer_Wheel *timers;
+   Eupnp_Timer *timer;
+   Eupnp_Discovery_Policy policy;
+   char *search_target;
+
+   int mx;
+   unsigned int round;
+   double sent_at;
+   double interval;
+
+   unsigned long round_new;
+   unsigned long scan_new;
+   unsigned long scan_responses;
+
+   /* Response delays (microseconds) for searches sent with the current mx */
+   Eupnp_Histogram delay;
+
+   unsigned long sent;
+};
+
+
+/*
+ * Private API
+ */
+
+static void eupnp_discovery_scheduler_round_end(void *data);
+static void eupnp_discovery_scheduler_rescan(void *data);
+
+static int
+eupnp_discovery_scheduler_mx_pick(const Eupnp_Discovery_Scheduler *s, unsigned long responses)
+{
+   int mx = (int)(responses / s->policy.target_rate) + 1;
+
+   if (mx < s->policy.mx_min) mx = s->policy.mx_min;
+   if (mx > s->policy.mx_max) mx = s->policy.mx_max;
+
+   return mx;
+}
+
+/*
+ * Seconds to wait for the answers of a round.
+ */
+static double
+eupnp_discovery_scheduler_window(const Eupnp_Discovery_Scheduler *s)
+{
+   double p99;
+
+   if (s->delay.count < EUPNP_DISCOVERY_MIN_SAMPLES)
+      return s->mx + EUPNP_DISCOVERY_SLACK;
+
+   p99 = eupnp_histogram_percentile_get(&s->delay, 0.99) / 1000000;
+   if (p99 > s->mx) p99 = s->mx;
+
+   return p99 + EUPNP_DISCOVERY_SLACK;
+}
+
+static Eina_Bool
+eupnp_discovery_scheduler_send(Eupnp_Discovery_Scheduler *s, double now)
+{
+   s->round_new = 0;
+   s->sent_at = now;
+
+   if (eupnp_ssdp_discovery_request_send(s->ssdp, s->mx, s->search_target))
+      s->sent++;
+   else
+      WARN("Could not send discovery search, will retry.\n");
+
+   s->timer = eupnp_timer_add(s->timers, now + eupnp_discovery_scheduler_window(s),
+			      eupnp_discovery_scheduler_round_end, s);
+
+   return s->timer != NULL;
+}
+
+static void
+eupnp_discovery_scheduler_scan(Eupnp_Discovery_Scheduler *s, double now)
+{
+   s->round = 0;
+   s->scan_new = 0;
+   s->scan_responses = 0;
+
+   if (!eupnp_discovery_scheduler_send(s, now))
+      ERROR("Could not schedule discovery.\n");
+}
+
+static void
+eupnp_discovery_scheduler_round_end(void *data)
+{
+   Eupnp_Discovery_Scheduler *s = data;
+   double now = eupnp_time_now();
+   int mx;
+
+   s->timer = NULL;
+
+   if (s->round_new && s->round < s->policy.retransmits)
+     {
+	s->round++;
+	DEBUG("Discovery round %u found %lu new devices, retransmitting\n",
+	      s->round, s->round_new);
+	eupnp_discovery_scheduler_send(s, now);
+	return;
+     }
+
+   DEBUG("Discovery converged after %u retransmits, %lu responses, %lu new\n",
+	 s->round, s->scan_responses, s->scan_new);
+
+   // Responses are counted once per scan, retransmits get the same answers
+   mx = eupnp_discovery_scheduler_mx_pick(s, s->scan_responses / (s->round + 1));
+
+   if (mx != s->mx)
+     {
+	s->mx = mx;
+	eupnp_histogram_reset(&s->delay);
+     }
+
+   if (s->policy.rescan_min <= 0)
+      return;
+
+   if (s->scan_new || !s->interval)
+      s->interval = s->policy.rescan_min;
+   else if (s->interval * 2 < s->policy.rescan_max)
+      s->interval *= 2;
+   else
+      s->interval = s->policy.rescan_max;
+
+   s->timer = eupnp_timer_add(s->timers, now + s->interval,
+			      eupnp_discovery_scheduler_rescan, s);
+}
+
+static void
+eupnp_discovery_scheduler_rescan(void *data)
+{
+   Eupnp_Discovery_Scheduler *s = data;
+
+   s->timer = NULL;
+   eupnp_discovery_scheduler_scan(s, eupnp_time_now());
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Discovery_Scheduler structure
+ *
+ * @param ssdp server used for sending searches
+ * @param timers timer wheel the scheduler runs on
+ *
+ * @return Eupnp_Discovery_Scheduler instance or NULL on error.
+ */
+Eupnp_Discovery_Scheduler *
+eupnp_discovery_scheduler_new(Eupnp_SSDP_Server *ssdp, Eupnp_Timer_Wheel *timers)
+{
+   Eupnp_Discovery_Scheduler *s;
+
+   s = calloc(1, sizeof(Eupnp_Discovery_Scheduler));
+
+   if (!s)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create discovery scheduler.\n");
+	return NULL;
+     }
+
+   s->ssdp = ssdp;
+   s->timers = timers;
+   s->policy.mx_min = EUPNP_DISCOVERY_MX_MIN;
+   s->policy.mx_max = EUPNP_DISCOVERY_MX_MAX;
+   s->policy.retransmits = EUPNP_DISCOVERY_RETRANSMITS;
+   s->policy.target_rate = EUPNP_DISCOVERY_TARGET_RATE;
+   s->policy.rescan_min = EUPNP_DISCOVERY_RESCAN_MIN;
+   s->policy.rescan_max = EUPNP_DISCOVERY_RESCAN_MAX;
+   s->mx = EUPNP_DISCOVERY_MX_MIN;
+
+   return s;
+}
+
+void
+eupnp_discovery_scheduler_free(Eupnp_Discovery_Scheduler *s)
+{
+   if (!s) return;
+
+   eupnp_discovery_scheduler_stop(s);
+   free(s);
+}
+
+void
+eupnp_discovery_scheduler_policy_set(Eupnp_Discovery_Scheduler *s, const Eupnp_Discovery_Policy *policy)
+{
+   s->policy = *policy;
+   if (s->policy.target_rate <= 0) s->policy.target_rate = EUPNP_DISCOVERY_TARGET_RATE;
+   s->mx = eupnp_discovery_scheduler_mx_pick(s, 0);
+}
+
+void
+eupnp_discovery_scheduler_policy_get(const Eupnp_Discovery_Scheduler *s, Eupnp_Discovery_Policy *policy)
+{
+   *policy = s->policy;
+}
+
+/*
+ * Starts discovering a search target, replacing any discovery in progress
+ *
+ * @param s scheduler
+ * @param search_target target, e.g. "ssdp:all"
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_discovery_scheduler_start(Eupnp_Discovery_Scheduler *s, const char *search_target, double now)
+{
+   char *target = strdup(search_target);
+
+   if (!target)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not start discovery.\n");
+	return EINA_FALSE;
+     }
+
+   eupnp_discovery_scheduler_stop(s);
+   s->search_target = target;
+   s->interval = 0;
+
+   eupnp_discovery_scheduler_scan(s, now);
+
+   return s->timer != NULL;
+}
+
+/*
+ * Stops discovery, cancelling retransmits and rescans
+ */
+void
+eupnp_discovery_scheduler_stop(Eupnp_Discovery_Scheduler *s)
+{
+   if (s->timer) eupnp_timer_del(s->timers, s->timer);
+   s->timer = NULL;
+
+   free(s->search_target);
+   s->search_target = NULL;
+}
+
+/*
+ * Accounts a search response
+ *
+ * @param s scheduler
+ * @param new_device whether the response is for a device or service not
+ *        known before
+ * @param now current time, see eupnp_time_now()
+ */
+void
+eupnp_discovery_scheduler_response_add(Eupnp_Discovery_Scheduler *s, Eina_Bool new_device, double now)
+{
+   if (!s->search_target) return;
+
+   s->scan_responses++;
+
+   if (new_device)
+     {
+	s->round_new++;
+	s->scan_new++;
+     }
+
+   if (now >= s->sent_at && now <= s->sent_at + s->mx + EUPNP_DISCOVERY_SLACK)
+      eupnp_histogram_add(&s->delay, (now - s->sent_at) * 1000000);
+}
+
+/*
+ * Retrieves the MX the next search will be sent with
+ */
+int
+eupnp_discovery_scheduler_mx_get(const Eupnp_Discovery_Scheduler *s)
+{
+   return s->mx;
+}
+
+/*
+ * Retrieves the current rescan interval in seconds, 0 before the first scan
+ * converges
+ */
+double
+eupnp_discovery_scheduler_rescan_interval_get(const Eupnp_Discovery_Scheduler *s)
+{
+   return s->interval;
+}
+
+/*
+ * Retrieves the number of searches sent
+ */
+unsigned long
+eupnp_discovery_scheduler_sent_get(const Eupnp_Discovery_Scheduler *s)
+{
+   return s->sent;
+}
+
+/*
+ * Retrieves the distribution of response delays observed with the current MX
+ */
+const Eupnp_Histogram *
+eupnp_discovery_scheduler_delay_get(const Eupnp_Discovery_Scheduler *s)
+{
+   return &s->delay;
+}
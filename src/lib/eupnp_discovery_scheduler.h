@@ -0,0 +1,70 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_DISCOVERY_SCHEDULER_H
+#define _EUPNP_DISCOVERY_SCHEDULER_H
+
+#include <Eina.h>
+#include <eupnp_ssdp.h>
+#include <eupnp_timer.h>
+#include <eupnp_metrics.h>
+
+/*
+ * Default policy. MX is kept within what UDA allows (1 to 5 seconds) and
+ * picked so responses arrive at about 200 per second. A scan retransmits its
+ * search up to 2 times while new devices keep answering. Rescans start 60
+ * seconds apart and back off up to 15 minutes while nothing changes.
+ */
+#define EUPNP_DISCOVERY_MX_MIN 1
+#define EUPNP_DISCOVERY_MX_MAX 5
+#define EUPNP_DISCOVERY_RETRANSMITS 2
+#define EUPNP_DISCOVERY_TARGET_RATE 200
+#define EUPNP_DISCOVERY_RESCAN_MIN 60
+#define EUPNP_DISCOVERY_RESCAN_MAX 900
+
+typedef struct _Eupnp_Discovery_Scheduler Eupnp_Discovery_Scheduler;
+typedef struct _Eupnp_Discovery_Policy Eupnp_Discovery_Policy;
+
+
+struct _Eupnp_Discovery_Policy {
+   int mx_min;
+   int mx_max;
+   unsigned int retransmits;  /* extra searches per scan */
+   double target_rate;        /* responses per second */
+   double rescan_min;         /* seconds, 0 for a single scan */
+   double rescan_max;
+};
+
+
+Eupnp_Discovery_Scheduler *eupnp_discovery_scheduler_new(Eupnp_SSDP_Server *ssdp, Eupnp_Timer_Wheel *timers) EINA_ARG_NONNULL(1,2);
+void                       eupnp_discovery_scheduler_free(Eupnp_Discovery_Scheduler *s) EINA_ARG_NONNULL(1);
+void                       eupnp_discovery_scheduler_policy_set(Eupnp_Discovery_Scheduler *s, const Eupnp_Discovery_Policy *policy) EINA_ARG_NONNULL(1,2);
+void                       eupnp_discovery_scheduler_policy_get(const Eupnp_Discovery_Scheduler *s, Eupnp_Discovery_Policy *policy) EINA_ARG_NONNULL(1,2);
+Eina_Bool                  eupnp_discovery_scheduler_start(Eupnp_Discovery_Scheduler *s, const char *search_target, double now) EINA_ARG_NONNULL(1,2);
+void                       eupnp_discovery_scheduler_stop(Eupnp_Discovery_Scheduler *s) EINA_ARG_NONNULL(1);
+void                       eupnp_discovery_scheduler_response_add(Eupnp_Discovery_Scheduler *s, Eina_Bool new_device, double now) EINA_ARG_NONNULL(1);
+int                        eupnp_discovery_scheduler_mx_get(const Eupnp_Discovery_Scheduler *s) EINA_ARG_NONNULL(1);
+double                     eupnp_discovery_scheduler_rescan_interval_get(const Eupnp_Discovery_Scheduler *s) EINA_ARG_NONNULL(1);
+unsigned long              eupnp_discovery_scheduler_sent_get(const Eupnp_Discovery_Scheduler *s) EINA_ARG_NONNULL(1);
+const Eupnp_Histogram     *eupnp_discovery_scheduler_delay_get(const Eupnp_Discovery_Scheduler *s) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_DISCOVERY_SCHEDULER_H */
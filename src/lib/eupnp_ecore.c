@@ -0,0 +1,248 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <math.h>
+#include <Eina.h>
+#include <Ecore.h>
+
+#include "eupnp.h"
+#include "eupnp_error.h"
+#include "eupnp_ecore.h"
+
+/*
+ * Deadlines closer than this are the same, so the timer is not re-created
+ * before every sleep
+ */
+#define EUPNP_ECORE_DEADLINE_SLACK 0.001
+
+struct _Eupnp_Ecore_Handle {
+   Ecore_Fd_Handler *fd_handler;
+   Ecore_Timer *timer;
+   double deadline;
+
+   void *obj;
+   double (*timeout_get) (const void *obj);
+   void (*dispatch) (void *obj);
+};
+
+
+/*
+ * Private API
+ */
+
+static void
+_eupnp_ecore_control_point_dispatch(void *obj)
+{
+   eupnp_control_point_dispatch(obj);
+}
+
+static double
+_eupnp_ecore_control_point_timeout_get(const void *obj)
+{
+   return eupnp_control_point_timeout_get(obj);
+}
+
+static void
+_eupnp_ecore_http_server_dispatch(void *obj)
+{
+   eupnp_http_server_process(obj);
+}
+
+static double
+_eupnp_ecore_http_server_timeout_get(const void *obj)
+{
+   return eupnp_http_server_timeout_get(obj);
+}
+
+static void
+_eupnp_ecore_http_client_dispatch(void *obj)
+{
+   eupnp_http_client_process(obj);
+}
+
+static double
+_eupnp_ecore_http_client_timeout_get(const void *obj)
+{
+   return eupnp_http_client_timeout_get(obj);
+}
+
+static Eina_Bool
+_eupnp_ecore_timer_cb(void *data)
+{
+   Eupnp_Ecore_Handle *h = data;
+
+   // Re-created by the prepare callback if there is a next deadline
+   h->timer = NULL;
+   h->dispatch(h->obj);
+
+   return ECORE_CALLBACK_CANCEL;
+}
+
+static Eina_Bool
+_eupnp_ecore_fd_cb(void *data, Ecore_Fd_Handler *fd_handler)
+{
+   Eupnp_Ecore_Handle *h = data;
+
+   h->dispatch(h->obj);
+
+   return ECORE_CALLBACK_RENEW;
+}
+
+/*
+ * Called before the main loop sleeps. Moves the timer to the next deadline,
+ * which changes as the library is used.
+ */
+static void
+_eupnp_ecore_prepare_cb(void *data, Ecore_Fd_Handler *fd_handler)
+{
+   Eupnp_Ecore_Handle *h = data;
+   double timeout, deadline;
+
+   timeout = h->timeout_get(h->obj);
+
+   if (timeout < 0)
+     {
+	if (h->timer) ecore_timer_del(h->timer);
+	h->timer = NULL;
+	return;
+     }
+
+   deadline = eupnp_time_now() + timeout;
+
+   if (h->timer && fabs(deadline - h->deadline) < EUPNP_ECORE_DEADLINE_SLACK)
+      return;
+
+   if (h->timer) ecore_timer_del(h->timer);
+
+   h->deadline = deadline;
+   h->timer = ecore_timer_add(timeout, _eupnp_ecore_timer_cb, h);
+
+   if (!h->timer)
+      ERROR("Could not add timer for deadline in %f s.\n", timeout);
+}
+
+static Eupnp_Ecore_Handle *
+_eupnp_ecore_attach(int fd, void *obj, double (*timeout_get) (const void *obj), void (*dispatch) (void *obj))
+{
+   Eupnp_Ecore_Handle *h;
+
+   if (fd < 0)
+     {
+	ERROR("Nothing to watch.\n");
+	return NULL;
+     }
+
+   h = calloc(1, sizeof(Eupnp_Ecore_Handle));
+
+   if (!h)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create ecore handle.\n");
+	return NULL;
+     }
+
+   h->obj = obj;
+   h->timeout_get = timeout_get;
+   h->dispatch = dispatch;
+   h->fd_handler = ecore_main_fd_handler_add(fd, ECORE_FD_READ,
+					     _eupnp_ecore_fd_cb, h, NULL, NULL);
+
+   if (!h->fd_handler)
+     {
+	ERROR("Could not add fd handler for %d.\n", fd);
+	free(h);
+	return NULL;
+     }
+
+   ecore_main_fd_handler_prepare_callback_set(h->fd_handler,
+					      _eupnp_ecore_prepare_cb, h);
+
+   return h;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Runs a control point from the Ecore main loop
+ *
+ * @param c Eupnp_Control_Point instance, must outlive the handle.
+ *
+ * @return handle for eupnp_ecore_detach() or NULL on error.
+ */
+Eupnp_Ecore_Handle *
+eupnp_ecore_control_point_attach(Eupnp_Control_Point *c)
+{
+   return _eupnp_ecore_attach(eupnp_control_point_fd_get(c), c,
+			      _eupnp_ecore_control_point_timeout_get,
+			      _eupnp_ecore_control_point_dispatch);
+}
+
+/*
+ * Runs a HTTP server from the Ecore main loop
+ *
+ * @param srv Eupnp_HTTP_Server instance, must outlive the handle.
+ *
+ * @return handle for eupnp_ecore_detach() or NULL on error.
+ */
+Eupnp_Ecore_Handle *
+eupnp_ecore_http_server_attach(Eupnp_HTTP_Server *srv)
+{
+   return _eupnp_ecore_attach(eupnp_http_server_fd_get(srv), srv,
+			      _eupnp_ecore_http_server_timeout_get,
+			      _eupnp_ecore_http_server_dispatch);
+}
+
+/*
+ * Runs a HTTP client from the Ecore main loop, settling request futures from
+ * it.
+ *
+ * @param c Eupnp_HTTP_Client instance, must outlive the handle.
+ *
+ * @return handle for eupnp_ecore_detach() or NULL on error.
+ */
+Eupnp_Ecore_Handle *
+eupnp_ecore_http_client_attach(Eupnp_HTTP_Client *c)
+{
+   return _eupnp_ecore_attach(eupnp_http_client_fd_get(c), c,
+			      _eupnp_ecore_http_client_timeout_get,
+			      _eupnp_ecore_http_client_dispatch);
+}
+
+/*
+ * Stops running a control point, HTTP server or client from the main loop
+ *
+ * @param h handle returned by eupnp_ecore_control_point_attach(),
+ *        eupnp_ecore_http_server_attach() or eupnp_ecore_http_client_attach().
+ */
+void
+eupnp_ecore_detach(Eupnp_Ecore_Handle *h)
+{
+   if (h->timer) ecore_timer_del(h->timer);
+   ecore_main_fd_handler_del(h->fd_handler);
+   free(h);
+}
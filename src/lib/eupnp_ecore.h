@@ -0,0 +1,46 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_ECORE_H
+#define _EUPNP_ECORE_H
+
+#include <Eina.h>
+#include <eupnp_control_point.h>
+#include <eupnp_http_server.h>
+#include <eupnp_http_client.h>
+
+/*
+ * Runs control points, HTTP servers and clients from the Ecore main loop.
+ *
+ * The library file descriptor gets an fd handler and its next timer deadline
+ * an Ecore timer, checked before each sleep of the main loop. Ready datagrams,
+ * connections and timers are all handled on a single wakeup.
+ */
+typedef struct _Eupnp_Ecore_Handle Eupnp_Ecore_Handle;
+
+
+Eupnp_Ecore_Handle *eupnp_ecore_control_point_attach(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+Eupnp_Ecore_Handle *eupnp_ecore_http_server_attach(Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+Eupnp_Ecore_Handle *eupnp_ecore_http_client_attach(Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+void                eupnp_ecore_detach(Eupnp_Ecore_Handle *h) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_ECORE_H */
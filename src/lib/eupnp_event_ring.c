@@ -0,0 +1,289 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_event_ring.h"
+
+/*
+ * Single producer, single consumer ring of SSDP events, for handing events
+ * from a library thread to the application thread.
+ *
+ * head is only written by the consumer and tail by the producer, each slot is
+ * owned by one side at a time, so neither side ever waits for the other. An
+ * eventfd tells the consumer there is something to take. It is written once
+ * per batch: the producer only writes it when the consumer has not been told
+ * yet, and the consumer clears that state right before emptying the ring.
+ *
+ * Datagrams are not carried over: the producer reuses its receive buffers
+ * right away, so events come out with a NULL datagram.
+ */
+
+typedef struct _Eupnp_Event_Ring_Slot Eupnp_Event_Ring_Slot;
+
+struct _Eupnp_Event_Ring_Slot {
+   Eupnp_SSDP_Message_Class type;
+   int max_age;
+   unsigned short target_len;
+   unsigned short usn_len;
+   short location_len;       /* -1 for no location */
+   char strings[EUPNP_EVENT_RING_STRINGS];
+};
+
+struct _Eupnp_Event_Ring {
+   Eupnp_Event_Ring_Slot *slots;
+   unsigned int mask;
+   int fd;
+
+   /* Producer side, dropped is read by any thread */
+   unsigned int tail __attribute__((aligned(64)));
+   unsigned long dropped;
+
+   /* Consumer side */
+   unsigned int head __attribute__((aligned(64)));
+
+   /* Set by the producer when it writes fd, cleared by the consumer */
+   int signaled __attribute__((aligned(64)));
+};
+
+
+/*
+ * Private API
+ */
+
+static size_t
+_eupnp_event_ring_strlen(const char *s)
+{
+   return s ? strlen(s) : 0;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Event_Ring structure
+ *
+ * @param size number of slots, rounded up to a power of two. 0 for
+ *        EUPNP_EVENT_RING_SIZE.
+ *
+ * @return Eupnp_Event_Ring instance or NULL on error.
+ */
+Eupnp_Event_Ring *
+eupnp_event_ring_new(unsigned int size)
+{
+   Eupnp_Event_Ring *r;
+   unsigned int n = 1;
+
+   if (!size) size = EUPNP_EVENT_RING_SIZE;
+   while (n < size) n <<= 1;
+
+   if (posix_memalign((void **)&r, 64, sizeof(Eupnp_Event_Ring)))
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create event ring.\n");
+	return NULL;
+     }
+
+   memset(r, 0, sizeof(Eupnp_Event_Ring));
+   r->mask = n - 1;
+   r->slots = malloc(n * sizeof(Eupnp_Event_Ring_Slot));
+
+   if (!r->slots)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not allocate %u event ring slots.\n", n);
+	free(r);
+	return NULL;
+     }
+
+   r->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+   if (r->fd < 0)
+     {
+	ERROR("Could not create event ring eventfd: %s\n", strerror(errno));
+	free(r->slots);
+	free(r);
+	return NULL;
+     }
+
+   return r;
+}
+
+void
+eupnp_event_ring_free(Eupnp_Event_Ring *r)
+{
+   close(r->fd);
+   free(r->slots);
+   free(r);
+}
+
+/*
+ * Retrieves the file descriptor the consumer waits on, readable when events
+ * have been signaled
+ */
+int
+eupnp_event_ring_fd_get(const Eupnp_Event_Ring *r)
+{
+   return r->fd;
+}
+
+/*
+ * Copies an event into the ring. Producer only.
+ *
+ * The consumer is not woken up, see eupnp_event_ring_signal().
+ *
+ * @return EINA_TRUE on success, EINA_FALSE if the ring is full or the event
+ *         strings do not fit a slot. Dropped events are counted, see
+ *         eupnp_event_ring_dropped_get().
+ */
+Eina_Bool
+eupnp_event_ring_push(Eupnp_Event_Ring *r, const Eupnp_SSDP_Event *ev)
+{
+   Eupnp_Event_Ring_Slot *slot;
+   size_t target_len, usn_len, location_len;
+   unsigned int tail = r->tail;
+   char *p;
+
+   target_len = _eupnp_event_ring_strlen(ev->target);
+   usn_len = _eupnp_event_ring_strlen(ev->usn);
+   location_len = _eupnp_event_ring_strlen(ev->location);
+
+   if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) > r->mask ||
+       target_len + usn_len + location_len + 3 > EUPNP_EVENT_RING_STRINGS)
+     {
+	__atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+	return EINA_FALSE;
+     }
+
+   slot = &r->slots[tail & r->mask];
+   slot->type = ev->type;
+   slot->max_age = ev->max_age;
+   slot->target_len = target_len;
+   slot->usn_len = usn_len;
+   slot->location_len = ev->location ? (short)location_len : -1;
+
+   p = slot->strings;
+   memcpy(p, ev->target ? ev->target : "", target_len + 1);
+   p += target_len + 1;
+   memcpy(p, ev->usn ? ev->usn : "", usn_len + 1);
+   p += usn_len + 1;
+   memcpy(p, ev->location ? ev->location : "", location_len + 1);
+
+   __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+   return EINA_TRUE;
+}
+
+/*
+ * Wakes up the consumer if there are events it has not been told about.
+ * Producer only, meant to be called once after pushing a batch.
+ */
+void
+eupnp_event_ring_signal(Eupnp_Event_Ring *r)
+{
+   uint64_t one = 1;
+
+   if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == r->tail)
+      return;
+
+   // Already signaled and not drained yet, one wakeup covers both batches
+   if (__atomic_exchange_n(&r->signaled, 1, __ATOMIC_ACQ_REL))
+      return;
+
+   if (write(r->fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      ERROR("Could not signal event ring: %s\n", strerror(errno));
+}
+
+/*
+ * Takes events from the ring, calling cb for each. Consumer only.
+ *
+ * @param r ring
+ * @param cb function to call for each event
+ * @param data data passed to cb
+ * @param max maximum number of events to take, 0 for no limit. Events left
+ *        in the ring keep the file descriptor readable.
+ *
+ * @return number of events taken.
+ */
+unsigned int
+eupnp_event_ring_drain(Eupnp_Event_Ring *r, Eupnp_Event_Ring_Cb cb, void *data, unsigned int max)
+{
+   Eupnp_Event_Ring_Slot *slot;
+   Eupnp_SSDP_Event ev;
+   unsigned int head = r->head, tail, n = 0;
+   uint64_t count;
+
+   // Clear the wakeup before looking at the ring, events pushed from now on
+   // signal again. Exchanging (not storing) orders this with the producer:
+   // if it saw the old value, its events are visible below.
+   if (read(r->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+      ERROR("Could not read event ring eventfd: %s\n", strerror(errno));
+   __atomic_exchange_n(&r->signaled, 0, __ATOMIC_ACQ_REL);
+
+   tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+   while (head != tail && (!max || n < max))
+     {
+	slot = &r->slots[head & r->mask];
+
+	ev.type = slot->type;
+	ev.max_age = slot->max_age;
+	ev.target = slot->strings;
+	ev.usn = ev.target + slot->target_len + 1;
+	ev.location = (slot->location_len < 0) ? NULL :
+		      ev.usn + slot->usn_len + 1;
+	ev.datagram = NULL;
+
+	cb(data, &ev);
+
+	head++;
+	n++;
+	__atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+     }
+
+   // Stopped at max, stay readable for the rest
+   if (head != tail && !__atomic_exchange_n(&r->signaled, 1, __ATOMIC_ACQ_REL))
+     {
+	count = 1;
+	if (write(r->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+	   ERROR("Could not signal event ring: %s\n", strerror(errno));
+     }
+
+   return n;
+}
+
+/*
+ * Retrieves the number of events dropped because the ring was full or they
+ * did not fit a slot
+ */
+unsigned long
+eupnp_event_ring_dropped_get(const Eupnp_Event_Ring *r)
+{
+   return __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,53 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_EVENT_RING_H
+#define _EUPNP_EVENT_RING_H
+
+#include <Eina.h>
+#include <eupnp_ssdp.h>
+
+/*
+ * Default number of slots and room for the strings of an event (target, USN
+ * and location). Events that do not fit are dropped and counted.
+ */
+#define EUPNP_EVENT_RING_SIZE 512
+#define EUPNP_EVENT_RING_STRINGS 1024
+
+typedef struct _Eupnp_Event_Ring Eupnp_Event_Ring;
+
+/*
+ * Called for each event taken from the ring. The event and its strings are
+ * valid during the call, its datagram is always NULL.
+ */
+typedef void (*Eupnp_Event_Ring_Cb) (void *data, const Eupnp_SSDP_Event *ev);
+
+
+Eupnp_Event_Ring *eupnp_event_ring_new(unsigned int size);
+void              eupnp_event_ring_free(Eupnp_Event_Ring *r) EINA_ARG_NONNULL(1);
+int               eupnp_event_ring_fd_get(const Eupnp_Event_Ring *r) EINA_ARG_NONNULL(1);
+Eina_Bool         eupnp_event_ring_push(Eupnp_Event_Ring *r, const Eupnp_SSDP_Event *ev) EINA_ARG_NONNULL(1,2);
+void              eupnp_event_ring_signal(Eupnp_Event_Ring *r) EINA_ARG_NONNULL(1);
+unsigned int      eupnp_event_ring_drain(Eupnp_Event_Ring *r, Eupnp_Event_Ring_Cb cb, void *data, unsigned int max) EINA_ARG_NONNULL(1,2);
+unsigned long     eupnp_event_ring_dropped_get(const Eupnp_Event_Ring *r) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_EVENT_RING_H */
@@ -0,0 +1,444 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_future.h"
+
+typedef struct _Eupnp_Future_Continuation Eupnp_Future_Continuation;
+typedef struct _Eupnp_Future_Link Eupnp_Future_Link;
+
+struct _Eupnp_Future_Continuation {
+   Eupnp_Future_Continuation *next;
+   Eupnp_Future_Cb cb;
+   void *data;
+};
+
+struct _Eupnp_Future {
+   Eupnp_Future_State state;
+   int refcount;
+
+   void *value;
+   Eupnp_Future_Free_Cb free_cb;
+   Eupnp_Future *owner;   /* future owning value, for chains */
+   int error;
+
+   Eupnp_Future_Cancel_Cb cancel_cb;
+   void *cancel_data;
+
+   /* Run in the order they were added */
+   Eupnp_Future_Continuation *continuations;
+   Eupnp_Future_Continuation **last;
+};
+
+/*
+ * State of a chain: the future given to the caller (out) and the future of
+ * the step running (step), first the one chained on, then the one returned
+ * by the chain callback.
+ */
+struct _Eupnp_Future_Link {
+   Eupnp_Future *out;
+   Eupnp_Future *step;
+   Eupnp_Future_Chain_Cb cb;
+   void *data;
+};
+
+
+/*
+ * Private API
+ */
+
+/*
+ * Runs the continuations of a future that just settled.
+ */
+static void
+_eupnp_future_settled(Eupnp_Future *f)
+{
+   Eupnp_Future_Continuation *c, *next;
+
+   c = f->continuations;
+   f->continuations = NULL;
+   f->last = &f->continuations;
+
+   // Continuations may drop the last references
+   eupnp_future_ref(f);
+
+   for (; c; c = next)
+     {
+	next = c->next;
+	c->cb(c->data, f);
+	free(c);
+     }
+
+   eupnp_future_unref(f);
+}
+
+static void
+_eupnp_future_link_finish(Eupnp_Future_Link *link)
+{
+   if (link->step) eupnp_future_unref(link->step);
+   eupnp_future_unref(link->out);
+   free(link);
+}
+
+static void
+_eupnp_future_link_next_cb(void *data, Eupnp_Future *f)
+{
+   Eupnp_Future_Link *link = data;
+   Eupnp_Future *out = link->out;
+
+   if (out->state == EUPNP_FUTURE_PENDING)
+     {
+	switch (f->state)
+	  {
+	   case EUPNP_FUTURE_RESOLVED:
+	      // The value stays owned by the step, kept alive by out
+	      out->owner = eupnp_future_ref(f);
+	      eupnp_future_resolve(out, f->value, NULL);
+	      break;
+	   case EUPNP_FUTURE_REJECTED:
+	      eupnp_future_reject(out, f->error);
+	      break;
+	   default:
+	      link->step = NULL;
+	      eupnp_future_unref(f);
+	      eupnp_future_cancel(out);
+	      break;
+	  }
+     }
+
+   _eupnp_future_link_finish(link);
+}
+
+static void
+_eupnp_future_link_first_cb(void *data, Eupnp_Future *f)
+{
+   Eupnp_Future_Link *link = data;
+   Eupnp_Future *out = link->out;
+   Eupnp_Future *next;
+
+   if (out->state != EUPNP_FUTURE_PENDING)
+     {
+	_eupnp_future_link_finish(link);
+	return;
+     }
+
+   switch (f->state)
+     {
+      case EUPNP_FUTURE_RESOLVED:
+	 next = link->cb(link->data, f->value);
+	 eupnp_future_unref(f);
+	 link->step = next;
+
+	 if (!next)
+	   {
+	      eupnp_future_reject(out, EINVAL);
+	      break;
+	   }
+
+	 // The link is released by the next step continuation
+	 if (eupnp_future_then(next, _eupnp_future_link_next_cb, link))
+	    return;
+
+	 eupnp_future_cancel(next);
+	 eupnp_future_reject(out, ENOMEM);
+	 break;
+      case EUPNP_FUTURE_REJECTED:
+	 eupnp_future_reject(out, f->error);
+	 break;
+      default:
+	 link->step = NULL;
+	 eupnp_future_unref(f);
+	 eupnp_future_cancel(out);
+	 break;
+     }
+
+   _eupnp_future_link_finish(link);
+}
+
+/*
+ * Cancelling a chain cancels the step running, whose continuation then
+ * releases the link.
+ */
+static void
+_eupnp_future_link_cancel(void *data, Eupnp_Future *out)
+{
+   Eupnp_Future_Link *link = data;
+
+   (void)out;
+
+   if (link->step && link->step->state == EUPNP_FUTURE_PENDING)
+      eupnp_future_cancel(link->step);
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Future structure, for producers
+ *
+ * The reference returned belongs to the producer, which settles the future
+ * and then drops it, or drops it from cancel_cb. Callers get their own with
+ * eupnp_future_ref().
+ *
+ * @param cancel_cb function called if the future is cancelled while pending,
+ *        may be NULL.
+ * @param data data passed to cancel_cb
+ *
+ * @return Eupnp_Future instance or NULL on error.
+ */
+Eupnp_Future *
+eupnp_future_new(Eupnp_Future_Cancel_Cb cancel_cb, void *data)
+{
+   Eupnp_Future *f;
+
+   f = calloc(1, sizeof(Eupnp_Future));
+
+   if (!f)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create future.\n");
+	return NULL;
+     }
+
+   f->refcount = 1;
+   f->cancel_cb = cancel_cb;
+   f->cancel_data = data;
+   f->last = &f->continuations;
+
+   return f;
+}
+
+Eupnp_Future *
+eupnp_future_ref(Eupnp_Future *f)
+{
+   f->refcount++;
+   return f;
+}
+
+/*
+ * Drops a reference, freeing the future and its value with the last one
+ */
+void
+eupnp_future_unref(Eupnp_Future *f)
+{
+   Eupnp_Future_Continuation *c, *next;
+
+   if (--f->refcount) return;
+
+   if (f->free_cb && f->value) f->free_cb(f->value);
+   if (f->owner) eupnp_future_unref(f->owner);
+
+   for (c = f->continuations; c; c = next)
+     {
+	next = c->next;
+	free(c);
+     }
+
+   free(f);
+}
+
+/*
+ * Settles a pending future with a value. Does nothing if it already settled,
+ * e.g. was cancelled, in which case value is freed right away.
+ *
+ * @param f future
+ * @param value result
+ * @param free_cb function freeing value with the future, may be NULL
+ */
+void
+eupnp_future_resolve(Eupnp_Future *f, void *value, Eupnp_Future_Free_Cb free_cb)
+{
+   if (f->state != EUPNP_FUTURE_PENDING)
+     {
+	if (free_cb && value) free_cb(value);
+	return;
+     }
+
+   f->state = EUPNP_FUTURE_RESOLVED;
+   f->value = value;
+   f->free_cb = free_cb;
+
+   _eupnp_future_settled(f);
+}
+
+/*
+ * Settles a pending future with an error. Does nothing if it already settled.
+ *
+ * @param f future
+ * @param error errno code, e.g. ETIMEDOUT
+ */
+void
+eupnp_future_reject(Eupnp_Future *f, int error)
+{
+   if (f->state != EUPNP_FUTURE_PENDING) return;
+
+   f->state = EUPNP_FUTURE_REJECTED;
+   f->error = error;
+
+   _eupnp_future_settled(f);
+}
+
+/*
+ * Cancels a pending future: the producer stops working on it and its
+ * continuations run with the cancelled state. Does nothing if it already
+ * settled.
+ */
+void
+eupnp_future_cancel(Eupnp_Future *f)
+{
+   if (f->state != EUPNP_FUTURE_PENDING) return;
+
+   f->state = EUPNP_FUTURE_CANCELLED;
+   f->error = ECANCELED;
+
+   eupnp_future_ref(f);
+   if (f->cancel_cb) f->cancel_cb(f->cancel_data, f);
+   _eupnp_future_settled(f);
+   eupnp_future_unref(f);
+}
+
+Eupnp_Future_State
+eupnp_future_state_get(const Eupnp_Future *f)
+{
+   return f->state;
+}
+
+/*
+ * Retrieves the value of a resolved future, valid while the future is
+ * referenced. NULL if it did not resolve.
+ */
+void *
+eupnp_future_value_get(const Eupnp_Future *f)
+{
+   return (f->state == EUPNP_FUTURE_RESOLVED) ? f->value : NULL;
+}
+
+/*
+ * Retrieves the errno code of a rejected (or ECANCELED for a cancelled)
+ * future, 0 otherwise.
+ */
+int
+eupnp_future_error_get(const Eupnp_Future *f)
+{
+   return f->error;
+}
+
+/*
+ * Adds a function to call once the future settles
+ *
+ * Continuations run in the order they were added, right away if the future
+ * already settled.
+ *
+ * @param f future
+ * @param cb function to call
+ * @param data data passed to cb
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_future_then(Eupnp_Future *f, Eupnp_Future_Cb cb, void *data)
+{
+   Eupnp_Future_Continuation *c;
+
+   if (f->state != EUPNP_FUTURE_PENDING)
+     {
+	cb(data, f);
+	return EINA_TRUE;
+     }
+
+   c = malloc(sizeof(Eupnp_Future_Continuation));
+
+   if (!c)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not add future continuation.\n");
+	return EINA_FALSE;
+     }
+
+   c->next = NULL;
+   c->cb = cb;
+   c->data = data;
+   *f->last = c;
+   f->last = &c->next;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Starts another step once a future resolves
+ *
+ * When f resolves, cb is called with its value and returns the future of the
+ * next step. The returned future settles like that one. If f is rejected or
+ * cancelled, cb is not called and the returned future is rejected or
+ * cancelled as well. Cancelling the returned future cancels whichever step is
+ * running.
+ *
+ * Chains of chains describe whole sequences, e.g. fetching a description,
+ * then invoking an action found in it.
+ *
+ * @param f future of the first step
+ * @param cb function starting the next step
+ * @param data data passed to cb
+ *
+ * @return future of the sequence or NULL on error.
+ */
+Eupnp_Future *
+eupnp_future_chain(Eupnp_Future *f, Eupnp_Future_Chain_Cb cb, void *data)
+{
+   Eupnp_Future_Link *link;
+   Eupnp_Future *out;
+
+   link = calloc(1, sizeof(Eupnp_Future_Link));
+
+   if (!link)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not chain future.\n");
+	return NULL;
+     }
+
+   link->out = eupnp_future_new(_eupnp_future_link_cancel, link);
+
+   if (!link->out)
+     {
+	free(link);
+	return NULL;
+     }
+
+   link->step = eupnp_future_ref(f);
+   link->cb = cb;
+   link->data = data;
+   out = eupnp_future_ref(link->out);
+
+   if (!eupnp_future_then(f, _eupnp_future_link_first_cb, link))
+     {
+	eupnp_future_unref(out);
+	_eupnp_future_link_finish(link);
+	return NULL;
+     }
+
+   return out;
+}
@@ -0,0 +1,80 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_FUTURE_H
+#define _EUPNP_FUTURE_H
+
+#include <Eina.h>
+
+/*
+ * Result of an operation still running on the library main loop (an HTTP
+ * request, an action invocation...).
+ *
+ * A future settles once: resolved with a value, rejected with an errno code
+ * or cancelled. Continuations added with eupnp_future_then() run when it
+ * settles, from the main loop, or right away if it already has.
+ * eupnp_future_chain() starts the next step of a sequence once a future
+ * resolves, giving a future for the whole sequence, which can be cancelled as
+ * a whole.
+ *
+ * Futures are reference counted. Functions returning one give the caller a
+ * reference, the producer keeps its own until the future settles.
+ */
+typedef struct _Eupnp_Future Eupnp_Future;
+
+typedef enum {
+   EUPNP_FUTURE_PENDING,
+   EUPNP_FUTURE_RESOLVED,
+   EUPNP_FUTURE_REJECTED,
+   EUPNP_FUTURE_CANCELLED
+} Eupnp_Future_State;
+
+typedef void (*Eupnp_Future_Free_Cb) (void *value);
+
+/* Called once the future settles, whatever the outcome */
+typedef void (*Eupnp_Future_Cb) (void *data, Eupnp_Future *f);
+
+/* Next step of a chain, called with the resolved value. Returns the future of
+ * the next step (the reference is taken over) or NULL to reject the chain. */
+typedef Eupnp_Future *(*Eupnp_Future_Chain_Cb) (void *data, void *value);
+
+/* Called when a pending future is cancelled, the producer stops working on
+ * it and must not settle it anymore */
+typedef void (*Eupnp_Future_Cancel_Cb) (void *data, Eupnp_Future *f);
+
+
+Eupnp_Future      *eupnp_future_new(Eupnp_Future_Cancel_Cb cancel_cb, void *data);
+Eupnp_Future      *eupnp_future_ref(Eupnp_Future *f) EINA_ARG_NONNULL(1);
+void               eupnp_future_unref(Eupnp_Future *f) EINA_ARG_NONNULL(1);
+
+void               eupnp_future_resolve(Eupnp_Future *f, void *value, Eupnp_Future_Free_Cb free_cb) EINA_ARG_NONNULL(1);
+void               eupnp_future_reject(Eupnp_Future *f, int error) EINA_ARG_NONNULL(1);
+void               eupnp_future_cancel(Eupnp_Future *f) EINA_ARG_NONNULL(1);
+
+Eupnp_Future_State eupnp_future_state_get(const Eupnp_Future *f) EINA_ARG_NONNULL(1);
+void              *eupnp_future_value_get(const Eupnp_Future *f) EINA_ARG_NONNULL(1);
+int                eupnp_future_error_get(const Eupnp_Future *f) EINA_ARG_NONNULL(1);
+
+Eina_Bool          eupnp_future_then(Eupnp_Future *f, Eupnp_Future_Cb cb, void *data) EINA_ARG_NONNULL(1,2);
+Eupnp_Future      *eupnp_future_chain(Eupnp_Future *f, Eupnp_Future_Chain_Cb cb, void *data) EINA_ARG_NONNULL(1,2);
+
+
+#endif /* _EUPNP_FUTURE_H */
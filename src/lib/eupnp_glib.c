@@ -0,0 +1,208 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <math.h>
+#include <glib.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_glib.h"
+
+typedef struct _Eupnp_GLib_Source Eupnp_GLib_Source;
+
+struct _Eupnp_GLib_Source {
+   GSource source;
+   GPollFD pfd;
+
+   void *obj;
+   double (*timeout_get) (const void *obj);
+   void (*dispatch) (void *obj);
+};
+
+
+/*
+ * Private API
+ */
+
+static void
+_eupnp_glib_control_point_dispatch(void *obj)
+{
+   eupnp_control_point_dispatch(obj);
+}
+
+static double
+_eupnp_glib_control_point_timeout_get(const void *obj)
+{
+   return eupnp_control_point_timeout_get(obj);
+}
+
+static void
+_eupnp_glib_http_server_dispatch(void *obj)
+{
+   eupnp_http_server_process(obj);
+}
+
+static double
+_eupnp_glib_http_server_timeout_get(const void *obj)
+{
+   return eupnp_http_server_timeout_get(obj);
+}
+
+static void
+_eupnp_glib_http_client_dispatch(void *obj)
+{
+   eupnp_http_client_process(obj);
+}
+
+static double
+_eupnp_glib_http_client_timeout_get(const void *obj)
+{
+   return eupnp_http_client_timeout_get(obj);
+}
+
+/*
+ * Called before the main context sleeps. Timeouts are rounded up to the
+ * millisecond, waking up early would only find nothing to do.
+ */
+static gboolean
+_eupnp_glib_source_prepare(GSource *source, gint *timeout)
+{
+   Eupnp_GLib_Source *s = (Eupnp_GLib_Source *)source;
+   double t;
+
+   t = s->timeout_get(s->obj);
+
+   if (t < 0)
+      *timeout = -1;
+   else if (t > G_MAXINT / 1000)
+      *timeout = G_MAXINT;
+   else
+      *timeout = ceil(t * 1000);
+
+   return (*timeout == 0);
+}
+
+static gboolean
+_eupnp_glib_source_check(GSource *source)
+{
+   Eupnp_GLib_Source *s = (Eupnp_GLib_Source *)source;
+
+   if (s->pfd.revents & (G_IO_IN | G_IO_ERR | G_IO_HUP))
+      return TRUE;
+
+   return (s->timeout_get(s->obj) == 0);
+}
+
+static gboolean
+_eupnp_glib_source_dispatch(GSource *source, GSourceFunc callback, gpointer data)
+{
+   Eupnp_GLib_Source *s = (Eupnp_GLib_Source *)source;
+
+   s->dispatch(s->obj);
+
+   if (callback) return callback(data);
+
+   return TRUE;
+}
+
+static GSourceFuncs _eupnp_glib_source_funcs = {
+   _eupnp_glib_source_prepare,
+   _eupnp_glib_source_check,
+   _eupnp_glib_source_dispatch,
+   NULL
+};
+
+static GSource *
+_eupnp_glib_source_new(int fd, void *obj, double (*timeout_get) (const void *obj), void (*dispatch) (void *obj))
+{
+   Eupnp_GLib_Source *s;
+
+   if (fd < 0)
+     {
+	ERROR("Nothing to watch.\n");
+	return NULL;
+     }
+
+   s = (Eupnp_GLib_Source *)g_source_new(&_eupnp_glib_source_funcs,
+					 sizeof(Eupnp_GLib_Source));
+
+   s->obj = obj;
+   s->timeout_get = timeout_get;
+   s->dispatch = dispatch;
+   s->pfd.fd = fd;
+   s->pfd.events = G_IO_IN | G_IO_ERR | G_IO_HUP;
+   g_source_add_poll(&s->source, &s->pfd);
+
+   return &s->source;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Creates a GSource running a control point
+ *
+ * @param c Eupnp_Control_Point instance, must outlive the source.
+ *
+ * @return new source, not attached to any context, or NULL on error.
+ */
+GSource *
+eupnp_glib_control_point_source_new(Eupnp_Control_Point *c)
+{
+   return _eupnp_glib_source_new(eupnp_control_point_fd_get(c), c,
+				 _eupnp_glib_control_point_timeout_get,
+				 _eupnp_glib_control_point_dispatch);
+}
+
+/*
+ * Creates a GSource running a HTTP server
+ *
+ * @param srv Eupnp_HTTP_Server instance, must outlive the source.
+ *
+ * @return new source, not attached to any context, or NULL on error.
+ */
+GSource *
+eupnp_glib_http_server_source_new(Eupnp_HTTP_Server *srv)
+{
+   return _eupnp_glib_source_new(eupnp_http_server_fd_get(srv), srv,
+				 _eupnp_glib_http_server_timeout_get,
+				 _eupnp_glib_http_server_dispatch);
+}
+
+/*
+ * Creates a GSource running a HTTP client, settling request futures from it
+ *
+ * @param c Eupnp_HTTP_Client instance, must outlive the source.
+ *
+ * @return new source, not attached to any context, or NULL on error.
+ */
+GSource *
+eupnp_glib_http_client_source_new(Eupnp_HTTP_Client *c)
+{
+   return _eupnp_glib_source_new(eupnp_http_client_fd_get(c), c,
+				 _eupnp_glib_http_client_timeout_get,
+				 _eupnp_glib_http_client_dispatch);
+}
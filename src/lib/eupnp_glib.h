@@ -0,0 +1,46 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_GLIB_H
+#define _EUPNP_GLIB_H
+
+#include <glib.h>
+#include <Eina.h>
+#include <eupnp_control_point.h>
+#include <eupnp_http_server.h>
+#include <eupnp_http_client.h>
+
+/*
+ * Runs control points, HTTP servers and clients from a GLib main context.
+ *
+ * The returned GSource polls the library file descriptor and uses its next
+ * timer deadline as timeout. Ready datagrams, connections and timers are all
+ * handled on a single dispatch. Attach it with g_source_attach() and release
+ * it with g_source_destroy() and g_source_unref(), before freeing the control
+ * point, server or client. A callback set with g_source_set_callback() is
+ * called after each dispatch.
+ */
+GSource *eupnp_glib_control_point_source_new(Eupnp_Control_Point *c) EINA_ARG_NONNULL(1);
+GSource *eupnp_glib_http_server_source_new(Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+GSource *eupnp_glib_http_client_source_new(Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_GLIB_H */
@@ -0,0 +1,57 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_HASH_H
+#define _EUPNP_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * FNV-1a hashing shared by the SSDP server alive sampling, the search filter,
+ * the intern table, the HTTP server ETags and the HTTP client request
+ * coalescing. Private to the library, not installed.
+ */
+
+#define EUPNP_HASH_INIT 2166136261u
+
+/*
+ * Adds len bytes of data to a running hash started from EUPNP_HASH_INIT.
+ */
+static inline uint32_t
+eupnp_hash_update(uint32_t h, const void *data, size_t len)
+{
+   const unsigned char *p = data;
+
+   while (len--)
+      h = (h ^ *p++) * 16777619u;
+
+   return h;
+}
+
+static inline uint32_t
+eupnp_hash(const void *data, size_t len)
+{
+   return eupnp_hash_update(EUPNP_HASH_INIT, data, len);
+}
+
+
+#endif /* _EUPNP_HASH_H */
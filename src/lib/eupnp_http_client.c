@@ -0,0 +1,1775 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <Eina.h>
+
+#include "eupnp.h"
+#include "eupnp_error.h"
+#include "eupnp_hash.h"
+#include "eupnp_http_client.h"
+#include "eupnp_probes.h"
+
+/*
+ * Non-blocking HTTP/1.1 client on epoll, for description fetches and action
+ * invocations. Each request returns a future settled from
+ * eupnp_http_client_process(), so hundreds of them can be started at once and
+ * composed with eupnp_future_chain().
+ *
+ * Connections are kept alive and pooled per host (address and port), at most
+ * max_per_host of them. A request goes to an idle connection, else to a new
+ * one, else is pipelined behind the requests outstanding on the least busy
+ * connection, up to the pipeline depth. At most max_in_flight requests are
+ * outstanding overall; others wait in a FIFO queue. The timeout counts from
+ * the moment a request is sent.
+ *
+ * Idempotent requests (GET, HEAD, and Get* actions, which only query state
+ * by UPnP convention) identical to one queued or outstanding share its round
+ * trip and its response. They are retried once on a new connection when a
+ * kept alive connection closes before answering them. Other requests are
+ * never pipelined nor retried, and only use connections which were idle for
+ * a short while, since devices close idle connections under our feet.
+ *
+ * Futures are settled once I/O handling is done, at the end of the public
+ * calls, so continuations never run while connections are being worked on.
+ *
+ * Only URLs with an IPv4 address are supported, as found in SSDP locations.
+ */
+
+#define EUPNP_HTTP_CLIENT_EVENTS 64
+#define EUPNP_HTTP_CLIENT_READ_SIZE 4096
+#define EUPNP_HTTP_CLIENT_CHUNK_LINE 1024
+
+/*
+ * Longest status line and headers, and most input buffered on a connection:
+ * a response in progress, body and head, is never larger.
+ */
+#define EUPNP_HTTP_CLIENT_MAX_HEAD (64 * 1024)
+#define EUPNP_HTTP_CLIENT_MAX_INPUT (EUPNP_HTTP_CLIENT_MAX_RESPONSE + EUPNP_HTTP_CLIENT_MAX_HEAD)
+
+/* Seconds an idle connection is trusted with non-idempotent requests */
+#define EUPNP_HTTP_CLIENT_REUSE_WINDOW 2.0
+
+typedef struct _Eupnp_HTTP_Client_Host Eupnp_HTTP_Client_Host;
+typedef struct _Eupnp_HTTP_Client_Connection Eupnp_HTTP_Client_Connection;
+typedef struct _Eupnp_HTTP_Client_Request Eupnp_HTTP_Client_Request;
+typedef struct _Eupnp_HTTP_Client_Waiter Eupnp_HTTP_Client_Waiter;
+
+typedef enum {
+   EUPNP_HTTP_CLIENT_BODY_NONE,
+   EUPNP_HTTP_CLIENT_BODY_LENGTH,
+   EUPNP_HTTP_CLIENT_BODY_CHUNKED,
+   EUPNP_HTTP_CLIENT_BODY_CLOSE
+} Eupnp_HTTP_Client_Body;
+
+typedef enum {
+   EUPNP_HTTP_CLIENT_CHUNK_SIZE,
+   EUPNP_HTTP_CLIENT_CHUNK_DATA,
+   EUPNP_HTTP_CLIENT_CHUNK_DATA_END,
+   EUPNP_HTTP_CLIENT_CHUNK_TRAILER
+} Eupnp_HTTP_Client_Chunk;
+
+/* Caller waiting for a request, one per future handed out */
+struct _Eupnp_HTTP_Client_Waiter {
+   Eupnp_HTTP_Client_Waiter *next;
+   Eupnp_HTTP_Client_Request *req;
+   Eupnp_Future *future;
+};
+
+struct _Eupnp_HTTP_Client_Request {
+   Eupnp_HTTP_Client *client;
+   Eupnp_HTTP_Client_Host *host;
+   Eupnp_HTTP_Client_Request *next;    /* in the queue, a pipeline or completed */
+   Eupnp_HTTP_Client_Request *prev;
+   Eupnp_HTTP_Client_Request *shared_next;
+   Eupnp_HTTP_Client_Request *shared_prev;
+   Eupnp_HTTP_Client_Connection *conn; /* NULL while queued */
+   Eupnp_HTTP_Client_Waiter *waiters; /* none once abandoned */
+
+   /* Serialized request, also the key requests are coalesced by */
+   char *out;
+   size_t out_len;
+   unsigned int hash;
+
+   double deadline;
+   Eina_Bool idempotent;
+   Eina_Bool head_only;
+   Eina_Bool shared;
+   Eina_Bool retried;
+   Eina_Bool done;
+
+   /* Outcome, until settled */
+   Eupnp_HTTP_Client_Response *result;
+   int error;
+};
+
+struct _Eupnp_HTTP_Client_Connection {
+   Eupnp_HTTP_Client *client;
+   Eupnp_HTTP_Client_Host *host;
+   Eupnp_HTTP_Client_Connection *next;
+   Eupnp_HTTP_Client_Connection *prev;
+   int fd;
+   uint32_t events;
+   Eina_Bool connected;
+   Eina_Bool reused;       /* answered a request already */
+   Eina_Bool last_use;     /* closed by the server after the current response */
+   Eina_Bool exclusive;    /* a non-idempotent request is outstanding */
+   double idle_since;
+
+   /* Requests sent, or being sent, in order */
+   Eupnp_HTTP_Client_Request *pipeline;
+   Eupnp_HTTP_Client_Request *pipeline_last;
+   unsigned int pipeline_count;
+
+   char *out;
+   size_t out_len;
+   size_t out_off;
+   size_t out_size;
+
+   /* Response to the first request of the pipeline, the body once the head
+    * is parsed, followed by the next responses */
+   char *in;
+   size_t in_len;
+   size_t in_size;
+   Eupnp_HTTP_Response *response;
+   Eupnp_HTTP_Client_Body framing;
+   size_t body_len;          /* expected or, when chunked, decoded */
+   Eupnp_HTTP_Client_Chunk chunk_state;
+   size_t chunk_left;
+};
+
+struct _Eupnp_HTTP_Client_Host {
+   Eupnp_HTTP_Client_Host *next;
+   struct sockaddr_in addr;
+   Eupnp_HTTP_Client_Connection *connections;
+   unsigned int connection_count;
+   unsigned int requests;    /* queued or outstanding */
+};
+
+struct _Eupnp_HTTP_Client {
+   int epfd;
+   unsigned int max_in_flight;
+   unsigned int max_per_host;
+   unsigned int pipeline_depth;
+   double timeout;
+
+   Eupnp_HTTP_Client_Host *hosts;
+   Eupnp_HTTP_Client_Request *queue;
+   Eupnp_HTTP_Client_Request *queue_last;
+   unsigned int queue_count;
+   unsigned int in_flight;
+
+   /* Idempotent requests queued or outstanding, to coalesce with */
+   Eupnp_HTTP_Client_Request *shared;
+
+   /* Completed, waiting to be settled */
+   Eupnp_HTTP_Client_Request *completed;
+   Eupnp_HTTP_Client_Request *completed_last;
+
+   Eina_Bool pumping;
+   Eina_Bool settling;
+   Eupnp_HTTP_Client_Stats stats;
+};
+
+static const char _eupnp_http_client_soap_head[] =
+   "<?xml version=\"1.0\" encoding=\"utf-8\"?>\r\n"
+   "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+   "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+   "<s:Body>";
+static const char _eupnp_http_client_soap_tail[] = "</s:Body></s:Envelope>\r\n";
+
+
+/*
+ * Private API
+ */
+
+static void eupnp_http_client_connection_close(Eupnp_HTTP_Client_Connection *conn, int error, Eina_Bool retry);
+
+static void
+eupnp_http_client_request_free(Eupnp_HTTP_Client_Request *req)
+{
+   req->host->requests--;
+   free(req->out);
+   free(req);
+}
+
+static void
+eupnp_http_client_request_unshare(Eupnp_HTTP_Client_Request *req)
+{
+   Eupnp_HTTP_Client *c = req->client;
+
+   if (!req->shared) return;
+
+   if (req->shared_prev) req->shared_prev->shared_next = req->shared_next;
+   else c->shared = req->shared_next;
+   if (req->shared_next) req->shared_next->shared_prev = req->shared_prev;
+
+   req->shared = EINA_FALSE;
+}
+
+static void
+eupnp_http_client_queue_remove(Eupnp_HTTP_Client_Request *req)
+{
+   Eupnp_HTTP_Client *c = req->client;
+
+   if (req->prev) req->prev->next = req->next;
+   else c->queue = req->next;
+   if (req->next) req->next->prev = req->prev;
+   else c->queue_last = req->prev;
+   c->queue_count--;
+}
+
+static void
+eupnp_http_client_queue_append(Eupnp_HTTP_Client *c, Eupnp_HTTP_Client_Request *req)
+{
+   req->conn = NULL;
+   req->next = NULL;
+   req->prev = c->queue_last;
+   if (c->queue_last) c->queue_last->next = req;
+   else c->queue = req;
+   c->queue_last = req;
+   c->queue_count++;
+}
+
+static void
+eupnp_http_client_queue_prepend(Eupnp_HTTP_Client *c, Eupnp_HTTP_Client_Request *req)
+{
+   req->conn = NULL;
+   req->prev = NULL;
+   req->next = c->queue;
+   if (c->queue) c->queue->prev = req;
+   else c->queue_last = req;
+   c->queue = req;
+   c->queue_count++;
+}
+
+/*
+ * Takes the first request out of the pipeline of its connection
+ */
+static void
+eupnp_http_client_pipeline_shift(Eupnp_HTTP_Client_Connection *conn)
+{
+   Eupnp_HTTP_Client_Request *req = conn->pipeline;
+   Eupnp_HTTP_Client *c = req->client;
+
+   conn->pipeline = req->next;
+   if (conn->pipeline) conn->pipeline->prev = NULL;
+   else conn->pipeline_last = NULL;
+   conn->pipeline_count--;
+   c->in_flight--;
+
+   if (!req->idempotent) conn->exclusive = EINA_FALSE;
+   if (!conn->pipeline_count) conn->idle_since = eupnp_time_now();
+
+   req->conn = NULL;
+   req->next = NULL;
+}
+
+/*
+ * Records the outcome of a request taken out of the queue or a pipeline, to
+ * be settled by eupnp_http_client_settle().
+ */
+static void
+eupnp_http_client_request_complete(Eupnp_HTTP_Client_Request *req, Eupnp_HTTP_Client_Response *result, int error)
+{
+   Eupnp_HTTP_Client *c = req->client;
+
+   Eupnp_HTTP_Client_Waiter *w;
+
+   eupnp_http_client_request_unshare(req);
+
+   // Each waiter owns a reference to the shared response
+   if (result)
+      for (w = req->waiters; w; w = w->next) result->refcount++;
+
+   req->done = EINA_TRUE;
+   req->result = result;
+   req->error = error;
+   req->next = NULL;
+
+   EUPNP_PROBE3(http_response, req, result ? result->response->status_code : -error,
+		result ? result->body_len : 0);
+
+   if (c->completed_last) c->completed_last->next = req;
+   else c->completed = req;
+   c->completed_last = req;
+}
+
+/*
+ * Settles the futures of completed requests. Continuations may start or
+ * cancel requests, which completes others, so this loops until none is left.
+ */
+static void
+eupnp_http_client_settle(Eupnp_HTTP_Client *c)
+{
+   Eupnp_HTTP_Client_Request *req;
+   Eupnp_HTTP_Client_Waiter *w;
+
+   if (c->settling) return;
+   c->settling = EINA_TRUE;
+
+   while ((req = c->completed))
+     {
+	c->completed = req->next;
+	if (!c->completed) c->completed_last = NULL;
+
+	// Nobody waits for abandoned requests
+	if (req->result && !req->result->refcount)
+	   eupnp_http_client_response_free(req->result);
+
+	while ((w = req->waiters))
+	  {
+	     req->waiters = w->next;
+
+	     if (req->result)
+		eupnp_future_resolve(w->future, req->result,
+				     (Eupnp_Future_Free_Cb)eupnp_http_client_response_free);
+	     else
+		eupnp_future_reject(w->future, req->error);
+
+	     eupnp_future_unref(w->future);
+	     free(w);
+	  }
+
+	eupnp_http_client_request_free(req);
+     }
+
+   c->settling = EINA_FALSE;
+}
+
+/*
+ * Completes every waiter of a request with an error, right away
+ */
+static void
+eupnp_http_client_request_fail(Eupnp_HTTP_Client_Request *req, int error)
+{
+   eupnp_http_client_request_complete(req, NULL, error);
+}
+
+static Eupnp_HTTP_Client_Host *
+eupnp_http_client_host_get(Eupnp_HTTP_Client *c, const struct sockaddr_in *addr)
+{
+   Eupnp_HTTP_Client_Host *h;
+
+   for (h = c->hosts; h; h = h->next)
+      if (h->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+	  h->addr.sin_port == addr->sin_port)
+	 return h;
+
+   h = calloc(1, sizeof(Eupnp_HTTP_Client_Host));
+
+   if (!h)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP client host.\n");
+	return NULL;
+     }
+
+   h->addr = *addr;
+   h->next = c->hosts;
+   c->hosts = h;
+
+   return h;
+}
+
+/*
+ * Frees hosts without connections nor requests
+ */
+static void
+eupnp_http_client_hosts_sweep(Eupnp_HTTP_Client *c)
+{
+   Eupnp_HTTP_Client_Host **p = &c->hosts;
+   Eupnp_HTTP_Client_Host *h;
+
+   while ((h = *p))
+     {
+	if (h->connection_count || h->requests)
+	  {
+	     p = &h->next;
+	     continue;
+	  }
+
+	*p = h->next;
+	free(h);
+     }
+}
+
+/*
+ * Watches a connection for input, and for output while connecting or with
+ * output pending.
+ */
+static Eina_Bool
+eupnp_http_client_connection_watch(Eupnp_HTTP_Client_Connection *conn)
+{
+   struct epoll_event ev;
+   uint32_t events = EPOLLIN;
+
+   if (!conn->connected || conn->out_off < conn->out_len) events |= EPOLLOUT;
+   if (events == conn->events) return EINA_TRUE;
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = events;
+   ev.data.ptr = conn;
+
+   if (epoll_ctl(conn->client->epfd, conn->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+		 conn->fd, &ev) < 0)
+     {
+	ERROR("Could not watch HTTP client socket: %s\n", strerror(errno));
+	return EINA_FALSE;
+     }
+
+   conn->events = events;
+   return EINA_TRUE;
+}
+
+static Eupnp_HTTP_Client_Connection *
+eupnp_http_client_connection_new(Eupnp_HTTP_Client *c, Eupnp_HTTP_Client_Host *host, int *error)
+{
+   Eupnp_HTTP_Client_Connection *conn;
+   char ip[INET_ADDRSTRLEN];
+
+   conn = calloc(1, sizeof(Eupnp_HTTP_Client_Connection));
+
+   if (!conn)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP client connection.\n");
+	*error = ENOMEM;
+	return NULL;
+     }
+
+   conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+   if (conn->fd < 0)
+     {
+	*error = errno;
+	ERROR("Could not create HTTP client socket: %s\n", strerror(*error));
+	free(conn);
+	return NULL;
+     }
+
+   if (connect(conn->fd, (struct sockaddr *)&host->addr, sizeof(host->addr)) < 0 &&
+       errno != EINPROGRESS)
+     {
+	*error = errno;
+	DEBUG("Could not connect to %s:%d: %s\n", inet_ntop(AF_INET, &host->addr.sin_addr, ip, sizeof(ip)),
+	      ntohs(host->addr.sin_port), strerror(*error));
+	close(conn->fd);
+	free(conn);
+	return NULL;
+     }
+
+   conn->client = c;
+   conn->host = host;
+
+   if (!eupnp_http_client_connection_watch(conn))
+     {
+	*error = errno;
+	close(conn->fd);
+	free(conn);
+	return NULL;
+     }
+
+   conn->next = host->connections;
+   if (host->connections) host->connections->prev = conn;
+   host->connections = conn;
+   host->connection_count++;
+
+   return conn;
+}
+
+/*
+ * Appends a request to the pipeline of a connection. It is written on the
+ * next loop iteration, along with others appended meanwhile.
+ *
+ * @return 0 on success, ENOMEM if the request could not be appended, another
+ *         errno code if the connection is broken.
+ */
+static int
+eupnp_http_client_connection_send(Eupnp_HTTP_Client_Connection *conn, Eupnp_HTTP_Client_Request *req)
+{
+   Eupnp_HTTP_Client *c = conn->client;
+
+   if (conn->out_len + req->out_len > conn->out_size)
+     {
+	size_t size = conn->out_len + req->out_len;
+	char *out = realloc(conn->out, size);
+
+	if (!out)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not send HTTP request.\n");
+	     return ENOMEM;
+	  }
+
+	conn->out = out;
+	conn->out_size = size;
+     }
+
+   memcpy(conn->out + conn->out_len, req->out, req->out_len);
+   conn->out_len += req->out_len;
+
+   if (conn->pipeline_count) c->stats.pipelined++;
+   if (conn->reused) c->stats.reused++;
+   c->stats.requests++;
+
+   req->conn = conn;
+   req->next = NULL;
+   req->prev = conn->pipeline_last;
+   req->deadline = eupnp_time_now() + c->timeout;
+   if (conn->pipeline_last) conn->pipeline_last->next = req;
+   else conn->pipeline = req;
+   conn->pipeline_last = req;
+   conn->pipeline_count++;
+   c->in_flight++;
+
+   if (!req->idempotent) conn->exclusive = EINA_TRUE;
+
+   EUPNP_PROBE3(http_request, req, req->out, req->out_len);
+
+   return eupnp_http_client_connection_watch(conn) ? 0 : EIO;
+}
+
+/*
+ * Closes a connection. Its first request is completed with error, unless
+ * retry is set and it may be retried. Other requests, which were not
+ * answered, go back to the head of the queue, or are completed with error as
+ * well if the connection could not even be established.
+ */
+static void
+eupnp_http_client_connection_close(Eupnp_HTTP_Client_Connection *conn, int error, Eina_Bool retry)
+{
+   Eupnp_HTTP_Client *c = conn->client;
+   Eupnp_HTTP_Client_Host *host = conn->host;
+   Eupnp_HTTP_Client_Request *req, *first = conn->pipeline;
+   Eina_Bool answered = conn->in_len || conn->response;
+   char ip[INET_ADDRSTRLEN];
+
+   // Requeued in order, from the last
+   while ((req = conn->pipeline_last))
+     {
+	conn->pipeline_last = req->prev;
+	conn->pipeline_count--;
+	c->in_flight--;
+
+	// Nothing to retry on when the host cannot be reached, nor for nobody
+	if (!req->waiters)
+	  {
+	     req->conn = NULL;
+	     eupnp_http_client_request_fail(req, error);
+	  }
+	else if (req != first && conn->connected)
+	   eupnp_http_client_queue_prepend(c, req);
+	else if (req != first || !retry || answered || !req->idempotent || req->retried)
+	  {
+	     req->conn = NULL;
+	     eupnp_http_client_request_fail(req, error);
+	  }
+	else
+	  {
+	     DEBUG("Retrying HTTP request to %s\n",
+		   inet_ntop(AF_INET, &host->addr.sin_addr, ip, sizeof(ip)));
+	     req->retried = EINA_TRUE;
+	     c->stats.retried++;
+	     eupnp_http_client_queue_prepend(c, req);
+	  }
+     }
+
+   conn->pipeline = NULL;
+
+   if (conn->events) epoll_ctl(c->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+   close(conn->fd);
+
+   if (conn->prev) conn->prev->next = conn->next;
+   else host->connections = conn->next;
+   if (conn->next) conn->next->prev = conn->prev;
+   host->connection_count--;
+
+   if (conn->response) eupnp_http_response_free(conn->response);
+   free(conn->out);
+   free(conn->in);
+   free(conn);
+}
+
+/*
+ * Picks the connection to send a request on: an idle one, else a new one,
+ * else the least busy one it may be pipelined on.
+ *
+ * @return connection, NULL if the request must wait. *error is set if a
+ *         connection could not be created.
+ */
+static Eupnp_HTTP_Client_Connection *
+eupnp_http_client_connection_get(Eupnp_HTTP_Client *c, Eupnp_HTTP_Client_Request *req, double now, int *error)
+{
+   Eupnp_HTTP_Client_Host *host = req->host;
+   Eupnp_HTTP_Client_Connection *conn, *best = NULL;
+
+   *error = 0;
+
+   for (conn = host->connections; conn; conn = conn->next)
+     {
+	if (conn->last_use) continue;
+
+	if (!conn->pipeline_count)
+	  {
+	     if (req->idempotent || !conn->reused ||
+		 now - conn->idle_since < EUPNP_HTTP_CLIENT_REUSE_WINDOW)
+		return conn;
+	     continue;
+	  }
+
+	if (!req->idempotent || conn->exclusive ||
+	    conn->pipeline_count >= c->pipeline_depth)
+	   continue;
+
+	if (!best || conn->pipeline_count < best->pipeline_count) best = conn;
+     }
+
+   if (host->connection_count < c->max_per_host)
+     {
+	conn = eupnp_http_client_connection_new(c, host, error);
+	if (conn) c->stats.connections++;
+	return conn;
+     }
+
+   return best;
+}
+
+/*
+ * Sends queued requests in order, skipping those whose host is busy.
+ */
+static void
+eupnp_http_client_pump(Eupnp_HTTP_Client *c)
+{
+   Eupnp_HTTP_Client_Connection *conn;
+   Eupnp_HTTP_Client_Request *req, *next;
+   double now = eupnp_time_now();
+   int error;
+
+   if (c->pumping) return;
+   c->pumping = EINA_TRUE;
+
+   for (req = c->queue; req && c->in_flight < c->max_in_flight; req = next)
+     {
+	next = req->next;
+
+	conn = eupnp_http_client_connection_get(c, req, now, &error);
+
+	if (!conn && !error) continue;
+
+	eupnp_http_client_queue_remove(req);
+
+	if (!conn)
+	  {
+	     eupnp_http_client_request_fail(req, error);
+	     continue;
+	  }
+
+	if ((error = eupnp_http_client_connection_send(conn, req)))
+	  {
+	     if (error == ENOMEM)
+		eupnp_http_client_request_fail(req, error);
+	     else
+		eupnp_http_client_connection_close(conn, error, EINA_FALSE);
+	  }
+     }
+
+   c->pumping = EINA_FALSE;
+}
+
+/*
+ * Splits an http://a.b.c.d[:port]/path URL. host points to the authority
+ * part, path to the path, both inside url.
+ */
+static Eina_Bool
+eupnp_http_client_url_parse(const char *url, struct sockaddr_in *addr, const char **host, int *host_len, const char **path)
+{
+   char ip[INET_ADDRSTRLEN];
+   const char *p, *end, *colon;
+   long port = 80;
+
+   if (strncasecmp(url, "http://", 7)) return EINA_FALSE;
+
+   p = url + 7;
+   end = strchr(p, '/');
+   if (!end) end = p + strlen(p);
+
+   colon = memchr(p, ':', end - p);
+
+   if (colon)
+     {
+	char *e;
+
+	port = strtol(colon + 1, &e, 10);
+	if (e != end || port <= 0 || port > 65535) return EINA_FALSE;
+     }
+   else
+      colon = end;
+
+   if (colon - p >= (int)sizeof(ip)) return EINA_FALSE;
+
+   memcpy(ip, p, colon - p);
+   ip[colon - p] = '\0';
+
+   memset(addr, 0, sizeof(*addr));
+   addr->sin_family = AF_INET;
+   addr->sin_port = htons(port);
+
+   if (inet_pton(AF_INET, ip, &addr->sin_addr) != 1) return EINA_FALSE;
+
+   *host = p;
+   *host_len = end - p;
+   *path = *end ? end : "/";
+
+   return EINA_TRUE;
+}
+
+/*
+ * Writes pending requests
+ *
+ * @return 0 on success, an errno code otherwise.
+ */
+static int
+eupnp_http_client_connection_flush(Eupnp_HTTP_Client_Connection *conn)
+{
+   ssize_t n;
+
+   while (conn->out_off < conn->out_len)
+     {
+	n = send(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off,
+		 MSG_NOSIGNAL);
+
+	if (n < 0)
+	  {
+	     if (errno == EINTR) continue;
+	     if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+	     return errno;
+	  }
+
+	conn->out_off += n;
+     }
+
+   if (conn->out_off == conn->out_len)
+      conn->out_off = conn->out_len = 0;
+
+   return eupnp_http_client_connection_watch(conn) ? 0 : EIO;
+}
+
+/*
+ * Parses the status line and headers once received and finds out how the
+ * body is delimited. The head is then dropped from the input buffer.
+ *
+ * @return 0 on success or while incomplete, an errno code otherwise.
+ */
+static int
+eupnp_http_client_head_parse(Eupnp_HTTP_Client_Connection *conn)
+{
+   const char *end, *value;
+   size_t head_len;
+   int status;
+
+   end = conn->in_len ? memmem(conn->in, conn->in_len, "\r\n\r\n", 4) : NULL;
+
+   if (!end)
+      return (conn->in_len < EUPNP_HTTP_CLIENT_MAX_HEAD) ? 0 : EMSGSIZE;
+
+   head_len = end - conn->in + 4;
+   conn->response = eupnp_http_response_parse_length(conn->in, head_len);
+
+   if (!conn->response) return EPROTO;
+
+   conn->in_len -= head_len;
+   memmove(conn->in, conn->in + head_len, conn->in_len);
+
+   status = conn->response->status_code;
+
+   if (status >= 100 && status < 200)
+     {
+	// Interim response, the final one follows
+	eupnp_http_response_free(conn->response);
+	conn->response = NULL;
+	return eupnp_http_client_head_parse(conn);
+     }
+
+   value = eupnp_http_response_header_get(conn->response, "connection");
+
+   if (value ? strcasestr(value, "close") != NULL :
+       !strcmp(conn->response->http_version, "HTTP/1.0"))
+      conn->last_use = EINA_TRUE;
+
+   if (conn->pipeline->head_only || status == 204 || status == 304)
+      conn->framing = EUPNP_HTTP_CLIENT_BODY_NONE;
+   else if ((value = eupnp_http_response_header_get(conn->response, "transfer-encoding")) &&
+	    strcasestr(value, "chunked"))
+     {
+	conn->framing = EUPNP_HTTP_CLIENT_BODY_CHUNKED;
+	conn->chunk_state = EUPNP_HTTP_CLIENT_CHUNK_SIZE;
+	conn->body_len = 0;
+     }
+   else if ((value = eupnp_http_response_header_get(conn->response, "content-length")))
+     {
+	char *e;
+	long l = strtol(value, &e, 10);
+
+	if (e == value || l < 0) return EPROTO;
+	if (l > EUPNP_HTTP_CLIENT_MAX_RESPONSE) return EMSGSIZE;
+
+	conn->framing = EUPNP_HTTP_CLIENT_BODY_LENGTH;
+	conn->body_len = l;
+     }
+   else
+     {
+	conn->framing = EUPNP_HTTP_CLIENT_BODY_CLOSE;
+	conn->last_use = EINA_TRUE;
+     }
+
+   return 0;
+}
+
+/*
+ * Decodes a chunked body in place: data is moved down to follow what was
+ * already decoded, leaving the undecoded input after it.
+ *
+ * @return 0 on success, an errno code otherwise. *complete tells whether the
+ *         last chunk and trailers were received.
+ */
+static int
+eupnp_http_client_chunked_decode(Eupnp_HTTP_Client_Connection *conn, Eina_Bool *complete)
+{
+   char *p = conn->in + conn->body_len;
+   char *end = conn->in + conn->in_len;
+   char *eol, *e;
+   size_t n;
+
+   *complete = EINA_FALSE;
+
+   while (p < end && !*complete)
+     {
+	switch (conn->chunk_state)
+	  {
+	   case EUPNP_HTTP_CLIENT_CHUNK_SIZE:
+	      eol = memmem(p, end - p, "\r\n", 2);
+
+	      if (!eol)
+		{
+		   if (end - p > EUPNP_HTTP_CLIENT_CHUNK_LINE) return EPROTO;
+		   goto out;
+		}
+
+	      errno = 0;
+	      conn->chunk_left = strtoul(p, &e, 16);
+
+	      // Chunk extensions are ignored
+	      if (e == p || errno || (*e != '\r' && *e != ';' && *e != ' '))
+		 return EPROTO;
+	      if (conn->chunk_left > EUPNP_HTTP_CLIENT_MAX_RESPONSE) return EMSGSIZE;
+
+	      p = eol + 2;
+	      conn->chunk_state = conn->chunk_left ? EUPNP_HTTP_CLIENT_CHUNK_DATA :
+		 EUPNP_HTTP_CLIENT_CHUNK_TRAILER;
+	      break;
+	   case EUPNP_HTTP_CLIENT_CHUNK_DATA:
+	      n = end - p;
+	      if (n > conn->chunk_left) n = conn->chunk_left;
+
+	      memmove(conn->in + conn->body_len, p, n);
+	      conn->body_len += n;
+	      conn->chunk_left -= n;
+	      p += n;
+
+	      if (conn->body_len > EUPNP_HTTP_CLIENT_MAX_RESPONSE) return EMSGSIZE;
+	      if (!conn->chunk_left) conn->chunk_state = EUPNP_HTTP_CLIENT_CHUNK_DATA_END;
+	      break;
+	   case EUPNP_HTTP_CLIENT_CHUNK_DATA_END:
+	      if (end - p < 2) goto out;
+	      if (p[0] != '\r' || p[1] != '\n') return EPROTO;
+
+	      p += 2;
+	      conn->chunk_state = EUPNP_HTTP_CLIENT_CHUNK_SIZE;
+	      break;
+	   case EUPNP_HTTP_CLIENT_CHUNK_TRAILER:
+	      eol = memmem(p, end - p, "\r\n", 2);
+
+	      if (!eol)
+		{
+		   if (end - p > EUPNP_HTTP_CLIENT_CHUNK_LINE) return EPROTO;
+		   goto out;
+		}
+
+	      // An empty line ends the trailers
+	      if (eol == p) *complete = EINA_TRUE;
+	      p = eol + 2;
+	      break;
+	  }
+     }
+
+out:
+   // Keep the input not decoded yet (or the next responses) after the body
+   n = end - p;
+   memmove(conn->in + conn->body_len, p, n);
+   conn->in_len = conn->body_len + n;
+
+   return 0;
+}
+
+/*
+ * Checks whether the response to the first request of the pipeline was fully
+ * received.
+ *
+ * @return 0 on success, an errno code otherwise. *complete tells whether the
+ *         response was fully received, its body being the first body_len
+ *         bytes of the input.
+ */
+static int
+eupnp_http_client_response_check(Eupnp_HTTP_Client_Connection *conn, Eina_Bool eof, Eina_Bool *complete)
+{
+   int error;
+
+   *complete = EINA_FALSE;
+
+   if (!conn->response)
+     {
+	if ((error = eupnp_http_client_head_parse(conn))) return error;
+	if (!conn->response) return eof ? ECONNRESET : 0;
+     }
+
+   switch (conn->framing)
+     {
+      case EUPNP_HTTP_CLIENT_BODY_NONE:
+	 conn->body_len = 0;
+	 *complete = EINA_TRUE;
+	 break;
+      case EUPNP_HTTP_CLIENT_BODY_LENGTH:
+	 *complete = conn->in_len >= conn->body_len;
+	 break;
+      case EUPNP_HTTP_CLIENT_BODY_CHUNKED:
+	 if ((error = eupnp_http_client_chunked_decode(conn, complete))) return error;
+	 break;
+      case EUPNP_HTTP_CLIENT_BODY_CLOSE:
+	 if (conn->in_len > EUPNP_HTTP_CLIENT_MAX_RESPONSE) return EMSGSIZE;
+	 conn->body_len = conn->in_len;
+	 *complete = eof;
+	 break;
+     }
+
+   if (!*complete && eof) return EPROTO;
+
+   return 0;
+}
+
+/*
+ * Completes the first request of the pipeline with the response received,
+ * keeping what follows it in the input.
+ */
+static int
+eupnp_http_client_response_take(Eupnp_HTTP_Client_Connection *conn)
+{
+   Eupnp_HTTP_Client_Request *req = conn->pipeline;
+   Eupnp_HTTP_Client_Response *r;
+   size_t left = conn->in_len - conn->body_len;
+
+   r = calloc(1, sizeof(Eupnp_HTTP_Client_Response));
+
+   if (!r)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP client response.\n");
+	return ENOMEM;
+     }
+
+   if (!left && conn->in_size > conn->body_len)
+     {
+	// Nothing follows, the buffer is handed over
+	r->body = conn->in;
+	conn->in = NULL;
+	conn->in_size = 0;
+     }
+   else
+     {
+	r->body = malloc(conn->body_len + 1);
+
+	if (!r->body)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not create HTTP client response.\n");
+	     free(r);
+	     return ENOMEM;
+	  }
+
+	memcpy(r->body, conn->in, conn->body_len);
+	memmove(conn->in, conn->in + conn->body_len, left);
+     }
+
+   r->body_len = conn->body_len;
+   r->body[r->body_len] = '\0';
+   r->response = conn->response;
+
+   conn->response = NULL;
+   conn->in_len = left;
+   conn->body_len = 0;
+   conn->reused = EINA_TRUE;
+
+   eupnp_http_client_pipeline_shift(conn);
+   eupnp_http_client_request_complete(req, r, 0);
+
+   return 0;
+}
+
+/*
+ * Reads what the connection received and completes the requests answered.
+ *
+ * @return EINA_FALSE if the connection was closed.
+ */
+static Eina_Bool
+eupnp_http_client_connection_read(Eupnp_HTTP_Client_Connection *conn)
+{
+   Eina_Bool complete, eof = EINA_FALSE;
+   char ip[INET_ADDRSTRLEN];
+   size_t space;
+   ssize_t n;
+   int error;
+
+   for (;;)
+     {
+	// Parsed first, more is read on the next event
+	if (conn->in_len >= EUPNP_HTTP_CLIENT_MAX_INPUT) break;
+
+	// Room for a read and the terminating NULL
+	if (conn->in_size - conn->in_len < EUPNP_HTTP_CLIENT_READ_SIZE + 1)
+	  {
+	     size_t size = conn->in_size ? conn->in_size * 2 : EUPNP_HTTP_CLIENT_READ_SIZE * 2;
+	     char *in = realloc(conn->in, size);
+
+	     if (!in)
+	       {
+		  eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+		  ERROR("Could not read HTTP response.\n");
+		  eupnp_http_client_connection_close(conn, ENOMEM, EINA_FALSE);
+		  return EINA_FALSE;
+	       }
+
+	     conn->in = in;
+	     conn->in_size = size;
+	  }
+
+	space = conn->in_size - conn->in_len - 1;
+	if (space > EUPNP_HTTP_CLIENT_MAX_INPUT - conn->in_len)
+	   space = EUPNP_HTTP_CLIENT_MAX_INPUT - conn->in_len;
+
+	n = read(conn->fd, conn->in + conn->in_len, space);
+
+	if (n < 0)
+	  {
+	     if (errno == EINTR) continue;
+	     if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+	     eupnp_http_client_connection_close(conn, errno, conn->reused);
+	     return EINA_FALSE;
+	  }
+
+	if (!n)
+	  {
+	     eof = EINA_TRUE;
+	     break;
+	  }
+
+	conn->in_len += n;
+
+	// Short read, the socket is drained
+	if ((size_t)n < space) break;
+     }
+
+   while (conn->pipeline)
+     {
+	error = eupnp_http_client_response_check(conn, eof, &complete);
+
+	if (!error && complete) error = eupnp_http_client_response_take(conn);
+	if (!error && !complete && conn->in_len >= EUPNP_HTTP_CLIENT_MAX_INPUT)
+	   error = EMSGSIZE;
+
+	if (error)
+	  {
+	     DEBUG("Bad HTTP response from %s: %s\n",
+		   inet_ntop(AF_INET, &conn->host->addr.sin_addr, ip, sizeof(ip)),
+		   strerror(error));
+	     eupnp_http_client_connection_close(conn, error, conn->reused);
+	     return EINA_FALSE;
+	  }
+
+	if (!complete) return EINA_TRUE;
+
+	if (conn->last_use)
+	  {
+	     // Requests pipelined after this one go elsewhere
+	     eupnp_http_client_connection_close(conn, ECONNRESET, EINA_TRUE);
+	     return EINA_FALSE;
+	  }
+     }
+
+   // Idle connections only get closed
+   if (eof || conn->in_len)
+     {
+	eupnp_http_client_connection_close(conn, ECONNRESET, EINA_FALSE);
+	return EINA_FALSE;
+     }
+
+   return EINA_TRUE;
+}
+
+static void
+eupnp_http_client_connection_ready(Eupnp_HTTP_Client_Connection *conn, uint32_t events)
+{
+   int error = 0;
+   socklen_t len = sizeof(error);
+
+   if (!conn->connected)
+     {
+	if (events & (EPOLLERR | EPOLLHUP))
+	  {
+	     if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || !error)
+		error = ECONNREFUSED;
+
+	     eupnp_http_client_connection_close(conn, error, EINA_FALSE);
+	     return;
+	  }
+
+	if (!(events & EPOLLOUT)) return;
+	conn->connected = EINA_TRUE;
+     }
+
+   if ((events & EPOLLOUT) && (error = eupnp_http_client_connection_flush(conn)))
+     {
+	eupnp_http_client_connection_close(conn, error, conn->reused);
+	return;
+     }
+
+   if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+      eupnp_http_client_connection_read(conn);
+}
+
+/*
+ * Times out late requests, closes connections idle for too long
+ */
+static void
+eupnp_http_client_sweep(Eupnp_HTTP_Client *c, double now)
+{
+   Eupnp_HTTP_Client_Connection *conn, *next;
+   Eupnp_HTTP_Client_Host *h;
+   char ip[INET_ADDRSTRLEN];
+
+   for (h = c->hosts; h; h = h->next)
+      for (conn = h->connections; conn; conn = next)
+	{
+	   next = conn->next;
+
+	   // Requests further in the pipeline were sent later
+	   if (conn->pipeline && conn->pipeline->deadline <= now)
+	     {
+		DEBUG("HTTP request to %s timed out\n",
+		      inet_ntop(AF_INET, &h->addr.sin_addr, ip, sizeof(ip)));
+		eupnp_http_client_connection_close(conn, ETIMEDOUT, EINA_FALSE);
+	     }
+	   else if (!conn->pipeline &&
+		    conn->idle_since + EUPNP_HTTP_CLIENT_IDLE_TIMEOUT <= now)
+	      eupnp_http_client_connection_close(conn, 0, EINA_FALSE);
+	}
+
+   eupnp_http_client_hosts_sweep(c);
+}
+
+/*
+ * Escapes XML special characters of s into out, when not NULL.
+ *
+ * @return escaped length
+ */
+static size_t
+eupnp_http_client_xml_escape(char *out, const char *s)
+{
+   const char *rep;
+   size_t len = 0, n;
+
+   for (; *s; s++)
+     {
+	switch (*s)
+	  {
+	   case '&': rep = "&amp;"; break;
+	   case '<': rep = "&lt;"; break;
+	   case '>': rep = "&gt;"; break;
+	   case '"': rep = "&quot;"; break;
+	   case '\'': rep = "&apos;"; break;
+	   default:
+	      if (out) out[len] = *s;
+	      len++;
+	      continue;
+	  }
+
+	n = strlen(rep);
+	if (out) memcpy(out + len, rep, n);
+	len += n;
+     }
+
+   return len;
+}
+
+
+/*
+ * Cancelling the last waiter of a request abandons it: a queued request is
+ * dropped, one alone on its connection aborted, and one pipelined behind
+ * others is left to be answered, for the connection to be kept.
+ */
+static void
+eupnp_http_client_waiter_cancel(void *data, Eupnp_Future *f)
+{
+   Eupnp_HTTP_Client_Waiter **p, *w = data;
+   Eupnp_HTTP_Client_Request *req = w->req;
+   Eupnp_HTTP_Client *c = req->client;
+
+   for (p = &req->waiters; *p != w; p = &(*p)->next) ;
+   *p = w->next;
+
+   if (req->done)
+     {
+	if (req->result && req->result->refcount == 1)
+	  {
+	     eupnp_http_client_response_free(req->result);
+	     req->result = NULL;
+	  }
+	else if (req->result)
+	   req->result->refcount--;
+     }
+   else if (!req->waiters)
+     {
+	DEBUG("Abandoning HTTP request %p\n", req);
+
+	if (!req->conn)
+	  {
+	     eupnp_http_client_queue_remove(req);
+	     eupnp_http_client_request_unshare(req);
+	     eupnp_http_client_request_free(req);
+	  }
+	else if (req->conn->pipeline_count == 1)
+	   eupnp_http_client_connection_close(req->conn, ECANCELED, EINA_FALSE);
+     }
+
+   eupnp_future_unref(f);
+   free(w);
+
+   eupnp_http_client_pump(c);
+   eupnp_http_client_settle(c);
+}
+
+/*
+ * Adds a waiter to a request
+ *
+ * @return future handed to the caller or NULL on error.
+ */
+static Eupnp_Future *
+eupnp_http_client_waiter_add(Eupnp_HTTP_Client_Request *req)
+{
+   Eupnp_HTTP_Client_Waiter *w;
+
+   w = malloc(sizeof(Eupnp_HTTP_Client_Waiter));
+
+   if (!w)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP request.\n");
+	return NULL;
+     }
+
+   w->future = eupnp_future_new(eupnp_http_client_waiter_cancel, w);
+
+   if (!w->future)
+     {
+	free(w);
+	return NULL;
+     }
+
+   w->req = req;
+   w->next = req->waiters;
+   req->waiters = w;
+
+   return eupnp_future_ref(w->future);
+}
+
+/*
+ * Queues a request, or joins an identical idempotent one.
+ */
+static Eupnp_Future *
+eupnp_http_client_request_send(Eupnp_HTTP_Client *c, const char *method, const char *url, const char *headers, const char *body, size_t len, Eina_Bool idempotent)
+{
+   Eupnp_HTTP_Client_Request *req;
+   Eupnp_HTTP_Client_Host *h;
+   Eupnp_Future *future;
+   const char *host, *path;
+   struct sockaddr_in addr;
+   unsigned int hash;
+   int host_len, n;
+   size_t size;
+   char *out;
+
+   if (!eupnp_http_client_url_parse(url, &addr, &host, &host_len, &path))
+     {
+	WARN("Unsupported URL %s\n", url);
+
+	// Failing through the future keeps chains uniform
+	if ((future = eupnp_future_new(NULL, NULL)))
+	   eupnp_future_reject(future, EINVAL);
+	return future;
+     }
+
+   if (!headers) headers = "";
+
+   size = strlen(method) + strlen(path) + host_len + strlen(headers) + len + 128;
+   out = malloc(size);
+
+   if (!out)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP request.\n");
+	return NULL;
+     }
+
+   n = snprintf(out, size,
+		"%s %s HTTP/1.1\r\n"
+		"Host: %.*s\r\n"
+		"%s",
+		method, path, host_len, host, headers);
+
+   if (body)
+      n += snprintf(out + n, size - n, "Content-Length: %zu\r\n", len);
+
+   memcpy(out + n, "\r\n", 2);
+   n += 2;
+
+   if (body) memcpy(out + n, body, len);
+   size = n + (body ? len : 0);
+   hash = eupnp_hash(out, size);
+
+   if (idempotent)
+      for (req = c->shared; req; req = req->shared_next)
+	 if (req->hash == hash && req->out_len == size &&
+	     !memcmp(req->out, out, size) &&
+	     req->host->addr.sin_addr.s_addr == addr.sin_addr.s_addr &&
+	     req->host->addr.sin_port == addr.sin_port)
+	   {
+	      free(out);
+
+	      if (!(future = eupnp_http_client_waiter_add(req))) return NULL;
+
+	      c->stats.coalesced++;
+	      return future;
+	   }
+
+   req = calloc(1, sizeof(Eupnp_HTTP_Client_Request));
+   h = req ? eupnp_http_client_host_get(c, &addr) : NULL;
+
+   if (!h)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP request.\n");
+	free(req);
+	free(out);
+	return NULL;
+     }
+
+   req->client = c;
+   req->host = h;
+   req->out = out;
+   req->out_len = size;
+   req->hash = hash;
+   req->idempotent = idempotent;
+   req->head_only = !strcmp(method, "HEAD");
+   h->requests++;
+
+   if (!(future = eupnp_http_client_waiter_add(req)))
+     {
+	eupnp_http_client_request_free(req);
+	return NULL;
+     }
+
+   if (idempotent)
+     {
+	req->shared = EINA_TRUE;
+	req->shared_next = c->shared;
+	if (c->shared) c->shared->shared_prev = req;
+	c->shared = req;
+     }
+
+   // May complete right away if no connection can be made
+   eupnp_http_client_queue_append(c, req);
+   eupnp_http_client_pump(c);
+   eupnp_http_client_settle(c);
+
+   return future;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_HTTP_Client structure
+ *
+ * @return Eupnp_HTTP_Client instance or NULL on error.
+ */
+Eupnp_HTTP_Client *
+eupnp_http_client_new(void)
+{
+   Eupnp_HTTP_Client *c;
+
+   c = calloc(1, sizeof(Eupnp_HTTP_Client));
+
+   if (!c)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP client.\n");
+	return NULL;
+     }
+
+   c->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+   if (c->epfd < 0)
+     {
+	ERROR("Could not create HTTP client: %s\n", strerror(errno));
+	free(c);
+	return NULL;
+     }
+
+   c->max_in_flight = EUPNP_HTTP_CLIENT_MAX_IN_FLIGHT;
+   c->max_per_host = EUPNP_HTTP_CLIENT_MAX_PER_HOST;
+   c->pipeline_depth = EUPNP_HTTP_CLIENT_PIPELINE_DEPTH;
+   c->timeout = EUPNP_HTTP_CLIENT_TIMEOUT;
+
+   return c;
+}
+
+/*
+ * Destructor for the Eupnp_HTTP_Client structure. Requests left are
+ * cancelled.
+ */
+void
+eupnp_http_client_free(Eupnp_HTTP_Client *c)
+{
+   Eupnp_HTTP_Client_Connection *conn;
+   Eupnp_HTTP_Client_Request *req;
+   Eupnp_HTTP_Client_Host *h;
+
+   if (!c) return;
+
+   // Nothing queued may be sent while cancelling
+   c->max_in_flight = 0;
+
+   // Cancelling may close connections, hence the restarts
+   for (h = c->hosts; h; )
+     {
+	req = NULL;
+
+	for (conn = h->connections; conn && !req; conn = conn->next)
+	   for (req = conn->pipeline; req && !req->waiters; req = req->next) ;
+
+	if (req) eupnp_future_cancel(req->waiters->future);
+	else h = h->next;
+     }
+
+   while (c->queue) eupnp_future_cancel(c->queue->waiters->future);
+
+   // Left with abandoned requests only
+   for (h = c->hosts; h; h = h->next)
+      while (h->connections)
+	 eupnp_http_client_connection_close(h->connections, ECANCELED, EINA_FALSE);
+
+   eupnp_http_client_settle(c);
+
+   while ((h = c->hosts))
+     {
+	c->hosts = h->next;
+	free(h);
+     }
+
+   close(c->epfd);
+   free(c);
+}
+
+/*
+ * Retrieves the file descriptor to watch for reading, ready when
+ * eupnp_http_client_process() has work to do.
+ */
+int
+eupnp_http_client_fd_get(const Eupnp_HTTP_Client *c)
+{
+   return c->epfd;
+}
+
+/*
+ * Retrieves the seconds left before the earliest outstanding request times
+ * out or an idle connection is closed, -1 if there is none.
+ */
+double
+eupnp_http_client_timeout_get(const Eupnp_HTTP_Client *c)
+{
+   Eupnp_HTTP_Client_Connection *conn;
+   Eupnp_HTTP_Client_Host *h;
+   double deadline = -1, d;
+
+   for (h = c->hosts; h; h = h->next)
+      for (conn = h->connections; conn; conn = conn->next)
+	{
+	   if (conn->pipeline) d = conn->pipeline->deadline;
+	   else d = conn->idle_since + EUPNP_HTTP_CLIENT_IDLE_TIMEOUT;
+
+	   if (deadline < 0 || d < deadline) deadline = d;
+	}
+
+   if (deadline < 0) return -1;
+
+   deadline -= eupnp_time_now();
+
+   return (deadline > 0) ? deadline : 0;
+}
+
+/*
+ * Handles pending socket events without blocking, settling the futures of
+ * completed requests, times out late ones and sends queued ones.
+ *
+ * @return number of events handled
+ */
+unsigned int
+eupnp_http_client_process(Eupnp_HTTP_Client *c)
+{
+   struct epoll_event events[EUPNP_HTTP_CLIENT_EVENTS];
+   int i, n;
+
+   n = epoll_wait(c->epfd, events, EUPNP_HTTP_CLIENT_EVENTS, 0);
+
+   if (n < 0)
+     {
+	if (errno != EINTR)
+	   ERROR("Could not wait for HTTP client events: %s\n", strerror(errno));
+	n = 0;
+     }
+
+   // A connection only ever closes itself here
+   for (i = 0; i < n; i++)
+      eupnp_http_client_connection_ready(events[i].data.ptr, events[i].events);
+
+   eupnp_http_client_sweep(c, eupnp_time_now());
+   eupnp_http_client_pump(c);
+   eupnp_http_client_settle(c);
+
+   return n;
+}
+
+/*
+ * Sets how many requests are outstanding at once, how many connections are
+ * open to a host, and the seconds an outstanding request may take. Zero
+ * values keep the current setting.
+ */
+void
+eupnp_http_client_limits_set(Eupnp_HTTP_Client *c, unsigned int max_in_flight, unsigned int max_per_host, double timeout)
+{
+   if (max_in_flight) c->max_in_flight = max_in_flight;
+   if (max_per_host) c->max_per_host = max_per_host;
+   if (timeout > 0) c->timeout = timeout;
+
+   eupnp_http_client_pump(c);
+   eupnp_http_client_settle(c);
+}
+
+/*
+ * Sets how many idempotent requests may be outstanding on a connection. 1
+ * disables pipelining.
+ */
+void
+eupnp_http_client_pipeline_set(Eupnp_HTTP_Client *c, unsigned int depth)
+{
+   c->pipeline_depth = depth ? depth : 1;
+
+   eupnp_http_client_pump(c);
+   eupnp_http_client_settle(c);
+}
+
+unsigned int
+eupnp_http_client_in_flight_get(const Eupnp_HTTP_Client *c)
+{
+   return c->in_flight;
+}
+
+unsigned int
+eupnp_http_client_queued_get(const Eupnp_HTTP_Client *c)
+{
+   return c->queue_count;
+}
+
+const Eupnp_HTTP_Client_Stats *
+eupnp_http_client_stats_get(const Eupnp_HTTP_Client *c)
+{
+   return &c->stats;
+}
+
+/*
+ * Sends a request
+ *
+ * The future resolves with an Eupnp_HTTP_Client_Response for any status
+ * code, or is rejected with an errno code: EINVAL for unsupported URLs,
+ * ETIMEDOUT, ECONNREFUSED and alike for network errors, EPROTO for malformed
+ * responses and EMSGSIZE for responses over EUPNP_HTTP_CLIENT_MAX_RESPONSE.
+ * Cancelling it aborts the request, unless identical GET or HEAD requests
+ * still wait for it.
+ *
+ * @param c client
+ * @param method request method, e.g. "GET"
+ * @param url http:// URL with an IPv4 address
+ * @param headers extra headers, each ending with CRLF, or NULL
+ * @param body request body or NULL
+ * @param len body length
+ *
+ * @return future of the response or NULL on error.
+ */
+Eupnp_Future *
+eupnp_http_client_request(Eupnp_HTTP_Client *c, const char *method, const char *url, const char *headers, const char *body, size_t len)
+{
+   return eupnp_http_client_request_send(c, method, url, headers, body, len,
+					 !strcmp(method, "GET") || !strcmp(method, "HEAD"));
+}
+
+/*
+ * Fetches a device or service description
+ *
+ * @param c client
+ * @param location description URL, e.g. from the LOCATION header
+ *
+ * @return future of the response or NULL on error.
+ */
+Eupnp_Future *
+eupnp_http_client_description_fetch(Eupnp_HTTP_Client *c, const char *location)
+{
+   return eupnp_http_client_request_send(c, "GET", location, NULL, NULL, 0, EINA_TRUE);
+}
+
+/*
+ * Invokes a service action
+ *
+ * Argument values are escaped. The future resolves with the SOAP response,
+ * including faults, which come with a 500 status code. Identical Get*
+ * invocations outstanding at once share the response.
+ *
+ * @param c client
+ * @param control_url service control URL
+ * @param service_type service type, e.g. urn:schemas-upnp-org:service:SwitchPower:1
+ * @param action action name
+ * @param args NULL-terminated array of argument name and value pairs, or NULL
+ *
+ * @return future of the response or NULL on error.
+ */
+Eupnp_Future *
+eupnp_http_client_action_invoke(Eupnp_HTTP_Client *c, const char *control_url, const char *service_type, const char *action, const char **args)
+{
+   Eupnp_Future *future;
+   const char **arg;
+   char *headers, *body, *p;
+   size_t action_len = strlen(action);
+   size_t type_len = strlen(service_type);
+   size_t len;
+   int n;
+
+   len = sizeof(_eupnp_http_client_soap_head) - 1 +
+	 sizeof(_eupnp_http_client_soap_tail) - 1 +
+	 2 * action_len + type_len + 32;
+
+   for (arg = args; arg && arg[0] && arg[1]; arg += 2)
+      len += 2 * strlen(arg[0]) + eupnp_http_client_xml_escape(NULL, arg[1]) + 5;
+
+   body = malloc(len + 1);
+   n = asprintf(&headers,
+		"Content-Type: text/xml; charset=\"utf-8\"\r\n"
+		"SOAPACTION: \"%s#%s\"\r\n", service_type, action);
+
+   if (!body || n < 0)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create %s action invocation.\n", action);
+	free(body);
+	if (n >= 0) free(headers);
+	return NULL;
+     }
+
+   p = body;
+   memcpy(p, _eupnp_http_client_soap_head, sizeof(_eupnp_http_client_soap_head) - 1);
+   p += sizeof(_eupnp_http_client_soap_head) - 1;
+   p += sprintf(p, "<u:%s xmlns:u=\"%s\">", action, service_type);
+
+   for (arg = args; arg && arg[0] && arg[1]; arg += 2)
+     {
+	p += sprintf(p, "<%s>", arg[0]);
+	p += eupnp_http_client_xml_escape(p, arg[1]);
+	p += sprintf(p, "</%s>", arg[0]);
+     }
+
+   p += sprintf(p, "</u:%s>", action);
+   memcpy(p, _eupnp_http_client_soap_tail, sizeof(_eupnp_http_client_soap_tail) - 1);
+   p += sizeof(_eupnp_http_client_soap_tail) - 1;
+
+   // Get* actions only query state
+   future = eupnp_http_client_request_send(c, "POST", control_url, headers, body, p - body,
+					   !strncmp(action, "Get", 3));
+
+   free(headers);
+   free(body);
+
+   return future;
+}
+
+/*
+ * Releases a response. Responses shared by coalesced requests are freed
+ * with the last future holding them.
+ */
+void
+eupnp_http_client_response_free(Eupnp_HTTP_Client_Response *r)
+{
+   if (!r) return;
+   if (r->refcount > 1)
+     {
+	r->refcount--;
+	return;
+     }
+
+   if (r->response) eupnp_http_response_free(r->response);
+   free(r->body);
+   free(r);
+}
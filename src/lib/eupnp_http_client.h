@@ -0,0 +1,94 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_HTTP_CLIENT_H
+#define _EUPNP_HTTP_CLIENT_H
+
+#include <Eina.h>
+#include <eupnp_http_message.h>
+#include <eupnp_future.h>
+
+/*
+ * Default limits: requests outstanding at once overall (others wait in a
+ * queue), connections open to a host, requests pipelined on a connection,
+ * seconds an outstanding request may take, seconds an idle connection is
+ * kept, and size of a response body.
+ */
+#define EUPNP_HTTP_CLIENT_MAX_IN_FLIGHT 64
+#define EUPNP_HTTP_CLIENT_MAX_PER_HOST 4
+#define EUPNP_HTTP_CLIENT_PIPELINE_DEPTH 4
+#define EUPNP_HTTP_CLIENT_TIMEOUT 30
+#define EUPNP_HTTP_CLIENT_IDLE_TIMEOUT 5
+#define EUPNP_HTTP_CLIENT_MAX_RESPONSE (1024 * 1024)
+
+typedef struct _Eupnp_HTTP_Client Eupnp_HTTP_Client;
+typedef struct _Eupnp_HTTP_Client_Response Eupnp_HTTP_Client_Response;
+typedef struct _Eupnp_HTTP_Client_Stats Eupnp_HTTP_Client_Stats;
+
+/*
+ * Value of resolved request futures, whatever the status code. body is
+ * NULL-terminated and owned by the future. Futures of coalesced requests
+ * share the same response.
+ */
+struct _Eupnp_HTTP_Client_Response {
+   Eupnp_HTTP_Response *response;
+   char *body;
+   size_t body_len;
+
+   /* private */
+   unsigned int refcount;
+};
+
+/*
+ * Counters since the client was created: requests sent, requests which
+ * joined an identical one instead, requests sent behind others on a
+ * connection, connections opened, requests sent on a connection already
+ * used, and requests retried after a kept alive connection closed.
+ */
+struct _Eupnp_HTTP_Client_Stats {
+   unsigned long requests;
+   unsigned long coalesced;
+   unsigned long pipelined;
+   unsigned long connections;
+   unsigned long reused;
+   unsigned long retried;
+};
+
+
+Eupnp_HTTP_Client *eupnp_http_client_new(void);
+void               eupnp_http_client_free(Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+int                eupnp_http_client_fd_get(const Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+double             eupnp_http_client_timeout_get(const Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_http_client_process(Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+
+void               eupnp_http_client_limits_set(Eupnp_HTTP_Client *c, unsigned int max_in_flight, unsigned int max_per_host, double timeout) EINA_ARG_NONNULL(1);
+void               eupnp_http_client_pipeline_set(Eupnp_HTTP_Client *c, unsigned int depth) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_http_client_in_flight_get(const Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_http_client_queued_get(const Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+const Eupnp_HTTP_Client_Stats *eupnp_http_client_stats_get(const Eupnp_HTTP_Client *c) EINA_ARG_NONNULL(1);
+
+Eupnp_Future      *eupnp_http_client_request(Eupnp_HTTP_Client *c, const char *method, const char *url, const char *headers, const char *body, size_t len) EINA_ARG_NONNULL(1,2,3);
+Eupnp_Future      *eupnp_http_client_description_fetch(Eupnp_HTTP_Client *c, const char *location) EINA_ARG_NONNULL(1,2);
+Eupnp_Future      *eupnp_http_client_action_invoke(Eupnp_HTTP_Client *c, const char *control_url, const char *service_type, const char *action, const char **args) EINA_ARG_NONNULL(1,2,3,4);
+void               eupnp_http_client_response_free(Eupnp_HTTP_Client_Response *r);
+
+
+#endif /* _EUPNP_HTTP_CLIENT_H */
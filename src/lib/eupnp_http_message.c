@@ -21,6 +21,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <Eina.h>
 
 #include "eupnp_error.h"
@@ -30,55 +31,73 @@
  * Private API
  */
 
+/*
+ * Finds the "\r\n" ending the line that starts at p, looking no further than
+ * end.
+ *
+ * @return pointer to the '\r' or NULL if the line is not terminated.
+ */
+static const char *
+eupnp_http_line_end_find(const char *p, const char *end)
+{
+   const char *cr;
+
+   while (p < end && (cr = memchr(p, '\r', end - p)))
+     {
+	if (cr + 1 < end && cr[1] == '\n')
+	   return cr;
+	p = cr + 1;
+     }
+
+   return NULL;
+}
+
 /*
  * Parses the first line of a HTTP message
  *
- * Parses first line of the form "a<SP>b<SP>c<SP>" and stores the points on the
+ * Parses first line of the form "a<SP>b<SP>c\r\n" and stores the points on the
  * pointers @p a, @p b and @p c given. Also marks @p headers_start on the
- * beginning of the headers 
+ * beginning of the headers. Nothing past @p end is read; c may contain spaces
+ * (reason phrases do).
  */
 static Eina_Bool
-eupnp_http_datagram_line_parse(const char *msg, const char **headers_start, const char **a, int *a_len, const char **b, int *b_len, const char **c, int *c_len)
+eupnp_http_datagram_line_parse(const char *msg, const char *end, const char **headers_start, const char **a, int *a_len, const char **b, int *b_len, const char **c, int *c_len)
 {
-   /*
-    * Parse first line of the form "a SP b SP c\r\n"
-    */
-   const char *begin, *end;
-   const char *vbegin, *vend;
+   const char *line_end, *sp;
 
-   *a = msg;
-   end = strchr(*a, ' ');
+   line_end = eupnp_http_line_end_find(msg, end);
 
-   if (!end)
+   if (!line_end)
      {
-	ERROR("Could not parse DATAGRAM.\n");
+	ERROR("Could not parse HTTP request.\n");
 	return EINA_FALSE;
      }
 
-   *a_len = end - *a;
-
-   /* Move our starting point to b */
-   *b = end + 1;
-   end = strchr(*b, ' ');
+   *a = msg;
+   sp = memchr(*a, ' ', line_end - *a);
 
-   if (!end)
+   if (!sp || sp == *a)
      {
-	ERROR("Could not parse HTTP.\n");
+	ERROR("Could not parse DATAGRAM.\n");
 	return EINA_FALSE;
      }
 
-   *b_len = end - *b;
-   *c = end + 1;
-   end = strstr(*c, "\r\n");
+   *a_len = sp - *a;
 
-   if (!end)
+   /* Move our starting point to b */
+   *b = sp + 1;
+   sp = memchr(*b, ' ', line_end - *b);
+
+   if (!sp || sp == *b)
      {
-	ERROR("Could not parse HTTP request.\n");
+	ERROR("Could not parse HTTP.\n");
 	return EINA_FALSE;
      }
 
-   *c_len = end - *c;
-   *headers_start = end + 2;
+   *b_len = sp - *b;
+   *c = sp + 1;
+   *c_len = line_end - *c;
+   *headers_start = line_end + 2;
 
    return EINA_TRUE;
 }
@@ -87,72 +106,86 @@ eupnp_http_datagram_line_parse(const char *msg, const char **headers_start, cons
  * Parses HTTP headers
  *
  * Given the starting point, parses the next header and sets the starting point
- * to the next header, if present. Sets the given pointers to the parsed key
- * and value.
+ * to the next header. Sets the given pointers to the parsed key and value,
+ * without the whitespace around the value.
+ *
+ * Parsing stops (EINA_FALSE) at the blank line ending the headers, which
+ * leaves the starting point on the body, and on malformed or unterminated
+ * lines, which set it to NULL. Nothing past @p end is read.
  */
 static Eina_Bool
-eupnp_http_datagram_header_next_parse(const char **line_start, const char **hkey, int *hkey_len, const char **hvalue, int *hvalue_len)
+eupnp_http_datagram_header_next_parse(const char **line_start, const char *end, const char **hkey, int *hkey_len, const char **hvalue, int *hvalue_len)
 {
-   const char *end;
+   const char *line_end, *colon, *vend;
 
-   if (!line_start)
+   if (!line_start || !*line_start)
       return EINA_FALSE;
 
-   *hkey = *line_start;
-
-   // Find first ':'. Do not trim spaces between the key and ':' - not on
-   // RFC2616.
-   end = strchr(*hkey, ':');
+   line_end = eupnp_http_line_end_find(*line_start, end);
 
-   if (!end)
+   if (!line_end)
      {
+	DEBUG("Unterminated header line.\n");
 	*line_start = NULL;
 	return EINA_FALSE;
      }
 
-   *hkey_len = end - *hkey;
-
-   // Move to the first char after ':' and check if the header value is empty.
-   *hvalue = end + 1;
-
-   if (**hvalue == '\r' && *(*hvalue+1) == '\n')
+   if (line_end == *line_start)
      {
-	DEBUG("Empty header value!\n");
-	*line_start = *hvalue + 2;
-	*hvalue_len = 0;
-	return EINA_TRUE;
+	*line_start = line_end + 2;
+	return EINA_FALSE;
      }
 
-   // Header value not empty, skip whitespaces before the actual value.
-   while (**hvalue == ' ') (*hvalue)++;
+   *hkey = *line_start;
+
+   // Find first ':' on this line. Do not trim spaces between the key and ':'
+   // - not on RFC2616.
+   colon = memchr(*hkey, ':', line_end - *hkey);
 
-   if (**hvalue == '\r' && *(*hvalue+1) == '\n')
+   if (!colon || colon == *hkey)
      {
-	DEBUG("Empty header value!\n");
-	*line_start = *hvalue + 2;
-	*hvalue_len = 0;
-	return EINA_TRUE;
+	ERROR("Header parsing error: no header name.\n");
+	*line_start = NULL;
+	return EINA_FALSE;
      }
 
-   // Mark value and skip possible whitespaces between value and \r\n
-   end = *hvalue;
+   *hkey_len = colon - *hkey;
 
-   while (*(end+1) != '\r') end++;
+   // Skip whitespaces before and after the value
+   *hvalue = colon + 1;
+   while (*hvalue < line_end && (**hvalue == ' ' || **hvalue == '\t'))
+      (*hvalue)++;
 
-   if (*(end+2) != '\n')
-     {
-	ERROR("Header parsing error: character after carrier is not \\n\n");
-	return EINA_FALSE;
-     }
+   vend = line_end;
+   while (vend > *hvalue && (*(vend - 1) == ' ' || *(vend - 1) == '\t'))
+      vend--;
 
-   *hvalue_len = end - *hvalue + 1;
+   *hvalue_len = vend - *hvalue;
 
    /* Set line_start for next header */
-   *line_start = end + 3;
+   *line_start = line_end + 2;
 
    return EINA_TRUE;
 }
 
+/*
+ * Parses a three digit status code
+ *
+ * @return status code or 0 if invalid.
+ */
+static int
+eupnp_http_status_code_parse(const char *status_code, int len)
+{
+   if (len != 3 ||
+       status_code[0] < '1' || status_code[0] > '5' ||
+       status_code[1] < '0' || status_code[1] > '9' ||
+       status_code[2] < '0' || status_code[2] > '9')
+      return 0;
+
+   return (status_code[0] - '0') * 100 + (status_code[1] - '0') * 10 +
+	  (status_code[2] - '0');
+}
+
 /*
  * Public API
  */
@@ -200,7 +233,7 @@ eupnp_http_header_new(const char *key, int key_len, const char *value, int value
 
    while (*p != '\0')
      {
-	*p = tolower(*p);
+	*p = tolower((unsigned char)*p);
 	(p)++;
      }
 
@@ -502,7 +535,7 @@ eupnp_http_response_new(const char *httpver, int httpver_len, const char *status
 	return NULL;
      }
 
-   r->status_code = strtol(status_code, NULL, 10);
+   r->status_code = eupnp_http_status_code_parse(status_code, status_code_len);
    r->reason_phrase = eina_stringshare_add_length(reason_phrase,
 						    reason_phrase_len);
 
@@ -659,6 +692,19 @@ eupnp_http_message_is_response(const char *msg)
    return EINA_FALSE;
 }
 
+/*
+ * Same as eupnp_http_message_is_response(), for a message of len bytes that
+ * need not be NULL-terminated.
+ */
+Eina_Bool
+eupnp_http_message_is_response_length(const char *msg, size_t len)
+{
+   if (len >= EUPNP_HTTP_VERSION_LEN &&
+       !memcmp(msg, EUPNP_HTTP_VERSION, EUPNP_HTTP_VERSION_LEN))
+      return EINA_TRUE;
+   return EINA_FALSE;
+}
+
 /*
  * Checks if a message type is request
  *
@@ -672,6 +718,16 @@ eupnp_http_message_is_request(const char *msg)
    return (!eupnp_http_message_is_response(msg));
 }
 
+/*
+ * Same as eupnp_http_message_is_request(), for a message of len bytes that
+ * need not be NULL-terminated.
+ */
+Eina_Bool
+eupnp_http_message_is_request_length(const char *msg, size_t len)
+{
+   return (!eupnp_http_message_is_response_length(msg, len));
+}
+
 /*
  * Parses a request message and mounts the request object
  *
@@ -679,13 +735,32 @@ eupnp_http_message_is_request(const char *msg)
  * eupnp_http_message_is_request()) and returns the
  * request object with attributes already set.
  *
- * @param msg HTTP message
+ * @param msg HTTP message, NULL-terminated
  *
  * @return Eupnp_HTTP_Request instance if parsed successfully, NULL otherwise.
  */
 Eupnp_HTTP_Request *
 eupnp_http_request_parse(const char *msg)
 {
+   return eupnp_http_request_parse_length(msg, strlen(msg));
+}
+
+/*
+ * Parses a request message of len bytes and mounts the request object
+ *
+ * The message need not be NULL-terminated and nothing past len is read, so
+ * it can be parsed where it was received, e.g. in a socket or mapped file
+ * buffer. Anything after the blank line ending the headers is ignored.
+ *
+ * @param msg HTTP message
+ * @param len message length
+ *
+ * @return Eupnp_HTTP_Request instance if parsed successfully, NULL otherwise.
+ */
+Eupnp_HTTP_Request *
+eupnp_http_request_parse_length(const char *msg, size_t len)
+{
+   const char *end = msg + len;
    Eupnp_HTTP_Request *r;
    const char *method;
    const char *uri;
@@ -695,7 +770,7 @@ eupnp_http_request_parse(const char *msg)
    int method_len, uri_len, httpver_len;
    int hk_len, hv_len;
 
-   if (!eupnp_http_datagram_line_parse(msg, &headers_start, &method, &method_len, &uri, &uri_len, &http_version, &httpver_len))
+   if (!eupnp_http_datagram_line_parse(msg, end, &headers_start, &method, &method_len, &uri, &uri_len, &http_version, &httpver_len))
      {
 	ERROR("Could not parse request line.\n");
 	return NULL;
@@ -714,7 +789,7 @@ eupnp_http_request_parse(const char *msg)
 
    while (next_header != NULL)
      {
-	if (eupnp_http_datagram_header_next_parse(&next_header, &hkey_begin, &hk_len, &hv_begin, &hv_len))
+	if (eupnp_http_datagram_header_next_parse(&next_header, end, &hkey_begin, &hk_len, &hv_begin, &hv_len))
 	  {
 	     if (!eupnp_http_request_header_add(r, hkey_begin, hk_len, hv_begin, hv_len))
 	       {
@@ -739,13 +814,30 @@ eupnp_http_request_parse(const char *msg)
  * eupnp_http_message_is_response()) and returns the
  * response object with attributes already set.
  *
- * @param msg HTTP message
+ * @param msg HTTP message, NULL-terminated
  *
  * @return Eupnp_HTTP_Response instance if parsed successfully, NULL otherwise.
  */
 Eupnp_HTTP_Response *
 eupnp_http_response_parse(const char *msg)
 {
+   return eupnp_http_response_parse_length(msg, strlen(msg));
+}
+
+/*
+ * Parses a response message of len bytes and mounts the response object
+ *
+ * Like eupnp_http_request_parse_length(), never reads past len.
+ *
+ * @param msg HTTP message
+ * @param len message length
+ *
+ * @return Eupnp_HTTP_Response instance if parsed successfully, NULL otherwise.
+ */
+Eupnp_HTTP_Response *
+eupnp_http_response_parse_length(const char *msg, size_t len)
+{
+   const char *end = msg + len;
    Eupnp_HTTP_Response *r;
    const char *reason_phrase;
    const char *status_code;
@@ -756,8 +848,9 @@ eupnp_http_response_parse(const char *msg)
    int hk_len, hv_len;
 
    if (!eupnp_http_datagram_line_parse
-		(msg, &headers_start, &http_version, &httpver_len, &status_code,
-		 &sc_len, &reason_phrase, &rp_len))
+		(msg, end, &headers_start, &http_version, &httpver_len,
+		 &status_code, &sc_len, &reason_phrase, &rp_len) ||
+       !eupnp_http_status_code_parse(status_code, sc_len))
      {
 	ERROR("Could not parse response line.\n");
 	return NULL;
@@ -776,7 +869,7 @@ eupnp_http_response_parse(const char *msg)
 
    while (next_header != NULL)
      {
-	if (eupnp_http_datagram_header_next_parse(&next_header, &hkey_begin, &hk_len, &hv_begin, &hv_len))
+	if (eupnp_http_datagram_header_next_parse(&next_header, end, &hkey_begin, &hk_len, &hv_begin, &hv_len))
 	  {
 	     if (!eupnp_http_response_header_add(r, hkey_begin, hk_len, hv_begin, hv_len))
 	       {
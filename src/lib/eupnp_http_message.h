@@ -50,10 +50,14 @@ typedef struct _Eupnp_HTTP_Header Eupnp_HTTP_Header;
 
 
 Eupnp_HTTP_Request  *eupnp_http_request_parse(const char *msg) EINA_ARG_NONNULL(1);
+Eupnp_HTTP_Request  *eupnp_http_request_parse_length(const char *msg, size_t len) EINA_ARG_NONNULL(1);
 Eupnp_HTTP_Response *eupnp_http_response_parse(const char *msg) EINA_ARG_NONNULL(1);
+Eupnp_HTTP_Response *eupnp_http_response_parse_length(const char *msg, size_t len) EINA_ARG_NONNULL(1);
 
 Eina_Bool            eupnp_http_message_is_response(const char *msg) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_http_message_is_response_length(const char *msg, size_t len) EINA_ARG_NONNULL(1);
 Eina_Bool            eupnp_http_message_is_request(const char *msg) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_http_message_is_request_length(const char *msg, size_t len) EINA_ARG_NONNULL(1);
 
 Eupnp_HTTP_Header   *eupnp_http_header_new(const char *key, int key_len, const char *value, int value_len) EINA_ARG_NONNULL(1,2,3);
 void                 eupnp_http_header_free(Eupnp_HTTP_Header *h) EINA_ARG_NONNULL(1);
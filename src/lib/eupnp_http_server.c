@@ -0,0 +1,1528 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <Eina.h>
+
+#include "eupnp.h"
+#include "eupnp_error.h"
+#include "eupnp_hash.h"
+#include "eupnp_http_server.h"
+#include "eupnp_uring.h"
+#include "eupnp_probes.h"
+
+/*
+ * Non-blocking HTTP/1.1 server on epoll, serving static resources (device and
+ * service descriptions) and passing other requests (control, event callbacks)
+ * to handlers.
+ *
+ * Static resources are kept with their response head already serialized,
+ * including an ETag, and are written with writev() straight from memory, or
+ * with sendfile() when backed by a file. Requests carrying a matching
+ * If-None-Match get a 304 without body.
+ *
+ * Request bodies are only delimited by Content-Length, requests with a
+ * Transfer-Encoding are refused with a 501 and their connection closed.
+ *
+ * Connections are kept alive unless the client asks otherwise. Requests are
+ * handled one at a time per connection: a pipelined request is only parsed
+ * once the response to the previous one is written.
+ *
+ * When built with io_uring (and EUPNP_IO_URING is not set to 0), connections
+ * are accepted with a multishot accept and read with multishot receives into
+ * provided buffers instead of epoll readiness plus read(). Responses are still
+ * written directly, a poll operation waits for the socket when it is full.
+ * Closed connections are released once their operations are cancelled.
+ */
+
+#define EUPNP_HTTP_SERVER_BACKLOG 511
+#define EUPNP_HTTP_SERVER_EVENTS 64
+
+/* Input buffer limit, a whole request always fits with some of the next one */
+#define EUPNP_HTTP_SERVER_BUFFER_MAX (EUPNP_HTTP_SERVER_MAX_REQUEST * 2)
+
+/* io_uring receive buffers shared by all connections, a power of two */
+#define EUPNP_HTTP_SERVER_URING_BUFFERS 256
+#define EUPNP_HTTP_SERVER_URING_BUFFER_SIZE 4096
+#define EUPNP_HTTP_SERVER_COMPLETIONS 256
+
+typedef struct _Eupnp_HTTP_Server_Resource Eupnp_HTTP_Server_Resource;
+typedef struct _Eupnp_HTTP_Server_Handler Eupnp_HTTP_Server_Handler;
+typedef struct _Eupnp_HTTP_Server_Connection Eupnp_HTTP_Server_Connection;
+
+/*
+ * Resources are referenced by the connections writing them, so they can be
+ * replaced or deleted while being sent.
+ */
+struct _Eupnp_HTTP_Server_Resource {
+   Eupnp_HTTP_Server_Resource *next;
+   char *path;
+   char *head;            /* status line and headers, no terminating CRLF */
+   size_t head_len;
+   char *not_modified;    /* same, for 304 responses */
+   size_t not_modified_len;
+   char etag[16];
+   char *body;            /* NULL for file resources */
+   int fd;                /* -1 for memory resources */
+   size_t len;
+   int refcount;
+};
+
+struct _Eupnp_HTTP_Server_Handler {
+   Eupnp_HTTP_Server_Handler *next;
+   char *prefix;
+   size_t prefix_len;
+   Eupnp_HTTP_Server_Handler_Cb cb;
+   void *data;
+};
+
+struct _Eupnp_HTTP_Server_Connection {
+   Eupnp_HTTP_Server *srv;
+   Eupnp_HTTP_Server_Connection *next;
+   Eupnp_HTTP_Server_Connection *prev;
+   int fd;
+   double last_active;
+
+   /* Received, not yet handled */
+   char *in;
+   size_t in_len;
+   size_t in_size;
+
+   /* Response being written */
+   struct iovec iov[3];
+   unsigned int iov_first;
+   unsigned int iov_count;
+   char *out;
+   Eupnp_HTTP_Server_Resource *resource;
+   off_t file_offset;
+   size_t file_left;
+   Eina_Bool writing;
+   Eina_Bool close_after;
+
+   /* io_uring operations, the connection is freed when none is armed */
+   Eupnp_Uring_Op recv_op;
+   Eupnp_Uring_Op poll_op;
+   Eina_Bool recv_armed;
+   Eina_Bool poll_armed;
+   Eina_Bool closing;
+   unsigned int dispatching;
+};
+
+struct _Eupnp_HTTP_Server {
+   int epfd;
+   int listen_fd;
+   int port;
+   Eupnp_HTTP_Server_Resource *resources;
+   Eupnp_HTTP_Server_Handler *handlers;
+   Eupnp_HTTP_Server_Connection *connections;
+   unsigned int connection_count;
+   double last_sweep;
+
+   /* io_uring backend, NULL when running on epoll */
+   Eupnp_Uring *uring;
+   Eupnp_Uring_Buffers *buffers;
+   Eupnp_Uring_Op accept_op;
+   Eupnp_HTTP_Server_Connection *closing;
+};
+
+static const char _eupnp_http_server_keep_alive[] = "\r\n";
+static const char _eupnp_http_server_close[] = "Connection: close\r\n\r\n";
+
+
+/*
+ * Private API
+ */
+
+static void eupnp_http_server_connection_input(Eupnp_HTTP_Server_Connection *conn);
+static Eina_Bool eupnp_http_server_connection_drain(Eupnp_HTTP_Server_Connection *conn);
+
+static void
+eupnp_http_server_resource_unref(Eupnp_HTTP_Server_Resource *r)
+{
+   if (--r->refcount) return;
+
+   if (r->fd >= 0) close(r->fd);
+   free(r->body);
+   free(r->head);
+   free(r->not_modified);
+   free(r->path);
+   free(r);
+}
+
+static Eina_Bool
+eupnp_http_server_resource_publish(Eupnp_HTTP_Server *srv, Eupnp_HTTP_Server_Resource *r, const char *content_type, unsigned int hash)
+{
+   snprintf(r->etag, sizeof(r->etag), "\"%08x\"", hash);
+
+   if (asprintf(&r->head, "HTTP/1.1 200 OK\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %zu\r\n"
+		"ETag: %s\r\n",
+		content_type, r->len, r->etag) < 0)
+      r->head = NULL;
+
+   if (asprintf(&r->not_modified, "HTTP/1.1 304 Not Modified\r\n"
+		"ETag: %s\r\n", r->etag) < 0)
+      r->not_modified = NULL;
+
+   if (!r->head || !r->not_modified)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not add resource %s.\n", r->path);
+	r->refcount = 1;
+	eupnp_http_server_resource_unref(r);
+	return EINA_FALSE;
+     }
+
+   r->head_len = strlen(r->head);
+   r->not_modified_len = strlen(r->not_modified);
+   r->refcount = 1;
+
+   // Replaces any resource on the same path
+   eupnp_http_server_resource_del(srv, r->path);
+   r->next = srv->resources;
+   srv->resources = r;
+
+   return EINA_TRUE;
+}
+
+static Eupnp_HTTP_Server_Resource *
+eupnp_http_server_resource_find(const Eupnp_HTTP_Server *srv, const char *path)
+{
+   Eupnp_HTTP_Server_Resource *r;
+
+   for (r = srv->resources; r; r = r->next)
+      if (!strcmp(r->path, path))
+	 return r;
+
+   return NULL;
+}
+
+static Eupnp_HTTP_Server_Handler *
+eupnp_http_server_handler_find(const Eupnp_HTTP_Server *srv, const char *uri)
+{
+   Eupnp_HTTP_Server_Handler *h, *best = NULL;
+
+   // Longest matching prefix
+   for (h = srv->handlers; h; h = h->next)
+      if (!strncmp(uri, h->prefix, h->prefix_len) &&
+	  (!best || h->prefix_len > best->prefix_len))
+	 best = h;
+
+   return best;
+}
+
+static Eina_Bool
+eupnp_http_server_epoll_set(Eupnp_HTTP_Server_Connection *conn, uint32_t events, int op)
+{
+   struct epoll_event ev;
+
+   if (conn->srv->uring)
+     {
+	// Receiving stays armed, only waiting for room to write takes an op
+	if (events != EPOLLOUT || conn->poll_armed) return EINA_TRUE;
+	conn->poll_armed = eupnp_uring_poll_add(conn->srv->uring, &conn->poll_op,
+						conn->fd, POLLOUT);
+	return conn->poll_armed;
+     }
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = events;
+   ev.data.ptr = conn;
+
+   if (epoll_ctl(conn->srv->epfd, op, conn->fd, &ev) < 0)
+     {
+	ERROR("Could not watch connection: %s\n", strerror(errno));
+	return EINA_FALSE;
+     }
+
+   return EINA_TRUE;
+}
+
+static void
+eupnp_http_server_connection_response_release(Eupnp_HTTP_Server_Connection *conn)
+{
+   if (conn->resource) eupnp_http_server_resource_unref(conn->resource);
+   free(conn->out);
+
+   conn->resource = NULL;
+   conn->out = NULL;
+   conn->iov_first = conn->iov_count = 0;
+   conn->file_left = 0;
+   conn->writing = EINA_FALSE;
+}
+
+/*
+ * Frees a closed connection once no io_uring operation refers to it. The
+ * socket is closed last so its number is not reused by a new connection
+ * while operations on it are still being cancelled.
+ */
+static void
+eupnp_http_server_connection_release(Eupnp_HTTP_Server_Connection *conn)
+{
+   Eupnp_HTTP_Server *srv = conn->srv;
+
+   if (conn->recv_armed || conn->poll_armed || conn->dispatching)
+      return;
+
+   if (conn->closing)
+     {
+	if (conn->prev)
+	   conn->prev->next = conn->next;
+	else
+	   srv->closing = conn->next;
+
+	if (conn->next) conn->next->prev = conn->prev;
+     }
+
+   close(conn->fd);
+   free(conn);
+}
+
+static void
+eupnp_http_server_connection_close(Eupnp_HTTP_Server_Connection *conn)
+{
+   Eupnp_HTTP_Server *srv = conn->srv;
+
+   eupnp_http_server_connection_response_release(conn);
+
+   if (conn->prev)
+      conn->prev->next = conn->next;
+   else
+      srv->connections = conn->next;
+
+   if (conn->next) conn->next->prev = conn->prev;
+
+   srv->connection_count--;
+   free(conn->in);
+   conn->in = NULL;
+   conn->in_len = conn->in_size = 0;
+
+   if (!srv->uring)
+     {
+	epoll_ctl(srv->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+	free(conn);
+	return;
+     }
+
+   // Wait for the operations in flight on the closing list
+   conn->closing = EINA_TRUE;
+   conn->prev = NULL;
+   conn->next = srv->closing;
+   if (conn->next) conn->next->prev = conn;
+   srv->closing = conn;
+
+   if (conn->recv_armed) eupnp_uring_cancel(srv->uring, &conn->recv_op);
+   if (conn->poll_armed) eupnp_uring_cancel(srv->uring, &conn->poll_op);
+
+   eupnp_http_server_connection_release(conn);
+}
+
+/*
+ * Writes as much of the pending response as the socket takes.
+ *
+ * @return EINA_FALSE if the connection was closed.
+ */
+static Eina_Bool
+eupnp_http_server_connection_flush(Eupnp_HTTP_Server_Connection *conn)
+{
+   ssize_t n;
+
+   while (conn->iov_first < conn->iov_count)
+     {
+	n = writev(conn->fd, conn->iov + conn->iov_first,
+		   conn->iov_count - conn->iov_first);
+
+	if (n < 0)
+	  {
+	     if (errno == EINTR) continue;
+	     if (errno == EAGAIN || errno == EWOULDBLOCK) goto wait;
+	     DEBUG("Could not write response: %s\n", strerror(errno));
+	     eupnp_http_server_connection_close(conn);
+	     return EINA_FALSE;
+	  }
+
+	while (n > 0 && conn->iov_first < conn->iov_count)
+	  {
+	     struct iovec *iov = &conn->iov[conn->iov_first];
+
+	     if ((size_t)n >= iov->iov_len)
+	       {
+		  n -= iov->iov_len;
+		  conn->iov_first++;
+	       }
+	     else
+	       {
+		  iov->iov_base = (char *)iov->iov_base + n;
+		  iov->iov_len -= n;
+		  n = 0;
+	       }
+	  }
+     }
+
+   while (conn->file_left)
+     {
+	n = sendfile(conn->fd, conn->resource->fd, &conn->file_offset,
+		     conn->file_left);
+
+	if (n < 0)
+	  {
+	     if (errno == EINTR) continue;
+	     if (errno == EAGAIN || errno == EWOULDBLOCK) goto wait;
+	  }
+
+	if (n <= 0)
+	  {
+	     DEBUG("Could not send file: %s\n", strerror(errno));
+	     eupnp_http_server_connection_close(conn);
+	     return EINA_FALSE;
+	  }
+
+	conn->file_left -= n;
+     }
+
+   eupnp_http_server_connection_response_release(conn);
+
+   if (conn->close_after)
+     {
+	eupnp_http_server_connection_close(conn);
+	return EINA_FALSE;
+     }
+
+   return eupnp_http_server_epoll_set(conn, EPOLLIN, EPOLL_CTL_MOD);
+
+wait:
+   return eupnp_http_server_epoll_set(conn, EPOLLOUT, EPOLL_CTL_MOD);
+}
+
+static Eina_Bool
+eupnp_http_server_connection_respond(Eupnp_HTTP_Server_Connection *conn, int status, const char *reason, const char *content_type, const void *body, size_t len)
+{
+   int head_len;
+
+   if (content_type)
+      head_len = asprintf(&conn->out, "HTTP/1.1 %d %s\r\n"
+			  "Content-Type: %s\r\n"
+			  "Content-Length: %zu\r\n",
+			  status, reason, content_type, len);
+   else
+      head_len = asprintf(&conn->out, "HTTP/1.1 %d %s\r\n"
+			  "Content-Length: %zu\r\n",
+			  status, reason, len);
+
+   if (head_len < 0)
+     {
+	conn->out = NULL;
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not allocate response.\n");
+	return EINA_FALSE;
+     }
+
+   if (len)
+     {
+	char *out = realloc(conn->out, head_len + len);
+
+	if (!out)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not allocate response.\n");
+	     free(conn->out);
+	     conn->out = NULL;
+	     return EINA_FALSE;
+	  }
+
+	memcpy(out + head_len, body, len);
+	conn->out = out;
+     }
+
+   conn->iov[0].iov_base = conn->out;
+   conn->iov[0].iov_len = head_len;
+   conn->iov[1].iov_base = (void *)(conn->close_after ? _eupnp_http_server_close : _eupnp_http_server_keep_alive);
+   conn->iov[1].iov_len = conn->close_after ? sizeof(_eupnp_http_server_close) - 1 : sizeof(_eupnp_http_server_keep_alive) - 1;
+   conn->iov[2].iov_base = conn->out + head_len;
+   conn->iov[2].iov_len = len;
+   conn->iov_first = 0;
+   conn->iov_count = len ? 3 : 2;
+   conn->writing = EINA_TRUE;
+
+   EUPNP_PROBE2(http_server_response, status, len);
+
+   return EINA_TRUE;
+}
+
+static void
+eupnp_http_server_resource_respond(Eupnp_HTTP_Server_Connection *conn, Eupnp_HTTP_Server_Resource *r, Eina_Bool head_only, Eina_Bool not_modified)
+{
+   r->refcount++;
+   conn->resource = r;
+
+   conn->iov[0].iov_base = not_modified ? r->not_modified : r->head;
+   conn->iov[0].iov_len = not_modified ? r->not_modified_len : r->head_len;
+   conn->iov[1].iov_base = (void *)(conn->close_after ? _eupnp_http_server_close : _eupnp_http_server_keep_alive);
+   conn->iov[1].iov_len = conn->close_after ? sizeof(_eupnp_http_server_close) - 1 : sizeof(_eupnp_http_server_keep_alive) - 1;
+   conn->iov_first = 0;
+   conn->iov_count = 2;
+   conn->writing = EINA_TRUE;
+
+   EUPNP_PROBE2(http_server_response, not_modified ? 304 : 200,
+		(head_only || not_modified) ? 0 : r->len);
+
+   if (head_only || not_modified)
+      return;
+
+   if (r->body)
+     {
+	conn->iov[2].iov_base = r->body;
+	conn->iov[2].iov_len = r->len;
+	conn->iov_count = 3;
+     }
+   else
+     {
+	conn->file_offset = 0;
+	conn->file_left = r->len;
+     }
+}
+
+/*
+ * Matches an If-None-Match header against the ETag of a resource: either "*"
+ * or a comma separated list of entity tags. Tags are compared weakly, as
+ * required for If-None-Match, so a W/ prefix is ignored.
+ */
+static Eina_Bool
+eupnp_http_server_etag_match(const char *header, const char *etag)
+{
+   size_t etag_len = strlen(etag);
+   const char *p = header;
+   const char *end;
+
+   while (*p == ' ' || *p == '\t') p++;
+   if (p[0] == '*' && !p[1 + strspn(p + 1, " \t")]) return EINA_TRUE;
+
+   while (*p)
+     {
+	p += strspn(p, " \t,");
+	if (!strncmp(p, "W/", 2)) p += 2;
+
+	if (*p == '"' && (end = strchr(p + 1, '"')))
+	  {
+	     end++;
+	     if ((size_t)(end - p) == etag_len && !memcmp(p, etag, etag_len))
+		return EINA_TRUE;
+	     p = end;
+	  }
+
+	// Skip to the next list element, past anything malformed
+	p += strcspn(p, ",");
+     }
+
+   return EINA_FALSE;
+}
+
+/*
+ * Handles a complete request, queueing its response.
+ */
+static void
+eupnp_http_server_request_handle(Eupnp_HTTP_Server_Connection *conn, Eupnp_HTTP_Request *request, const char *body, size_t body_len)
+{
+   Eupnp_HTTP_Server *srv = conn->srv;
+   Eupnp_HTTP_Server_Resource *r;
+   Eupnp_HTTP_Server_Handler *h;
+   Eupnp_HTTP_Server_Request req;
+   const char *connection, *etag;
+   Eina_Bool get, head;
+
+   connection = eupnp_http_request_header_get(request, "connection");
+
+   if (strcmp(request->http_version, EUPNP_HTTP_VERSION))
+      conn->close_after = !connection || strcasecmp(connection, "keep-alive");
+   else
+      conn->close_after = connection && !strcasecmp(connection, "close");
+
+   EUPNP_PROBE2(http_server_request, request->method, request->uri);
+
+   get = !strcmp(request->method, "GET");
+   head = !strcmp(request->method, "HEAD");
+
+   if ((get || head) && (r = eupnp_http_server_resource_find(srv, request->uri)))
+     {
+	etag = eupnp_http_request_header_get(request, "if-none-match");
+	eupnp_http_server_resource_respond(conn, r, head, etag && eupnp_http_server_etag_match(etag, r->etag));
+	return;
+     }
+
+   h = eupnp_http_server_handler_find(srv, request->uri);
+
+   if (!h)
+     {
+	eupnp_http_server_connection_respond(conn, 404, "Not Found", NULL, NULL, 0);
+	return;
+     }
+
+   req.request = request;
+   req.body = body;
+   req.body_len = body_len;
+   req.connection = conn;
+   req.responded = EINA_FALSE;
+
+   h->cb(h->data, &req);
+
+   if (!req.responded)
+     {
+	WARN("Handler for %s did not respond.\n", h->prefix);
+	eupnp_http_server_connection_respond(conn, 500, "Internal Server Error", NULL, NULL, 0);
+     }
+}
+
+/*
+ * Retrieves the body length of a request from its Content-Length headers,
+ * several of them must agree. Lengths past EUPNP_HTTP_SERVER_MAX_REQUEST are
+ * all reported as EUPNP_HTTP_SERVER_MAX_REQUEST + 1.
+ *
+ * @return EINA_FALSE if a value is not a plain decimal number.
+ */
+static Eina_Bool
+eupnp_http_server_content_length_get(Eupnp_HTTP_Request *request, size_t *len)
+{
+   Eina_Array_Iterator it;
+   Eupnp_HTTP_Header *h;
+   Eina_Bool found = EINA_FALSE;
+   int i;
+
+   *len = 0;
+
+   EINA_ARRAY_ITER_NEXT(request->headers, i, h, it)
+     {
+	const char *p;
+	size_t l = 0;
+
+	if (strcmp(h->key, "content-length")) continue;
+
+	p = h->value + strspn(h->value, " \t");
+	if (*p < '0' || *p > '9') return EINA_FALSE;
+
+	for (; *p >= '0' && *p <= '9'; p++)
+	   if (l <= EUPNP_HTTP_SERVER_MAX_REQUEST) l = l * 10 + (*p - '0');
+
+	if (p[strspn(p, " \t")]) return EINA_FALSE;
+
+	if (l > EUPNP_HTTP_SERVER_MAX_REQUEST) l = EUPNP_HTTP_SERVER_MAX_REQUEST + 1;
+	if (found && l != *len) return EINA_FALSE;
+
+	*len = l;
+	found = EINA_TRUE;
+     }
+
+   return EINA_TRUE;
+}
+
+/*
+ * Handles the next buffered request, if complete.
+ *
+ * @return EINA_FALSE if the connection was closed.
+ */
+static Eina_Bool
+eupnp_http_server_connection_parse(Eupnp_HTTP_Server_Connection *conn)
+{
+   Eupnp_HTTP_Request *request;
+   const char *end;
+   size_t head_len, body_len;
+
+   end = memmem(conn->in, conn->in_len, "\r\n\r\n", 4);
+
+   if (!end)
+     {
+	if (conn->in_len < EUPNP_HTTP_SERVER_MAX_REQUEST)
+	   return EINA_TRUE;
+
+	conn->close_after = EINA_TRUE;
+	eupnp_http_server_connection_respond(conn, 431, "Request Header Fields Too Large", NULL, NULL, 0);
+	return eupnp_http_server_connection_flush(conn);
+     }
+
+   head_len = end - conn->in + 4;
+
+   if (head_len > EUPNP_HTTP_SERVER_MAX_REQUEST)
+     {
+	conn->close_after = EINA_TRUE;
+	eupnp_http_server_connection_respond(conn, 431, "Request Header Fields Too Large", NULL, NULL, 0);
+	return eupnp_http_server_connection_flush(conn);
+     }
+
+   request = eupnp_http_request_parse_length(conn->in, head_len);
+
+   if (!request)
+     {
+	conn->close_after = EINA_TRUE;
+	eupnp_http_server_connection_respond(conn, 400, "Bad Request", NULL, NULL, 0);
+	return eupnp_http_server_connection_flush(conn);
+     }
+
+   // Chunked bodies are not supported, and the end of the request could not
+   // be found without decoding them
+   if (eupnp_http_request_header_get(request, "transfer-encoding"))
+     {
+	eupnp_http_request_free(request);
+	conn->close_after = EINA_TRUE;
+	eupnp_http_server_connection_respond(conn, 501, "Not Implemented", NULL, NULL, 0);
+	return eupnp_http_server_connection_flush(conn);
+     }
+
+   if (!eupnp_http_server_content_length_get(request, &body_len))
+     {
+	eupnp_http_request_free(request);
+	conn->close_after = EINA_TRUE;
+	eupnp_http_server_connection_respond(conn, 400, "Bad Request", NULL, NULL, 0);
+	return eupnp_http_server_connection_flush(conn);
+     }
+
+   if (body_len > EUPNP_HTTP_SERVER_MAX_REQUEST - head_len)
+     {
+	eupnp_http_request_free(request);
+	conn->close_after = EINA_TRUE;
+	eupnp_http_server_connection_respond(conn, 413, "Payload Too Large", NULL, NULL, 0);
+	return eupnp_http_server_connection_flush(conn);
+     }
+
+   if (conn->in_len < head_len + body_len)
+     {
+	// Body still on its way
+	eupnp_http_request_free(request);
+	return EINA_TRUE;
+     }
+
+   eupnp_http_server_request_handle(conn, request, conn->in + head_len, body_len);
+   eupnp_http_request_free(request);
+
+   conn->in_len -= head_len + body_len;
+   memmove(conn->in, conn->in + head_len + body_len, conn->in_len);
+
+   if (!conn->writing)
+     {
+	// Could not build a response
+	eupnp_http_server_connection_close(conn);
+	return EINA_FALSE;
+     }
+
+   return eupnp_http_server_connection_flush(conn);
+}
+
+static void
+eupnp_http_server_connection_input(Eupnp_HTTP_Server_Connection *conn)
+{
+   Eina_Bool full = EINA_FALSE;
+   ssize_t n;
+
+   for (;;)
+     {
+	if (conn->in_len == conn->in_size)
+	  {
+	     size_t size = conn->in_size ? conn->in_size * 2 : 4096;
+	     char *in;
+
+	     if (size > EUPNP_HTTP_SERVER_BUFFER_MAX)
+	       {
+		  full = EINA_TRUE;
+		  break;
+	       }
+
+	     in = realloc(conn->in, size);
+
+	     if (!in)
+	       {
+		  eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+		  ERROR("Could not grow connection buffer.\n");
+		  eupnp_http_server_connection_close(conn);
+		  return;
+	       }
+
+	     conn->in = in;
+	     conn->in_size = size;
+	  }
+
+	n = read(conn->fd, conn->in + conn->in_len, conn->in_size - conn->in_len);
+
+	if (n < 0 && errno == EINTR) continue;
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+
+	if (n <= 0)
+	  {
+	     eupnp_http_server_connection_close(conn);
+	     return;
+	  }
+
+	conn->in_len += n;
+     }
+
+   if (!eupnp_http_server_connection_drain(conn))
+      return;
+
+   // The socket stays readable, do not wait on it for a buffer nothing frees
+   if (full && !conn->writing && conn->in_len == conn->in_size)
+     {
+	WARN("Request too large on connection %d\n", conn->fd);
+	eupnp_http_server_connection_close(conn);
+     }
+}
+
+/*
+ * Handles buffered requests until one has to wait for the socket.
+ *
+ * @return EINA_FALSE if the connection was closed.
+ */
+static Eina_Bool
+eupnp_http_server_connection_drain(Eupnp_HTTP_Server_Connection *conn)
+{
+   while (!conn->writing && conn->in_len)
+     {
+	size_t before = conn->in_len;
+
+	if (!eupnp_http_server_connection_parse(conn))
+	   return EINA_FALSE;
+
+	if (conn->in_len == before) break;
+     }
+
+   return EINA_TRUE;
+}
+
+/*
+ * Appends received data to the input buffer of a connection.
+ *
+ * @return EINA_FALSE if the buffer would grow past the request limit.
+ */
+static Eina_Bool
+eupnp_http_server_connection_append(Eupnp_HTTP_Server_Connection *conn, const char *data, size_t len)
+{
+   if (conn->in_len + len > conn->in_size)
+     {
+	size_t size = conn->in_size ? conn->in_size : 4096;
+	char *in;
+
+	while (size < conn->in_len + len) size *= 2;
+
+	if (size > EUPNP_HTTP_SERVER_BUFFER_MAX)
+	  {
+	     WARN("Request too large on connection %d\n", conn->fd);
+	     return EINA_FALSE;
+	  }
+
+	in = realloc(conn->in, size);
+
+	if (!in)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not grow connection buffer.\n");
+	     return EINA_FALSE;
+	  }
+
+	conn->in = in;
+	conn->in_size = size;
+     }
+
+   memcpy(conn->in + conn->in_len, data, len);
+   conn->in_len += len;
+
+   return EINA_TRUE;
+}
+
+static void
+eupnp_http_server_uring_recv_cb(void *data, int res, Eina_Bool more, void *buf)
+{
+   Eupnp_HTTP_Server_Connection *conn = data;
+
+   if (!more) conn->recv_armed = EINA_FALSE;
+
+   if (conn->closing)
+     {
+	eupnp_http_server_connection_release(conn);
+	return;
+     }
+
+   conn->dispatching++;
+   conn->last_active = eupnp_time_now();
+
+   if (res > 0 && buf)
+     {
+	if (eupnp_http_server_connection_append(conn, buf, res))
+	   eupnp_http_server_connection_drain(conn);
+	else
+	   eupnp_http_server_connection_close(conn);
+     }
+   else if (res != -ENOBUFS)
+     {
+	// Peer closed or error. Out of buffers just means re-arming below
+	if (res < 0) DEBUG("Could not read request: %s\n", strerror(-res));
+	eupnp_http_server_connection_close(conn);
+     }
+
+   if (!conn->closing && !conn->recv_armed)
+     {
+	conn->recv_armed = eupnp_uring_recv_multishot(conn->srv->uring,
+						      &conn->recv_op, conn->fd);
+	if (!conn->recv_armed) eupnp_http_server_connection_close(conn);
+     }
+
+   conn->dispatching--;
+   if (conn->closing) eupnp_http_server_connection_release(conn);
+}
+
+static void
+eupnp_http_server_uring_poll_cb(void *data, int res, Eina_Bool more, void *buf)
+{
+   Eupnp_HTTP_Server_Connection *conn = data;
+
+   (void)res;
+   (void)more;
+   (void)buf;
+
+   conn->poll_armed = EINA_FALSE;
+
+   if (conn->closing)
+     {
+	eupnp_http_server_connection_release(conn);
+	return;
+     }
+
+   conn->dispatching++;
+   conn->last_active = eupnp_time_now();
+
+   if (eupnp_http_server_connection_flush(conn) && !conn->writing)
+      eupnp_http_server_connection_drain(conn);
+
+   conn->dispatching--;
+   if (conn->closing) eupnp_http_server_connection_release(conn);
+}
+
+/*
+ * Starts serving an accepted socket.
+ */
+static void
+eupnp_http_server_connection_add(Eupnp_HTTP_Server *srv, int fd, double now)
+{
+   Eupnp_HTTP_Server_Connection *conn;
+   Eina_Bool watched;
+   int one = 1;
+
+   if (srv->connection_count >= EUPNP_HTTP_SERVER_MAX_CONNECTIONS)
+     {
+	WARN("Too many connections, refusing one.\n");
+	close(fd);
+	return;
+     }
+
+   conn = calloc(1, sizeof(Eupnp_HTTP_Server_Connection));
+
+   if (!conn)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not accept connection.\n");
+	close(fd);
+	return;
+     }
+
+   setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+   conn->srv = srv;
+   conn->fd = fd;
+   conn->last_active = now;
+
+   if (srv->uring)
+     {
+	conn->recv_op.cb = eupnp_http_server_uring_recv_cb;
+	conn->recv_op.data = conn;
+	conn->recv_op.buffers = srv->buffers;
+	conn->poll_op.cb = eupnp_http_server_uring_poll_cb;
+	conn->poll_op.data = conn;
+	watched = conn->recv_armed = eupnp_uring_recv_multishot(srv->uring, &conn->recv_op, fd);
+     }
+   else
+      watched = eupnp_http_server_epoll_set(conn, EPOLLIN, EPOLL_CTL_ADD);
+
+   if (!watched)
+     {
+	close(fd);
+	free(conn);
+	return;
+     }
+
+   conn->next = srv->connections;
+   if (conn->next) conn->next->prev = conn;
+   srv->connections = conn;
+   srv->connection_count++;
+}
+
+static void
+eupnp_http_server_accept(Eupnp_HTTP_Server *srv, double now)
+{
+   int fd;
+
+   while ((fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+      eupnp_http_server_connection_add(srv, fd, now);
+
+   if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      ERROR("Could not accept connection: %s\n", strerror(errno));
+}
+
+static void
+eupnp_http_server_uring_accept_cb(void *data, int res, Eina_Bool more, void *buf)
+{
+   Eupnp_HTTP_Server *srv = data;
+
+   (void)buf;
+
+   if (res >= 0)
+      eupnp_http_server_connection_add(srv, res, eupnp_time_now());
+   else if (res != -ECANCELED)
+      ERROR("Could not accept connection: %s\n", strerror(-res));
+
+   if (!more && !eupnp_uring_accept_multishot(srv->uring, &srv->accept_op, srv->listen_fd))
+      ERROR("Could not accept connections anymore.\n");
+}
+
+/*
+ * Switches the server to io_uring, if available.
+ */
+static Eina_Bool
+eupnp_http_server_uring_setup(Eupnp_HTTP_Server *srv)
+{
+   srv->uring = eupnp_uring_new(EUPNP_URING_ENTRIES);
+   if (!srv->uring) return EINA_FALSE;
+
+   srv->buffers = eupnp_uring_buffers_new(srv->uring,
+					  EUPNP_HTTP_SERVER_URING_BUFFERS,
+					  EUPNP_HTTP_SERVER_URING_BUFFER_SIZE);
+   srv->accept_op.cb = eupnp_http_server_uring_accept_cb;
+   srv->accept_op.data = srv;
+
+   if (!srv->buffers ||
+       !eupnp_uring_accept_multishot(srv->uring, &srv->accept_op, srv->listen_fd) ||
+       !eupnp_uring_submit(srv->uring))
+     {
+	WARN("Could not serve through io_uring, using epoll.\n");
+	eupnp_uring_free(srv->uring);
+	srv->uring = NULL;
+	srv->buffers = NULL;
+	return EINA_FALSE;
+     }
+
+   INFO("Serving HTTP through io_uring.\n");
+
+   return EINA_TRUE;
+}
+
+/*
+ * Closes connections idle for too long.
+ */
+static void
+eupnp_http_server_sweep(Eupnp_HTTP_Server *srv, double now)
+{
+   Eupnp_HTTP_Server_Connection *conn, *next;
+
+   if (now - srv->last_sweep < 1) return;
+   srv->last_sweep = now;
+
+   for (conn = srv->connections; conn; conn = next)
+     {
+	next = conn->next;
+
+	if (now - conn->last_active >= EUPNP_HTTP_SERVER_IDLE_TIMEOUT)
+	  {
+	     DEBUG("Closing idle connection %d\n", conn->fd);
+	     eupnp_http_server_connection_close(conn);
+	  }
+     }
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_HTTP_Server structure
+ *
+ * @param addr address to listen on, e.g. "0.0.0.0"
+ * @param port port to listen on, 0 for any (see eupnp_http_server_port_get())
+ *
+ * @return Eupnp_HTTP_Server instance or NULL on error.
+ */
+Eupnp_HTTP_Server *
+eupnp_http_server_new(const char *addr, int port)
+{
+   Eupnp_HTTP_Server *srv;
+   struct sockaddr_in sa;
+   socklen_t sa_len = sizeof(sa);
+   struct epoll_event ev;
+   int one = 1;
+
+   srv = calloc(1, sizeof(Eupnp_HTTP_Server));
+
+   if (!srv)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create HTTP server.\n");
+	return NULL;
+     }
+
+   memset(&sa, 0, sizeof(sa));
+   sa.sin_family = AF_INET;
+   sa.sin_port = htons(port);
+
+   if (!inet_aton(addr, &sa.sin_addr))
+     {
+	ERROR("Could not convert address %s.\n", addr);
+	free(srv);
+	return NULL;
+     }
+
+   srv->epfd = -1;
+   srv->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+   if (srv->listen_fd < 0)
+     {
+	ERROR("Could not create HTTP server: %s\n", strerror(errno));
+	goto error;
+     }
+
+   setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+   if (bind(srv->listen_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+       listen(srv->listen_fd, EUPNP_HTTP_SERVER_BACKLOG) < 0 ||
+       getsockname(srv->listen_fd, (struct sockaddr *)&sa, &sa_len) < 0)
+     {
+	ERROR("Could not listen on %s:%d: %s\n", addr, port, strerror(errno));
+	goto error;
+     }
+
+   srv->port = ntohs(sa.sin_port);
+   srv->last_sweep = eupnp_time_now();
+
+   if (eupnp_http_server_uring_setup(srv))
+      return srv;
+
+   srv->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+   if (srv->epfd < 0)
+     {
+	ERROR("Could not create HTTP server: %s\n", strerror(errno));
+	goto error;
+     }
+
+   // Listening socket is told apart by its NULL data
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.ptr = NULL;
+
+   if (epoll_ctl(srv->epfd, EPOLL_CTL_ADD, srv->listen_fd, &ev) < 0)
+     {
+	ERROR("Could not watch HTTP server socket: %s\n", strerror(errno));
+	goto error;
+     }
+
+   return srv;
+
+error:
+   if (srv->listen_fd >= 0) close(srv->listen_fd);
+   if (srv->epfd >= 0) close(srv->epfd);
+   free(srv);
+   return NULL;
+}
+
+void
+eupnp_http_server_free(Eupnp_HTTP_Server *srv)
+{
+   Eupnp_HTTP_Server_Connection *conn;
+   Eupnp_HTTP_Server_Handler *h;
+   Eupnp_HTTP_Server_Resource *r;
+
+   if (!srv) return;
+
+   while (srv->connections)
+      eupnp_http_server_connection_close(srv->connections);
+
+   // Tearing the ring down cancels what is left in flight
+   if (srv->uring) eupnp_uring_free(srv->uring);
+
+   while ((conn = srv->closing))
+     {
+	srv->closing = conn->next;
+	close(conn->fd);
+	free(conn);
+     }
+
+   while ((r = srv->resources))
+     {
+	srv->resources = r->next;
+	eupnp_http_server_resource_unref(r);
+     }
+
+   while ((h = srv->handlers))
+     {
+	srv->handlers = h->next;
+	free(h->prefix);
+	free(h);
+     }
+
+   close(srv->listen_fd);
+   if (srv->epfd >= 0) close(srv->epfd);
+   free(srv);
+}
+
+/*
+ * Retrieves a file descriptor that becomes readable when the server has work
+ * to do, for adding to a main loop. Call eupnp_http_server_process() then.
+ */
+int
+eupnp_http_server_fd_get(const Eupnp_HTTP_Server *srv)
+{
+   if (srv->uring) return eupnp_uring_fd_get(srv->uring);
+   return srv->epfd;
+}
+
+/*
+ * Retrieves the port the server listens on
+ */
+int
+eupnp_http_server_port_get(const Eupnp_HTTP_Server *srv)
+{
+   return srv->port;
+}
+
+/*
+ * Retrieves the number of open connections
+ */
+unsigned int
+eupnp_http_server_connections_get(const Eupnp_HTTP_Server *srv)
+{
+   return srv->connection_count;
+}
+
+/*
+ * Retrieves how long the main loop may sleep before calling
+ * eupnp_http_server_process() for closing idle connections
+ *
+ * @param srv server
+ *
+ * @return timeout in seconds, 0 if idle connections are due to be closed and
+ *         -1 if there are no connections.
+ */
+double
+eupnp_http_server_timeout_get(const Eupnp_HTTP_Server *srv)
+{
+   Eupnp_HTTP_Server_Connection *conn;
+   double oldest, deadline;
+
+   if (!srv->connections) return -1;
+
+   oldest = srv->connections->last_active;
+   for (conn = srv->connections->next; conn; conn = conn->next)
+      if (conn->last_active < oldest) oldest = conn->last_active;
+
+   deadline = oldest + EUPNP_HTTP_SERVER_IDLE_TIMEOUT;
+   if (deadline < srv->last_sweep + 1) deadline = srv->last_sweep + 1;
+
+   deadline -= eupnp_time_now();
+
+   return (deadline > 0) ? deadline : 0;
+}
+
+/*
+ * Accepts connections, reads requests and writes responses, without blocking
+ *
+ * @param srv server
+ *
+ * @return number of socket events (io_uring completions) handled.
+ */
+unsigned int
+eupnp_http_server_process(Eupnp_HTTP_Server *srv)
+{
+   struct epoll_event events[EUPNP_HTTP_SERVER_EVENTS];
+   Eupnp_HTTP_Server_Connection *conn;
+   double now = eupnp_time_now();
+   int i, n;
+
+   if (srv->uring)
+     {
+	n = eupnp_uring_process(srv->uring, EUPNP_HTTP_SERVER_COMPLETIONS);
+	eupnp_http_server_sweep(srv, now);
+	return n;
+     }
+
+   n = epoll_wait(srv->epfd, events, EUPNP_HTTP_SERVER_EVENTS, 0);
+
+   if (n < 0)
+     {
+	if (errno != EINTR)
+	   ERROR("Could not wait for HTTP server events: %s\n", strerror(errno));
+	n = 0;
+     }
+
+   for (i = 0; i < n; i++)
+     {
+	conn = events[i].data.ptr;
+
+	if (!conn)
+	  {
+	     eupnp_http_server_accept(srv, now);
+	     continue;
+	  }
+
+	conn->last_active = now;
+
+	if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN))
+	   eupnp_http_server_connection_close(conn);
+	else if (conn->writing)
+	  {
+	     if (eupnp_http_server_connection_flush(conn) && !conn->writing)
+		eupnp_http_server_connection_input(conn);
+	  }
+	else
+	   eupnp_http_server_connection_input(conn);
+     }
+
+   eupnp_http_server_sweep(srv, now);
+
+   return n;
+}
+
+/*
+ * Serves a resource from memory, e.g. a device or service description
+ *
+ * The content is copied and its response head serialized upfront. Adding a
+ * resource on a path already in use replaces it.
+ *
+ * @param srv server
+ * @param path request path, e.g. "/description.xml"
+ * @param content_type e.g. "text/xml; charset=\"utf-8\""
+ * @param body content
+ * @param len content length
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_http_server_resource_add(Eupnp_HTTP_Server *srv, const char *path, const char *content_type, const void *body, size_t len)
+{
+   Eupnp_HTTP_Server_Resource *r;
+
+   r = calloc(1, sizeof(Eupnp_HTTP_Server_Resource));
+
+   if (r)
+     {
+	r->fd = -1;
+	r->path = strdup(path);
+	r->body = malloc(len ? len : 1);
+     }
+
+   if (!r || !r->path || !r->body)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not add resource %s.\n", path);
+	if (r) free(r->path);
+	if (r) free(r->body);
+	free(r);
+	return EINA_FALSE;
+     }
+
+   memcpy(r->body, body, len);
+   r->len = len;
+
+   return eupnp_http_server_resource_publish(srv, r, content_type,
+					     eupnp_hash(body, len));
+}
+
+/*
+ * Serves a file with sendfile(). The file is opened now and its content
+ * should not change while it is served; add it again after changing it.
+ *
+ * @param srv server
+ * @param path request path
+ * @param content_type content type
+ * @param filename file to serve
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_http_server_file_add(Eupnp_HTTP_Server *srv, const char *path, const char *content_type, const char *filename)
+{
+   Eupnp_HTTP_Server_Resource *r;
+   struct stat st;
+   uint32_t hash = EUPNP_HASH_INIT;
+
+   r = calloc(1, sizeof(Eupnp_HTTP_Server_Resource));
+
+   if (!r || !(r->path = strdup(path)))
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not add resource %s.\n", path);
+	free(r);
+	return EINA_FALSE;
+     }
+
+   r->fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+   if (r->fd < 0 || fstat(r->fd, &st) < 0)
+     {
+	ERROR("Could not open %s: %s\n", filename, strerror(errno));
+	if (r->fd >= 0) close(r->fd);
+	free(r->path);
+	free(r);
+	return EINA_FALSE;
+     }
+
+   r->len = st.st_size;
+
+   // Validators from the file identity, no need to read it
+   hash = eupnp_hash_update(hash, &st.st_ino, sizeof(st.st_ino));
+   hash = eupnp_hash_update(hash, &st.st_mtime, sizeof(st.st_mtime));
+   hash = eupnp_hash_update(hash, &st.st_size, sizeof(st.st_size));
+
+   return eupnp_http_server_resource_publish(srv, r, content_type, hash);
+}
+
+/*
+ * Stops serving a resource. Responses being written are completed.
+ *
+ * @return EINA_TRUE if the resource existed.
+ */
+Eina_Bool
+eupnp_http_server_resource_del(Eupnp_HTTP_Server *srv, const char *path)
+{
+   Eupnp_HTTP_Server_Resource **p, *r;
+
+   for (p = &srv->resources; *p; p = &(*p)->next)
+      if (!strcmp((*p)->path, path))
+	{
+	   r = *p;
+	   *p = r->next;
+	   eupnp_http_server_resource_unref(r);
+	   return EINA_TRUE;
+	}
+
+   return EINA_FALSE;
+}
+
+/*
+ * Passes requests whose path starts with prefix to a handler. When several
+ * prefixes match, the longest wins. Static resources take precedence for GET
+ * and HEAD.
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_http_server_handler_add(Eupnp_HTTP_Server *srv, const char *prefix, Eupnp_HTTP_Server_Handler_Cb cb, void *data)
+{
+   Eupnp_HTTP_Server_Handler *h;
+
+   h = calloc(1, sizeof(Eupnp_HTTP_Server_Handler));
+
+   if (!h || !(h->prefix = strdup(prefix)))
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not add handler for %s.\n", prefix);
+	free(h);
+	return EINA_FALSE;
+     }
+
+   h->prefix_len = strlen(prefix);
+   h->cb = cb;
+   h->data = data;
+   h->next = srv->handlers;
+   srv->handlers = h;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Removes the handler of a prefix
+ *
+ * @return EINA_TRUE if the handler existed.
+ */
+Eina_Bool
+eupnp_http_server_handler_del(Eupnp_HTTP_Server *srv, const char *prefix)
+{
+   Eupnp_HTTP_Server_Handler **p, *h;
+
+   for (p = &srv->handlers; *p; p = &(*p)->next)
+      if (!strcmp((*p)->prefix, prefix))
+	{
+	   h = *p;
+	   *p = h->next;
+	   free(h->prefix);
+	   free(h);
+	   return EINA_TRUE;
+	}
+
+   return EINA_FALSE;
+}
+
+/*
+ * Answers a request from within its handler
+ *
+ * @param req request
+ * @param status status code
+ * @param reason reason phrase
+ * @param content_type content type, NULL for none
+ * @param body response body, copied, may be NULL if len is 0
+ * @param len body length
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error or if the request was
+ *         already answered.
+ */
+Eina_Bool
+eupnp_http_server_respond(Eupnp_HTTP_Server_Request *req, int status, const char *reason, const char *content_type, const void *body, size_t len)
+{
+   if (req->responded)
+     {
+	ERROR("Request already answered.\n");
+	return EINA_FALSE;
+     }
+
+   if (!eupnp_http_server_connection_respond(req->connection, status, reason,
+					     content_type, body, len))
+      return EINA_FALSE;
+
+   req->responded = EINA_TRUE;
+
+   return EINA_TRUE;
+}
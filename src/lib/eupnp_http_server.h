@@ -0,0 +1,77 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_HTTP_SERVER_H
+#define _EUPNP_HTTP_SERVER_H
+
+#include <Eina.h>
+#include <eupnp_http_message.h>
+
+/*
+ * Limits: connections open at once (others are closed right after being
+ * accepted), seconds an idle keep-alive connection is kept, and size of a
+ * request including its body.
+ */
+#define EUPNP_HTTP_SERVER_MAX_CONNECTIONS 4096
+#define EUPNP_HTTP_SERVER_IDLE_TIMEOUT 30
+#define EUPNP_HTTP_SERVER_MAX_REQUEST 65536
+
+typedef struct _Eupnp_HTTP_Server Eupnp_HTTP_Server;
+typedef struct _Eupnp_HTTP_Server_Request Eupnp_HTTP_Server_Request;
+
+
+/*
+ * Request handed to handlers. body is not NULL-terminated and, like request,
+ * is only valid during the handler call.
+ */
+struct _Eupnp_HTTP_Server_Request {
+   Eupnp_HTTP_Request *request;
+   const char *body;
+   size_t body_len;
+   void *connection;
+   Eina_Bool responded;
+};
+
+/*
+ * Handlers must answer with eupnp_http_server_respond() before returning,
+ * requests left unanswered get a 500 response.
+ */
+typedef void (*Eupnp_HTTP_Server_Handler_Cb) (void *data, Eupnp_HTTP_Server_Request *req);
+
+
+Eupnp_HTTP_Server *eupnp_http_server_new(const char *addr, int port) EINA_ARG_NONNULL(1);
+void               eupnp_http_server_free(Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+int                eupnp_http_server_fd_get(const Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+int                eupnp_http_server_port_get(const Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_http_server_connections_get(const Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+double             eupnp_http_server_timeout_get(const Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_http_server_process(Eupnp_HTTP_Server *srv) EINA_ARG_NONNULL(1);
+
+Eina_Bool          eupnp_http_server_resource_add(Eupnp_HTTP_Server *srv, const char *path, const char *content_type, const void *body, size_t len) EINA_ARG_NONNULL(1,2,3,4);
+Eina_Bool          eupnp_http_server_file_add(Eupnp_HTTP_Server *srv, const char *path, const char *content_type, const char *filename) EINA_ARG_NONNULL(1,2,3,4);
+Eina_Bool          eupnp_http_server_resource_del(Eupnp_HTTP_Server *srv, const char *path) EINA_ARG_NONNULL(1,2);
+Eina_Bool          eupnp_http_server_handler_add(Eupnp_HTTP_Server *srv, const char *prefix, Eupnp_HTTP_Server_Handler_Cb cb, void *data) EINA_ARG_NONNULL(1,2,3);
+Eina_Bool          eupnp_http_server_handler_del(Eupnp_HTTP_Server *srv, const char *prefix) EINA_ARG_NONNULL(1,2);
+
+Eina_Bool          eupnp_http_server_respond(Eupnp_HTTP_Server_Request *req, int status, const char *reason, const char *content_type, const void *body, size_t len) EINA_ARG_NONNULL(1,3);
+
+
+#endif /* _EUPNP_HTTP_SERVER_H */
@@ -0,0 +1,381 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_intern.h"
+#include "eupnp_hash.h"
+
+/*
+ * Interned strings live on an array indexed by their ID. A linear probing
+ * table maps string hashes to IDs. Released IDs go to a free list and are
+ * handed out again before the array grows, keeping IDs dense.
+ *
+ * Each table is owned by a single user (e.g. a control point), so unlike
+ * eina_stringshare there's no global table shared by the whole process.
+ */
+
+typedef struct _Eupnp_Intern_Entry Eupnp_Intern_Entry;
+
+struct _Eupnp_Intern_Entry {
+   char *str;
+   uint32_t len;
+   uint32_t hash;
+   uint32_t refs;   /* next free ID when released */
+};
+
+struct _Eupnp_Intern {
+   Eupnp_Intern_Entry *entries;  /* entries[0] is unused, EUPNP_ID_NONE */
+   Eupnp_Id *table;              /* 0 for empty slots */
+   uint32_t entries_size;
+   uint32_t id_max;
+   uint32_t mask;
+   uint32_t count;
+   Eupnp_Id free_list;
+};
+
+
+/*
+ * Private API
+ */
+
+static uint32_t
+eupnp_intern_slot_find(const Eupnp_Intern *t, const char *str, size_t len, uint32_t hash)
+{
+   const Eupnp_Intern_Entry *e;
+   uint32_t i;
+
+   for (i = hash & t->mask; t->table[i]; i = (i + 1) & t->mask)
+     {
+	e = &t->entries[t->table[i]];
+	if (e->hash == hash && e->len == len && !memcmp(e->str, str, len))
+	   return i;
+     }
+
+   return i;
+}
+
+static void
+eupnp_intern_slot_del(Eupnp_Intern *t, uint32_t i)
+{
+   uint32_t j = i, k;
+
+   t->table[i] = 0;
+
+   for (;;)
+     {
+	j = (j + 1) & t->mask;
+
+	if (!t->table[j])
+	   return;
+
+	k = t->entries[t->table[j]].hash & t->mask;
+
+	if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+	   continue;
+
+	t->table[i] = t->table[j];
+	t->table[j] = 0;
+	i = j;
+     }
+}
+
+static Eina_Bool
+eupnp_intern_table_grow(Eupnp_Intern *t)
+{
+   Eupnp_Id *table;
+   uint32_t size = (t->mask + 1) * 2;
+   uint32_t id, i;
+
+   table = calloc(size, sizeof(Eupnp_Id));
+
+   if (!table)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not grow intern table.\n");
+	return EINA_FALSE;
+     }
+
+   for (id = 1; id <= t->id_max; id++)
+     {
+	if (!t->entries[id].str) continue;
+
+	for (i = t->entries[id].hash & (size - 1); table[i]; i = (i + 1) & (size - 1));
+	table[i] = id;
+     }
+
+   free(t->table);
+   t->table = table;
+   t->mask = size - 1;
+
+   return EINA_TRUE;
+}
+
+static Eupnp_Id
+eupnp_intern_id_new(Eupnp_Intern *t)
+{
+   Eupnp_Intern_Entry *entries;
+   Eupnp_Id id;
+   uint32_t size;
+
+   if (t->free_list)
+     {
+	id = t->free_list;
+	t->free_list = t->entries[id].refs;
+	return id;
+     }
+
+   if (t->id_max + 1 >= t->entries_size)
+     {
+	size = t->entries_size * 2;
+	entries = realloc(t->entries, size * sizeof(Eupnp_Intern_Entry));
+
+	if (!entries)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not grow intern entries.\n");
+	     return EUPNP_ID_NONE;
+	  }
+
+	memset(entries + t->entries_size, 0,
+	       (size - t->entries_size) * sizeof(Eupnp_Intern_Entry));
+	t->entries = entries;
+	t->entries_size = size;
+     }
+
+   return ++t->id_max;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Intern structure
+ *
+ * @return Eupnp_Intern instance or NULL on error.
+ */
+Eupnp_Intern *
+eupnp_intern_new(void)
+{
+   Eupnp_Intern *t;
+
+   t = calloc(1, sizeof(Eupnp_Intern));
+
+   if (!t)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create intern table.\n");
+	return NULL;
+     }
+
+   t->entries_size = 64;
+   t->mask = 127;
+   t->entries = calloc(t->entries_size, sizeof(Eupnp_Intern_Entry));
+   t->table = calloc(t->mask + 1, sizeof(Eupnp_Id));
+
+   if (!t->entries || !t->table)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create intern table.\n");
+	free(t->entries);
+	free(t->table);
+	free(t);
+	return NULL;
+     }
+
+   return t;
+}
+
+void
+eupnp_intern_free(Eupnp_Intern *t)
+{
+   Eupnp_Id id;
+
+   if (!t) return;
+
+   for (id = 1; id <= t->id_max; id++)
+      free(t->entries[id].str);
+
+   free(t->entries);
+   free(t->table);
+   free(t);
+}
+
+/*
+ * Interns a string
+ *
+ * If the string is already interned its reference count is increased,
+ * otherwise a copy is made and a new ID is assigned.
+ *
+ * @param t intern table
+ * @param str string, doesn't need to be NULL-terminated
+ * @param len string length
+ *
+ * @return ID of the string, to be released with eupnp_intern_unref(), or
+ *         EUPNP_ID_NONE on error.
+ */
+Eupnp_Id
+eupnp_intern_add(Eupnp_Intern *t, const char *str, size_t len)
+{
+   Eupnp_Intern_Entry *e;
+   uint32_t hash, slot;
+   Eupnp_Id id;
+
+   hash = eupnp_hash(str, len);
+   slot = eupnp_intern_slot_find(t, str, len, hash);
+
+   if (t->table[slot])
+     {
+	t->entries[t->table[slot]].refs++;
+	return t->table[slot];
+     }
+
+   if ((t->count + 1) * 2 > t->mask + 1)
+     {
+	if (!eupnp_intern_table_grow(t))
+	   return EUPNP_ID_NONE;
+	slot = eupnp_intern_slot_find(t, str, len, hash);
+     }
+
+   id = eupnp_intern_id_new(t);
+
+   if (id == EUPNP_ID_NONE)
+      return EUPNP_ID_NONE;
+
+   e = &t->entries[id];
+   e->str = malloc(len + 1);
+
+   if (!e->str)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not intern string.\n");
+	e->refs = t->free_list;
+	t->free_list = id;
+	return EUPNP_ID_NONE;
+     }
+
+   memcpy(e->str, str, len);
+   e->str[len] = '\0';
+   e->len = len;
+   e->hash = hash;
+   e->refs = 1;
+
+   t->table[slot] = id;
+   t->count++;
+
+   return id;
+}
+
+/*
+ * Looks up a string without interning it
+ *
+ * @return ID of the string or EUPNP_ID_NONE if not interned.
+ */
+Eupnp_Id
+eupnp_intern_find(const Eupnp_Intern *t, const char *str, size_t len)
+{
+   uint32_t slot;
+
+   slot = eupnp_intern_slot_find(t, str, len, eupnp_hash(str, len));
+   return t->table[slot];
+}
+
+/*
+ * Takes an extra reference on an interned string
+ *
+ * @return id
+ */
+Eupnp_Id
+eupnp_intern_ref(Eupnp_Intern *t, Eupnp_Id id)
+{
+   if (id == EUPNP_ID_NONE || id > t->id_max || !t->entries[id].str)
+      return EUPNP_ID_NONE;
+
+   t->entries[id].refs++;
+   return id;
+}
+
+/*
+ * Releases a reference on an interned string, freeing it and its ID when the
+ * last one is gone.
+ */
+void
+eupnp_intern_unref(Eupnp_Intern *t, Eupnp_Id id)
+{
+   Eupnp_Intern_Entry *e;
+
+   if (id == EUPNP_ID_NONE || id > t->id_max) return;
+
+   e = &t->entries[id];
+
+   if (!e->str || --e->refs) return;
+
+   eupnp_intern_slot_del(t, eupnp_intern_slot_find(t, e->str, e->len, e->hash));
+
+   free(e->str);
+   e->str = NULL;
+   e->refs = t->free_list;
+   t->free_list = id;
+   t->count--;
+}
+
+/*
+ * Retrieves an interned string
+ *
+ * @return NULL-terminated string, valid while referenced, or NULL if id is not
+ *         in use.
+ */
+const char *
+eupnp_intern_str_get(const Eupnp_Intern *t, Eupnp_Id id)
+{
+   if (id == EUPNP_ID_NONE || id > t->id_max) return NULL;
+   return t->entries[id].str;
+}
+
+size_t
+eupnp_intern_len_get(const Eupnp_Intern *t, Eupnp_Id id)
+{
+   if (id == EUPNP_ID_NONE || id > t->id_max) return 0;
+   return t->entries[id].len;
+}
+
+/*
+ * Retrieves the highest ID ever handed out. Arrays indexed by ID need
+ * eupnp_intern_id_max_get() + 1 elements.
+ */
+Eupnp_Id
+eupnp_intern_id_max_get(const Eupnp_Intern *t)
+{
+   return t->id_max;
+}
+
+/*
+ * Retrieves the number of strings interned
+ */
+unsigned int
+eupnp_intern_count_get(const Eupnp_Intern *t)
+{
+   return t->count;
+}
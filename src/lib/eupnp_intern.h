@@ -0,0 +1,51 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_INTERN_H
+#define _EUPNP_INTERN_H
+
+#include <stdint.h>
+#include <Eina.h>
+
+/*
+ * Dense identifier of an interned string. IDs start at 1 and are reused once
+ * released, so they can index plain arrays.
+ */
+typedef uint32_t Eupnp_Id;
+
+#define EUPNP_ID_NONE 0
+
+typedef struct _Eupnp_Intern Eupnp_Intern;
+
+
+Eupnp_Intern        *eupnp_intern_new(void);
+void                 eupnp_intern_free(Eupnp_Intern *t) EINA_ARG_NONNULL(1);
+Eupnp_Id             eupnp_intern_add(Eupnp_Intern *t, const char *str, size_t len) EINA_ARG_NONNULL(1,2);
+Eupnp_Id             eupnp_intern_find(const Eupnp_Intern *t, const char *str, size_t len) EINA_ARG_NONNULL(1,2);
+Eupnp_Id             eupnp_intern_ref(Eupnp_Intern *t, Eupnp_Id id) EINA_ARG_NONNULL(1);
+void                 eupnp_intern_unref(Eupnp_Intern *t, Eupnp_Id id) EINA_ARG_NONNULL(1);
+const char          *eupnp_intern_str_get(const Eupnp_Intern *t, Eupnp_Id id) EINA_ARG_NONNULL(1);
+size_t               eupnp_intern_len_get(const Eupnp_Intern *t, Eupnp_Id id) EINA_ARG_NONNULL(1);
+Eupnp_Id             eupnp_intern_id_max_get(const Eupnp_Intern *t) EINA_ARG_NONNULL(1);
+unsigned int         eupnp_intern_count_get(const Eupnp_Intern *t) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_INTERN_H */
@@ -0,0 +1,742 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_soap.h"
+#include "eupnp_last_change.h"
+
+/*
+ * Two small state machines: the outer one walks the GENA property set and
+ * decodes entities of property values. Decoded bytes of the LastChange
+ * property are handed one at a time to the inner one, which parses the
+ * LastChange document and decodes entities of its attribute values. Nothing
+ * is buffered but names, the value being read and the values completed,
+ * which are staged per variable and only applied to the table once the whole
+ * body decoded.
+ */
+
+/* Longest entity, e.g. &#x10FFFF; */
+#define EUPNP_LAST_CHANGE_MAX_ENTITY 12
+
+typedef enum {
+   EUPNP_LAST_CHANGE_TEXT,
+   EUPNP_LAST_CHANGE_TAG_OPEN,
+   EUPNP_LAST_CHANGE_TAG_NAME,
+   EUPNP_LAST_CHANGE_ATTRS,
+   EUPNP_LAST_CHANGE_ATTR_NAME,
+   EUPNP_LAST_CHANGE_ATTR_EQ,
+   EUPNP_LAST_CHANGE_ATTR_VALUE,
+   EUPNP_LAST_CHANGE_SKIP,
+   EUPNP_LAST_CHANGE_BANG,
+   EUPNP_LAST_CHANGE_CDATA
+} Eupnp_Last_Change_State;
+
+typedef enum {
+   EUPNP_LAST_CHANGE_ATTR_NONE,
+   EUPNP_LAST_CHANGE_ATTR_VAL,
+   EUPNP_LAST_CHANGE_ATTR_CHANNEL
+} Eupnp_Last_Change_Attr;
+
+typedef struct _Eupnp_Last_Change_Name Eupnp_Last_Change_Name;
+typedef struct _Eupnp_Last_Change_Staged Eupnp_Last_Change_Staged;
+
+/* Local name, without namespace prefix. len is past the buffer on overflow. */
+struct _Eupnp_Last_Change_Name {
+   char buf[EUPNP_LAST_CHANGE_MAX_NAME];
+   size_t len;
+};
+
+/* Value of a variable decoded from the current body, not yet applied */
+struct _Eupnp_Last_Change_Staged {
+   char *value;
+   size_t len;
+   size_t size;
+   Eina_Bool set;
+};
+
+struct _Eupnp_Last_Change_Decoder {
+   Eupnp_State_Table *table;
+   unsigned int instance_id;
+   Eina_Bool failed;
+   Eupnp_Last_Change_Staged *staged;  /* One per table variable */
+
+   /* Property set */
+   Eupnp_Last_Change_State ostate;
+   Eupnp_Last_Change_Name oname;
+   Eina_Bool oclosing;
+   Eina_Bool oself_closing;
+   char oquote;
+   unsigned int depth;
+   unsigned int property_depth;    /* 0 outside properties */
+   Eina_Bool in_variable;
+   Eina_Bool last_change;
+   Eupnp_Last_Change_Name variable;
+   char oentity[EUPNP_LAST_CHANGE_MAX_ENTITY];
+   size_t oentity_len;
+   unsigned int ocdata;            /* "<![CDATA[" or "]]" matched so far */
+
+   /* LastChange document */
+   Eupnp_Last_Change_State istate;
+   Eupnp_Last_Change_Name iname;
+   Eina_Bool iclosing;
+   Eupnp_Last_Change_Name aname;
+   Eupnp_Last_Change_Attr attr;
+   char iquote;
+   Eupnp_Last_Change_Name channel;
+   Eina_Bool has_channel;
+   Eina_Bool has_val;
+   char ientity[EUPNP_LAST_CHANGE_MAX_ENTITY];
+   size_t ientity_len;
+   long instance;                  /* -1 outside InstanceID */
+
+   /* Value being read */
+   char *value;
+   size_t value_len;
+   size_t value_size;
+};
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+
+/*
+ * Private API
+ */
+
+static void
+_eupnp_last_change_name_append(Eupnp_Last_Change_Name *n, char c)
+{
+   // Drop the namespace prefix
+   if (c == ':' && n->len <= sizeof(n->buf))
+     {
+	n->len = 0;
+	return;
+     }
+
+   if (n->len < sizeof(n->buf)) n->buf[n->len] = c;
+   if (n->len <= sizeof(n->buf)) n->len++;
+}
+
+static Eina_Bool
+_eupnp_last_change_name_is(const Eupnp_Last_Change_Name *n, const char *s, size_t len)
+{
+   return n->len == len && !memcmp(n->buf, s, len);
+}
+
+static void
+_eupnp_last_change_value_append(Eupnp_Last_Change_Decoder *d, const char *s, size_t len)
+{
+   if (d->value_len + len > d->value_size)
+     {
+	size_t size = d->value_size ? d->value_size * 2 : 256;
+	char *tmp;
+
+	while (size < d->value_len + len) size *= 2;
+
+	if (size > EUPNP_LAST_CHANGE_MAX_VALUE)
+	  {
+	     WARN("Event value too long, dropping event\n");
+	     d->failed = EINA_TRUE;
+	     return;
+	  }
+
+	tmp = realloc(d->value, size);
+
+	if (!tmp)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not decode event value.\n");
+	     d->failed = EINA_TRUE;
+	     return;
+	  }
+
+	d->value = tmp;
+	d->value_size = size;
+     }
+
+   memcpy(d->value + d->value_len, s, len);
+   d->value_len += len;
+}
+
+/*
+ * Appends a complete entity to the value, decoded if known, as is otherwise
+ */
+static void
+_eupnp_last_change_entity_append(Eupnp_Last_Change_Decoder *d, const char *entity, size_t len)
+{
+   char utf8[4];
+   unsigned long cp;
+
+   if (eupnp_soap_entity_decode(entity, entity + len, &cp) == len)
+      _eupnp_last_change_value_append(d, utf8, eupnp_soap_utf8_put(utf8, sizeof(utf8), cp));
+   else
+      _eupnp_last_change_value_append(d, entity, len);
+}
+
+/*
+ * Stages the value read for a variable. A variable set twice in the same
+ * body keeps the last value.
+ */
+static void
+_eupnp_last_change_commit(Eupnp_Last_Change_Decoder *d, const Eupnp_Last_Change_Name *name, const Eupnp_Last_Change_Name *channel)
+{
+   Eupnp_Last_Change_Staged *st;
+   int index;
+
+   if (name->len > sizeof(name->buf)) return;
+   if (channel && channel->len > sizeof(channel->buf)) return;
+
+   index = eupnp_state_table_find(d->table, name->buf, name->len,
+				  channel ? channel->buf : NULL,
+				  channel ? channel->len : 0);
+
+   if (index < 0) return;
+
+   st = &d->staged[index];
+
+   if (d->value_len > st->size)
+     {
+	char *tmp = realloc(st->value, d->value_len);
+
+	if (!tmp)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not stage event value.\n");
+	     d->failed = EINA_TRUE;
+	     return;
+	  }
+
+	st->value = tmp;
+	st->size = d->value_len;
+     }
+
+   if (d->value_len) memcpy(st->value, d->value, d->value_len);
+   st->len = d->value_len;
+   st->set = EINA_TRUE;
+}
+
+/*
+ * End of a tag of the LastChange document
+ */
+static void
+_eupnp_last_change_inner_tag_end(Eupnp_Last_Change_Decoder *d)
+{
+   if (_eupnp_last_change_name_is(&d->iname, "InstanceID", 10))
+     {
+	if (d->iclosing || !d->has_val)
+	   d->instance = -1;
+	else
+	  {
+	     char *e;
+
+	     _eupnp_last_change_value_append(d, "", 1);
+	     d->instance = d->failed ? -1 : strtol(d->value, &e, 10);
+	     // Empty or trailing garbage
+	     if (d->instance >= 0 && (e == d->value || *e)) d->instance = -1;
+	  }
+     }
+   else if (!d->iclosing && d->has_val && d->instance >= 0 &&
+	    (unsigned long)d->instance == d->instance_id)
+      _eupnp_last_change_commit(d, &d->iname, d->has_channel ? &d->channel : NULL);
+
+   d->istate = EUPNP_LAST_CHANGE_TEXT;
+   d->iname.len = 0;
+   d->iclosing = EINA_FALSE;
+   d->has_val = EINA_FALSE;
+   d->has_channel = EINA_FALSE;
+   d->value_len = 0;
+}
+
+/*
+ * Handles a byte of the LastChange document, once unescaped from the property
+ * set
+ */
+static void
+_eupnp_last_change_inner_byte(Eupnp_Last_Change_Decoder *d, char c)
+{
+   switch (d->istate)
+     {
+      case EUPNP_LAST_CHANGE_TEXT:
+	 if (c == '<') d->istate = EUPNP_LAST_CHANGE_TAG_OPEN;
+	 break;
+      case EUPNP_LAST_CHANGE_TAG_OPEN:
+	 if (c == '/')
+	    d->iclosing = EINA_TRUE;
+	 else if (c == '?' || c == '!')
+	    d->istate = EUPNP_LAST_CHANGE_SKIP;
+	 else
+	   {
+	      _eupnp_last_change_name_append(&d->iname, c);
+	      d->istate = EUPNP_LAST_CHANGE_TAG_NAME;
+	   }
+	 break;
+      case EUPNP_LAST_CHANGE_TAG_NAME:
+	 if (c == '>')
+	    _eupnp_last_change_inner_tag_end(d);
+	 else if (IS_SPACE(c) || c == '/')
+	    d->istate = EUPNP_LAST_CHANGE_ATTRS;
+	 else
+	    _eupnp_last_change_name_append(&d->iname, c);
+	 break;
+      case EUPNP_LAST_CHANGE_ATTRS:
+	 if (c == '>')
+	    _eupnp_last_change_inner_tag_end(d);
+	 else if (!IS_SPACE(c) && c != '/')
+	   {
+	      d->aname.len = 0;
+	      _eupnp_last_change_name_append(&d->aname, c);
+	      d->istate = EUPNP_LAST_CHANGE_ATTR_NAME;
+	   }
+	 break;
+      case EUPNP_LAST_CHANGE_ATTR_NAME:
+	 if (c == '=' || IS_SPACE(c))
+	    d->istate = EUPNP_LAST_CHANGE_ATTR_EQ;
+	 else
+	    _eupnp_last_change_name_append(&d->aname, c);
+	 break;
+      case EUPNP_LAST_CHANGE_ATTR_EQ:
+	 if (c != '"' && c != '\'') break;
+
+	 d->iquote = c;
+	 d->ientity_len = 0;
+	 d->istate = EUPNP_LAST_CHANGE_ATTR_VALUE;
+
+	 if (_eupnp_last_change_name_is(&d->aname, "val", 3))
+	   {
+	      d->attr = EUPNP_LAST_CHANGE_ATTR_VAL;
+	      d->value_len = 0;
+	   }
+	 else if (_eupnp_last_change_name_is(&d->aname, "channel", 7))
+	   {
+	      d->attr = EUPNP_LAST_CHANGE_ATTR_CHANNEL;
+	      d->channel.len = 0;
+	   }
+	 else
+	    d->attr = EUPNP_LAST_CHANGE_ATTR_NONE;
+	 break;
+      case EUPNP_LAST_CHANGE_ATTR_VALUE:
+	 if (d->ientity_len)
+	   {
+	      // Entities only make it to val, channels are plain names
+	      d->ientity[d->ientity_len++] = c;
+
+	      if (c == ';' || d->ientity_len == sizeof(d->ientity))
+		{
+		   if (d->attr == EUPNP_LAST_CHANGE_ATTR_VAL)
+		      _eupnp_last_change_entity_append(d, d->ientity, d->ientity_len);
+		   d->ientity_len = 0;
+		}
+	      break;
+	   }
+
+	 if (c == d->iquote)
+	   {
+	      if (d->attr == EUPNP_LAST_CHANGE_ATTR_VAL) d->has_val = EINA_TRUE;
+	      else if (d->attr == EUPNP_LAST_CHANGE_ATTR_CHANNEL) d->has_channel = EINA_TRUE;
+	      d->istate = EUPNP_LAST_CHANGE_ATTRS;
+	   }
+	 else if (c == '&')
+	    d->ientity[d->ientity_len++] = c;
+	 else if (d->attr == EUPNP_LAST_CHANGE_ATTR_VAL)
+	    _eupnp_last_change_value_append(d, &c, 1);
+	 else if (d->attr == EUPNP_LAST_CHANGE_ATTR_CHANNEL)
+	    _eupnp_last_change_name_append(&d->channel, c);
+	 break;
+      case EUPNP_LAST_CHANGE_SKIP:
+	 if (c == '>')
+	   {
+	      d->istate = EUPNP_LAST_CHANGE_TEXT;
+	      d->iclosing = EINA_FALSE;
+	   }
+	 break;
+      default:
+	 break;
+     }
+}
+
+/*
+ * Handles a byte of a property value, once unescaped
+ */
+static void
+_eupnp_last_change_text(Eupnp_Last_Change_Decoder *d, const char *s, size_t len)
+{
+   size_t i;
+
+   if (!d->last_change)
+     {
+	_eupnp_last_change_value_append(d, s, len);
+	return;
+     }
+
+   for (i = 0; i < len; i++)
+      _eupnp_last_change_inner_byte(d, s[i]);
+}
+
+/*
+ * End of a tag of the property set
+ */
+static void
+_eupnp_last_change_outer_tag_end(Eupnp_Last_Change_Decoder *d)
+{
+   d->ostate = EUPNP_LAST_CHANGE_TEXT;
+
+   if (d->oclosing)
+     {
+	if (d->in_variable && d->depth == d->property_depth + 1)
+	  {
+	     if (!d->last_change) _eupnp_last_change_commit(d, &d->variable, NULL);
+	     d->in_variable = EINA_FALSE;
+	     d->last_change = EINA_FALSE;
+	     d->value_len = 0;
+	  }
+	else if (d->depth == d->property_depth)
+	   d->property_depth = 0;
+
+	if (d->depth) d->depth--;
+	return;
+     }
+
+   if (!d->oself_closing) d->depth++;
+
+   if (!d->property_depth && _eupnp_last_change_name_is(&d->oname, "property", 8))
+     {
+	if (!d->oself_closing) d->property_depth = d->depth;
+	return;
+     }
+
+   if (!d->property_depth || d->in_variable ||
+       d->depth != d->property_depth + !d->oself_closing)
+      return;
+
+   d->variable = d->oname;
+   d->value_len = 0;
+
+   if (d->oself_closing)
+     {
+	// Empty value
+	_eupnp_last_change_commit(d, &d->variable, NULL);
+	return;
+     }
+
+   d->in_variable = EINA_TRUE;
+   d->last_change = _eupnp_last_change_name_is(&d->oname, "LastChange", 10);
+   d->istate = EUPNP_LAST_CHANGE_TEXT;
+   d->iname.len = 0;
+   d->iclosing = EINA_FALSE;
+   d->has_val = EINA_FALSE;
+   d->has_channel = EINA_FALSE;
+   d->instance = -1;
+}
+
+static void
+_eupnp_last_change_outer_byte(Eupnp_Last_Change_Decoder *d, char c)
+{
+   switch (d->ostate)
+     {
+      case EUPNP_LAST_CHANGE_TEXT:
+	 if (d->oentity_len)
+	   {
+	      d->oentity[d->oentity_len++] = c;
+
+	      if (c == ';' || d->oentity_len == sizeof(d->oentity))
+		{
+		   char utf8[4];
+		   unsigned long cp;
+
+		   if (d->in_variable)
+		     {
+			if (eupnp_soap_entity_decode(d->oentity, d->oentity + d->oentity_len, &cp) == d->oentity_len)
+			   _eupnp_last_change_text(d, utf8, eupnp_soap_utf8_put(utf8, sizeof(utf8), cp));
+			else
+			   _eupnp_last_change_text(d, d->oentity, d->oentity_len);
+		     }
+		   d->oentity_len = 0;
+		}
+	   }
+	 else if (c == '<')
+	   {
+	      d->ostate = EUPNP_LAST_CHANGE_TAG_OPEN;
+	      d->oname.len = 0;
+	      d->oclosing = EINA_FALSE;
+	      d->oself_closing = EINA_FALSE;
+	   }
+	 else if (c == '&')
+	    d->oentity[d->oentity_len++] = c;
+	 else if (d->in_variable)
+	    _eupnp_last_change_text(d, &c, 1);
+	 break;
+      case EUPNP_LAST_CHANGE_TAG_OPEN:
+	 if (c == '/')
+	    d->oclosing = EINA_TRUE;
+	 else if (c == '!')
+	   {
+	      d->ostate = EUPNP_LAST_CHANGE_BANG;
+	      d->ocdata = 0;
+	   }
+	 else if (c == '?')
+	    d->ostate = EUPNP_LAST_CHANGE_SKIP;
+	 else
+	   {
+	      _eupnp_last_change_name_append(&d->oname, c);
+	      d->ostate = EUPNP_LAST_CHANGE_TAG_NAME;
+	   }
+	 break;
+      case EUPNP_LAST_CHANGE_BANG:
+	 // Some devices send LastChange unescaped, in a CDATA section
+	 if (c != "[CDATA["[d->ocdata])
+	   {
+	      d->ostate = (c == '>') ? EUPNP_LAST_CHANGE_TEXT : EUPNP_LAST_CHANGE_SKIP;
+	      break;
+	   }
+
+	 if (++d->ocdata == 7)
+	   {
+	      d->ostate = EUPNP_LAST_CHANGE_CDATA;
+	      d->ocdata = 0;
+	   }
+	 break;
+      case EUPNP_LAST_CHANGE_CDATA:
+	 if (c == ']')
+	   {
+	      // Held back until known not to end the section
+	      if (++d->ocdata <= 2) break;
+	      d->ocdata = 2;
+	   }
+	 else if (c == '>' && d->ocdata == 2)
+	   {
+	      d->ostate = EUPNP_LAST_CHANGE_TEXT;
+	      d->ocdata = 0;
+	      break;
+	   }
+	 else
+	   {
+	      for (; d->ocdata; d->ocdata--)
+		 if (d->in_variable) _eupnp_last_change_text(d, "]", 1);
+	   }
+
+	 if (d->in_variable) _eupnp_last_change_text(d, &c, 1);
+	 break;
+      case EUPNP_LAST_CHANGE_TAG_NAME:
+	 if (c == '>')
+	    _eupnp_last_change_outer_tag_end(d);
+	 else if (c == '/')
+	    d->oself_closing = EINA_TRUE;
+	 else if (IS_SPACE(c))
+	    d->ostate = EUPNP_LAST_CHANGE_ATTRS;
+	 else
+	    _eupnp_last_change_name_append(&d->oname, c);
+	 break;
+      case EUPNP_LAST_CHANGE_ATTRS:
+	 // Attributes (namespaces) are not needed, only skipped
+	 if (d->oquote)
+	   {
+	      if (c == d->oquote) d->oquote = 0;
+	   }
+	 else if (c == '"' || c == '\'')
+	    d->oquote = c;
+	 else if (c == '/')
+	    d->oself_closing = EINA_TRUE;
+	 else if (c == '>')
+	    _eupnp_last_change_outer_tag_end(d);
+	 else if (!IS_SPACE(c))
+	    d->oself_closing = EINA_FALSE;
+	 break;
+      case EUPNP_LAST_CHANGE_SKIP:
+	 if (c == '>') d->ostate = EUPNP_LAST_CHANGE_TEXT;
+	 break;
+      default:
+	 break;
+     }
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Last_Change_Decoder structure
+ *
+ * @param t state table of the service, must outlive the decoder
+ * @param instance_id LastChange instance to apply, usually 0
+ *
+ * @return Eupnp_Last_Change_Decoder instance or NULL on error.
+ */
+Eupnp_Last_Change_Decoder *
+eupnp_last_change_decoder_new(Eupnp_State_Table *t, unsigned int instance_id)
+{
+   Eupnp_Last_Change_Decoder *d;
+
+   d = calloc(1, sizeof(Eupnp_Last_Change_Decoder));
+
+   if (!d)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create LastChange decoder.\n");
+	return NULL;
+     }
+
+   // One spare, so that an empty table does not look like a failure
+   d->staged = calloc(eupnp_state_table_count_get(t) + 1, sizeof(Eupnp_Last_Change_Staged));
+
+   if (!d->staged)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create LastChange decoder.\n");
+	free(d);
+	return NULL;
+     }
+
+   d->table = t;
+   d->instance_id = instance_id;
+   eupnp_last_change_decoder_reset(d);
+
+   return d;
+}
+
+void
+eupnp_last_change_decoder_free(Eupnp_Last_Change_Decoder *d)
+{
+   unsigned int i;
+
+   if (!d) return;
+
+   for (i = 0; i < eupnp_state_table_count_get(d->table); i++)
+      free(d->staged[i].value);
+
+   free(d->staged);
+   free(d->value);
+   free(d);
+}
+
+/*
+ * Prepares the decoder for a new event body
+ */
+void
+eupnp_last_change_decoder_reset(Eupnp_Last_Change_Decoder *d)
+{
+   unsigned int i;
+
+   for (i = 0; i < eupnp_state_table_count_get(d->table); i++)
+      d->staged[i].set = EINA_FALSE;
+
+   d->failed = EINA_FALSE;
+   d->ostate = EUPNP_LAST_CHANGE_TEXT;
+   d->oquote = 0;
+   d->oentity_len = 0;
+   d->ocdata = 0;
+   d->depth = 0;
+   d->property_depth = 0;
+   d->in_variable = EINA_FALSE;
+   d->last_change = EINA_FALSE;
+   d->istate = EUPNP_LAST_CHANGE_TEXT;
+   d->ientity_len = 0;
+   d->instance = -1;
+   d->value_len = 0;
+}
+
+/*
+ * Feeds a piece of an event body, staging the variables it completes. The
+ * table is left untouched until eupnp_last_change_decoder_end().
+ *
+ * @param d decoder
+ * @param data body piece, split anywhere
+ * @param len piece length
+ *
+ * @return EINA_FALSE if the event must be dropped (e.g. a value is too long),
+ *         EINA_TRUE otherwise.
+ */
+Eina_Bool
+eupnp_last_change_decoder_feed(Eupnp_Last_Change_Decoder *d, const char *data, size_t len)
+{
+   const char *end = data + len;
+   const char *lt;
+
+   if (d->failed) return EINA_FALSE;
+
+   while (data < end && !d->failed)
+     {
+	// Plain text outside properties is skipped at once
+	if (d->ostate == EUPNP_LAST_CHANGE_TEXT && !d->in_variable && !d->oentity_len)
+	  {
+	     lt = memchr(data, '<', end - data);
+	     if (!lt) break;
+	     data = lt;
+	  }
+
+	_eupnp_last_change_outer_byte(d, *data++);
+     }
+
+   return !d->failed;
+}
+
+/*
+ * Ends an event body, applying its variables to the table if it decoded
+ * completely. A dropped or truncated event changes nothing.
+ *
+ * @return number of variables the event changed, -1 if the event was
+ *         dropped or truncated.
+ */
+int
+eupnp_last_change_decoder_end(Eupnp_Last_Change_Decoder *d)
+{
+   Eupnp_Last_Change_Staged *st;
+   unsigned int i;
+   int changes = 0;
+
+   if (d->failed || d->depth || d->ostate != EUPNP_LAST_CHANGE_TEXT)
+     {
+	eupnp_last_change_decoder_reset(d);
+	return -1;
+     }
+
+   for (i = 0; i < eupnp_state_table_count_get(d->table); i++)
+     {
+	st = &d->staged[i];
+
+	if (st->set && eupnp_state_table_value_set(d->table, i, st->value ? st->value : "", st->len))
+	   changes++;
+     }
+
+   eupnp_last_change_decoder_reset(d);
+
+   return changes;
+}
+
+/*
+ * Decodes a whole event body
+ *
+ * @return number of variables the event changed, -1 if the event was
+ *         dropped or truncated.
+ */
+int
+eupnp_last_change_decode(Eupnp_Last_Change_Decoder *d, const char *body, size_t len)
+{
+   eupnp_last_change_decoder_reset(d);
+   eupnp_last_change_decoder_feed(d, body, len);
+   return eupnp_last_change_decoder_end(d);
+}
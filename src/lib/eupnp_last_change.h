@@ -0,0 +1,62 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_LAST_CHANGE_H
+#define _EUPNP_LAST_CHANGE_H
+
+#include <Eina.h>
+#include <eupnp_state_table.h>
+
+/*
+ * Longest variable, attribute or channel name, and longest value handled.
+ * Longer names never match, longer values fail the event.
+ */
+#define EUPNP_LAST_CHANGE_MAX_NAME 64
+#define EUPNP_LAST_CHANGE_MAX_VALUE 65536
+
+/*
+ * Decodes GENA event bodies into a state table.
+ *
+ * Properties of the event property set update the variables of the same
+ * name. The LastChange property (AVTransport, RenderingControl) carries an
+ * escaped XML document listing the variables changed for each instance:
+ *
+ *   <Event><InstanceID val="0"><TransportState val="PLAYING"/>
+ *   <Volume channel="Master" val="20"/></InstanceID></Event>
+ *
+ * It is unescaped and parsed in the same pass as the property set, byte by
+ * byte, so bodies can be fed in pieces as they are received. Values are
+ * staged and applied to the table when the body ends, and only if all of it
+ * decoded: a dropped or truncated event leaves the table as it was. Only the
+ * instance given to the decoder is applied.
+ */
+typedef struct _Eupnp_Last_Change_Decoder Eupnp_Last_Change_Decoder;
+
+
+Eupnp_Last_Change_Decoder *eupnp_last_change_decoder_new(Eupnp_State_Table *t, unsigned int instance_id) EINA_ARG_NONNULL(1);
+void                       eupnp_last_change_decoder_free(Eupnp_Last_Change_Decoder *d) EINA_ARG_NONNULL(1);
+void                       eupnp_last_change_decoder_reset(Eupnp_Last_Change_Decoder *d) EINA_ARG_NONNULL(1);
+Eina_Bool                  eupnp_last_change_decoder_feed(Eupnp_Last_Change_Decoder *d, const char *data, size_t len) EINA_ARG_NONNULL(1,2);
+int                        eupnp_last_change_decoder_end(Eupnp_Last_Change_Decoder *d) EINA_ARG_NONNULL(1);
+int                        eupnp_last_change_decode(Eupnp_Last_Change_Decoder *d, const char *body, size_t len) EINA_ARG_NONNULL(1,2);
+
+
+#endif /* _EUPNP_LAST_CHANGE_H */
@@ -0,0 +1,188 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <string.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_metrics.h"
+
+/*
+ * Private API
+ */
+
+static int
+eupnp_histogram_bucket_get(double usec)
+{
+   unsigned long v;
+   int i = 0;
+
+   if (usec < 1) return 0;
+
+   v = (unsigned long) usec;
+
+   while (v && i < EUPNP_HISTOGRAM_BUCKETS - 1)
+     {
+	v >>= 1;
+	i++;
+     }
+
+   return i;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Accounts a value on the histogram
+ *
+ * @param h histogram
+ * @param usec value in microseconds. Negative values (e.g. clock steps) are
+ *        accounted as 0.
+ */
+void
+eupnp_histogram_add(Eupnp_Histogram *h, double usec)
+{
+   if (usec < 0) usec = 0;
+
+   h->buckets[eupnp_histogram_bucket_get(usec)]++;
+   h->count++;
+   h->sum += usec;
+   if (usec > h->max) h->max = usec;
+}
+
+void
+eupnp_histogram_reset(Eupnp_Histogram *h)
+{
+   memset(h, 0, sizeof(Eupnp_Histogram));
+}
+
+/*
+ * Retrieves an estimate of the p-th percentile
+ *
+ * @param h histogram
+ * @param p percentile, between 0 and 1
+ *
+ * @return upper bound, in microseconds, of the bucket holding the percentile
+ *         or 0 if the histogram is empty.
+ */
+double
+eupnp_histogram_percentile_get(const Eupnp_Histogram *h, double p)
+{
+   unsigned long target, acc = 0;
+   int i;
+
+   if (!h->count) return 0;
+
+   target = (unsigned long)(p * h->count);
+   if (target >= h->count) target = h->count - 1;
+
+   for (i = 0; i < EUPNP_HISTOGRAM_BUCKETS; i++)
+     {
+	acc += h->buckets[i];
+	if (acc > target)
+	   return (i == EUPNP_HISTOGRAM_BUCKETS - 1) ? h->max : (double)(1UL << i);
+     }
+
+   return h->max;
+}
+
+double
+eupnp_histogram_mean_get(const Eupnp_Histogram *h)
+{
+   if (!h->count) return 0;
+   return h->sum / h->count;
+}
+
+/*
+ * Prints out the histogram buckets
+ *
+ * Use EINA_ERROR_LEVEL=2 for seeing the printed messages.
+ */
+void
+eupnp_histogram_dump(const Eupnp_Histogram *h, const char *name)
+{
+   int i;
+
+   INFO("%s: count %lu mean %.1fus p50 %.0fus p99 %.0fus max %.0fus\n", name,
+	h->count, eupnp_histogram_mean_get(h),
+	eupnp_histogram_percentile_get(h, 0.5),
+	eupnp_histogram_percentile_get(h, 0.99), h->max);
+
+   for (i = 0; i < EUPNP_HISTOGRAM_BUCKETS; i++)
+      if (h->buckets[i])
+	 INFO("* < %luus: %lu\n", 1UL << i, h->buckets[i]);
+}
+
+void
+eupnp_metrics_reset(Eupnp_Metrics *m)
+{
+   memset(m, 0, sizeof(Eupnp_Metrics));
+}
+
+/*
+ * Retrieves a short printable name of a message class
+ *
+ * @return class name, "unknown" for values out of range.
+ */
+const char *
+eupnp_metrics_class_name_get(Eupnp_SSDP_Message_Class cls)
+{
+   static const char *names[EUPNP_SSDP_MESSAGE_CLASSES] = {
+      [EUPNP_SSDP_MESSAGE_UNKNOWN] = "unknown",
+      [EUPNP_SSDP_MESSAGE_RESPONSE] = "response",
+      [EUPNP_SSDP_MESSAGE_NOTIFY_ALIVE] = "alive",
+      [EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE] = "byebye",
+      [EUPNP_SSDP_MESSAGE_NOTIFY_UPDATE] = "update",
+      [EUPNP_SSDP_MESSAGE_MSEARCH] = "m-search"
+   };
+
+   if ((unsigned int)cls >= EUPNP_SSDP_MESSAGE_CLASSES)
+      return names[EUPNP_SSDP_MESSAGE_UNKNOWN];
+
+   return names[cls];
+}
+
+/*
+ * Prints out the metrics
+ *
+ * Use EINA_ERROR_LEVEL=2 for seeing the printed messages.
+ */
+void
+eupnp_metrics_dump(const Eupnp_Metrics *m)
+{
+   int i;
+
+   INFO("Datagrams: %lu\n", m->datagrams);
+   INFO("Overload transitions: %lu\n", m->overload_transitions);
+   INFO("Rate limited: %lu\n", m->rate_limited);
+   INFO("Filtered: %lu\n", m->filtered);
+   INFO("Truncated: %lu\n", m->truncated);
+   INFO("Kernel dropped: %lu\n", m->kernel_dropped);
+
+   for (i = 0; i < EUPNP_SSDP_MESSAGE_CLASSES; i++)
+      INFO("* %s: received %lu shed %lu\n", eupnp_metrics_class_name_get(i),
+	   m->received[i], m->shed[i]);
+
+   eupnp_histogram_dump(&m->queue_delay, "Queue delay");
+   eupnp_histogram_dump(&m->process_delay, "Process delay");
+}
@@ -0,0 +1,100 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_METRICS_H
+#define _EUPNP_METRICS_H
+
+#include <Eina.h>
+
+/*
+ * Log2 histogram of microsecond values. Bucket 0 holds values below 1us and
+ * bucket i (i > 0) holds values in [2^(i-1), 2^i) us. The last bucket also
+ * holds everything above its lower bound (~8s).
+ */
+#define EUPNP_HISTOGRAM_BUCKETS 24
+
+typedef struct _Eupnp_Histogram Eupnp_Histogram;
+typedef struct _Eupnp_Metrics Eupnp_Metrics;
+
+/*
+ * SSDP message classes, see eupnp_ssdp_message_classify(). Declared here as
+ * the metrics are indexed by them.
+ */
+typedef enum {
+   EUPNP_SSDP_MESSAGE_UNKNOWN,
+   EUPNP_SSDP_MESSAGE_RESPONSE,
+   EUPNP_SSDP_MESSAGE_NOTIFY_ALIVE,
+   EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE,
+   EUPNP_SSDP_MESSAGE_NOTIFY_UPDATE,
+   EUPNP_SSDP_MESSAGE_MSEARCH,
+   EUPNP_SSDP_MESSAGE_CLASSES /* number of classes, not a class */
+} Eupnp_SSDP_Message_Class;
+
+
+struct _Eupnp_Histogram {
+   unsigned long buckets[EUPNP_HISTOGRAM_BUCKETS];
+   unsigned long count;
+   double sum;
+   double max;
+};
+
+/*
+ * Counters kept by the SSDP server.
+ *
+ * queue_delay is the time a datagram waited on the socket queue (kernel
+ * receive timestamp until the handler picked it up), process_delay the time
+ * the handler spent on it. Both in microseconds.
+ *
+ * received and shed count datagrams per message class. Shed datagrams were
+ * dropped by the overload policy without being parsed. rate_limited counts
+ * datagrams dropped because their source was over its rate or quarantined.
+ * filtered counts messages discarded because nobody was interested in their
+ * target. truncated counts datagrams discarded because they did not fit in
+ * the receive buffer. kernel_dropped counts datagrams the kernel dropped
+ * because the socket receive buffer was full, as reported along with
+ * received datagrams (SO_RXQ_OVFL); it stays 0 where unsupported.
+ */
+struct _Eupnp_Metrics {
+   Eupnp_Histogram queue_delay;
+   Eupnp_Histogram process_delay;
+   unsigned long datagrams;
+   unsigned long overload_transitions;
+   unsigned long rate_limited;
+   unsigned long filtered;
+   unsigned long truncated;
+   unsigned long kernel_dropped;
+   unsigned long received[EUPNP_SSDP_MESSAGE_CLASSES];
+   unsigned long shed[EUPNP_SSDP_MESSAGE_CLASSES];
+};
+
+
+void                 eupnp_histogram_add(Eupnp_Histogram *h, double usec) EINA_ARG_NONNULL(1);
+void                 eupnp_histogram_reset(Eupnp_Histogram *h) EINA_ARG_NONNULL(1);
+double               eupnp_histogram_percentile_get(const Eupnp_Histogram *h, double p) EINA_ARG_NONNULL(1);
+double               eupnp_histogram_mean_get(const Eupnp_Histogram *h) EINA_ARG_NONNULL(1);
+void                 eupnp_histogram_dump(const Eupnp_Histogram *h, const char *name) EINA_ARG_NONNULL(1,2);
+
+void                 eupnp_metrics_reset(Eupnp_Metrics *m) EINA_ARG_NONNULL(1);
+const char          *eupnp_metrics_class_name_get(Eupnp_SSDP_Message_Class cls);
+void                 eupnp_metrics_dump(const Eupnp_Metrics *m) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_METRICS_H */
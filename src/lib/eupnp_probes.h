@@ -0,0 +1,64 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_PROBES_H
+#define _EUPNP_PROBES_H
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+/*
+ * USDT probes of the eupnp provider, for bpftrace, SystemTap or perf (see the
+ * scripts in src/bin). Built in when sys/sdt.h is found at configure time,
+ * see --enable-sdt, and no-ops otherwise.
+ *
+ * A probe compiles to a single nop until a tracer attaches to it. Arguments
+ * are values at hand on the probe site, loaded at most, never formatted nor
+ * computed for the sake of the probe.
+ *
+ *   datagram_receive(len, saddr, ifindex)   datagram read from the socket
+ *   parse_start(data, len, class)           SSDP message handling starts
+ *   parse_end(class)                        and ends
+ *   cache_insert(usn, location)             device registry entry added
+ *   cache_expire(usn)                       and expired
+ *   msearch_send(target, mx, daddr)         M-SEARCH sent, mx 0 if unicast
+ *   http_request(request, data, len)        HTTP client request sent
+ *   http_response(request, status, len)     and completed, status is
+ *                                           -errno on failure
+ *   http_server_request(method, uri)        HTTP server request received
+ *   http_server_response(status, len)       and its response queued
+ *
+ * Addresses are IPv4 in network byte order.
+ */
+
+#ifdef HAVE_SYS_SDT_H
+# include <sys/sdt.h>
+# define EUPNP_PROBE1(name, a) DTRACE_PROBE1(eupnp, name, a)
+# define EUPNP_PROBE2(name, a, b) DTRACE_PROBE2(eupnp, name, a, b)
+# define EUPNP_PROBE3(name, a, b, c) DTRACE_PROBE3(eupnp, name, a, b, c)
+#else
+# define EUPNP_PROBE1(name, a) do { } while (0)
+# define EUPNP_PROBE2(name, a, b) do { } while (0)
+# define EUPNP_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+#endif /* _EUPNP_PROBES_H */
@@ -0,0 +1,438 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <Eina.h>
+
+#include "eupnp.h"
+#include "eupnp_error.h"
+#include "eupnp_rate_limiter.h"
+
+/*
+ * Sources are kept on a fixed size entry array, indexed by an open addressing
+ * (linear probing) table keyed on the binary address. Entries are also linked
+ * on a LRU list; when the array is full the least recently seen source is
+ * evicted.
+ */
+
+#define EUPNP_RATE_LIMITER_NIL 0xffffffff
+
+typedef struct _Eupnp_Rate_Limiter_Source Eupnp_Rate_Limiter_Source;
+
+struct _Eupnp_Rate_Limiter_Source {
+   in_addr_t addr;
+   uint32_t prev;
+   uint32_t next;
+   uint32_t violations;
+   Eupnp_Token_Bucket bucket;
+   double quarantine_until;
+   unsigned long packets;
+   unsigned long dropped;
+};
+
+struct _Eupnp_Rate_Limiter {
+   Eupnp_Rate_Limiter_Policy policy;
+   Eupnp_Rate_Limiter_Source *sources;
+   uint32_t *table;  /* source index + 1, 0 for empty slots */
+   uint32_t mask;
+   uint32_t count;
+   uint32_t max;
+   uint32_t lru_head;
+   uint32_t lru_tail;
+   unsigned long quarantines;
+};
+
+
+/*
+ * Private API
+ */
+
+static uint32_t
+eupnp_rate_limiter_slot_home(const Eupnp_Rate_Limiter *rl, in_addr_t addr)
+{
+   return ((uint32_t)addr * 2654435761u) & rl->mask;
+}
+
+static uint32_t
+eupnp_rate_limiter_slot_find(const Eupnp_Rate_Limiter *rl, in_addr_t addr)
+{
+   uint32_t i = eupnp_rate_limiter_slot_home(rl, addr);
+
+   while (rl->table[i])
+     {
+	if (rl->sources[rl->table[i] - 1].addr == addr)
+	   return i;
+	i = (i + 1) & rl->mask;
+     }
+
+   return EUPNP_RATE_LIMITER_NIL;
+}
+
+/*
+ * Removes the slot at i, shifting back the entries that follow it on the same
+ * probe sequence so that no tombstones are needed.
+ */
+static void
+eupnp_rate_limiter_slot_del(Eupnp_Rate_Limiter *rl, uint32_t i)
+{
+   uint32_t j = i, k;
+
+   rl->table[i] = 0;
+
+   for (;;)
+     {
+	j = (j + 1) & rl->mask;
+
+	if (!rl->table[j])
+	   return;
+
+	k = eupnp_rate_limiter_slot_home(rl, rl->sources[rl->table[j] - 1].addr);
+
+	// Entry at j may stay if its home lies cyclically in (i, j]
+	if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+	   continue;
+
+	rl->table[i] = rl->table[j];
+	rl->table[j] = 0;
+	i = j;
+     }
+}
+
+static void
+eupnp_rate_limiter_lru_unlink(Eupnp_Rate_Limiter *rl, uint32_t idx)
+{
+   Eupnp_Rate_Limiter_Source *s = &rl->sources[idx];
+
+   if (s->prev != EUPNP_RATE_LIMITER_NIL)
+      rl->sources[s->prev].next = s->next;
+   else
+      rl->lru_head = s->next;
+
+   if (s->next != EUPNP_RATE_LIMITER_NIL)
+      rl->sources[s->next].prev = s->prev;
+   else
+      rl->lru_tail = s->prev;
+}
+
+static void
+eupnp_rate_limiter_lru_push(Eupnp_Rate_Limiter *rl, uint32_t idx)
+{
+   Eupnp_Rate_Limiter_Source *s = &rl->sources[idx];
+
+   s->prev = EUPNP_RATE_LIMITER_NIL;
+   s->next = rl->lru_head;
+
+   if (rl->lru_head != EUPNP_RATE_LIMITER_NIL)
+      rl->sources[rl->lru_head].prev = idx;
+   else
+      rl->lru_tail = idx;
+
+   rl->lru_head = idx;
+}
+
+/*
+ * Retrieves the source entry for addr, creating it (and evicting the least
+ * recently seen source if full) when not present.
+ */
+static Eupnp_Rate_Limiter_Source *
+eupnp_rate_limiter_source_get(Eupnp_Rate_Limiter *rl, in_addr_t addr, double now)
+{
+   Eupnp_Rate_Limiter_Source *s;
+   uint32_t slot, idx;
+
+   slot = eupnp_rate_limiter_slot_find(rl, addr);
+
+   if (slot != EUPNP_RATE_LIMITER_NIL)
+     {
+	idx = rl->table[slot] - 1;
+	if (rl->lru_head != idx)
+	  {
+	     eupnp_rate_limiter_lru_unlink(rl, idx);
+	     eupnp_rate_limiter_lru_push(rl, idx);
+	  }
+	return &rl->sources[idx];
+     }
+
+   if (rl->count < rl->max)
+      idx = rl->count++;
+   else
+     {
+	idx = rl->lru_tail;
+	eupnp_rate_limiter_slot_del(rl, eupnp_rate_limiter_slot_find(rl, rl->sources[idx].addr));
+	eupnp_rate_limiter_lru_unlink(rl, idx);
+     }
+
+   s = &rl->sources[idx];
+   memset(s, 0, sizeof(Eupnp_Rate_Limiter_Source));
+   s->addr = addr;
+   eupnp_token_bucket_init(&s->bucket, rl->policy.burst, now);
+
+   slot = eupnp_rate_limiter_slot_home(rl, addr);
+   while (rl->table[slot])
+      slot = (slot + 1) & rl->mask;
+   rl->table[slot] = idx + 1;
+
+   eupnp_rate_limiter_lru_push(rl, idx);
+
+   return s;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Initializes a token bucket, full
+ */
+void
+eupnp_token_bucket_init(Eupnp_Token_Bucket *b, double burst, double now)
+{
+   b->tokens = burst;
+   b->last = now;
+}
+
+/*
+ * Takes a token from a bucket
+ *
+ * The bucket is refilled at @p rate tokens per second, up to @p burst tokens.
+ *
+ * @return EINA_TRUE if a token was available, EINA_FALSE otherwise.
+ */
+Eina_Bool
+eupnp_token_bucket_take(Eupnp_Token_Bucket *b, double rate, double burst, double now)
+{
+   if (now > b->last)
+     {
+	b->tokens += (now - b->last) * rate;
+	if (b->tokens > burst) b->tokens = burst;
+	b->last = now;
+     }
+
+   if (b->tokens < 1)
+      return EINA_FALSE;
+
+   b->tokens -= 1;
+   return EINA_TRUE;
+}
+
+/*
+ * Constructor for the Eupnp_Rate_Limiter structure
+ *
+ * @param max_sources maximum number of sources tracked at once. Memory is
+ *        allocated upfront.
+ * @param policy rate and quarantine policy.
+ *
+ * @return Eupnp_Rate_Limiter instance or NULL on error.
+ */
+Eupnp_Rate_Limiter *
+eupnp_rate_limiter_new(unsigned int max_sources, const Eupnp_Rate_Limiter_Policy *policy)
+{
+   Eupnp_Rate_Limiter *rl;
+   uint32_t size = 16;
+
+   if (!max_sources) max_sources = EUPNP_RATE_LIMITER_DEFAULT_SOURCES;
+
+   // Keep the table at most half full
+   while (size < max_sources * 2) size <<= 1;
+
+   rl = calloc(1, sizeof(Eupnp_Rate_Limiter));
+
+   if (!rl)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create rate limiter.\n");
+	return NULL;
+     }
+
+   rl->sources = malloc(sizeof(Eupnp_Rate_Limiter_Source) * max_sources);
+   rl->table = calloc(size, sizeof(uint32_t));
+
+   if (!rl->sources || !rl->table)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not allocate rate limiter tables.\n");
+	free(rl->sources);
+	free(rl->table);
+	free(rl);
+	return NULL;
+     }
+
+   rl->policy = *policy;
+   rl->mask = size - 1;
+   rl->max = max_sources;
+   rl->lru_head = EUPNP_RATE_LIMITER_NIL;
+   rl->lru_tail = EUPNP_RATE_LIMITER_NIL;
+
+   return rl;
+}
+
+void
+eupnp_rate_limiter_free(Eupnp_Rate_Limiter *rl)
+{
+   if (!rl) return;
+   free(rl->sources);
+   free(rl->table);
+   free(rl);
+}
+
+void
+eupnp_rate_limiter_policy_set(Eupnp_Rate_Limiter *rl, const Eupnp_Rate_Limiter_Policy *policy)
+{
+   rl->policy = *policy;
+}
+
+/*
+ * Accounts a datagram from a source and checks whether it should be accepted
+ *
+ * Only looks at the binary address, so it's meant to be called before the
+ * datagram is parsed.
+ *
+ * @param rl rate limiter
+ * @param addr source address, network byte order
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return EINA_TRUE if the datagram should be accepted, EINA_FALSE if it
+ *         should be dropped.
+ */
+Eina_Bool
+eupnp_rate_limiter_check(Eupnp_Rate_Limiter *rl, in_addr_t addr, double now)
+{
+   Eupnp_Rate_Limiter_Source *s;
+   char host[INET_ADDRSTRLEN];
+
+   s = eupnp_rate_limiter_source_get(rl, addr, now);
+   s->packets++;
+
+   if (s->quarantine_until > now)
+     {
+	s->dropped++;
+	return EINA_FALSE;
+     }
+
+   if (eupnp_token_bucket_take(&s->bucket, rl->policy.rate, rl->policy.burst, now))
+     {
+	// Source is back within its rate
+	if (s->bucket.tokens >= rl->policy.burst - 1)
+	   s->violations = 0;
+	return EINA_TRUE;
+     }
+
+   s->dropped++;
+   s->violations++;
+
+   if (!rl->policy.quarantine_threshold ||
+       s->violations < rl->policy.quarantine_threshold)
+      return EINA_FALSE;
+
+   s->violations = 0;
+   s->quarantine_until = now + rl->policy.quarantine_time;
+   rl->quarantines++;
+
+   WARN("Quarantining %s for %.0fs, %lu datagrams dropped so far\n",
+	inet_ntop(AF_INET, &addr, host, sizeof(host)),
+	rl->policy.quarantine_time, s->dropped);
+
+   return EINA_FALSE;
+}
+
+/*
+ * Checks whether a source is quarantined
+ */
+Eina_Bool
+eupnp_rate_limiter_quarantined_get(const Eupnp_Rate_Limiter *rl, in_addr_t addr, double now)
+{
+   uint32_t slot;
+
+   slot = eupnp_rate_limiter_slot_find(rl, addr);
+
+   if (slot == EUPNP_RATE_LIMITER_NIL)
+      return EINA_FALSE;
+
+   return (rl->sources[rl->table[slot] - 1].quarantine_until > now);
+}
+
+/*
+ * Retrieves the sources that sent the most datagrams
+ *
+ * @param rl rate limiter
+ * @param talkers array to fill, sorted by descending datagram count
+ * @param max size of @p talkers
+ * @param now current time, for the quarantine state
+ *
+ * @return number of talkers filled.
+ */
+unsigned int
+eupnp_rate_limiter_top_talkers_get(const Eupnp_Rate_Limiter *rl, Eupnp_Rate_Limiter_Talker *talkers, unsigned int max, double now)
+{
+   const Eupnp_Rate_Limiter_Source *s;
+   unsigned int n = 0, i, j;
+
+   for (i = 0; i < rl->count; i++)
+     {
+	s = &rl->sources[i];
+
+	if (n == max && (!max || s->packets <= talkers[n - 1].packets))
+	   continue;
+
+	j = (n < max) ? n++ : n - 1;
+
+	// Insertion on the sorted array, dropping the last one if full
+	while (j > 0 && talkers[j - 1].packets < s->packets)
+	  {
+	     talkers[j] = talkers[j - 1];
+	     j--;
+	  }
+
+	talkers[j].addr.s_addr = s->addr;
+	talkers[j].packets = s->packets;
+	talkers[j].dropped = s->dropped;
+	talkers[j].quarantined = (s->quarantine_until > now);
+     }
+
+   return n;
+}
+
+/*
+ * Prints out the top talkers
+ *
+ * Use EINA_ERROR_LEVEL=2 for seeing the printed messages.
+ */
+void
+eupnp_rate_limiter_dump(const Eupnp_Rate_Limiter *rl, unsigned int max)
+{
+   Eupnp_Rate_Limiter_Talker talkers[16];
+   char host[INET_ADDRSTRLEN];
+   unsigned int i, n;
+
+   if (max > 16) max = 16;
+
+   n = eupnp_rate_limiter_top_talkers_get(rl, talkers, max, eupnp_time_now());
+
+   INFO("Tracked sources: %u, quarantines: %lu\n", rl->count, rl->quarantines);
+
+   for (i = 0; i < n; i++)
+      INFO("* %s: %lu datagrams, %lu dropped%s\n",
+	   inet_ntop(AF_INET, &talkers[i].addr, host, sizeof(host)),
+	   talkers[i].packets, talkers[i].dropped,
+	   talkers[i].quarantined ? " (quarantined)" : "");
+}
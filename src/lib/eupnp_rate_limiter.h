@@ -0,0 +1,76 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_RATE_LIMITER_H
+#define _EUPNP_RATE_LIMITER_H
+
+#include <stdint.h>
+#include <Eina.h>
+#include <netinet/in.h>
+
+#define EUPNP_RATE_LIMITER_DEFAULT_SOURCES 1024
+
+typedef struct _Eupnp_Token_Bucket Eupnp_Token_Bucket;
+typedef struct _Eupnp_Rate_Limiter Eupnp_Rate_Limiter;
+typedef struct _Eupnp_Rate_Limiter_Policy Eupnp_Rate_Limiter_Policy;
+typedef struct _Eupnp_Rate_Limiter_Talker Eupnp_Rate_Limiter_Talker;
+
+
+struct _Eupnp_Token_Bucket {
+   double tokens;
+   double last;
+};
+
+/*
+ * Every source may send rate datagrams per second, with bursts of up to burst
+ * datagrams. A source that has quarantine_threshold datagrams dropped before
+ * its bucket fills up again is quarantined for quarantine_time seconds, during
+ * which all of its datagrams are dropped. A quarantine_threshold of 0 disables
+ * quarantine.
+ */
+struct _Eupnp_Rate_Limiter_Policy {
+   double rate;
+   double burst;
+   unsigned int quarantine_threshold;
+   double quarantine_time;
+};
+
+struct _Eupnp_Rate_Limiter_Talker {
+   struct in_addr addr;
+   unsigned long packets;
+   unsigned long dropped;
+   Eina_Bool quarantined;
+};
+
+
+void                 eupnp_token_bucket_init(Eupnp_Token_Bucket *b, double burst, double now) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_token_bucket_take(Eupnp_Token_Bucket *b, double rate, double burst, double now) EINA_ARG_NONNULL(1);
+
+Eupnp_Rate_Limiter  *eupnp_rate_limiter_new(unsigned int max_sources, const Eupnp_Rate_Limiter_Policy *policy) EINA_ARG_NONNULL(2);
+void                 eupnp_rate_limiter_free(Eupnp_Rate_Limiter *rl) EINA_ARG_NONNULL(1);
+void                 eupnp_rate_limiter_policy_set(Eupnp_Rate_Limiter *rl, const Eupnp_Rate_Limiter_Policy *policy) EINA_ARG_NONNULL(1,2);
+Eina_Bool            eupnp_rate_limiter_check(Eupnp_Rate_Limiter *rl, in_addr_t addr, double now) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_rate_limiter_quarantined_get(const Eupnp_Rate_Limiter *rl, in_addr_t addr, double now) EINA_ARG_NONNULL(1);
+unsigned int         eupnp_rate_limiter_top_talkers_get(const Eupnp_Rate_Limiter *rl, Eupnp_Rate_Limiter_Talker *talkers, unsigned int max, double now) EINA_ARG_NONNULL(1,2);
+void                 eupnp_rate_limiter_dump(const Eupnp_Rate_Limiter *rl, unsigned int max) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_RATE_LIMITER_H */
@@ -0,0 +1,284 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_revalidator.h"
+
+/*
+ * Keeps the device registry fresh without multicast searches. Entries close
+ * to expiring, or restored from a snapshot and never confirmed, are probed
+ * with a unicast M-Search to the address they were announced from; the
+ * answer refreshes them through the usual event path. Probes are paced by a
+ * token bucket so a registry full of stale entries does not turn into a
+ * burst, and each entry gets a limited number of attempts before it is left
+ * to expire.
+ */
+
+typedef struct _Eupnp_Revalidator_Probe Eupnp_Revalidator_Probe;
+
+/*
+ * Probe state of an USN. expire is the entry expiry when last probed, a
+ * different value means the entry was refreshed (or the ID reused) since.
+ */
+struct _Eupnp_Revalidator_Probe {
+   double last;
+   double expire;
+   unsigned int attempts;
+};
+
+struct _Eupnp_Revalidator {
+   Eupnp_SSDP_Server *ssdp;
+   Eupnp_Device_Registry *registry;
+   Eupnp_Intern *intern;
+   Eupnp_Revalidator_Policy policy;
+   Eupnp_Token_Bucket bucket;
+
+   /* Indexed by USN ID */
+   Eupnp_Revalidator_Probe *probes;
+   Eupnp_Id probes_size;
+
+   /* Scratch space for registry queries */
+   unsigned int *slots;
+   unsigned int slots_size;
+
+   unsigned long sent;
+   unsigned long throttled;
+};
+
+
+/*
+ * Private API
+ */
+
+static Eina_Bool
+eupnp_revalidator_grow(Eupnp_Revalidator *rv)
+{
+   Eupnp_Id size = eupnp_intern_id_max_get(rv->intern) + 1;
+   unsigned int count = eupnp_device_registry_count_get(rv->registry);
+
+   if (size > rv->probes_size)
+     {
+	Eupnp_Revalidator_Probe *probes;
+
+	if (size < rv->probes_size * 2) size = rv->probes_size * 2;
+
+	probes = realloc(rv->probes, size * sizeof(Eupnp_Revalidator_Probe));
+	if (!probes) goto error;
+
+	memset(probes + rv->probes_size, 0,
+	       (size - rv->probes_size) * sizeof(Eupnp_Revalidator_Probe));
+	rv->probes = probes;
+	rv->probes_size = size;
+     }
+
+   if (count > rv->slots_size)
+     {
+	unsigned int *slots;
+
+	if (count < rv->slots_size * 2) count = rv->slots_size * 2;
+
+	slots = realloc(rv->slots, count * sizeof(unsigned int));
+	if (!slots) goto error;
+
+	rv->slots = slots;
+	rv->slots_size = count;
+     }
+
+   return EINA_TRUE;
+
+error:
+   eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+   ERROR("Could not grow revalidator.\n");
+   return EINA_FALSE;
+}
+
+/*
+ * Sends a unicast search for the entry's own target.
+ */
+static Eina_Bool
+eupnp_revalidator_probe(Eupnp_Revalidator *rv, const Eupnp_Device_Info *info)
+{
+   struct sockaddr_in addr = info->addr;
+   char target[512];
+
+   // Devices listen for searches on the SSDP port, not the one they sent from
+   addr.sin_port = 0;
+
+   if (info->version)
+     {
+	snprintf(target, sizeof(target), "%s:%u", info->type, info->version);
+	return eupnp_ssdp_unicast_search_send(rv->ssdp, &addr, target);
+     }
+
+   return eupnp_ssdp_unicast_search_send(rv->ssdp, &addr, info->type);
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Revalidator structure
+ *
+ * @param ssdp server used for sending probes
+ * @param registry registry to keep fresh
+ * @param intern table the registry interns its strings on
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return Eupnp_Revalidator instance or NULL on error.
+ */
+Eupnp_Revalidator *
+eupnp_revalidator_new(Eupnp_SSDP_Server *ssdp, Eupnp_Device_Registry *registry, Eupnp_Intern *intern, double now)
+{
+   Eupnp_Revalidator *rv;
+
+   rv = calloc(1, sizeof(Eupnp_Revalidator));
+
+   if (!rv)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create revalidator.\n");
+	return NULL;
+     }
+
+   rv->ssdp = ssdp;
+   rv->registry = registry;
+   rv->intern = intern;
+   rv->policy.margin = EUPNP_REVALIDATOR_MARGIN;
+   rv->policy.retry = EUPNP_REVALIDATOR_RETRY;
+   rv->policy.attempts = EUPNP_REVALIDATOR_ATTEMPTS;
+   rv->policy.rate = EUPNP_REVALIDATOR_RATE;
+   rv->policy.burst = EUPNP_REVALIDATOR_BURST;
+   eupnp_token_bucket_init(&rv->bucket, rv->policy.burst, now);
+
+   return rv;
+}
+
+void
+eupnp_revalidator_free(Eupnp_Revalidator *rv)
+{
+   if (!rv) return;
+
+   free(rv->probes);
+   free(rv->slots);
+   free(rv);
+}
+
+/*
+ * Changes the revalidation policy. A rate of 0 disables probing.
+ */
+void
+eupnp_revalidator_policy_set(Eupnp_Revalidator *rv, const Eupnp_Revalidator_Policy *policy)
+{
+   rv->policy = *policy;
+   if (rv->bucket.tokens > policy->burst) rv->bucket.tokens = policy->burst;
+}
+
+void
+eupnp_revalidator_policy_get(const Eupnp_Revalidator *rv, Eupnp_Revalidator_Policy *policy)
+{
+   *policy = rv->policy;
+}
+
+/*
+ * Probes the entries due for revalidation, as far as the rate allows. Meant
+ * to be called periodically, e.g. every second.
+ *
+ * @param rv revalidator
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return number of probes sent.
+ */
+unsigned int
+eupnp_revalidator_run(Eupnp_Revalidator *rv, double now)
+{
+   Eupnp_Revalidator_Probe *p;
+   Eupnp_Device_Info info;
+   unsigned int i, n, sent = 0;
+
+   if (rv->policy.rate <= 0 || !eupnp_revalidator_grow(rv))
+      return 0;
+
+   n = eupnp_device_registry_expiring_query(rv->registry, now + rv->policy.margin,
+					    rv->slots, rv->slots_size);
+
+   for (i = 0; i < n; i++)
+     {
+	if (!eupnp_device_registry_info_get(rv->registry, rv->slots[i], &info))
+	   continue;
+
+	p = &rv->probes[info.usn_id];
+
+	if (p->expire != info.expire)
+	  {
+	     p->expire = info.expire;
+	     p->attempts = 0;
+	     p->last = 0;
+	  }
+
+	if (p->attempts >= rv->policy.attempts ||
+	    (p->last && now - p->last < rv->policy.retry) ||
+	    !info.addr.sin_addr.s_addr)
+	   continue;
+
+	if (!eupnp_token_bucket_take(&rv->bucket, rv->policy.rate, rv->policy.burst, now))
+	  {
+	     rv->throttled++;
+	     break;
+	  }
+
+	DEBUG("Revalidating %s\n", info.usn);
+
+	p->last = now;
+	p->attempts++;
+
+	if (eupnp_revalidator_probe(rv, &info))
+	  {
+	     rv->sent++;
+	     sent++;
+	  }
+     }
+
+   return sent;
+}
+
+/*
+ * Retrieves the number of probes sent
+ */
+unsigned long
+eupnp_revalidator_sent_get(const Eupnp_Revalidator *rv)
+{
+   return rv->sent;
+}
+
+/*
+ * Retrieves how many times probing stopped short because of the rate limit
+ */
+unsigned long
+eupnp_revalidator_throttled_get(const Eupnp_Revalidator *rv)
+{
+   return rv->throttled;
+}
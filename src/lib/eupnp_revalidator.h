@@ -0,0 +1,65 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_REVALIDATOR_H
+#define _EUPNP_REVALIDATOR_H
+
+#include <stdint.h>
+#include <Eina.h>
+#include <eupnp_ssdp.h>
+#include <eupnp_intern.h>
+#include <eupnp_rate_limiter.h>
+#include <eupnp_device_registry.h>
+
+/*
+ * Default policy: entries expiring within 60 seconds or restored from a
+ * snapshot are probed up to 3 times, 10 seconds apart, sending no more than
+ * 10 probes per second with bursts of 20.
+ */
+#define EUPNP_REVALIDATOR_MARGIN 60
+#define EUPNP_REVALIDATOR_RETRY 10
+#define EUPNP_REVALIDATOR_ATTEMPTS 3
+#define EUPNP_REVALIDATOR_RATE 10
+#define EUPNP_REVALIDATOR_BURST 20
+
+typedef struct _Eupnp_Revalidator Eupnp_Revalidator;
+typedef struct _Eupnp_Revalidator_Policy Eupnp_Revalidator_Policy;
+
+
+struct _Eupnp_Revalidator_Policy {
+   double margin;          /* probe entries expiring within, in seconds */
+   double retry;           /* seconds between probes of the same entry */
+   unsigned int attempts;  /* probes per entry before giving up */
+   double rate;            /* probes per second */
+   double burst;
+};
+
+
+Eupnp_Revalidator *eupnp_revalidator_new(Eupnp_SSDP_Server *ssdp, Eupnp_Device_Registry *registry, Eupnp_Intern *intern, double now) EINA_ARG_NONNULL(1,2,3);
+void               eupnp_revalidator_free(Eupnp_Revalidator *rv) EINA_ARG_NONNULL(1);
+void               eupnp_revalidator_policy_set(Eupnp_Revalidator *rv, const Eupnp_Revalidator_Policy *policy) EINA_ARG_NONNULL(1,2);
+void               eupnp_revalidator_policy_get(const Eupnp_Revalidator *rv, Eupnp_Revalidator_Policy *policy) EINA_ARG_NONNULL(1,2);
+unsigned int       eupnp_revalidator_run(Eupnp_Revalidator *rv, double now) EINA_ARG_NONNULL(1);
+unsigned long      eupnp_revalidator_sent_get(const Eupnp_Revalidator *rv) EINA_ARG_NONNULL(1);
+unsigned long      eupnp_revalidator_throttled_get(const Eupnp_Revalidator *rv) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_REVALIDATOR_H */
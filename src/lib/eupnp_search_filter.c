@@ -0,0 +1,366 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_search_filter.h"
+#include "eupnp_hash.h"
+
+/*
+ * Patterns are compiled into a hash index keyed on the target without its
+ * version, e.g. "urn:schemas-upnp-org:device:MediaRenderer", each entry
+ * carrying the accepted version range. Matching a target is a single lookup
+ * plus a version comparison.
+ *
+ * Pattern syntax:
+ *  - urn:<domain>:<device|service>:<type>            any version
+ *  - urn:<domain>:<device|service>:<type>:<v>        version v only
+ *  - urn:<domain>:<device|service>:<type>:<v>+       version v or later
+ *  - urn:<domain>:<device|service>:<type>:<v>-<w>    versions v to w
+ *  - any other target (upnp:rootdevice, uuid:...) is matched as is
+ *  - ssdp:all matches everything
+ */
+
+#define EUPNP_SEARCH_FILTER_VERSION_NONE -1
+
+typedef struct _Eupnp_Search_Filter_Entry Eupnp_Search_Filter_Entry;
+
+struct _Eupnp_Search_Filter_Entry {
+   char *base;
+   size_t len;
+   uint32_t hash;
+   int min;
+   int max;
+};
+
+struct _Eupnp_Search_Filter {
+   Eupnp_Search_Filter_Entry *entries;
+   unsigned int size;  /* power of 2 */
+   unsigned int count;
+   Eina_Bool all;
+};
+
+
+/*
+ * Private API
+ */
+
+/*
+ * Splits a target into its base and version. Only URNs carry versions.
+ *
+ * @return EINA_TRUE if a version was found, its digits starting at *version
+ *         and running until the end of the target.
+ */
+static Eina_Bool
+eupnp_search_filter_target_split(const char *target, size_t len, size_t *base_len, const char **version)
+{
+   const char *p;
+
+   *base_len = len;
+
+   if (len < 4 || strncmp(target, "urn:", 4))
+      return EINA_FALSE;
+
+   for (p = target + len - 1; p > target; p--)
+      if (*p == ':') break;
+
+   if (p == target || p + 1 == target + len || p[1] < '0' || p[1] > '9')
+      return EINA_FALSE;
+
+   *base_len = p - target;
+   *version = p + 1;
+   return EINA_TRUE;
+}
+
+static int
+eupnp_search_filter_number_parse(const char **p, const char *end)
+{
+   int v = 0;
+
+   while (*p < end && **p >= '0' && **p <= '9')
+     {
+	if (v > (INT_MAX - 9) / 10) return INT_MAX;
+	v = v * 10 + (**p - '0');
+	(*p)++;
+     }
+
+   return v;
+}
+
+static Eina_Bool
+eupnp_search_filter_insert(Eupnp_Search_Filter *f, Eupnp_Search_Filter_Entry *e)
+{
+   unsigned int i;
+
+   if ((f->count + 1) * 2 > f->size)
+     {
+	Eupnp_Search_Filter_Entry *old = f->entries;
+	unsigned int old_size = f->size;
+	unsigned int size = old_size ? old_size * 2 : 16;
+
+	f->entries = calloc(size, sizeof(Eupnp_Search_Filter_Entry));
+
+	if (!f->entries)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not grow search filter.\n");
+	     f->entries = old;
+	     return EINA_FALSE;
+	  }
+
+	f->size = size;
+	f->count = 0;
+
+	for (i = 0; i < old_size; i++)
+	   if (old[i].base)
+	      eupnp_search_filter_insert(f, &old[i]);
+
+	free(old);
+     }
+
+   i = e->hash & (f->size - 1);
+   while (f->entries[i].base)
+      i = (i + 1) & (f->size - 1);
+
+   f->entries[i] = *e;
+   f->count++;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Splits a search or notification target into its type and version
+ *
+ * E.g. "urn:schemas-upnp-org:device:MediaRenderer:2" is split into
+ * "urn:schemas-upnp-org:device:MediaRenderer" and 2. Targets that are not
+ * versioned URNs are returned whole, with version 0.
+ *
+ * @param target target, doesn't need to be NULL-terminated
+ * @param len target length
+ * @param base_len length of the type part
+ * @param version version
+ */
+void
+eupnp_search_target_split(const char *target, size_t len, size_t *base_len, unsigned int *version)
+{
+   const char *v;
+
+   *version = 0;
+
+   if (eupnp_search_filter_target_split(target, len, base_len, &v))
+      *version = eupnp_search_filter_number_parse(&v, target + len);
+}
+
+/*
+ * Constructor for the Eupnp_Search_Filter structure
+ *
+ * An empty filter matches every target.
+ *
+ * @return Eupnp_Search_Filter instance or NULL on error.
+ */
+Eupnp_Search_Filter *
+eupnp_search_filter_new(void)
+{
+   Eupnp_Search_Filter *f;
+
+   f = calloc(1, sizeof(Eupnp_Search_Filter));
+
+   if (!f)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create search filter.\n");
+	return NULL;
+     }
+
+   return f;
+}
+
+void
+eupnp_search_filter_free(Eupnp_Search_Filter *f)
+{
+   if (!f) return;
+   eupnp_search_filter_clear(f);
+   free(f->entries);
+   free(f);
+}
+
+/*
+ * Removes all patterns from the filter
+ */
+void
+eupnp_search_filter_clear(Eupnp_Search_Filter *f)
+{
+   unsigned int i;
+
+   for (i = 0; i < f->size; i++)
+     {
+	free(f->entries[i].base);
+	f->entries[i].base = NULL;
+     }
+
+   f->count = 0;
+   f->all = EINA_FALSE;
+}
+
+/*
+ * Adds a pattern to the filter
+ *
+ * @param f filter
+ * @param pattern search target pattern, e.g.
+ *        "urn:schemas-upnp-org:device:MediaRenderer:1+". See the syntax above.
+ *
+ * @return EINA_TRUE on success, EINA_FALSE if the pattern is invalid or on
+ *         allocation errors.
+ */
+Eina_Bool
+eupnp_search_filter_add(Eupnp_Search_Filter *f, const char *pattern)
+{
+   Eupnp_Search_Filter_Entry e;
+   const char *version, *end, *p;
+   size_t len = strlen(pattern);
+
+   if (!len)
+     {
+	ERROR("Empty search filter pattern.\n");
+	return EINA_FALSE;
+     }
+
+   if (!strcmp(pattern, "ssdp:all"))
+     {
+	f->all = EINA_TRUE;
+	return EINA_TRUE;
+     }
+
+   e.min = EUPNP_SEARCH_FILTER_VERSION_NONE;
+   e.max = INT_MAX;
+
+   if (eupnp_search_filter_target_split(pattern, len, &e.len, &version))
+     {
+	p = version;
+	end = pattern + len;
+	e.min = eupnp_search_filter_number_parse(&p, end);
+
+	if (p == end)
+	   e.max = e.min;
+	else if (*p == '+' && p + 1 == end)
+	   e.max = INT_MAX;
+	else if (*p == '-')
+	  {
+	     p++;
+	     e.max = eupnp_search_filter_number_parse(&p, end);
+	     if (p != end || e.max < e.min)
+	       {
+		  ERROR("Invalid version range on pattern %s.\n", pattern);
+		  return EINA_FALSE;
+	       }
+	  }
+	else
+	  {
+	     ERROR("Invalid version on pattern %s.\n", pattern);
+	     return EINA_FALSE;
+	  }
+     }
+
+   e.base = malloc(e.len + 1);
+
+   if (!e.base)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not add search filter pattern.\n");
+	return EINA_FALSE;
+     }
+
+   memcpy(e.base, pattern, e.len);
+   e.base[e.len] = '\0';
+   e.hash = eupnp_hash(e.base, e.len);
+
+   if (!eupnp_search_filter_insert(f, &e))
+     {
+	free(e.base);
+	return EINA_FALSE;
+     }
+
+   return EINA_TRUE;
+}
+
+/*
+ * Checks whether the filter has any pattern
+ */
+Eina_Bool
+eupnp_search_filter_empty_get(const Eupnp_Search_Filter *f)
+{
+   return (!f->count && !f->all);
+}
+
+/*
+ * Checks whether a search or notification target matches the filter
+ *
+ * @param f filter
+ * @param target ST or NT value, doesn't need to be NULL-terminated.
+ * @param len target length.
+ *
+ * @return EINA_TRUE if the target matches any of the patterns (or if the
+ *         filter is empty), EINA_FALSE otherwise.
+ */
+Eina_Bool
+eupnp_search_filter_match(const Eupnp_Search_Filter *f, const char *target, size_t len)
+{
+   const Eupnp_Search_Filter_Entry *e;
+   const char *version;
+   size_t base_len;
+   uint32_t hash;
+   unsigned int i;
+   int v = EUPNP_SEARCH_FILTER_VERSION_NONE;
+
+   if (f->all || !f->count) return EINA_TRUE;
+
+   if (eupnp_search_filter_target_split(target, len, &base_len, &version))
+      v = eupnp_search_filter_number_parse(&version, target + len);
+
+   hash = eupnp_hash(target, base_len);
+
+   for (i = hash & (f->size - 1); f->entries[i].base; i = (i + 1) & (f->size - 1))
+     {
+	e = &f->entries[i];
+
+	if (e->hash != hash || e->len != base_len ||
+	    memcmp(e->base, target, base_len))
+	   continue;
+
+	// Versionless patterns match any version
+	if (e->min == EUPNP_SEARCH_FILTER_VERSION_NONE)
+	   return EINA_TRUE;
+
+	if (v >= e->min && v <= e->max)
+	   return EINA_TRUE;
+     }
+
+   return EINA_FALSE;
+}
@@ -0,0 +1,39 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_SEARCH_FILTER_H
+#define _EUPNP_SEARCH_FILTER_H
+
+#include <Eina.h>
+
+typedef struct _Eupnp_Search_Filter Eupnp_Search_Filter;
+
+
+Eupnp_Search_Filter *eupnp_search_filter_new(void);
+void                 eupnp_search_filter_free(Eupnp_Search_Filter *f) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_search_filter_add(Eupnp_Search_Filter *f, const char *pattern) EINA_ARG_NONNULL(1,2);
+void                 eupnp_search_filter_clear(Eupnp_Search_Filter *f) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_search_filter_empty_get(const Eupnp_Search_Filter *f) EINA_ARG_NONNULL(1);
+void                 eupnp_search_target_split(const char *target, size_t len, size_t *base_len, unsigned int *version) EINA_ARG_NONNULL(1,3,4);
+Eina_Bool            eupnp_search_filter_match(const Eupnp_Search_Filter *f, const char *target, size_t len) EINA_ARG_NONNULL(1,2);
+
+
+#endif /* _EUPNP_SEARCH_FILTER_H */
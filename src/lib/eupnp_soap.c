@@ -0,0 +1,642 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_soap.h"
+
+/*
+ * Fast path decoder for SOAP action responses.
+ *
+ * Responses are a flat list of out arguments inside the action response
+ * element, e.g.
+ *
+ *   <u:GetPositionInfoResponse xmlns:u="...">
+ *      <Track>1</Track><TrackDuration>0:03:12</TrackDuration>...
+ *   </u:GetPositionInfoResponse>
+ *
+ * so instead of building a tree, each argument element is looked up directly
+ * in the body, in SCPD order first (which is how devices send them), and its
+ * content is converted into the caller struct. Strings are not copied nor
+ * unescaped, they point into the body.
+ */
+
+typedef struct _Eupnp_Soap_Decoder_Arg Eupnp_Soap_Decoder_Arg;
+
+struct _Eupnp_Soap_Decoder_Arg {
+   char *tag;             /* "<Name" */
+   size_t tag_len;
+   Eupnp_Soap_Type type;
+   size_t offset;
+};
+
+struct _Eupnp_Soap_Decoder {
+   char *response;        /* "ActionResponse" */
+   size_t response_len;
+   unsigned int count;
+   Eupnp_Soap_Decoder_Arg args[];
+};
+
+#define IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n')
+
+
+/*
+ * Private API
+ */
+
+/*
+ * Finds the first <tag> element in [p, end).
+ *
+ * @param tag element name preceded by '<'
+ * @param content set to the element content
+ * @param content_len set to the content length
+ * @param escaped set if the content contains entities
+ * @param next set to where to look for the following element
+ *
+ * @return EINA_TRUE if found, EINA_FALSE otherwise.
+ */
+static Eina_Bool
+_eupnp_soap_element_find(const char *p, const char *end, const char *tag, size_t tag_len, const char **content, size_t *content_len, Eina_Bool *escaped, const char **next)
+{
+   const char *q, *c, *gt, *lt;
+
+   while (p < end && (q = memmem(p, end - p, tag, tag_len)))
+     {
+	c = q + tag_len;
+	if (c >= end) return EINA_FALSE;
+
+	// <Name> or <Name attr...>, not <NameSuffix>
+	if (*c != '>' && *c != '/' && !IS_SPACE(*c))
+	  {
+	     p = q + 1;
+	     continue;
+	  }
+
+	gt = memchr(c, '>', end - c);
+	if (!gt) return EINA_FALSE;
+
+	if (gt[-1] == '/')
+	  {
+	     // <Name/>
+	     *content = gt + 1;
+	     *content_len = 0;
+	     *escaped = EINA_FALSE;
+	     *next = gt + 1;
+	     return EINA_TRUE;
+	  }
+
+	c = gt + 1;
+
+	if (end - c >= 9 && !memcmp(c, "<![CDATA[", 9))
+	  {
+	     lt = memmem(c + 9, end - c - 9, "]]>", 3);
+	     if (!lt) return EINA_FALSE;
+
+	     *content = c + 9;
+	     *content_len = lt - c - 9;
+	     *escaped = EINA_FALSE;
+	     *next = lt + 3;
+	     return EINA_TRUE;
+	  }
+
+	lt = memchr(c, '<', end - c);
+	if (!lt) return EINA_FALSE;
+
+	*content = c;
+	*content_len = lt - c;
+	*escaped = memchr(c, '&', lt - c) != NULL;
+	*next = lt;
+	return EINA_TRUE;
+     }
+
+   return EINA_FALSE;
+}
+
+static void
+_eupnp_soap_trim(const char **p, size_t *len)
+{
+   while (*len && IS_SPACE(**p))
+     {
+	(*p)++;
+	(*len)--;
+     }
+
+   while (*len && IS_SPACE((*p)[*len - 1])) (*len)--;
+}
+
+static Eina_Bool
+_eupnp_soap_ui4_parse(const char *p, size_t len, uint32_t *v)
+{
+   uint64_t n = 0;
+
+   _eupnp_soap_trim(&p, &len);
+   if (len && *p == '+')
+     {
+	p++;
+	len--;
+     }
+
+   if (!len || len > 10) return EINA_FALSE;
+
+   for (; len; p++, len--)
+     {
+	if (*p < '0' || *p > '9') return EINA_FALSE;
+	n = n * 10 + (*p - '0');
+     }
+
+   if (n > UINT32_MAX) return EINA_FALSE;
+
+   *v = n;
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_eupnp_soap_i4_parse(const char *p, size_t len, int32_t *v)
+{
+   Eina_Bool negative = EINA_FALSE;
+   uint32_t n;
+
+   _eupnp_soap_trim(&p, &len);
+   if (len && *p == '-')
+     {
+	negative = EINA_TRUE;
+	p++;
+	len--;
+     }
+
+   if (!_eupnp_soap_ui4_parse(p, len, &n)) return EINA_FALSE;
+
+   if (negative)
+     {
+	if (n > (uint32_t)INT32_MAX + 1) return EINA_FALSE;
+	*v = (int32_t)(0 - (int64_t)n);
+     }
+   else
+     {
+	if (n > INT32_MAX) return EINA_FALSE;
+	*v = n;
+     }
+
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_eupnp_soap_boolean_parse(const char *p, size_t len, Eina_Bool *v)
+{
+   _eupnp_soap_trim(&p, &len);
+
+   if ((len == 1 && *p == '1') ||
+       (len == 4 && !strncasecmp(p, "true", 4)) ||
+       (len == 3 && !strncasecmp(p, "yes", 3)))
+     {
+	*v = EINA_TRUE;
+	return EINA_TRUE;
+     }
+
+   if ((len == 1 && *p == '0') ||
+       (len == 5 && !strncasecmp(p, "false", 5)) ||
+       (len == 2 && !strncasecmp(p, "no", 2)))
+     {
+	*v = EINA_FALSE;
+	return EINA_TRUE;
+     }
+
+   return EINA_FALSE;
+}
+
+/*
+ * Converts an argument into its slot
+ */
+static Eina_Bool
+_eupnp_soap_arg_store(const Eupnp_Soap_Decoder_Arg *a, const char *p, size_t len, Eina_Bool escaped, void *out)
+{
+   char *slot = (char *)out + a->offset;
+   Eupnp_Soap_String *s;
+
+   switch (a->type)
+     {
+      case EUPNP_SOAP_TYPE_UI4:
+	 return _eupnp_soap_ui4_parse(p, len, (uint32_t *)slot);
+      case EUPNP_SOAP_TYPE_I4:
+	 return _eupnp_soap_i4_parse(p, len, (int32_t *)slot);
+      case EUPNP_SOAP_TYPE_BOOLEAN:
+	 return _eupnp_soap_boolean_parse(p, len, (Eina_Bool *)slot);
+      default:
+	 s = (Eupnp_Soap_String *)slot;
+	 s->value = p;
+	 s->len = len;
+	 s->escaped = escaped;
+	 return EINA_TRUE;
+     }
+}
+
+/*
+ * Finds the action response element
+ *
+ * @return position right after its name, NULL if not found.
+ */
+static const char *
+_eupnp_soap_response_find(const Eupnp_Soap_Decoder *d, const char *p, const char *end)
+{
+   const char *q, *c;
+
+   while (p < end && (q = memmem(p, end - p, d->response, d->response_len)))
+     {
+	c = q + d->response_len;
+
+	// <u:ActionResponse or <ActionResponse, not a closing tag
+	if (q > p && (q[-1] == ':' || q[-1] == '<') && c < end &&
+	    (*c == '>' || IS_SPACE(*c)))
+	  {
+	     const char *lt = q - 1;
+
+	     while (lt > p && *lt != '<' && *lt != '/') lt--;
+	     if (*lt == '<') return c;
+	  }
+
+	p = q + 1;
+     }
+
+   return NULL;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Maps a SCPD dataType to the slot type it is decoded into
+ *
+ * @param data_type state variable dataType, e.g. "ui4"
+ *
+ * @return slot type, EUPNP_SOAP_TYPE_STRING for unknown types.
+ */
+Eupnp_Soap_Type
+eupnp_soap_type_get(const char *data_type)
+{
+   if (!strcmp(data_type, "ui4") || !strcmp(data_type, "ui2") ||
+       !strcmp(data_type, "ui1"))
+      return EUPNP_SOAP_TYPE_UI4;
+
+   if (!strcmp(data_type, "i4") || !strcmp(data_type, "i2") ||
+       !strcmp(data_type, "i1") || !strcmp(data_type, "int"))
+      return EUPNP_SOAP_TYPE_I4;
+
+   if (!strcmp(data_type, "boolean"))
+      return EUPNP_SOAP_TYPE_BOOLEAN;
+
+   return EUPNP_SOAP_TYPE_STRING;
+}
+
+/*
+ * Constructor for the Eupnp_Soap_Decoder structure
+ *
+ * Decoders are built once per action and reused for all its responses.
+ *
+ * @param action action name
+ * @param args out arguments, copied
+ * @param count number of arguments
+ *
+ * @return Eupnp_Soap_Decoder instance or NULL on error.
+ */
+Eupnp_Soap_Decoder *
+eupnp_soap_decoder_new(const char *action, const Eupnp_Soap_Arg *args, unsigned int count)
+{
+   Eupnp_Soap_Decoder *d;
+   unsigned int i;
+
+   d = calloc(1, sizeof(Eupnp_Soap_Decoder) + count * sizeof(Eupnp_Soap_Decoder_Arg));
+
+   if (!d)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create SOAP decoder.\n");
+	return NULL;
+     }
+
+   d->response_len = strlen(action) + 8;
+   d->response = malloc(d->response_len + 1);
+
+   if (!d->response) goto error;
+
+   memcpy(d->response, action, d->response_len - 8);
+   memcpy(d->response + d->response_len - 8, "Response", 9);
+
+   for (i = 0; i < count; i++, d->count++)
+     {
+	Eupnp_Soap_Decoder_Arg *a = &d->args[i];
+
+	a->tag_len = strlen(args[i].name) + 1;
+	a->tag = malloc(a->tag_len + 1);
+
+	if (!a->tag) goto error;
+
+	a->tag[0] = '<';
+	memcpy(a->tag + 1, args[i].name, a->tag_len);
+	a->type = args[i].type;
+	a->offset = args[i].offset;
+     }
+
+   return d;
+
+error:
+   eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+   ERROR("Could not create SOAP decoder.\n");
+   eupnp_soap_decoder_free(d);
+   return NULL;
+}
+
+void
+eupnp_soap_decoder_free(Eupnp_Soap_Decoder *d)
+{
+   unsigned int i;
+
+   if (!d) return;
+
+   for (i = 0; i < d->count; i++)
+      free(d->args[i].tag);
+
+   free(d->response);
+   free(d);
+}
+
+/*
+ * Decodes an action response into the caller struct
+ *
+ * Slots of arguments missing from the response are left untouched.
+ * String slots point into body, which must outlive them.
+ *
+ * @param d decoder of the action
+ * @param body response body
+ * @param len body length
+ * @param out caller struct, holding the slots
+ *
+ * @return number of arguments decoded, -1 if body is not a response to the
+ *         action (e.g. a fault) or an argument has an invalid value.
+ */
+int
+eupnp_soap_response_decode(const Eupnp_Soap_Decoder *d, const char *body, size_t len, void *out)
+{
+   const char *end = body + len;
+   const char *start, *p, *content, *next;
+   size_t content_len;
+   Eina_Bool escaped, found;
+   unsigned int i;
+   int n = 0;
+
+   start = _eupnp_soap_response_find(d, body, end);
+
+   if (!start)
+     {
+	DEBUG("No %.*s element in SOAP response\n", (int)d->response_len, d->response);
+	return -1;
+     }
+
+   p = start;
+
+   for (i = 0; i < d->count; i++)
+     {
+	const Eupnp_Soap_Decoder_Arg *a = &d->args[i];
+
+	// Arguments usually come in order, else look behind as well
+	found = _eupnp_soap_element_find(p, end, a->tag, a->tag_len, &content,
+					 &content_len, &escaped, &next);
+	if (!found && p != start)
+	   found = _eupnp_soap_element_find(start, p, a->tag, a->tag_len,
+					    &content, &content_len, &escaped,
+					    &next);
+	if (!found) continue;
+
+	if (!_eupnp_soap_arg_store(a, content, content_len, escaped, out))
+	  {
+	     DEBUG("Invalid value for SOAP argument %s\n", a->tag + 1);
+	     return -1;
+	  }
+
+	p = next;
+	n++;
+     }
+
+   return n;
+}
+
+/*
+ * Retrieves the UPnP error code of a SOAP fault
+ *
+ * @param body response body
+ * @param len body length
+ *
+ * @return error code, e.g. 401 for an invalid action, or -1 if body is not a
+ *         fault.
+ */
+int
+eupnp_soap_fault_code_get(const char *body, size_t len)
+{
+   const char *content, *next;
+   size_t content_len;
+   Eina_Bool escaped;
+   uint32_t code;
+
+   if (!_eupnp_soap_element_find(body, body + len, "<errorCode", 10, &content,
+				 &content_len, &escaped, &next) ||
+       !_eupnp_soap_ui4_parse(content, content_len, &code) || code > INT32_MAX)
+      return -1;
+
+   return code;
+}
+
+/*
+ * Encodes a code point as UTF-8 into buf, up to the room left
+ *
+ * @return encoded length, may be larger than room.
+ */
+size_t
+eupnp_soap_utf8_put(char *buf, size_t room, unsigned long cp)
+{
+   char tmp[4];
+   size_t n, i;
+
+   if (cp < 0x80)
+     {
+	tmp[0] = cp;
+	n = 1;
+     }
+   else if (cp < 0x800)
+     {
+	tmp[0] = 0xc0 | (cp >> 6);
+	tmp[1] = 0x80 | (cp & 0x3f);
+	n = 2;
+     }
+   else if (cp < 0x10000)
+     {
+	tmp[0] = 0xe0 | (cp >> 12);
+	tmp[1] = 0x80 | ((cp >> 6) & 0x3f);
+	tmp[2] = 0x80 | (cp & 0x3f);
+	n = 3;
+     }
+   else
+     {
+	tmp[0] = 0xf0 | (cp >> 18);
+	tmp[1] = 0x80 | ((cp >> 12) & 0x3f);
+	tmp[2] = 0x80 | ((cp >> 6) & 0x3f);
+	tmp[3] = 0x80 | (cp & 0x3f);
+	n = 4;
+     }
+
+   for (i = 0; i < n && i < room; i++) buf[i] = tmp[i];
+
+   return n;
+}
+
+/*
+ * Decodes the XML entity at p (pointing to '&'), predefined or numeric
+ *
+ * @param p entity start
+ * @param end end of input
+ * @param cp set to the code point
+ *
+ * @return entity length, 0 if it is not a known entity.
+ */
+size_t
+eupnp_soap_entity_decode(const char *p, const char *end, unsigned long *cp)
+{
+   static const struct {
+      const char *name;
+      size_t len;
+      char c;
+   } entities[] = {
+	{"&lt;", 4, '<'},
+	{"&gt;", 4, '>'},
+	{"&amp;", 5, '&'},
+	{"&quot;", 6, '"'},
+	{"&apos;", 6, '\''}
+   };
+   const char *semi;
+   unsigned int i;
+   char *e;
+
+   for (i = 0; i < sizeof(entities) / sizeof(entities[0]); i++)
+      if ((size_t)(end - p) >= entities[i].len &&
+	  !memcmp(p, entities[i].name, entities[i].len))
+	{
+	   *cp = (unsigned char)entities[i].c;
+	   return entities[i].len;
+	}
+
+   if (end - p < 4 || p[1] != '#') return 0;
+
+   semi = memchr(p, ';', (end - p < 12) ? end - p : 12);
+   if (!semi) return 0;
+
+   if (p[2] == 'x' || p[2] == 'X')
+      *cp = strtoul(p + 3, &e, 16);
+   else
+      *cp = strtoul(p + 2, &e, 10);
+
+   if (e != semi || e == p + 2 || *cp == 0 || *cp > 0x10ffff) return 0;
+
+   return semi - p + 1;
+}
+
+/*
+ * Unescapes a string argument into buf, like snprintf().
+ *
+ * @param s string argument
+ * @param buf destination, NULL-terminated when size is not 0
+ * @param size buf size
+ *
+ * @return unescaped length, excluding the terminating NULL. The string was
+ *         truncated if it is size or more.
+ */
+size_t
+eupnp_soap_string_unescape(const Eupnp_Soap_String *s, char *buf, size_t size)
+{
+   const char *p = s->value;
+   const char *end = s->value + s->len;
+   size_t n = 0, room, elen;
+   unsigned long cp;
+
+   room = size ? size - 1 : 0;
+
+   if (!s->escaped)
+     {
+	if (room) memcpy(buf, p, (s->len < room) ? s->len : room);
+	n = s->len;
+	goto out;
+     }
+
+   while (p < end)
+     {
+	if (*p == '&' && (elen = eupnp_soap_entity_decode(p, end, &cp)))
+	  {
+	     n += eupnp_soap_utf8_put(buf + n, (n < room) ? room - n : 0, cp);
+	     p += elen;
+	     continue;
+	  }
+
+	if (n < room) buf[n] = *p;
+	n++;
+	p++;
+     }
+
+out:
+   if (size) buf[(n < room) ? n : room] = '\0';
+
+   return n;
+}
+
+/*
+ * Unescapes a string argument into a newly allocated string
+ *
+ * @return string to be freed with free() or NULL on error.
+ */
+char *
+eupnp_soap_string_dup(const Eupnp_Soap_String *s)
+{
+   size_t len;
+   char *r;
+
+   // Unescaping never makes a string longer
+   r = malloc(s->len + 1);
+
+   if (!r)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not duplicate SOAP string.\n");
+	return NULL;
+     }
+
+   len = eupnp_soap_string_unescape(s, r, s->len + 1);
+   r[len] = '\0';
+
+   return r;
+}
@@ -0,0 +1,80 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_SOAP_H
+#define _EUPNP_SOAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <Eina.h>
+
+/*
+ * Types of the state variables related to action arguments. Smaller integer
+ * types (ui1, ui2, i1, i2) use the ui4 and i4 slots, types without a
+ * dedicated slot are decoded as strings.
+ */
+typedef enum {
+   EUPNP_SOAP_TYPE_STRING,
+   EUPNP_SOAP_TYPE_UI4,
+   EUPNP_SOAP_TYPE_I4,
+   EUPNP_SOAP_TYPE_BOOLEAN
+} Eupnp_Soap_Type;
+
+/*
+ * Out argument of an action, as listed in the service SCPD. The decoded
+ * value is stored offset bytes into the caller struct, in an uint32_t,
+ * int32_t, Eina_Bool or Eupnp_Soap_String slot depending on type.
+ */
+typedef struct _Eupnp_Soap_Arg {
+   const char *name;
+   Eupnp_Soap_Type type;
+   size_t offset;
+} Eupnp_Soap_Arg;
+
+/*
+ * String argument, pointing into the response body and still escaped when
+ * escaped is set. Use eupnp_soap_string_unescape() or eupnp_soap_string_dup()
+ * to get the actual text.
+ */
+typedef struct _Eupnp_Soap_String {
+   const char *value;
+   size_t len;
+   Eina_Bool escaped;
+} Eupnp_Soap_String;
+
+typedef struct _Eupnp_Soap_Decoder Eupnp_Soap_Decoder;
+
+
+Eupnp_Soap_Type     eupnp_soap_type_get(const char *data_type) EINA_ARG_NONNULL(1);
+
+Eupnp_Soap_Decoder *eupnp_soap_decoder_new(const char *action, const Eupnp_Soap_Arg *args, unsigned int count) EINA_ARG_NONNULL(1);
+void                eupnp_soap_decoder_free(Eupnp_Soap_Decoder *d) EINA_ARG_NONNULL(1);
+int                 eupnp_soap_response_decode(const Eupnp_Soap_Decoder *d, const char *body, size_t len, void *out) EINA_ARG_NONNULL(1,2,4);
+int                 eupnp_soap_fault_code_get(const char *body, size_t len) EINA_ARG_NONNULL(1);
+
+size_t              eupnp_soap_string_unescape(const Eupnp_Soap_String *s, char *buf, size_t size) EINA_ARG_NONNULL(1);
+char               *eupnp_soap_string_dup(const Eupnp_Soap_String *s) EINA_ARG_NONNULL(1);
+
+size_t              eupnp_soap_entity_decode(const char *p, const char *end, unsigned long *cp) EINA_ARG_NONNULL(1,2,3);
+size_t              eupnp_soap_utf8_put(char *buf, size_t room, unsigned long cp);
+
+
+#endif /* _EUPNP_SOAP_H */
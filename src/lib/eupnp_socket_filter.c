@@ -0,0 +1,376 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_socket_filter.h"
+
+/*
+ * Generates classic BPF programs for the SSDP socket, so that datagrams
+ * nobody is interested in are dropped by the kernel instead of being queued,
+ * copied to user space and waking up the loop.
+ *
+ * A datagram passes if its source address belongs to one of the subnets
+ * (any source when there is none) and it starts like one of the message
+ * classes accepted (anything when there is none), the same way
+ * eupnp_ssdp_message_classify() tells them apart. NOTIFY subtypes and
+ * ST/NT targets live in headers at variable offsets, which classic BPF
+ * cannot search, so they are still filtered in user space.
+ *
+ * The program sees UDP datagrams from the UDP header on; the source address
+ * is loaded from the IP header through SKF_NET_OFF.
+ */
+
+#define EUPNP_SOCKET_FILTER_PAYLOAD 8
+#define EUPNP_SOCKET_FILTER_SADDR 12
+
+/* Subnet checks, message checks and the verdicts */
+#define EUPNP_SOCKET_FILTER_INSNS_MAX (3 * EUPNP_SOCKET_FILTER_SUBNETS_MAX + 32)
+
+typedef struct _Eupnp_Socket_Filter_Subnet Eupnp_Socket_Filter_Subnet;
+
+struct _Eupnp_Socket_Filter_Subnet {
+   uint32_t net;   /* host byte order */
+   uint32_t mask;
+};
+
+struct _Eupnp_Socket_Filter {
+   unsigned int classes;   /* bit per Eupnp_SSDP_Message_Class accepted */
+   Eupnp_Socket_Filter_Subnet subnets[EUPNP_SOCKET_FILTER_SUBNETS_MAX];
+   unsigned int subnet_count;
+};
+
+/* Message starts checked, indexed by Eupnp_SSDP_Message_Class */
+static const char *_eupnp_socket_filter_prefixes[EUPNP_SSDP_MESSAGE_CLASSES] = {
+   [EUPNP_SSDP_MESSAGE_UNKNOWN] = NULL,
+   [EUPNP_SSDP_MESSAGE_RESPONSE] = "HTTP/1.",
+   [EUPNP_SSDP_MESSAGE_NOTIFY_ALIVE] = "NOTIFY ",
+   [EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE] = "NOTIFY ",
+   [EUPNP_SSDP_MESSAGE_NOTIFY_UPDATE] = "NOTIFY ",
+   [EUPNP_SSDP_MESSAGE_MSEARCH] = "M-SEARCH "
+};
+
+
+/*
+ * Private API
+ */
+
+/*
+ * Splits a prefix in 4, 2 and 1 byte loads
+ *
+ * @return number of loads.
+ */
+static unsigned int
+eupnp_socket_filter_chunks_count(const char *prefix)
+{
+   size_t len = strlen(prefix);
+
+   return len / 4 + (len % 4) / 2 + len % 2;
+}
+
+/*
+ * Emits the checks of a prefix. Every load is followed by a comparison
+ * jumping to fail on mismatch, the last one to pass on match.
+ *
+ * @return number of instructions emitted.
+ */
+static unsigned int
+eupnp_socket_filter_prefix_emit(struct sock_filter *insns, unsigned int pc, const char *prefix, unsigned int pass, unsigned int fail)
+{
+   const unsigned char *p = (const unsigned char *)prefix;
+   size_t off = 0, len = strlen(prefix);
+   unsigned int start = pc;
+   uint32_t value;
+   int size, n, i;
+
+   while (off < len)
+     {
+	n = (len - off >= 4) ? 4 : (len - off >= 2) ? 2 : 1;
+	size = (n == 4) ? BPF_W : (n == 2) ? BPF_H : BPF_B;
+
+	// Loads are converted to host byte order
+	for (value = 0, i = 0; i < n; i++) value = (value << 8) | p[off + i];
+
+	insns[pc++] = (struct sock_filter)
+	   BPF_STMT(BPF_LD | size | BPF_ABS, EUPNP_SOCKET_FILTER_PAYLOAD + off);
+
+	off += n;
+	insns[pc] = (struct sock_filter)
+	   BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, value,
+		    (off == len) ? pass - pc - 1 : 0, fail - pc - 1);
+	pc++;
+     }
+
+   return pc - start;
+}
+
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Socket_Filter structure. A new filter accepts
+ * everything.
+ *
+ * @return Eupnp_Socket_Filter instance or NULL on error.
+ */
+Eupnp_Socket_Filter *
+eupnp_socket_filter_new(void)
+{
+   Eupnp_Socket_Filter *f;
+
+   f = calloc(1, sizeof(Eupnp_Socket_Filter));
+
+   if (!f)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create socket filter.\n");
+	return NULL;
+     }
+
+   return f;
+}
+
+/*
+ * Constructor for a filter matching a control point search filter: search
+ * responses and NOTIFY messages are accepted, which are what the search
+ * filter is applied to, and M-SEARCH requests are dropped.
+ *
+ * The patterns are not part of the program, as ST and NT are headers at
+ * variable offsets; targets keep being checked in user space by sf.
+ *
+ * @param sf search filter of the control point
+ *
+ * @return Eupnp_Socket_Filter instance or NULL on error.
+ */
+Eupnp_Socket_Filter *
+eupnp_socket_filter_search_new(const Eupnp_Search_Filter *sf)
+{
+   Eupnp_Socket_Filter *f;
+
+   (void)sf;
+
+   if (!(f = eupnp_socket_filter_new())) return NULL;
+
+   eupnp_socket_filter_message_add(f, EUPNP_SSDP_MESSAGE_RESPONSE);
+   eupnp_socket_filter_message_add(f, EUPNP_SSDP_MESSAGE_NOTIFY_ALIVE);
+
+   return f;
+}
+
+void
+eupnp_socket_filter_free(Eupnp_Socket_Filter *f)
+{
+   if (!f) return;
+   free(f);
+}
+
+/*
+ * Accepts a message class. Accepting any NOTIFY class accepts them all, as
+ * their NTS header is too far in for the kernel to look at it. Accepting
+ * EUPNP_SSDP_MESSAGE_UNKNOWN accepts every message.
+ */
+void
+eupnp_socket_filter_message_add(Eupnp_Socket_Filter *f, Eupnp_SSDP_Message_Class cls)
+{
+   if ((unsigned int)cls >= EUPNP_SSDP_MESSAGE_CLASSES) return;
+   f->classes |= 1 << cls;
+}
+
+/*
+ * Accepts datagrams from a subnet
+ *
+ * @param f filter
+ * @param subnet IPv4 subnet in CIDR notation, e.g. 192.168.1.0/24, or a
+ *        single address
+ *
+ * @return EINA_TRUE on success, EINA_FALSE if the subnet is invalid or there
+ *         are already EUPNP_SOCKET_FILTER_SUBNETS_MAX of them.
+ */
+Eina_Bool
+eupnp_socket_filter_subnet_add(Eupnp_Socket_Filter *f, const char *subnet)
+{
+   char addr[INET_ADDRSTRLEN];
+   const char *slash;
+   struct in_addr in;
+   long bits = 32;
+   size_t len;
+
+   if (f->subnet_count == EUPNP_SOCKET_FILTER_SUBNETS_MAX)
+     {
+	ERROR("Too many socket filter subnets.\n");
+	return EINA_FALSE;
+     }
+
+   slash = strchr(subnet, '/');
+   len = slash ? (size_t)(slash - subnet) : strlen(subnet);
+
+   if (slash)
+     {
+	char *end;
+
+	bits = strtol(slash + 1, &end, 10);
+	if (end == slash + 1 || *end || bits < 0 || bits > 32) len = sizeof(addr);
+     }
+
+   if (len >= sizeof(addr))
+     {
+	WARN("Invalid subnet %s\n", subnet);
+	return EINA_FALSE;
+     }
+
+   memcpy(addr, subnet, len);
+   addr[len] = '\0';
+
+   if (inet_pton(AF_INET, addr, &in) != 1)
+     {
+	WARN("Invalid subnet %s\n", subnet);
+	return EINA_FALSE;
+     }
+
+   f->subnets[f->subnet_count].mask = bits ? 0xffffffff << (32 - bits) : 0;
+   f->subnets[f->subnet_count].net = ntohl(in.s_addr) &
+				     f->subnets[f->subnet_count].mask;
+   f->subnet_count++;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Removes every subnet and message class, the filter accepts everything
+ * again.
+ */
+void
+eupnp_socket_filter_clear(Eupnp_Socket_Filter *f)
+{
+   f->classes = 0;
+   f->subnet_count = 0;
+}
+
+/*
+ * Generates the BPF program of a filter
+ *
+ * @param f filter
+ * @param insns where to store the program, or NULL to get its length only
+ * @param size room on insns, in instructions
+ *
+ * @return number of instructions, 0 if they do not fit in size.
+ */
+unsigned int
+eupnp_socket_filter_program_get(const Eupnp_Socket_Filter *f, struct sock_filter *insns, unsigned int size)
+{
+   const char *prefixes[EUPNP_SSDP_MESSAGE_CLASSES];
+   unsigned int i, j, n = 0, pc = 0, checks, accept, reject, next;
+
+   // Prefixes to check, unless everything is accepted
+   if (!(f->classes & (1 << EUPNP_SSDP_MESSAGE_UNKNOWN)))
+      for (i = 0; i < EUPNP_SSDP_MESSAGE_CLASSES; i++)
+	{
+	   if (!(f->classes & (1 << i))) continue;
+
+	   for (j = 0; j < n; j++)
+	      if (prefixes[j] == _eupnp_socket_filter_prefixes[i]) break;
+
+	   if (j == n) prefixes[n++] = _eupnp_socket_filter_prefixes[i];
+	}
+
+   checks = f->subnet_count ? 3 * f->subnet_count + 1 : 0;
+   accept = checks;
+
+   for (j = 0; j < n; j++)
+      accept += 2 * eupnp_socket_filter_chunks_count(prefixes[j]);
+
+   if (n) accept++;
+
+   if (!insns) return accept + 1;
+   if (accept + 1 > size) return 0;
+
+   // Source address in one of the subnets, then the message checks
+   for (i = 0; i < f->subnet_count; i++)
+     {
+	insns[pc++] = (struct sock_filter)
+	   BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + EUPNP_SOCKET_FILTER_SADDR);
+	insns[pc++] = (struct sock_filter)
+	   BPF_STMT(BPF_ALU | BPF_AND | BPF_K, f->subnets[i].mask);
+	insns[pc] = (struct sock_filter)
+	   BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, f->subnets[i].net, checks - pc - 1, 0);
+	pc++;
+     }
+
+   if (f->subnet_count)
+      insns[pc++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+   // Starts like one of the prefixes
+   reject = accept - 1;
+
+   for (j = 0; j < n; j++)
+     {
+	next = pc + 2 * eupnp_socket_filter_chunks_count(prefixes[j]);
+	pc += eupnp_socket_filter_prefix_emit(insns, pc, prefixes[j], accept,
+					      (j == n - 1) ? reject : next);
+     }
+
+   if (n)
+      insns[pc++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+   insns[pc++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+   return pc;
+}
+
+/*
+ * Attaches the program of a filter to a transport, replacing the previous
+ * one. A filter accepting everything detaches it instead.
+ *
+ * Messages filtered out never reach eupnp_ssdp_server_dispatch(), hence they
+ * are not accounted in the server metrics either.
+ *
+ * @return EINA_TRUE on success, EINA_FALSE otherwise.
+ */
+Eina_Bool
+eupnp_socket_filter_attach(const Eupnp_Socket_Filter *f, Eupnp_UDP_Transport *s)
+{
+   struct sock_filter insns[EUPNP_SOCKET_FILTER_INSNS_MAX];
+   unsigned int count;
+
+   count = eupnp_socket_filter_program_get(f, insns, EUPNP_SOCKET_FILTER_INSNS_MAX);
+
+   if (!count)
+     {
+	ERROR("Socket filter program too long.\n");
+	return EINA_FALSE;
+     }
+
+   // Only the final verdict left
+   if (count == 1)
+      return eupnp_udp_transport_filter_set(s, NULL, 0);
+
+   DEBUG("Attaching socket filter of %u instructions\n", count);
+
+   return eupnp_udp_transport_filter_set(s, insns, count);
+}
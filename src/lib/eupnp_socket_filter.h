@@ -0,0 +1,46 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_SOCKET_FILTER_H
+#define _EUPNP_SOCKET_FILTER_H
+
+#include <Eina.h>
+#include <eupnp_ssdp.h>
+#include <eupnp_search_filter.h>
+#include <eupnp_udp_transport.h>
+
+/* Source subnets a filter may accept */
+#define EUPNP_SOCKET_FILTER_SUBNETS_MAX 32
+
+typedef struct _Eupnp_Socket_Filter Eupnp_Socket_Filter;
+
+
+Eupnp_Socket_Filter *eupnp_socket_filter_new(void);
+Eupnp_Socket_Filter *eupnp_socket_filter_search_new(const Eupnp_Search_Filter *sf) EINA_ARG_NONNULL(1);
+void                 eupnp_socket_filter_free(Eupnp_Socket_Filter *f) EINA_ARG_NONNULL(1);
+void                 eupnp_socket_filter_message_add(Eupnp_Socket_Filter *f, Eupnp_SSDP_Message_Class cls) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_socket_filter_subnet_add(Eupnp_Socket_Filter *f, const char *subnet) EINA_ARG_NONNULL(1,2);
+void                 eupnp_socket_filter_clear(Eupnp_Socket_Filter *f) EINA_ARG_NONNULL(1);
+unsigned int         eupnp_socket_filter_program_get(const Eupnp_Socket_Filter *f, struct sock_filter *insns, unsigned int size) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_socket_filter_attach(const Eupnp_Socket_Filter *f, Eupnp_UDP_Transport *s) EINA_ARG_NONNULL(1,2);
+
+
+#endif /* _EUPNP_SOCKET_FILTER_H */
@@ -19,13 +19,21 @@
  *
  */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <Eina.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
+#include "eupnp.h"
+#include "eupnp_hash.h"
 #include "eupnp_ssdp.h"
 #include "eupnp_error.h"
 #include "eupnp_udp_transport.h"
+#include "eupnp_probes.h"
 #include "eupnp_http_message.h"
 
 
@@ -35,6 +43,336 @@
 
 static int _eupnp_ssdp_main_count = 0;
 
+char *_eupnp_ssdp_notify = NULL;
+char *_eupnp_ssdp_msearch = NULL;
+char *_eupnp_ssdp_http_version = NULL;
+
+static double
+_eupnp_ssdp_timespec_diff_usec(const struct timespec *end, const struct timespec *start)
+{
+   return (end->tv_sec - start->tv_sec) * 1e6 +
+	  (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+/*
+ * Feeds the queueing delay of the last datagram into the overload detector.
+ *
+ * The delay is smoothed with an EWMA (1/8 weight) and compared against the
+ * thresholds with hysteresis, so that a single late datagram does not flip the
+ * state. Interested parties are notified on transitions.
+ */
+static void
+_eupnp_ssdp_overload_update(Eupnp_SSDP_Server *ssdp, double queue_delay)
+{
+   Eina_Bool overloaded = ssdp->overloaded;
+
+   ssdp->queue_delay_avg += (queue_delay - ssdp->queue_delay_avg) / 8;
+
+   if (!overloaded && ssdp->queue_delay_avg > ssdp->overload_high)
+      overloaded = EINA_TRUE;
+   else if (overloaded && ssdp->queue_delay_avg < ssdp->overload_low)
+      overloaded = EINA_FALSE;
+
+   if (overloaded == ssdp->overloaded)
+      return;
+
+   ssdp->overloaded = overloaded;
+   ssdp->metrics.overload_transitions++;
+
+   if (overloaded)
+      WARN("SSDP server overloaded, average queueing delay %.0fus\n",
+	   ssdp->queue_delay_avg);
+   else
+      INFO("SSDP server no longer overloaded\n");
+
+   if (ssdp->overload_cb)
+      ssdp->overload_cb(ssdp->overload_cb_data, ssdp, overloaded);
+}
+
+static Eina_Bool
+_eupnp_ssdp_prefix_match(const char *msg, size_t len, const char *prefix)
+{
+   size_t prefix_len = strlen(prefix);
+
+   return (len >= prefix_len && !memcmp(msg, prefix, prefix_len));
+}
+
+/*
+ * Finds a header value without parsing the whole message.
+ *
+ * @param key lowercase header name, including the ':'
+ *
+ * @return start of the value (not NULL-terminated) with its length, trailing
+ *         whitespace excluded, on value_len or NULL if the header is not
+ *         present.
+ */
+static const char *
+_eupnp_ssdp_header_find(const char *msg, size_t len, const char *key, size_t *value_len)
+{
+   const char *p = msg;
+   const char *end = msg + len;
+   const char *nl, *value;
+   size_t key_len = strlen(key);
+
+   while ((nl = memchr(p, '\n', end - p)))
+     {
+	p = nl + 1;
+
+	if ((size_t)(end - p) < key_len || strncasecmp(p, key, key_len))
+	   continue;
+
+	p += key_len;
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+
+	value = p;
+	while (p < end && *p != '\r' && *p != '\n') p++;
+	while (p > value && (p[-1] == ' ' || p[-1] == '\t')) p--;
+
+	*value_len = p - value;
+	return value;
+     }
+
+   return NULL;
+}
+
+/*
+ * Parses the max-age directive of a CACHE-CONTROL header value.
+ *
+ * @return max-age in seconds or 0 if not present.
+ */
+static int
+_eupnp_ssdp_max_age_parse(const char *cache_control)
+{
+   const char *p;
+   int max_age;
+
+   if (!cache_control) return 0;
+
+   p = strcasestr(cache_control, "max-age");
+   if (!p) return 0;
+
+   p += 7;
+   while (*p == ' ' || *p == '=') p++;
+
+   // Saturate instead of overflowing on absurd values
+   for (max_age = 0; *p >= '0' && *p <= '9'; p++)
+      if (max_age < 100000000) max_age = max_age * 10 + (*p - '0');
+
+   return max_age;
+}
+
+/*
+ * Decides whether a datagram must be handled before the others on a batch.
+ * These are responses to our own searches and byebyes, losing them would
+ * leave the device view stale.
+ */
+static Eina_Bool
+_eupnp_ssdp_datagram_is_priority(Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Message_Class cls, double now)
+{
+   if (cls == EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE)
+      return EINA_TRUE;
+
+   if (cls == EUPNP_SSDP_MESSAGE_RESPONSE && now <= ssdp->search_deadline)
+      return EINA_TRUE;
+
+   return EINA_FALSE;
+}
+
+/*
+ * Samples alives per USN: the first one of each USN within
+ * EUPNP_SSDP_ALIVE_WINDOW is kept, then one of every alive_sample. Alives
+ * without an USN are keyed on their sender.
+ *
+ * @return EINA_TRUE if the alive must be dropped.
+ */
+static Eina_Bool
+_eupnp_ssdp_alive_shed(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d, double now)
+{
+   Eupnp_SSDP_Alive_Slot *slot;
+   const char *usn;
+   size_t usn_len;
+   uint32_t hash;
+
+   if (!ssdp->shed_policy.alive_sample) return EINA_TRUE;
+
+   usn = _eupnp_ssdp_header_find(d->data, d->len, "usn:", &usn_len);
+
+   if (usn)
+      hash = eupnp_hash(usn, usn_len);
+   else
+      hash = eupnp_hash(&d->addr, sizeof(d->addr));
+
+   slot = &ssdp->alive_slots[hash % EUPNP_SSDP_ALIVE_SLOTS];
+
+   if (slot->hash != hash || !slot->seen ||
+       now - slot->start > EUPNP_SSDP_ALIVE_WINDOW)
+     {
+	slot->hash = hash;
+	slot->seen = 1;
+	slot->start = now;
+	return EINA_FALSE;
+     }
+
+   return ((slot->seen++ % ssdp->shed_policy.alive_sample) != 0);
+}
+
+/*
+ * Decides, according to the shed policy, whether a datagram of the given
+ * class must be dropped.
+ */
+static Eina_Bool
+_eupnp_ssdp_datagram_shed(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d, Eupnp_SSDP_Message_Class cls, double now)
+{
+   const Eupnp_SSDP_Shed_Policy *p = &ssdp->shed_policy;
+
+   switch (cls)
+     {
+      case EUPNP_SSDP_MESSAGE_RESPONSE:
+	 return (p->drop_unsolicited && now > ssdp->search_deadline);
+      case EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE:
+	 return EINA_FALSE;
+      case EUPNP_SSDP_MESSAGE_NOTIFY_ALIVE:
+      case EUPNP_SSDP_MESSAGE_NOTIFY_UPDATE:
+	 return _eupnp_ssdp_alive_shed(ssdp, d, now);
+      case EUPNP_SSDP_MESSAGE_MSEARCH:
+	 return p->drop_msearch;
+      default:
+	 return p->drop_unknown;
+     }
+}
+
+/*
+ * Builds an event out of the parsed headers of a NOTIFY message or search
+ * response and hands it to the event callback.
+ */
+static void
+_eupnp_ssdp_event_emit(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d, Eupnp_SSDP_Message_Class cls, Eina_Array *headers)
+{
+   Eupnp_SSDP_Event ev;
+
+   if (!ssdp->event_cb) return;
+
+   ev.type = cls;
+   ev.target = eupnp_http_header_get(headers,
+			(cls == EUPNP_SSDP_MESSAGE_RESPONSE) ? "st" : "nt");
+   ev.usn = eupnp_http_header_get(headers, "usn");
+   ev.location = eupnp_http_header_get(headers, "location");
+   ev.max_age = _eupnp_ssdp_max_age_parse(eupnp_http_header_get(headers,
+							      "cache-control"));
+   ev.datagram = d;
+
+   if (!ev.target || !ev.usn)
+     {
+	DEBUG("Discarding message without target or USN\n");
+	return;
+     }
+
+   ssdp->event_cb(ssdp->event_cb_data, &ev);
+}
+
+static void
+_eupnp_ssdp_response_process(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d)
+{
+   Eupnp_HTTP_Response *r;
+
+   DEBUG("Message is response!\n");
+
+   r = eupnp_http_response_parse_length(d->data, d->len);
+
+   if (!r)
+     {
+	ERROR("Failed parsing response datagram\n");
+	return;
+     }
+
+   eupnp_http_response_dump(r);
+   _eupnp_ssdp_event_emit(ssdp, d, EUPNP_SSDP_MESSAGE_RESPONSE, r->headers);
+   eupnp_http_response_free(r);
+}
+
+static void
+_eupnp_ssdp_notify_process(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d, Eupnp_SSDP_Message_Class cls)
+{
+   Eupnp_HTTP_Request *m;
+
+   DEBUG("Received NOTIFY request.\n");
+
+   m = eupnp_http_request_parse_length(d->data, d->len);
+
+   if (!m)
+     {
+	ERROR("Failed parsing request datagram\n");
+	return;
+     }
+
+   eupnp_http_request_dump(m);
+   _eupnp_ssdp_event_emit(ssdp, d, cls, m->headers);
+   eupnp_http_request_free(m);
+}
+
+static void
+_eupnp_ssdp_msearch_process(Eupnp_UDP_Datagram *d)
+{
+   const char *target;
+   size_t target_len;
+
+   target = _eupnp_ssdp_header_find(d->data, d->len, "st:", &target_len);
+
+   if (target)
+      DEBUG("Received M-SEARCH for %.*s\n", (int)target_len, target);
+}
+
+/*
+ * Takes the appropriate actions for a datagram, considering its class.
+ *
+ * For NOTIFY messages and search responses the target (NT or ST) is picked
+ * straight from the datagram and checked against the filter before anything
+ * gets parsed.
+ */
+static void
+_eupnp_ssdp_datagram_process(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d, Eupnp_SSDP_Message_Class cls)
+{
+   const char *target;
+   size_t target_len;
+
+   switch (cls)
+     {
+      case EUPNP_SSDP_MESSAGE_RESPONSE:
+      case EUPNP_SSDP_MESSAGE_NOTIFY_ALIVE:
+      case EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE:
+      case EUPNP_SSDP_MESSAGE_NOTIFY_UPDATE:
+	 target = _eupnp_ssdp_header_find(d->data, d->len,
+			(cls == EUPNP_SSDP_MESSAGE_RESPONSE) ? "st:" : "nt:",
+			&target_len);
+
+	 if (!target)
+	   {
+	      DEBUG("Discarding message without target\n");
+	      return;
+	   }
+
+	 if (ssdp->filter_cb &&
+	     !ssdp->filter_cb(ssdp->filter_cb_data, target, target_len))
+	   {
+	      ssdp->metrics.filtered++;
+	      return;
+	   }
+
+	 if (cls == EUPNP_SSDP_MESSAGE_RESPONSE)
+	    _eupnp_ssdp_response_process(ssdp, d);
+	 else
+	    _eupnp_ssdp_notify_process(ssdp, d, cls);
+	 break;
+
+      case EUPNP_SSDP_MESSAGE_MSEARCH:
+	 _eupnp_ssdp_msearch_process(d);
+	 break;
+
+      default:
+	 DEBUG("Discarding unknown message\n");
+     }
+}
+
 /*
  * Public API
  */
@@ -81,10 +419,20 @@ eupnp_ssdp_shutdown(void)
    return --_eupnp_ssdp_main_count;
 }
 
-Eupnp_SSDP_Server *
-eupnp_ssdp_server_new(void)
+/*
+ * Creates a server with the default overload thresholds, shed policy and rate
+ * limiter, but no socket.
+ */
+static Eupnp_SSDP_Server *
+_eupnp_ssdp_server_alloc(void)
 {
    Eupnp_SSDP_Server *ssdp;
+   Eupnp_Rate_Limiter_Policy source_policy = {
+      EUPNP_SSDP_SOURCE_RATE,
+      EUPNP_SSDP_SOURCE_BURST,
+      EUPNP_SSDP_SOURCE_QUARANTINE_THRESHOLD,
+      EUPNP_SSDP_SOURCE_QUARANTINE_TIME
+   };
 
    ssdp = calloc(1, sizeof(Eupnp_SSDP_Server));
 
@@ -95,6 +443,37 @@ eupnp_ssdp_server_new(void)
 	return NULL;
      }
 
+   ssdp->overload_high = EUPNP_SSDP_OVERLOAD_HIGH_USEC;
+   ssdp->overload_low = EUPNP_SSDP_OVERLOAD_LOW_USEC;
+
+   ssdp->shed_policy.enabled = EINA_TRUE;
+   ssdp->shed_policy.batch = EUPNP_SSDP_SHED_BATCH_MAX / 2;
+   ssdp->shed_policy.alive_sample = 4;
+   ssdp->shed_policy.drop_msearch = EINA_TRUE;
+   ssdp->shed_policy.drop_unsolicited = EINA_FALSE;
+   ssdp->shed_policy.drop_unknown = EINA_TRUE;
+
+   ssdp->rate_limiter = eupnp_rate_limiter_new(EUPNP_RATE_LIMITER_DEFAULT_SOURCES,
+					       &source_policy);
+
+   if (!ssdp->rate_limiter)
+     {
+	ERROR("Could not create SSDP server rate limiter.\n");
+	free(ssdp);
+	return NULL;
+     }
+
+   return ssdp;
+}
+
+Eupnp_SSDP_Server *
+eupnp_ssdp_server_new(void)
+{
+   Eupnp_SSDP_Server *ssdp;
+
+   ssdp = _eupnp_ssdp_server_alloc();
+   if (!ssdp) return NULL;
+
    ssdp->udp_sock = eupnp_udp_transport_new(EUPNP_SSDP_ADDR,
 					    EUPNP_SSDP_PORT,
 					    EUPNP_SSDP_LOCAL_IFACE);
@@ -102,18 +481,39 @@ eupnp_ssdp_server_new(void)
    if (!ssdp->udp_sock)
      {
 	ERROR("Could not create SSDP server instance.\n");
-	free(ssdp);
+	eupnp_ssdp_server_free(ssdp);
 	return NULL;
      }
 
    return ssdp;
 }
 
+/*
+ * Creates a SSDP server without a socket
+ *
+ * Datagrams are handed to it with eupnp_ssdp_server_datagram_feed(), e.g. to
+ * replay captured traffic. Searches cannot be sent.
+ *
+ * @return Eupnp_SSDP_Server instance or NULL on error.
+ */
+Eupnp_SSDP_Server *
+eupnp_ssdp_server_offline_new(void)
+{
+   return _eupnp_ssdp_server_alloc();
+}
+
 void
 eupnp_ssdp_server_free(Eupnp_SSDP_Server *ssdp)
 {
+   unsigned int i;
+
    if (!ssdp) return;
-   eupnp_udp_transport_free(ssdp->udp_sock);
+
+   for (i = 0; i < EUPNP_SSDP_SHED_BATCH_MAX; i++)
+      if (ssdp->rx[i]) eupnp_udp_transport_datagram_free(ssdp->rx[i]);
+
+   if (ssdp->rate_limiter) eupnp_rate_limiter_free(ssdp->rate_limiter);
+   if (ssdp->udp_sock) eupnp_udp_transport_free(ssdp->udp_sock);
    free(ssdp);
 }
 
@@ -132,6 +532,9 @@ Eina_Bool
 eupnp_ssdp_discovery_request_send(Eupnp_SSDP_Server *ssdp, int mx, char *search_target)
 {
    char *msearch;
+   double deadline;
+
+   if (!ssdp->udp_sock) return EINA_FALSE;
 
    if (asprintf(&msearch, EUPNP_SSDP_MSEARCH_TEMPLATE,
                 EUPNP_SSDP_ADDR, EUPNP_SSDP_PORT, mx, search_target) < 0)
@@ -145,85 +548,533 @@ eupnp_ssdp_discovery_request_send(Eupnp_SSDP_Server *ssdp, int mx, char *search_
                                EUPNP_SSDP_PORT) < 0)
      {
 	ERROR("Could not send search message.\n");
+	free(msearch);
 	return EINA_FALSE;
      }
 
+   EUPNP_PROBE3(msearch_send, search_target, mx, ssdp->udp_sock->mreq.imr_multiaddr.s_addr);
+
+   /* Responses are expected within mx seconds, give them some slack */
+   deadline = eupnp_time_now() + mx + 1;
+   if (deadline > ssdp->search_deadline)
+      ssdp->search_deadline = deadline;
+
    free(msearch);
    return EINA_TRUE;
 }
 
 /*
- * Called when a datagram is ready to be read from the socket. Parses it and
- * takes the appropriate actions, considering the method of the request.
+ * Sends a search message to a single device (unicast M-Search, UDA 1.1)
+ *
+ * Only the device at addr answers, right away, instead of every device on the
+ * network within mx seconds. Used to check whether a known device is still
+ * there.
  *
- * TODO auto-register me on the event loop.
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param addr device address, port 0 for the SSDP port.
+ * @param search_target target for the search, usually the device's own type
+ *        or UUID.
+ * @return On success EINA_TRUE, EINA_FALSE on error.
  */
-void
-_eupnp_ssdp_on_datagram_available(Eupnp_SSDP_Server *ssdp)
+Eina_Bool
+eupnp_ssdp_unicast_search_send(Eupnp_SSDP_Server *ssdp, const struct sockaddr_in *addr, const char *search_target)
+{
+   char msearch[EUPNP_UDP_PACKET_LEN];
+   char host[INET_ADDRSTRLEN];
+   struct sockaddr_in dest = *addr;
+   double deadline;
+   int len;
+
+   if (!ssdp->udp_sock) return EINA_FALSE;
+
+   if (!dest.sin_port) dest.sin_port = htons(EUPNP_SSDP_PORT);
+
+   if (!inet_ntop(AF_INET, &dest.sin_addr, host, sizeof(host)))
+      return EINA_FALSE;
+
+   len = snprintf(msearch, sizeof(msearch), EUPNP_SSDP_UNICAST_MSEARCH_TEMPLATE,
+		  host, ntohs(dest.sin_port), search_target);
+
+   if (len < 0 || (size_t)len >= sizeof(msearch))
+     {
+	ERROR("Search target too long: %s\n", search_target);
+	return EINA_FALSE;
+     }
+
+   if (eupnp_udp_transport_sendto_addr(ssdp->udp_sock, msearch, len, &dest) < 0)
+     {
+	ERROR("Could not send unicast search message to %s.\n", host);
+	return EINA_FALSE;
+     }
+
+   EUPNP_PROBE3(msearch_send, search_target, 0, dest.sin_addr.s_addr);
+
+   /* Unicast searches are answered at once */
+   deadline = eupnp_time_now() + 1;
+   if (deadline > ssdp->search_deadline)
+      ssdp->search_deadline = deadline;
+
+   return EINA_TRUE;
+}
+
+/*
+ * Retrieves the i-th receive buffer, allocating it if needed.
+ */
+static Eupnp_UDP_Datagram *
+_eupnp_ssdp_rx_get(Eupnp_SSDP_Server *ssdp, unsigned int i)
+{
+   if (!ssdp->rx[i])
+      ssdp->rx[i] = eupnp_udp_transport_datagram_new(EUPNP_UDP_PACKET_LEN);
+
+   return ssdp->rx[i];
+}
+
+/*
+ * Reads the next datagram accepted by the rate limiter into d. Datagrams from
+ * sources over their rate or quarantined are dropped right after being read,
+ * looking only at the binary source address.
+ *
+ * @return EINA_TRUE if a datagram was read, EINA_FALSE if none is available.
+ */
+static Eina_Bool
+_eupnp_ssdp_datagram_recv(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d)
+{
+   Eina_Bool received;
+   unsigned int i;
+
+   for (i = 0; i < EUPNP_SSDP_SHED_BATCH_MAX; i++)
+     {
+	received = eupnp_udp_transport_recvfrom_into(ssdp->udp_sock, d);
+	ssdp->metrics.truncated += d->truncated;
+
+	if (!received) return EINA_FALSE;
+
+	if (!ssdp->rate_limiter ||
+	    eupnp_rate_limiter_check(ssdp->rate_limiter,
+				     d->addr.sin_addr.s_addr, eupnp_time_now()))
+	   return EINA_TRUE;
+
+	ssdp->metrics.rate_limited++;
+     }
+
+   return EINA_FALSE;
+}
+
+/*
+ * Accounts a datagram that has just been read: queueing delay, overload state
+ * and class counters.
+ *
+ * @return class of the datagram.
+ */
+static Eupnp_SSDP_Message_Class
+_eupnp_ssdp_datagram_account(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d)
+{
+   Eupnp_SSDP_Message_Class cls;
+   struct timespec now;
+   double queue_delay;
+
+   clock_gettime(CLOCK_REALTIME, &now);
+
+   DEBUG("Message of %zu bytes\n", d->len);
+
+   queue_delay = _eupnp_ssdp_timespec_diff_usec(&now, &d->timestamp);
+   eupnp_histogram_add(&ssdp->metrics.queue_delay, queue_delay);
+   ssdp->metrics.datagrams++;
+   _eupnp_ssdp_overload_update(ssdp, queue_delay);
+
+   cls = eupnp_ssdp_message_classify(d->data, d->len);
+   ssdp->metrics.received[cls]++;
+
+   return cls;
+}
+
+/*
+ * Accounts the datagrams the kernel dropped since the last batch read. The
+ * counter of the last datagram read covers the whole batch.
+ */
+static void
+_eupnp_ssdp_kernel_drops_account(Eupnp_SSDP_Server *ssdp, const Eupnp_UDP_Datagram *d)
+{
+   uint32_t dropped = d->drops - ssdp->kernel_drops;
+
+   if (!dropped) return;
+
+   // Wraps around along with the kernel counter
+   ssdp->metrics.kernel_dropped += dropped;
+   ssdp->kernel_drops = d->drops;
+
+   DEBUG("Kernel dropped %u datagrams\n", dropped);
+}
+
+/*
+ * Processes a datagram, accounting the time spent on it.
+ */
+static void
+_eupnp_ssdp_datagram_handle(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d, Eupnp_SSDP_Message_Class cls)
+{
+   struct timespec start, end;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   EUPNP_PROBE3(parse_start, d->data, d->len, cls);
+
+   _eupnp_ssdp_datagram_process(ssdp, d, cls);
+
+   EUPNP_PROBE1(parse_end, cls);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   eupnp_histogram_add(&ssdp->metrics.process_delay,
+		       _eupnp_ssdp_timespec_diff_usec(&end, &start));
+}
+
+/*
+ * Drains a batch of datagrams from the socket while overloaded. Priority
+ * datagrams are handled first, the rest go through the shed policy.
+ *
+ * @return number of datagrams read.
+ */
+static unsigned int
+_eupnp_ssdp_batch_handle(Eupnp_SSDP_Server *ssdp)
+{
+   Eupnp_UDP_Datagram *batch[EUPNP_SSDP_SHED_BATCH_MAX];
+   Eupnp_SSDP_Message_Class cls[EUPNP_SSDP_SHED_BATCH_MAX];
+   Eupnp_UDP_Datagram *d;
+   unsigned int i, n, max;
+   double now;
+
+   max = ssdp->shed_policy.batch;
+   if (!max || max > EUPNP_SSDP_SHED_BATCH_MAX)
+      max = EUPNP_SSDP_SHED_BATCH_MAX;
+
+   for (n = 0; n < max; n++)
+     {
+	d = _eupnp_ssdp_rx_get(ssdp, n);
+	if (!d || !_eupnp_ssdp_datagram_recv(ssdp, d)) break;
+	batch[n] = d;
+	cls[n] = _eupnp_ssdp_datagram_account(ssdp, d);
+     }
+
+   if (n) _eupnp_ssdp_kernel_drops_account(ssdp, batch[n - 1]);
+
+   now = eupnp_time_now();
+
+   for (i = 0; i < n; i++)
+     {
+	if (!_eupnp_ssdp_datagram_is_priority(ssdp, cls[i], now))
+	   continue;
+
+	_eupnp_ssdp_datagram_handle(ssdp, batch[i], cls[i]);
+	batch[i] = NULL;
+     }
+
+   for (i = 0; i < n; i++)
+     {
+	if (!batch[i]) continue;
+
+	if (_eupnp_ssdp_datagram_shed(ssdp, batch[i], cls[i], now))
+	   ssdp->metrics.shed[cls[i]]++;
+	else
+	   _eupnp_ssdp_datagram_handle(ssdp, batch[i], cls[i]);
+     }
+
+   DEBUG("Handled batch of %u datagrams while overloaded\n", n);
+
+   return n;
+}
+
+/*
+ * Reads and handles the next datagram, or a batch of them while overloaded.
+ *
+ * @return number of datagrams read, 0 if none was accepted.
+ */
+static unsigned int
+_eupnp_ssdp_datagram_available_handle(Eupnp_SSDP_Server *ssdp)
 {
+   Eupnp_SSDP_Message_Class cls;
    Eupnp_UDP_Datagram *d;
-   const char *tmp;
 
-   d = eupnp_udp_transport_recvfrom(ssdp->udp_sock);
+   if (ssdp->overloaded && ssdp->shed_policy.enabled)
+      return _eupnp_ssdp_batch_handle(ssdp);
 
-   DEBUG("Message from %s:%d\n", d->host, d->port);
+   d = _eupnp_ssdp_rx_get(ssdp, 0);
 
    if (!d)
      {
-	ERROR("Could not retrieve a valid datagram\n");
-	return;
+	ERROR("Could not allocate receive buffer\n");
+	return 0;
      }
 
-   if (eupnp_http_message_is_response(d->data))
+   if (!_eupnp_ssdp_datagram_recv(ssdp, d))
      {
-	DEBUG("Message is response!\n");
+	DEBUG("No datagram accepted\n");
+	return 0;
+     }
 
-	Eupnp_HTTP_Response *r;
-	r = eupnp_http_response_parse(d->data);
+   _eupnp_ssdp_kernel_drops_account(ssdp, d);
+   cls = _eupnp_ssdp_datagram_account(ssdp, d);
+   _eupnp_ssdp_datagram_handle(ssdp, d, cls);
 
-	if (!r)
-	  {
-	     ERROR("Failed parsing response datagram\n");
-	     eupnp_udp_transport_datagram_free(d);
-	     return;
-	  }
+   return 1;
+}
 
-	eupnp_http_response_dump(r);
-	eupnp_http_response_free(r);
+/*
+ * Called when a datagram is ready to be read from the socket. Parses it and
+ * takes the appropriate actions, considering the method of the request.
+ *
+ * Also accounts how long the datagram waited on the socket queue and how long
+ * it took to process it, see eupnp_ssdp_server_metrics_get(). While the server
+ * is overloaded, datagrams are handled in batches according to the shed policy
+ * (see eupnp_ssdp_server_shed_policy_set()). Datagrams from sources over
+ * their rate are dropped before any parsing, see
+ * eupnp_ssdp_server_rate_limiter_get().
+ *
+ * See eupnp_ssdp_server_dispatch() for handling everything that is ready.
+ */
+void
+_eupnp_ssdp_on_datagram_available(Eupnp_SSDP_Server *ssdp)
+{
+   _eupnp_ssdp_datagram_available_handle(ssdp);
+}
+
+/*
+ * Handles the datagrams waiting on the socket
+ *
+ * Meant to be called when the socket (see eupnp_udp_transport_fd_get()) is
+ * readable, from any event loop. Datagrams are read until the socket is
+ * empty or max have been read, the socket stays readable in the latter case.
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param max maximum number of datagrams to read, 0 for no limit.
+ * @return number of datagrams read.
+ */
+unsigned int
+eupnp_ssdp_server_dispatch(Eupnp_SSDP_Server *ssdp, unsigned int max)
+{
+   unsigned int n, total = 0;
+
+   if (!ssdp->udp_sock) return 0;
+
+   while (!max || total < max)
+     {
+	n = _eupnp_ssdp_datagram_available_handle(ssdp);
+	if (!n) break;
+	total += n;
      }
-   else
+
+   return total;
+}
+
+/*
+ * Hands a datagram to the server as if it had been read from the socket
+ *
+ * The datagram goes through the rate limiter, classification, target filter
+ * and parsing exactly like received ones, updating the server metrics. Its
+ * timestamp is taken as the arrival time for the rate limiter, so captured
+ * traffic is limited as it was when captured regardless of the replay speed.
+ * Queueing delay and overload shedding are not accounted, they depend on the
+ * socket and not on the traffic.
+ *
+ * @param ssdp Eupnp_SSDP_Server instance, usually created with
+ *        eupnp_ssdp_server_offline_new().
+ * @param d datagram, with its source address and timestamp set.
+ * @return EINA_TRUE if the datagram was handled, EINA_FALSE if it was rate
+ *         limited.
+ */
+Eina_Bool
+eupnp_ssdp_server_datagram_feed(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d)
+{
+   Eupnp_SSDP_Message_Class cls;
+
+   if (ssdp->rate_limiter &&
+       !eupnp_rate_limiter_check(ssdp->rate_limiter, d->addr.sin_addr.s_addr,
+				 d->timestamp.tv_sec + d->timestamp.tv_nsec / 1e9))
      {
-	DEBUG("Message is request!\n");
-	Eupnp_HTTP_Request *m;
-	m = eupnp_http_request_parse(d->data);
+	ssdp->metrics.rate_limited++;
+	return EINA_FALSE;
+     }
 
-	if (!m)
-	  {
-	     ERROR("Failed parsing request datagram\n");
-	     eupnp_udp_transport_datagram_free(d);
-	     return;
-	  }
+   DEBUG("Message of %zu bytes fed\n", d->len);
 
-	eupnp_http_request_dump(m);
+   ssdp->metrics.datagrams++;
+   cls = eupnp_ssdp_message_classify(d->data, d->len);
+   ssdp->metrics.received[cls]++;
 
-	if (m->method == _eupnp_ssdp_notify)
-	  {
-	     // TODO Handle notify message (ssdp:alive or ssdp:byebye)
-	     DEBUG("Received NOTIFY request.\n");
-	  }
-	else if (m->method == _eupnp_ssdp_msearch)
-	  {
-	     // TODO Remove me.
-	     DEBUG("Received M-SEARCH request\n'");
-	     tmp = eupnp_http_request_header_get(m, "st");
+   _eupnp_ssdp_datagram_handle(ssdp, d, cls);
 
-	     if (tmp)
-		DEBUG("Search Target is %s\n", tmp);
+   return EINA_TRUE;
+}
 
-	  }
+/*
+ * Checks whether the server is overloaded
+ *
+ * The server is overloaded when datagrams have been waiting too long on the
+ * socket queue before being handled, see
+ * eupnp_ssdp_server_overload_thresholds_set().
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @return EINA_TRUE if overloaded, EINA_FALSE otherwise.
+ */
+Eina_Bool
+eupnp_ssdp_server_overloaded_get(const Eupnp_SSDP_Server *ssdp)
+{
+   return ssdp->overloaded;
+}
 
-	eupnp_http_request_free(m);
+/*
+ * Sets the overload thresholds
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param high_usec average queueing delay, in microseconds, above which the
+ *        server enters the overload state.
+ * @param low_usec average queueing delay, in microseconds, below which the
+ *        server leaves the overload state. Must be lower than @p high_usec.
+ */
+void
+eupnp_ssdp_server_overload_thresholds_set(Eupnp_SSDP_Server *ssdp, double high_usec, double low_usec)
+{
+   if (low_usec > high_usec)
+     {
+	WARN("Low overload threshold above the high one, ignoring.\n");
+	return;
      }
 
-   eupnp_udp_transport_datagram_free(d);
+   ssdp->overload_high = high_usec;
+   ssdp->overload_low = low_usec;
+}
+
+/*
+ * Sets the function called when the server enters or leaves the overload state
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param cb callback, NULL for unsetting.
+ * @param data data passed to the callback.
+ */
+void
+eupnp_ssdp_server_overload_callback_set(Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Overload_Cb cb, void *data)
+{
+   ssdp->overload_cb = cb;
+   ssdp->overload_cb_data = data;
+}
+
+/*
+ * Retrieves the server metrics
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @return metrics, owned by the server.
+ */
+const Eupnp_Metrics *
+eupnp_ssdp_server_metrics_get(const Eupnp_SSDP_Server *ssdp)
+{
+   return &ssdp->metrics;
+}
+
+/*
+ * Sets the policy applied to incoming datagrams while the server is
+ * overloaded
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param policy policy to copy from.
+ */
+void
+eupnp_ssdp_server_shed_policy_set(Eupnp_SSDP_Server *ssdp, const Eupnp_SSDP_Shed_Policy *policy)
+{
+   ssdp->shed_policy = *policy;
+}
+
+/*
+ * Retrieves the policy applied to incoming datagrams while the server is
+ * overloaded
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param policy policy to copy into.
+ */
+void
+eupnp_ssdp_server_shed_policy_get(const Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Shed_Policy *policy)
+{
+   *policy = ssdp->shed_policy;
+}
+
+/*
+ * Sets the function that decides which targets are of interest
+ *
+ * NOTIFY messages and search responses whose target (NT or ST) is rejected
+ * are discarded before being parsed.
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param cb filter, NULL for accepting all targets.
+ * @param data data passed to the filter.
+ */
+void
+eupnp_ssdp_server_filter_set(Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Filter_Cb cb, void *data)
+{
+   ssdp->filter_cb = cb;
+   ssdp->filter_cb_data = data;
+}
+
+/*
+ * Sets the function called for every NOTIFY message and search response
+ * accepted
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @param cb callback, NULL for unsetting.
+ * @param data data passed to the callback.
+ */
+void
+eupnp_ssdp_server_event_callback_set(Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Event_Cb cb, void *data)
+{
+   ssdp->event_cb = cb;
+   ssdp->event_cb_data = data;
+}
+
+/*
+ * Retrieves the per-source rate limiter
+ *
+ * Use it for changing the per-source policy or for retrieving the top
+ * talkers (see eupnp_rate_limiter_top_talkers_get()).
+ *
+ * @param ssdp Eupnp_SSDP_Server instance.
+ * @return rate limiter, owned by the server.
+ */
+Eupnp_Rate_Limiter *
+eupnp_ssdp_server_rate_limiter_get(const Eupnp_SSDP_Server *ssdp)
+{
+   return ssdp->rate_limiter;
+}
+
+/*
+ * Classifies a SSDP message looking only at its first bytes and NTS header
+ *
+ * @param msg message, doesn't need to be NULL-terminated.
+ * @param len message length.
+ *
+ * @return message class, EUPNP_SSDP_MESSAGE_UNKNOWN if not recognized.
+ */
+Eupnp_SSDP_Message_Class
+eupnp_ssdp_message_classify(const char *msg, size_t len)
+{
+   const char *nts;
+   size_t nts_len;
+
+   if (_eupnp_ssdp_prefix_match(msg, len, "HTTP/1."))
+      return EUPNP_SSDP_MESSAGE_RESPONSE;
+
+   if (_eupnp_ssdp_prefix_match(msg, len, "M-SEARCH "))
+      return EUPNP_SSDP_MESSAGE_MSEARCH;
+
+   if (!_eupnp_ssdp_prefix_match(msg, len, "NOTIFY "))
+      return EUPNP_SSDP_MESSAGE_UNKNOWN;
+
+   nts = _eupnp_ssdp_header_find(msg, len, "nts:", &nts_len);
+
+   if (!nts)
+      return EUPNP_SSDP_MESSAGE_UNKNOWN;
+
+   if (_eupnp_ssdp_prefix_match(nts, nts_len, EUPNP_SSDP_NOTIFY_ALIVE))
+      return EUPNP_SSDP_MESSAGE_NOTIFY_ALIVE;
+
+   if (_eupnp_ssdp_prefix_match(nts, nts_len, EUPNP_SSDP_NOTIFY_BYEBYE))
+      return EUPNP_SSDP_MESSAGE_NOTIFY_BYEBYE;
+
+   if (_eupnp_ssdp_prefix_match(nts, nts_len, EUPNP_SSDP_NOTIFY_UPDATE))
+      return EUPNP_SSDP_MESSAGE_NOTIFY_UPDATE;
+
+   return EUPNP_SSDP_MESSAGE_UNKNOWN;
 }
@@ -22,8 +22,11 @@
 #ifndef _EUPNP_SSDP_H
 #define _EUPNP_SSDP_H
 
+#include <stdint.h>
 #include <Eina.h>
 #include <eupnp_udp_transport.h>
+#include <eupnp_metrics.h>
+#include <eupnp_rate_limiter.h>
 
 #define EUPNP_SSDP_ADDR "239.255.255.250"
 #define EUPNP_SSDP_PORT 1900
@@ -35,23 +38,142 @@
                                     "MX: %d\r\n"                  \
                                     "ST: %s\r\n\r\n"              \
 
+/* Unicast searches (UDA 1.1) are sent to a device's address and carry no MX */
+#define EUPNP_SSDP_UNICAST_MSEARCH_TEMPLATE "M-SEARCH * HTTP/1.1\r\n"     \
+                                            "HOST: %s:%d\r\n"             \
+                                            "MAN: \"ssdp:discover\"\r\n"  \
+                                            "ST: %s\r\n\r\n"              \
+
 #define EUPNP_SSDP_NOTIFY_ALIVE "ssdp:alive"
 #define EUPNP_SSDP_NOTIFY_BYEBYE "ssdp:byebye"
+#define EUPNP_SSDP_NOTIFY_UPDATE "ssdp:update"
+
+/*
+ * Socket queueing delay (microseconds) above which the server enters the
+ * overload state and below which it leaves it. The delay is averaged over the
+ * last few datagrams.
+ */
+#define EUPNP_SSDP_OVERLOAD_HIGH_USEC 20000
+#define EUPNP_SSDP_OVERLOAD_LOW_USEC 5000
+
+/*
+ * Maximum number of datagrams drained from the socket on a single wakeup while
+ * overloaded.
+ */
+#define EUPNP_SSDP_SHED_BATCH_MAX 64
+
+/*
+ * Alive sampling while overloaded: the first alive of each USN is always kept
+ * for EUPNP_SSDP_ALIVE_WINDOW seconds, then sampling for that USN starts
+ * over. USNs are tracked on EUPNP_SSDP_ALIVE_SLOTS slots; USNs sharing a slot
+ * evict each other, which only makes sampling less aggressive.
+ */
+#define EUPNP_SSDP_ALIVE_WINDOW 30
+#define EUPNP_SSDP_ALIVE_SLOTS 256
+
+/*
+ * Default per-source limits: datagrams per second, burst, dropped datagrams
+ * that trigger a quarantine and the quarantine time in seconds.
+ */
+#define EUPNP_SSDP_SOURCE_RATE 20
+#define EUPNP_SSDP_SOURCE_BURST 60
+#define EUPNP_SSDP_SOURCE_QUARANTINE_THRESHOLD 200
+#define EUPNP_SSDP_SOURCE_QUARANTINE_TIME 60
 
 
 /*
  * Shared strings, retrieve it with stringshare{ref|add}
  */
-char *_eupnp_ssdp_notify;
-char *_eupnp_ssdp_msearch;
-char *_eupnp_ssdp_http_version;
+extern char *_eupnp_ssdp_notify;
+extern char *_eupnp_ssdp_msearch;
+extern char *_eupnp_ssdp_http_version;
 
 
 typedef struct _Eupnp_SSDP_Server Eupnp_SSDP_Server;
+typedef struct _Eupnp_SSDP_Shed_Policy Eupnp_SSDP_Shed_Policy;
+typedef struct _Eupnp_SSDP_Alive_Slot Eupnp_SSDP_Alive_Slot;
+
+typedef struct _Eupnp_SSDP_Event Eupnp_SSDP_Event;
+
+typedef Eina_Bool (*Eupnp_SSDP_Filter_Cb) (void *data, const char *target, size_t len);
+typedef void (*Eupnp_SSDP_Event_Cb) (void *data, const Eupnp_SSDP_Event *ev);
 
+typedef void (*Eupnp_SSDP_Overload_Cb) (void *data, Eupnp_SSDP_Server *ssdp, Eina_Bool overloaded);
+
+
+/*
+ * What to do with incoming datagrams while the server is overloaded.
+ *
+ * While overloaded, up to batch datagrams are drained on each wakeup and
+ * classified from their first bytes. Responses to our own searches and
+ * byebyes are handled first, then the rest according to the policy. Shed
+ * datagrams are never parsed.
+ */
+struct _Eupnp_SSDP_Shed_Policy {
+   Eina_Bool enabled;
+   unsigned int batch;           /* datagrams drained per wakeup */
+   unsigned int alive_sample;    /* keep one of every alive_sample alives of a USN, 0 drops all */
+   Eina_Bool drop_msearch;       /* drop M-SEARCH requests from other control points */
+   Eina_Bool drop_unsolicited;   /* drop responses that arrive with no search in flight */
+   Eina_Bool drop_unknown;       /* drop datagrams that are not SSDP */
+};
+
+/*
+ * Alives seen of a USN (identified by hash) since start.
+ */
+struct _Eupnp_SSDP_Alive_Slot {
+   uint32_t hash;
+   unsigned int seen;
+   double start;
+};
+
+/*
+ * Presence information carried by a NOTIFY message or search response.
+ *
+ * target is the NT or ST header, location is NULL for byebyes and max_age is
+ * 0 when not present. datagram is NULL for events synthesized locally, e.g.
+ * the byebye a control point reports when an announcement expires, and for
+ * events handed over from a control point I/O thread.
+ * Everything is only valid during the event callback.
+ */
+struct _Eupnp_SSDP_Event {
+   Eupnp_SSDP_Message_Class type;
+   const char *target;
+   const char *usn;
+   const char *location;
+   int max_age;
+   Eupnp_UDP_Datagram *datagram;
+};
 
 struct _Eupnp_SSDP_Server {
    Eupnp_UDP_Transport *udp_sock;
+   Eupnp_Metrics metrics;
+   uint32_t kernel_drops;        /* last kernel drop counter seen */
+
+   /* Load shedding */
+   Eupnp_SSDP_Shed_Policy shed_policy;
+   Eupnp_SSDP_Alive_Slot alive_slots[EUPNP_SSDP_ALIVE_SLOTS];
+   double search_deadline;
+
+   /* Overload detection */
+   double queue_delay_avg;
+   double overload_high;
+   double overload_low;
+   Eina_Bool overloaded;
+   Eupnp_SSDP_Overload_Cb overload_cb;
+   void *overload_cb_data;
+
+   /* Target filter and event delivery */
+   Eupnp_SSDP_Filter_Cb filter_cb;
+   void *filter_cb_data;
+   Eupnp_SSDP_Event_Cb event_cb;
+   void *event_cb_data;
+
+   /* Per-source rate limiting, NULL if disabled */
+   Eupnp_Rate_Limiter *rate_limiter;
+
+   /* Receive buffers, allocated on demand */
+   Eupnp_UDP_Datagram *rx[EUPNP_SSDP_SHED_BATCH_MAX];
 };
 
 
@@ -59,10 +181,26 @@ int                 eupnp_ssdp_init(void);
 int                 eupnp_ssdp_shutdown(void);
 
 Eupnp_SSDP_Server  *eupnp_ssdp_server_new(void);
+Eupnp_SSDP_Server  *eupnp_ssdp_server_offline_new(void);
 void                eupnp_ssdp_server_free(Eupnp_SSDP_Server *ssdp) EINA_ARG_NONNULL(1);
 
 Eina_Bool           eupnp_ssdp_discovery_request_send(Eupnp_SSDP_Server *ssdp, int mx, char *search_target) EINA_ARG_NONNULL(1,2,3);
+Eina_Bool           eupnp_ssdp_unicast_search_send(Eupnp_SSDP_Server *ssdp, const struct sockaddr_in *addr, const char *search_target) EINA_ARG_NONNULL(1,2,3);
 void               _eupnp_ssdp_on_datagram_available(Eupnp_SSDP_Server *ssdp) EINA_ARG_NONNULL(1);
+unsigned int        eupnp_ssdp_server_dispatch(Eupnp_SSDP_Server *ssdp, unsigned int max) EINA_ARG_NONNULL(1);
+Eina_Bool           eupnp_ssdp_server_datagram_feed(Eupnp_SSDP_Server *ssdp, Eupnp_UDP_Datagram *d) EINA_ARG_NONNULL(1,2);
+
+Eina_Bool           eupnp_ssdp_server_overloaded_get(const Eupnp_SSDP_Server *ssdp) EINA_ARG_NONNULL(1);
+void                eupnp_ssdp_server_overload_thresholds_set(Eupnp_SSDP_Server *ssdp, double high_usec, double low_usec) EINA_ARG_NONNULL(1);
+void                eupnp_ssdp_server_overload_callback_set(Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Overload_Cb cb, void *data) EINA_ARG_NONNULL(1);
+const Eupnp_Metrics *eupnp_ssdp_server_metrics_get(const Eupnp_SSDP_Server *ssdp) EINA_ARG_NONNULL(1);
+void                eupnp_ssdp_server_shed_policy_set(Eupnp_SSDP_Server *ssdp, const Eupnp_SSDP_Shed_Policy *policy) EINA_ARG_NONNULL(1,2);
+void                eupnp_ssdp_server_shed_policy_get(const Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Shed_Policy *policy) EINA_ARG_NONNULL(1,2);
+void                eupnp_ssdp_server_filter_set(Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Filter_Cb cb, void *data) EINA_ARG_NONNULL(1);
+void                eupnp_ssdp_server_event_callback_set(Eupnp_SSDP_Server *ssdp, Eupnp_SSDP_Event_Cb cb, void *data) EINA_ARG_NONNULL(1);
+Eupnp_Rate_Limiter *eupnp_ssdp_server_rate_limiter_get(const Eupnp_SSDP_Server *ssdp) EINA_ARG_NONNULL(1);
+
+Eupnp_SSDP_Message_Class eupnp_ssdp_message_classify(const char *msg, size_t len) EINA_ARG_NONNULL(1);
 
 
 #endif /* _EUPNP_SSDP_H */
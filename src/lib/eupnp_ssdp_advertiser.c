@@ -0,0 +1,718 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <Eina.h>
+
+#include "eupnp.h"
+#include "eupnp_error.h"
+#include "eupnp_udp_transport.h"
+#include "eupnp_ssdp_advertiser.h"
+
+/*
+ * A root device with d embedded devices and k service types is announced
+ * with 3 + 2d + k NOTIFY messages: upnp:rootdevice, the root UUID and device
+ * type, UUID and type of each embedded device, then each service type.
+ *
+ * Every alive, byebye and update message of an advertisement is rendered once
+ * into a single buffer, so announcing is a batched send of ready packets.
+ * Advertisements re-announce themselves at a random point between a quarter
+ * and half of their max-age, which keeps many devices hosted by the same
+ * process from announcing in lockstep. Each advertiser has its own seeded
+ * random state for that.
+ *
+ * When the socket send buffer fills up, the packets left over are copied to
+ * the advertiser backlog and sent from a timer, in order, before anything
+ * else is sent.
+ */
+
+typedef enum {
+   EUPNP_SSDP_ADVERTISEMENT_ALIVE,
+   EUPNP_SSDP_ADVERTISEMENT_BYEBYE,
+   EUPNP_SSDP_ADVERTISEMENT_UPDATE,
+   EUPNP_SSDP_ADVERTISEMENT_KINDS
+} Eupnp_SSDP_Advertisement_Kind;
+
+typedef struct _Eupnp_SSDP_Advertised_Target Eupnp_SSDP_Advertised_Target;
+
+struct _Eupnp_SSDP_Advertised_Target {
+   char *nt;
+   char *usn;
+};
+
+struct _Eupnp_SSDP_Advertiser {
+   Eupnp_SSDP_Server *ssdp;
+   Eupnp_Timer_Wheel *timers;
+   char *server;
+   struct sockaddr_in dest;
+   Eupnp_SSDP_Advertisement *advertisements;
+   unsigned long sent;
+   unsigned int seed;
+
+   /* packets left over by short sends, each one malloc'ed */
+   struct iovec *backlog;
+   unsigned int backlog_count;
+   Eupnp_Timer *retry;
+};
+
+struct _Eupnp_SSDP_Advertisement {
+   Eupnp_SSDP_Advertiser *adv;
+   Eupnp_SSDP_Advertisement *next;
+   Eupnp_SSDP_Advertisement *prev;
+
+   char *uuid;
+   char *location;
+   int max_age;
+   unsigned int boot_id;
+   unsigned int config_id;
+
+   Eupnp_SSDP_Advertised_Target *targets;
+   unsigned int count;
+   unsigned int size;
+
+   /* count packets of each kind, rendered in packets */
+   char *packets;
+   struct iovec *iov[EUPNP_SSDP_ADVERTISEMENT_KINDS];
+   Eina_Bool dirty;
+
+   Eina_Bool published;
+   Eupnp_Timer *timer;
+   unsigned int repeats;
+};
+
+
+/*
+ * Private API
+ */
+
+static void eupnp_ssdp_advertisement_announce(void *data);
+
+static Eina_Bool
+eupnp_ssdp_advertisement_target_add(Eupnp_SSDP_Advertisement *a, const char *nt, const char *uuid, const char *type)
+{
+   Eupnp_SSDP_Advertised_Target *t;
+   char *usn;
+   unsigned int i;
+
+   if (type)
+     {
+	if (asprintf(&usn, "%s::%s", uuid, type) < 0)
+	   usn = NULL;
+     }
+   else
+      usn = strdup(uuid);
+
+   if (!usn) goto error;
+
+   for (i = 0; i < a->count; i++)
+      if (!strcmp(a->targets[i].usn, usn))
+	{
+	   free(usn);
+	   return EINA_TRUE;
+	}
+
+   if (a->count == a->size)
+     {
+	unsigned int size = a->size ? a->size * 2 : 8;
+
+	t = realloc(a->targets, size * sizeof(Eupnp_SSDP_Advertised_Target));
+
+	if (!t)
+	  {
+	     free(usn);
+	     goto error;
+	  }
+
+	a->targets = t;
+	a->size = size;
+     }
+
+   t = &a->targets[a->count];
+   t->usn = usn;
+   t->nt = strdup(nt);
+
+   if (!t->nt)
+     {
+	free(usn);
+	goto error;
+     }
+
+   a->count++;
+   a->dirty = EINA_TRUE;
+
+   return EINA_TRUE;
+
+error:
+   eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+   ERROR("Could not add advertisement target %s.\n", nt);
+   return EINA_FALSE;
+}
+
+static int
+eupnp_ssdp_advertisement_packet_render(const Eupnp_SSDP_Advertisement *a, Eupnp_SSDP_Advertisement_Kind kind, const Eupnp_SSDP_Advertised_Target *t, char *buf, size_t size)
+{
+   switch (kind)
+     {
+      case EUPNP_SSDP_ADVERTISEMENT_ALIVE:
+	 return snprintf(buf, size, EUPNP_SSDP_NOTIFY_ALIVE_TEMPLATE,
+			 EUPNP_SSDP_ADDR, EUPNP_SSDP_PORT, a->max_age,
+			 a->location, t->nt, a->adv->server, t->usn,
+			 a->boot_id, a->config_id);
+      case EUPNP_SSDP_ADVERTISEMENT_BYEBYE:
+	 return snprintf(buf, size, EUPNP_SSDP_NOTIFY_BYEBYE_TEMPLATE,
+			 EUPNP_SSDP_ADDR, EUPNP_SSDP_PORT, t->nt, t->usn,
+			 a->boot_id, a->config_id);
+      case EUPNP_SSDP_ADVERTISEMENT_UPDATE:
+	 return snprintf(buf, size, EUPNP_SSDP_NOTIFY_UPDATE_TEMPLATE,
+			 EUPNP_SSDP_ADDR, EUPNP_SSDP_PORT, a->location, t->nt,
+			 t->usn, a->boot_id, a->config_id, a->boot_id + 1);
+      default:
+	 return 0;
+     }
+}
+
+/*
+ * Renders every packet of the advertisement, if anything changed since the
+ * last time.
+ */
+static Eina_Bool
+eupnp_ssdp_advertisement_render(Eupnp_SSDP_Advertisement *a)
+{
+   struct iovec *iov;
+   char *packets;
+   size_t total = 0;
+   unsigned int i, k;
+   int len;
+
+   if (!a->dirty) return EINA_TRUE;
+
+   for (k = 0; k < EUPNP_SSDP_ADVERTISEMENT_KINDS; k++)
+      for (i = 0; i < a->count; i++)
+	{
+	   len = eupnp_ssdp_advertisement_packet_render(a, k, &a->targets[i], NULL, 0);
+	   if (len < 0) return EINA_FALSE;
+	   total += len + 1;
+	}
+
+   packets = malloc(total);
+   iov = malloc(EUPNP_SSDP_ADVERTISEMENT_KINDS * a->count * sizeof(struct iovec));
+
+   if (!packets || !iov)
+     {
+	free(packets);
+	free(iov);
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not render advertisement for %s.\n", a->uuid);
+	return EINA_FALSE;
+     }
+
+   free(a->packets);
+   free(a->iov[0]);
+   a->packets = packets;
+
+   for (k = 0; k < EUPNP_SSDP_ADVERTISEMENT_KINDS; k++)
+     {
+	a->iov[k] = iov + k * a->count;
+
+	for (i = 0; i < a->count; i++)
+	  {
+	     len = eupnp_ssdp_advertisement_packet_render(a, k, &a->targets[i],
+							 packets, total);
+	     a->iov[k][i].iov_base = packets;
+	     a->iov[k][i].iov_len = len;
+	     packets += len + 1;
+	     total -= len + 1;
+	  }
+     }
+
+   a->dirty = EINA_FALSE;
+
+   return EINA_TRUE;
+}
+
+static void
+eupnp_ssdp_advertiser_backlog_drop(Eupnp_SSDP_Advertiser *adv, unsigned int count)
+{
+   unsigned int i;
+
+   for (i = 0; i < count; i++)
+      free(adv->backlog[i].iov_base);
+
+   adv->backlog_count -= count;
+   memmove(adv->backlog, adv->backlog + count,
+	   adv->backlog_count * sizeof(struct iovec));
+}
+
+/*
+ * Sends as much of the backlog as the socket takes, rescheduling itself while
+ * the send buffer is full.
+ */
+static void
+eupnp_ssdp_advertiser_backlog_flush(void *data)
+{
+   Eupnp_SSDP_Advertiser *adv = data;
+   unsigned int sent;
+
+   adv->retry = NULL;
+
+   if (!adv->backlog_count) return;
+
+   sent = eupnp_udp_transport_sendto_batch(adv->ssdp->udp_sock, adv->backlog,
+					   adv->backlog_count, &adv->dest);
+   adv->sent += sent;
+
+   if (sent < adv->backlog_count && errno != EAGAIN && errno != EWOULDBLOCK)
+     {
+	ERROR("Dropping %u unsent announcements.\n", adv->backlog_count - sent);
+	sent = adv->backlog_count;
+     }
+
+   eupnp_ssdp_advertiser_backlog_drop(adv, sent);
+
+   if (adv->backlog_count)
+     {
+	adv->retry = eupnp_timer_add(adv->timers,
+				     eupnp_time_now() + EUPNP_SSDP_ADVERTISER_RETRY_DELAY,
+				     eupnp_ssdp_advertiser_backlog_flush, adv);
+
+	if (!adv->retry)
+	  {
+	     ERROR("Could not schedule unsent announcements.\n");
+	     eupnp_ssdp_advertiser_backlog_drop(adv, adv->backlog_count);
+	  }
+     }
+}
+
+static Eina_Bool
+eupnp_ssdp_advertiser_backlog_add(Eupnp_SSDP_Advertiser *adv, const struct iovec *packets, unsigned int count)
+{
+   struct iovec *backlog;
+   Eina_Bool ret = EINA_TRUE;
+   unsigned int i;
+
+   if (adv->backlog_count + count > EUPNP_SSDP_ADVERTISER_BACKLOG_MAX)
+     {
+	WARN("Announcement backlog full, dropping %u packets.\n", count);
+	return EINA_FALSE;
+     }
+
+   backlog = realloc(adv->backlog, (adv->backlog_count + count) * sizeof(struct iovec));
+
+   if (!backlog)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not queue unsent announcements.\n");
+	return EINA_FALSE;
+     }
+
+   adv->backlog = backlog;
+
+   for (i = 0; i < count; i++)
+     {
+	backlog = &adv->backlog[adv->backlog_count];
+	backlog->iov_base = malloc(packets[i].iov_len);
+
+	if (!backlog->iov_base)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not queue unsent announcements.\n");
+	     ret = EINA_FALSE;
+	     break;
+	  }
+
+	memcpy(backlog->iov_base, packets[i].iov_base, packets[i].iov_len);
+	backlog->iov_len = packets[i].iov_len;
+	adv->backlog_count++;
+     }
+
+   if (adv->backlog_count && !adv->retry)
+      adv->retry = eupnp_timer_add(adv->timers,
+				   eupnp_time_now() + EUPNP_SSDP_ADVERTISER_RETRY_DELAY,
+				   eupnp_ssdp_advertiser_backlog_flush, adv);
+
+   return ret && adv->retry != NULL;
+}
+
+/*
+ * Sends packets right away, unless earlier ones are still waiting on the
+ * backlog. Whatever the socket does not take because its send buffer is full
+ * goes to the backlog.
+ */
+static Eina_Bool
+eupnp_ssdp_advertiser_send(Eupnp_SSDP_Advertiser *adv, const struct iovec *packets, unsigned int count)
+{
+   unsigned int sent = 0;
+
+   if (!adv->backlog_count)
+     {
+	sent = eupnp_udp_transport_sendto_batch(adv->ssdp->udp_sock, packets,
+						count, &adv->dest);
+	adv->sent += sent;
+
+	if (sent == count) return EINA_TRUE;
+	if (errno != EAGAIN && errno != EWOULDBLOCK) return EINA_FALSE;
+
+	DEBUG("Send buffer full, %u announcements left for later.\n", count - sent);
+     }
+
+   return eupnp_ssdp_advertiser_backlog_add(adv, packets + sent, count - sent);
+}
+
+static Eina_Bool
+eupnp_ssdp_advertisement_send(Eupnp_SSDP_Advertisement *a, Eupnp_SSDP_Advertisement_Kind kind)
+{
+   if (!a->adv->ssdp->udp_sock)
+      return EINA_FALSE;
+
+   if (!eupnp_ssdp_advertisement_render(a))
+      return EINA_FALSE;
+
+   return eupnp_ssdp_advertiser_send(a->adv, a->iov[kind], a->count);
+}
+
+static double
+eupnp_ssdp_advertisement_jitter(Eupnp_SSDP_Advertisement *a)
+{
+   return (double)rand_r(&a->adv->seed) / RAND_MAX;
+}
+
+static Eina_Bool
+eupnp_ssdp_advertisement_schedule(Eupnp_SSDP_Advertisement *a, double now)
+{
+   double when;
+
+   if (a->timer) eupnp_timer_del(a->adv->timers, a->timer);
+
+   if (a->repeats)
+      when = now + EUPNP_SSDP_ADVERTISER_REPEAT_DELAY *
+		   (1 + eupnp_ssdp_advertisement_jitter(a));
+   else
+      when = now + a->max_age * (0.25 + 0.25 * eupnp_ssdp_advertisement_jitter(a));
+
+   a->timer = eupnp_timer_add(a->adv->timers, when,
+			      eupnp_ssdp_advertisement_announce, a);
+
+   return a->timer != NULL;
+}
+
+static void
+eupnp_ssdp_advertisement_announce(void *data)
+{
+   Eupnp_SSDP_Advertisement *a = data;
+
+   a->timer = NULL;
+
+   if (a->repeats)
+      a->repeats--;
+   else
+      a->repeats = EUPNP_SSDP_ADVERTISER_REPEAT - 1;
+
+   if (!eupnp_ssdp_advertisement_send(a, EUPNP_SSDP_ADVERTISEMENT_ALIVE))
+      WARN("Could not announce %s.\n", a->uuid);
+
+   if (!eupnp_ssdp_advertisement_schedule(a, eupnp_time_now()))
+      ERROR("Could not schedule announcement of %s.\n", a->uuid);
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_SSDP_Advertiser structure
+ *
+ * @param ssdp server whose socket is used for sending
+ * @param timers timer wheel re-announcements run on
+ * @param server value of the SERVER header, "OS/version UPnP/1.1
+ *        product/version"
+ *
+ * @return Eupnp_SSDP_Advertiser instance or NULL on error.
+ */
+Eupnp_SSDP_Advertiser *
+eupnp_ssdp_advertiser_new(Eupnp_SSDP_Server *ssdp, Eupnp_Timer_Wheel *timers, const char *server)
+{
+   Eupnp_SSDP_Advertiser *adv;
+
+   adv = calloc(1, sizeof(Eupnp_SSDP_Advertiser));
+
+   if (!adv)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create advertiser.\n");
+	return NULL;
+     }
+
+   adv->server = strdup(server);
+
+   if (!adv->server)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create advertiser.\n");
+	free(adv);
+	return NULL;
+     }
+
+   adv->ssdp = ssdp;
+   adv->timers = timers;
+   adv->seed = (unsigned int)(eupnp_time_now() * 1e6) ^
+	       ((unsigned int)getpid() << 16) ^ (unsigned int)(uintptr_t)adv;
+   adv->dest.sin_family = AF_INET;
+   adv->dest.sin_port = htons(EUPNP_SSDP_PORT);
+   inet_aton(EUPNP_SSDP_ADDR, &adv->dest.sin_addr);
+
+   return adv;
+}
+
+/*
+ * Destructor for the Eupnp_SSDP_Advertiser structure. Published
+ * advertisements are withdrawn.
+ */
+void
+eupnp_ssdp_advertiser_free(Eupnp_SSDP_Advertiser *adv)
+{
+   if (!adv) return;
+
+   while (adv->advertisements)
+      eupnp_ssdp_advertisement_del(adv->advertisements);
+
+   // Last chance for the byebyes
+   if (adv->retry) eupnp_timer_del(adv->timers, adv->retry);
+   eupnp_ssdp_advertiser_backlog_flush(adv);
+   if (adv->retry) eupnp_timer_del(adv->timers, adv->retry);
+
+   eupnp_ssdp_advertiser_backlog_drop(adv, adv->backlog_count);
+   free(adv->backlog);
+
+   free(adv->server);
+   free(adv);
+}
+
+/*
+ * Retrieves the number of NOTIFY messages sent
+ */
+unsigned long
+eupnp_ssdp_advertiser_sent_get(const Eupnp_SSDP_Advertiser *adv)
+{
+   return adv->sent;
+}
+
+/*
+ * Creates the advertisement of a root device
+ *
+ * Embedded devices and services are added with
+ * eupnp_ssdp_advertisement_embedded_add() and
+ * eupnp_ssdp_advertisement_service_add(), then the advertisement is
+ * published with eupnp_ssdp_advertisement_publish().
+ *
+ * @param adv advertiser
+ * @param uuid root device UUID, "uuid:..."
+ * @param device_type root device type, e.g.
+ *        "urn:schemas-upnp-org:device:MediaServer:1"
+ * @param location URL of the device description
+ * @param max_age seconds the announcements are valid for, 0 for
+ *        EUPNP_SSDP_ADVERTISER_MAX_AGE
+ *
+ * @return Eupnp_SSDP_Advertisement instance or NULL on error.
+ */
+Eupnp_SSDP_Advertisement *
+eupnp_ssdp_advertisement_new(Eupnp_SSDP_Advertiser *adv, const char *uuid, const char *device_type, const char *location, int max_age)
+{
+   Eupnp_SSDP_Advertisement *a;
+
+   a = calloc(1, sizeof(Eupnp_SSDP_Advertisement));
+
+   if (!a)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create advertisement.\n");
+	return NULL;
+     }
+
+   a->adv = adv;
+   a->uuid = strdup(uuid);
+   a->location = strdup(location);
+   a->max_age = max_age > 0 ? max_age : EUPNP_SSDP_ADVERTISER_MAX_AGE;
+   a->boot_id = time(NULL);
+   a->config_id = 1;
+
+   if (!a->uuid || !a->location ||
+       !eupnp_ssdp_advertisement_target_add(a, "upnp:rootdevice", uuid, "upnp:rootdevice") ||
+       !eupnp_ssdp_advertisement_target_add(a, uuid, uuid, NULL) ||
+       !eupnp_ssdp_advertisement_target_add(a, device_type, uuid, device_type))
+     {
+	ERROR("Could not create advertisement.\n");
+	eupnp_ssdp_advertisement_del(a);
+	return NULL;
+     }
+
+   a->next = adv->advertisements;
+   if (a->next) a->next->prev = a;
+   adv->advertisements = a;
+
+   return a;
+}
+
+/*
+ * Withdraws an advertisement, sending byebyes if it was published, and frees
+ * it
+ */
+void
+eupnp_ssdp_advertisement_del(Eupnp_SSDP_Advertisement *a)
+{
+   unsigned int i;
+
+   if (!a) return;
+
+   if (a->published && !eupnp_ssdp_advertisement_send(a, EUPNP_SSDP_ADVERTISEMENT_BYEBYE))
+      WARN("Could not withdraw %s.\n", a->uuid);
+
+   if (a->timer) eupnp_timer_del(a->adv->timers, a->timer);
+
+   if (a->prev)
+      a->prev->next = a->next;
+   else if (a->adv->advertisements == a)
+      a->adv->advertisements = a->next;
+
+   if (a->next) a->next->prev = a->prev;
+
+   for (i = 0; i < a->count; i++)
+     {
+	free(a->targets[i].nt);
+	free(a->targets[i].usn);
+     }
+
+   free(a->targets);
+   free(a->packets);
+   free(a->iov[0]);
+   free(a->uuid);
+   free(a->location);
+   free(a);
+}
+
+/*
+ * Adds an embedded device
+ *
+ * @param a advertisement
+ * @param uuid embedded device UUID
+ * @param device_type embedded device type
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_ssdp_advertisement_embedded_add(Eupnp_SSDP_Advertisement *a, const char *uuid, const char *device_type)
+{
+   return eupnp_ssdp_advertisement_target_add(a, uuid, uuid, NULL) &&
+	  eupnp_ssdp_advertisement_target_add(a, device_type, uuid, device_type);
+}
+
+/*
+ * Adds a service type. Each type is announced once per device.
+ *
+ * @param a advertisement
+ * @param uuid UUID of the device offering the service, NULL for the root
+ *        device
+ * @param service_type service type, e.g.
+ *        "urn:schemas-upnp-org:service:ContentDirectory:1"
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_ssdp_advertisement_service_add(Eupnp_SSDP_Advertisement *a, const char *uuid, const char *service_type)
+{
+   return eupnp_ssdp_advertisement_target_add(a, service_type,
+					      uuid ? uuid : a->uuid,
+					      service_type);
+}
+
+/*
+ * Announces the advertisement and keeps re-announcing it before it expires.
+ * Requires the timer wheel of the advertiser to be run.
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_ssdp_advertisement_publish(Eupnp_SSDP_Advertisement *a)
+{
+   if (!eupnp_ssdp_advertisement_render(a))
+      return EINA_FALSE;
+
+   a->published = EINA_TRUE;
+   a->repeats = 0;
+
+   eupnp_ssdp_advertisement_announce(a);
+
+   return a->timer != NULL;
+}
+
+/*
+ * Moves an advertisement to a new location, e.g. after a change of network
+ * address
+ *
+ * An ssdp:update announcing the next BOOTID is sent first, then the
+ * advertisement is announced again with the new location and BOOTID.
+ *
+ * @return EINA_TRUE on success, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_ssdp_advertisement_update(Eupnp_SSDP_Advertisement *a, const char *location)
+{
+   char *l = strdup(location);
+
+   if (!l)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not update advertisement for %s.\n", a->uuid);
+	return EINA_FALSE;
+     }
+
+   free(a->location);
+   a->location = l;
+   a->dirty = EINA_TRUE;
+
+   if (!a->published)
+      return EINA_TRUE;
+
+   if (!eupnp_ssdp_advertisement_send(a, EUPNP_SSDP_ADVERTISEMENT_UPDATE))
+      WARN("Could not send update for %s.\n", a->uuid);
+
+   a->boot_id++;
+   a->dirty = EINA_TRUE;
+
+   return eupnp_ssdp_advertisement_publish(a);
+}
+
+/*
+ * Retrieves the number of messages making up one announcement, 3 + 2d + k
+ */
+unsigned int
+eupnp_ssdp_advertisement_packets_get(const Eupnp_SSDP_Advertisement *a)
+{
+   return a->count;
+}
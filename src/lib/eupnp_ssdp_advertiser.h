@@ -0,0 +1,92 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_SSDP_ADVERTISER_H
+#define _EUPNP_SSDP_ADVERTISER_H
+
+#include <Eina.h>
+#include <eupnp_ssdp.h>
+#include <eupnp_timer.h>
+
+#define EUPNP_SSDP_ADVERTISER_MAX_AGE 1800
+
+/*
+ * Each announcement is sent EUPNP_SSDP_ADVERTISER_REPEAT times, a fraction of
+ * a second apart, as UDP may lose some of the copies.
+ */
+#define EUPNP_SSDP_ADVERTISER_REPEAT 2
+#define EUPNP_SSDP_ADVERTISER_REPEAT_DELAY 0.2
+
+/*
+ * Packets the socket did not take because its send buffer was full are sent
+ * again EUPNP_SSDP_ADVERTISER_RETRY_DELAY seconds later. At most
+ * EUPNP_SSDP_ADVERTISER_BACKLOG_MAX are kept waiting.
+ */
+#define EUPNP_SSDP_ADVERTISER_RETRY_DELAY 0.01
+#define EUPNP_SSDP_ADVERTISER_BACKLOG_MAX 1024
+
+#define EUPNP_SSDP_NOTIFY_ALIVE_TEMPLATE "NOTIFY * HTTP/1.1\r\n"        \
+                                         "HOST: %s:%d\r\n"              \
+                                         "CACHE-CONTROL: max-age=%d\r\n"\
+                                         "LOCATION: %s\r\n"             \
+                                         "NT: %s\r\n"                   \
+                                         "NTS: ssdp:alive\r\n"          \
+                                         "SERVER: %s\r\n"               \
+                                         "USN: %s\r\n"                  \
+                                         "BOOTID.UPNP.ORG: %u\r\n"      \
+                                         "CONFIGID.UPNP.ORG: %u\r\n\r\n"
+
+#define EUPNP_SSDP_NOTIFY_BYEBYE_TEMPLATE "NOTIFY * HTTP/1.1\r\n"       \
+                                          "HOST: %s:%d\r\n"             \
+                                          "NT: %s\r\n"                  \
+                                          "NTS: ssdp:byebye\r\n"        \
+                                          "USN: %s\r\n"                 \
+                                          "BOOTID.UPNP.ORG: %u\r\n"     \
+                                          "CONFIGID.UPNP.ORG: %u\r\n\r\n"
+
+#define EUPNP_SSDP_NOTIFY_UPDATE_TEMPLATE "NOTIFY * HTTP/1.1\r\n"       \
+                                          "HOST: %s:%d\r\n"             \
+                                          "LOCATION: %s\r\n"            \
+                                          "NT: %s\r\n"                  \
+                                          "NTS: ssdp:update\r\n"        \
+                                          "USN: %s\r\n"                 \
+                                          "BOOTID.UPNP.ORG: %u\r\n"     \
+                                          "CONFIGID.UPNP.ORG: %u\r\n"   \
+                                          "NEXTBOOTID.UPNP.ORG: %u\r\n\r\n"
+
+typedef struct _Eupnp_SSDP_Advertiser Eupnp_SSDP_Advertiser;
+typedef struct _Eupnp_SSDP_Advertisement Eupnp_SSDP_Advertisement;
+
+
+Eupnp_SSDP_Advertiser    *eupnp_ssdp_advertiser_new(Eupnp_SSDP_Server *ssdp, Eupnp_Timer_Wheel *timers, const char *server) EINA_ARG_NONNULL(1,2,3);
+void                      eupnp_ssdp_advertiser_free(Eupnp_SSDP_Advertiser *adv) EINA_ARG_NONNULL(1);
+unsigned long             eupnp_ssdp_advertiser_sent_get(const Eupnp_SSDP_Advertiser *adv) EINA_ARG_NONNULL(1);
+
+Eupnp_SSDP_Advertisement *eupnp_ssdp_advertisement_new(Eupnp_SSDP_Advertiser *adv, const char *uuid, const char *device_type, const char *location, int max_age) EINA_ARG_NONNULL(1,2,3,4);
+void                      eupnp_ssdp_advertisement_del(Eupnp_SSDP_Advertisement *a) EINA_ARG_NONNULL(1);
+Eina_Bool                 eupnp_ssdp_advertisement_embedded_add(Eupnp_SSDP_Advertisement *a, const char *uuid, const char *device_type) EINA_ARG_NONNULL(1,2,3);
+Eina_Bool                 eupnp_ssdp_advertisement_service_add(Eupnp_SSDP_Advertisement *a, const char *uuid, const char *service_type) EINA_ARG_NONNULL(1,3);
+Eina_Bool                 eupnp_ssdp_advertisement_publish(Eupnp_SSDP_Advertisement *a) EINA_ARG_NONNULL(1);
+Eina_Bool                 eupnp_ssdp_advertisement_update(Eupnp_SSDP_Advertisement *a, const char *location) EINA_ARG_NONNULL(1,2);
+unsigned int              eupnp_ssdp_advertisement_packets_get(const Eupnp_SSDP_Advertisement *a) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_SSDP_ADVERTISER_H */
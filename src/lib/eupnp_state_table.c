@@ -0,0 +1,333 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_state_table.h"
+
+typedef struct _Eupnp_State_Variable Eupnp_State_Variable;
+
+struct _Eupnp_State_Variable {
+   char *name;            /* "Name" or "Name/Channel" */
+   size_t name_len;       /* without the channel */
+   const char *channel;   /* NULL when not qualified */
+   size_t channel_len;
+   char *value;           /* NULL-terminated, NULL until first set */
+   size_t len;
+   size_t size;
+};
+
+struct _Eupnp_State_Table {
+   unsigned int count;
+   unsigned int words;
+   uint32_t *dirty;
+   Eupnp_State_Variable vars[];
+};
+
+
+/*
+ * Private API
+ */
+
+static Eina_Bool
+_eupnp_state_table_channel_is_master(const char *channel, size_t len)
+{
+   return !channel || (len == 6 && !memcmp(channel, "Master", 6));
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_State_Table structure
+ *
+ * @param names evented state variable names, copied
+ * @param count number of names
+ *
+ * @return Eupnp_State_Table instance or NULL on error.
+ */
+Eupnp_State_Table *
+eupnp_state_table_new(const char **names, unsigned int count)
+{
+   Eupnp_State_Table *t;
+   const char *slash;
+   unsigned int i;
+
+   t = calloc(1, sizeof(Eupnp_State_Table) + count * sizeof(Eupnp_State_Variable));
+
+   if (!t)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create state table.\n");
+	return NULL;
+     }
+
+   t->words = (count + 31) / 32;
+   t->dirty = calloc(t->words ? t->words : 1, sizeof(uint32_t));
+
+   if (!t->dirty) goto error;
+
+   for (i = 0; i < count; i++, t->count++)
+     {
+	Eupnp_State_Variable *v = &t->vars[i];
+
+	v->name = strdup(names[i]);
+	if (!v->name) goto error;
+
+	slash = strchr(v->name, '/');
+
+	if (slash && !_eupnp_state_table_channel_is_master(slash + 1, strlen(slash + 1)))
+	  {
+	     v->name_len = slash - v->name;
+	     v->channel = slash + 1;
+	     v->channel_len = strlen(v->channel);
+	  }
+	else
+	   v->name_len = slash ? (size_t)(slash - v->name) : strlen(v->name);
+     }
+
+   return t;
+
+error:
+   eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+   ERROR("Could not create state table.\n");
+   eupnp_state_table_free(t);
+   return NULL;
+}
+
+void
+eupnp_state_table_free(Eupnp_State_Table *t)
+{
+   unsigned int i;
+
+   if (!t) return;
+
+   for (i = 0; i < t->count; i++)
+     {
+	free(t->vars[i].name);
+	free(t->vars[i].value);
+     }
+
+   free(t->dirty);
+   free(t);
+}
+
+unsigned int
+eupnp_state_table_count_get(const Eupnp_State_Table *t)
+{
+   return t->count;
+}
+
+/*
+ * Retrieves the index of a variable
+ *
+ * @param t state table
+ * @param name variable name, as given to eupnp_state_table_new()
+ *
+ * @return variable index or -1 if not in the table.
+ */
+int
+eupnp_state_table_index_get(const Eupnp_State_Table *t, const char *name)
+{
+   const char *slash = strchr(name, '/');
+
+   if (!slash)
+      return eupnp_state_table_find(t, name, strlen(name), NULL, 0);
+
+   return eupnp_state_table_find(t, name, slash - name, slash + 1, strlen(slash + 1));
+}
+
+/*
+ * Finds a variable from an event, without copying its name
+ *
+ * @param t state table
+ * @param name variable name, not NULL-terminated
+ * @param name_len name length
+ * @param channel channel qualifying the variable or NULL
+ * @param channel_len channel length
+ *
+ * @return variable index or -1 if not in the table.
+ */
+int
+eupnp_state_table_find(const Eupnp_State_Table *t, const char *name, size_t name_len, const char *channel, size_t channel_len)
+{
+   const Eupnp_State_Variable *v;
+   unsigned int i;
+
+   if (_eupnp_state_table_channel_is_master(channel, channel_len))
+      channel = NULL;
+
+   for (i = 0; i < t->count; i++)
+     {
+	v = &t->vars[i];
+
+	if (v->name_len != name_len || memcmp(v->name, name, name_len))
+	   continue;
+
+	if (!channel && !v->channel) return i;
+
+	if (channel && v->channel && v->channel_len == channel_len &&
+	    !memcmp(v->channel, channel, channel_len))
+	   return i;
+     }
+
+   return -1;
+}
+
+const char *
+eupnp_state_table_name_get(const Eupnp_State_Table *t, unsigned int index)
+{
+   if (index >= t->count) return NULL;
+   return t->vars[index].name;
+}
+
+/*
+ * Retrieves the last known value of a variable
+ *
+ * @param t state table
+ * @param index variable index
+ * @param len set to the value length if not NULL
+ *
+ * @return NULL-terminated value, NULL if it was never evented.
+ */
+const char *
+eupnp_state_table_value_get(const Eupnp_State_Table *t, unsigned int index, size_t *len)
+{
+   if (index >= t->count) return NULL;
+   if (len) *len = t->vars[index].len;
+   return t->vars[index].value;
+}
+
+/*
+ * Updates the value of a variable, marking it dirty if it changed
+ *
+ * @param t state table
+ * @param index variable index
+ * @param value new value, not NULL-terminated
+ * @param len value length
+ *
+ * @return EINA_TRUE if the value changed, EINA_FALSE otherwise.
+ */
+Eina_Bool
+eupnp_state_table_value_set(Eupnp_State_Table *t, unsigned int index, const char *value, size_t len)
+{
+   Eupnp_State_Variable *v;
+
+   if (index >= t->count) return EINA_FALSE;
+
+   v = &t->vars[index];
+
+   if (v->value && v->len == len && !memcmp(v->value, value, len))
+      return EINA_FALSE;
+
+   if (len + 1 > v->size)
+     {
+	char *tmp = realloc(v->value, len + 1);
+
+	if (!tmp)
+	  {
+	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	     ERROR("Could not store state variable %s.\n", v->name);
+	     return EINA_FALSE;
+	  }
+
+	v->value = tmp;
+	v->size = len + 1;
+     }
+
+   memcpy(v->value, value, len);
+   v->value[len] = '\0';
+   v->len = len;
+
+   t->dirty[index / 32] |= 1U << (index % 32);
+
+   return EINA_TRUE;
+}
+
+Eina_Bool
+eupnp_state_table_dirty_get(const Eupnp_State_Table *t, unsigned int index)
+{
+   if (index >= t->count) return EINA_FALSE;
+   return !!(t->dirty[index / 32] & (1U << (index % 32)));
+}
+
+/*
+ * Tells whether any variable changed since the last poll
+ */
+Eina_Bool
+eupnp_state_table_changed_get(const Eupnp_State_Table *t)
+{
+   unsigned int i;
+
+   for (i = 0; i < t->words; i++)
+      if (t->dirty[i]) return EINA_TRUE;
+
+   return EINA_FALSE;
+}
+
+/*
+ * Polls changed variables, clearing their dirty bit
+ *
+ * Iterate with:
+ *
+ *   for (i = -1; (i = eupnp_state_table_changed_next(t, i)) >= 0;)
+ *      value = eupnp_state_table_value_get(t, i, &len);
+ *
+ * @param t state table
+ * @param prev index returned by the previous call, -1 to start
+ *
+ * @return index of the next changed variable, -1 if there is none left.
+ */
+int
+eupnp_state_table_changed_next(Eupnp_State_Table *t, int prev)
+{
+   unsigned int i = prev + 1;
+   unsigned int w;
+   uint32_t bits;
+
+   for (w = i / 32; w < t->words; w++, i = w * 32)
+     {
+	bits = t->dirty[w] & (~0U << (i % 32));
+	if (!bits) continue;
+
+	i = w * 32 + ffs(bits) - 1;
+	t->dirty[w] &= ~(1U << (i % 32));
+	return i;
+     }
+
+   return -1;
+}
+
+void
+eupnp_state_table_changes_clear(Eupnp_State_Table *t)
+{
+   memset(t->dirty, 0, t->words * sizeof(uint32_t));
+}
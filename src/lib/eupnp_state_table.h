@@ -0,0 +1,58 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_STATE_TABLE_H
+#define _EUPNP_STATE_TABLE_H
+
+#include <stddef.h>
+#include <Eina.h>
+
+/*
+ * Last known values of the evented state variables of a service, fed by
+ * event decoders (see eupnp_last_change.h).
+ *
+ * Each variable has a dirty bit, set when an event changes its value.
+ * Applications poll with eupnp_state_table_changed_next() and only read
+ * variables changed since their last poll.
+ *
+ * Variables are named as in the SCPD. Variables qualified by a channel in
+ * LastChange events (RenderingControl Volume, Mute...) are named
+ * "Volume/LF"; the bare name stands for the Master channel.
+ */
+typedef struct _Eupnp_State_Table Eupnp_State_Table;
+
+
+Eupnp_State_Table *eupnp_state_table_new(const char **names, unsigned int count) EINA_ARG_NONNULL(1);
+void               eupnp_state_table_free(Eupnp_State_Table *t) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_state_table_count_get(const Eupnp_State_Table *t) EINA_ARG_NONNULL(1);
+int                eupnp_state_table_index_get(const Eupnp_State_Table *t, const char *name) EINA_ARG_NONNULL(1,2);
+int                eupnp_state_table_find(const Eupnp_State_Table *t, const char *name, size_t name_len, const char *channel, size_t channel_len) EINA_ARG_NONNULL(1,2);
+const char        *eupnp_state_table_name_get(const Eupnp_State_Table *t, unsigned int index) EINA_ARG_NONNULL(1);
+const char        *eupnp_state_table_value_get(const Eupnp_State_Table *t, unsigned int index, size_t *len) EINA_ARG_NONNULL(1);
+Eina_Bool          eupnp_state_table_value_set(Eupnp_State_Table *t, unsigned int index, const char *value, size_t len) EINA_ARG_NONNULL(1,3);
+
+Eina_Bool          eupnp_state_table_dirty_get(const Eupnp_State_Table *t, unsigned int index) EINA_ARG_NONNULL(1);
+Eina_Bool          eupnp_state_table_changed_get(const Eupnp_State_Table *t) EINA_ARG_NONNULL(1);
+int                eupnp_state_table_changed_next(Eupnp_State_Table *t, int prev) EINA_ARG_NONNULL(1);
+void               eupnp_state_table_changes_clear(Eupnp_State_Table *t) EINA_ARG_NONNULL(1);
+
+
+#endif /* _EUPNP_STATE_TABLE_H */
@@ -0,0 +1,270 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <Eina.h>
+
+#include "eupnp_error.h"
+#include "eupnp_timer.h"
+
+/*
+ * Hashed timing wheel: a timer due at tick T lives on slot T % slots. Adding
+ * and deleting are O(1); running the wheel visits only the slots of the ticks
+ * elapsed since the last run. Timers more than one revolution away share
+ * slots with nearer ones and are skipped until their tick comes.
+ */
+
+struct _Eupnp_Timer {
+   Eupnp_Timer *next;
+   Eupnp_Timer *prev;
+   uint64_t tick;
+   Eupnp_Timer_Cb cb;
+   void *data;
+};
+
+struct _Eupnp_Timer_Wheel {
+   Eupnp_Timer *slots[EUPNP_TIMER_WHEEL_SLOTS];
+   double resolution;
+   double origin;
+   uint64_t current;  /* next tick to run */
+   unsigned int count;
+};
+
+
+/*
+ * Private API
+ */
+
+static uint64_t
+eupnp_timer_wheel_tick(const Eupnp_Timer_Wheel *w, double t)
+{
+   if (t <= w->origin) return 0;
+   return (uint64_t)((t - w->origin) / w->resolution);
+}
+
+static void
+eupnp_timer_link(Eupnp_Timer_Wheel *w, Eupnp_Timer *t)
+{
+   Eupnp_Timer **slot = &w->slots[t->tick % EUPNP_TIMER_WHEEL_SLOTS];
+
+   t->prev = NULL;
+   t->next = *slot;
+   if (*slot) (*slot)->prev = t;
+   *slot = t;
+}
+
+static void
+eupnp_timer_unlink(Eupnp_Timer_Wheel *w, Eupnp_Timer *t)
+{
+   if (t->prev)
+      t->prev->next = t->next;
+   else
+      w->slots[t->tick % EUPNP_TIMER_WHEEL_SLOTS] = t->next;
+
+   if (t->next) t->next->prev = t->prev;
+}
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Timer_Wheel structure
+ *
+ * @param resolution tick length in seconds, timers fire at most this late.
+ *        EUPNP_TIMER_WHEEL_RESOLUTION if <= 0.
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return Eupnp_Timer_Wheel instance or NULL on error.
+ */
+Eupnp_Timer_Wheel *
+eupnp_timer_wheel_new(double resolution, double now)
+{
+   Eupnp_Timer_Wheel *w;
+
+   w = calloc(1, sizeof(Eupnp_Timer_Wheel));
+
+   if (!w)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create timer wheel.\n");
+	return NULL;
+     }
+
+   w->resolution = (resolution > 0) ? resolution : EUPNP_TIMER_WHEEL_RESOLUTION;
+   w->origin = now;
+
+   return w;
+}
+
+void
+eupnp_timer_wheel_free(Eupnp_Timer_Wheel *w)
+{
+   Eupnp_Timer *t;
+   unsigned int i;
+
+   if (!w) return;
+
+   for (i = 0; i < EUPNP_TIMER_WHEEL_SLOTS; i++)
+      while ((t = w->slots[i]))
+	{
+	   w->slots[i] = t->next;
+	   free(t);
+	}
+
+   free(w);
+}
+
+/*
+ * Adds a timer
+ *
+ * @param w timer wheel
+ * @param when time the timer is due, see eupnp_time_now(). Times in the past
+ *        fire on the next run.
+ * @param cb function to call
+ * @param data data passed to cb
+ *
+ * @return timer, valid until it fires or is deleted, or NULL on error.
+ */
+Eupnp_Timer *
+eupnp_timer_add(Eupnp_Timer_Wheel *w, double when, Eupnp_Timer_Cb cb, void *data)
+{
+   Eupnp_Timer *t;
+
+   t = malloc(sizeof(Eupnp_Timer));
+
+   if (!t)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create timer.\n");
+	return NULL;
+     }
+
+   t->tick = eupnp_timer_wheel_tick(w, when);
+
+   // Round up so timers never fire early, but never into the past
+   if (w->origin + t->tick * w->resolution < when) t->tick++;
+   if (t->tick < w->current) t->tick = w->current;
+
+   t->cb = cb;
+   t->data = data;
+
+   eupnp_timer_link(w, t);
+   w->count++;
+
+   return t;
+}
+
+/*
+ * Deletes a pending timer
+ */
+void
+eupnp_timer_del(Eupnp_Timer_Wheel *w, Eupnp_Timer *t)
+{
+   eupnp_timer_unlink(w, t);
+   w->count--;
+   free(t);
+}
+
+/*
+ * Fires the timers due up to now
+ *
+ * @param w timer wheel
+ * @param now current time, see eupnp_time_now()
+ *
+ * @return number of timers fired.
+ */
+unsigned int
+eupnp_timer_wheel_run(Eupnp_Timer_Wheel *w, double now)
+{
+   uint64_t tick, last = eupnp_timer_wheel_tick(w, now);
+   unsigned int fired = 0;
+   Eupnp_Timer **slot, *t, *next;
+
+   // After a long sleep one revolution visits every slot, and overdue timers
+   // fire on the first visit of their slot
+   if (w->current + EUPNP_TIMER_WHEEL_SLOTS <= last)
+      w->current = last - EUPNP_TIMER_WHEEL_SLOTS + 1;
+
+   for (tick = w->current; tick <= last; tick++)
+     {
+	// Timers added by callbacks go to later ticks
+	w->current = tick + 1;
+	slot = &w->slots[tick % EUPNP_TIMER_WHEEL_SLOTS];
+
+	for (t = *slot; t; t = next)
+	  {
+	     next = t->next;
+
+	     if (t->tick > tick) continue;
+
+	     eupnp_timer_unlink(w, t);
+	     w->count--;
+
+	     t->cb(t->data);
+	     free(t);
+	     fired++;
+
+	     // The callback may have deleted the next timer
+	     next = *slot;
+	  }
+     }
+
+   return fired;
+}
+
+/*
+ * Retrieves when the next timer is due, for use as a poll timeout
+ *
+ * @return deadline on the library clock or 0 if there are no timers.
+ */
+double
+eupnp_timer_wheel_next_deadline_get(const Eupnp_Timer_Wheel *w)
+{
+   uint64_t min = UINT64_MAX;
+   const Eupnp_Timer *t;
+   unsigned int i;
+
+   if (!w->count) return 0;
+
+   for (i = 0; i < EUPNP_TIMER_WHEEL_SLOTS; i++)
+     {
+	uint64_t tick = w->current + i;
+
+	for (t = w->slots[tick % EUPNP_TIMER_WHEEL_SLOTS]; t; t = t->next)
+	   if (t->tick < min) min = t->tick;
+
+	// Slots are visited in order, nothing later can be due earlier
+	if (min <= tick) break;
+     }
+
+   return w->origin + min * w->resolution;
+}
+
+/*
+ * Retrieves the number of pending timers
+ */
+unsigned int
+eupnp_timer_wheel_count_get(const Eupnp_Timer_Wheel *w)
+{
+   return w->count;
+}
@@ -0,0 +1,56 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_TIMER_H
+#define _EUPNP_TIMER_H
+
+#include <stdint.h>
+#include <Eina.h>
+
+/*
+ * Default tick and number of slots. Timers up to
+ * EUPNP_TIMER_WHEEL_SLOTS * EUPNP_TIMER_WHEEL_RESOLUTION seconds away are
+ * found in a single slot visit, farther ones wait for their round.
+ */
+#define EUPNP_TIMER_WHEEL_RESOLUTION 0.1
+#define EUPNP_TIMER_WHEEL_SLOTS 256
+
+typedef struct _Eupnp_Timer Eupnp_Timer;
+typedef struct _Eupnp_Timer_Wheel Eupnp_Timer_Wheel;
+
+/*
+ * Timers fire once. Callbacks may add and delete timers, including adding a
+ * new one to repeat themselves.
+ */
+typedef void (*Eupnp_Timer_Cb) (void *data);
+
+
+Eupnp_Timer_Wheel *eupnp_timer_wheel_new(double resolution, double now);
+void               eupnp_timer_wheel_free(Eupnp_Timer_Wheel *w) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_timer_wheel_run(Eupnp_Timer_Wheel *w, double now) EINA_ARG_NONNULL(1);
+double             eupnp_timer_wheel_next_deadline_get(const Eupnp_Timer_Wheel *w) EINA_ARG_NONNULL(1);
+unsigned int       eupnp_timer_wheel_count_get(const Eupnp_Timer_Wheel *w) EINA_ARG_NONNULL(1);
+
+Eupnp_Timer       *eupnp_timer_add(Eupnp_Timer_Wheel *w, double when, Eupnp_Timer_Cb cb, void *data) EINA_ARG_NONNULL(1,3);
+void               eupnp_timer_del(Eupnp_Timer_Wheel *w, Eupnp_Timer *t) EINA_ARG_NONNULL(1,2);
+
+
+#endif /* _EUPNP_TIMER_H */
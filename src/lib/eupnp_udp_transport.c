@@ -19,17 +19,53 @@
  *
  */
 
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
+#include <time.h>
 
 #include <eupnp_error.h>
 #include <eupnp_udp_transport.h>
+#include "eupnp_probes.h"
+
+/* Room for the control messages a datagram is received with */
+#define EUPNP_UDP_CONTROL_LEN (CMSG_SPACE(sizeof(struct timespec)) +	\
+			       CMSG_SPACE(sizeof(struct in_pktinfo)) +	\
+			       CMSG_SPACE(sizeof(uint32_t)))
+
+/*
+ * io_uring receive state. A multishot recvmsg stays armed on the socket and
+ * the kernel queues datagrams into provided buffers as they arrive; reading
+ * one copies it from its buffer into the caller's datagram, so the kernel is
+ * only entered once per burst instead of once per datagram.
+ */
+struct _Eupnp_UDP_Uring {
+   Eupnp_Uring *ring;
+   Eupnp_Uring_Buffers *buffers;
+   Eupnp_Uring_Op op;
+   struct msghdr msg;
+   int socket;
+   Eina_Bool armed;
+
+   /* Datagram being read, set while processing completions */
+   Eupnp_UDP_Datagram *target;
+   size_t target_len;
+   Eina_Bool received;
+};
 
 
 /*
@@ -37,7 +73,7 @@
  */
 
 static Eupnp_UDP_Datagram *
-eupnp_udp_datagram_new(const char *host, int port, char *data, size_t data_len)
+eupnp_udp_datagram_new(size_t data_len)
 {
    Eupnp_UDP_Datagram *datagram;
 
@@ -50,22 +86,18 @@ eupnp_udp_datagram_new(const char *host, int port, char *data, size_t data_len)
 	return NULL;
      }
 
-   if (data)
-      datagram->data = data;
-   else
+   datagram->data = calloc(1, sizeof(char) * (data_len + 1));
+
+   if (!datagram->data)
      {
-	datagram->data = calloc(1, sizeof(char) * (data_len + 1));
-	if (!datagram->data)
-	  {
-	     eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
-	     ERROR("could not allocate buffer for new datagram.\n");
-	     return NULL;
-	  }
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("could not allocate buffer for new datagram.\n");
+	free(datagram);
+	return NULL;
      }
-   if (host)
-      datagram->host = host;
-   if (port)
-      datagram->port = port;
+
+   datagram->size = data_len;
+
    return datagram;
 }
 
@@ -77,10 +109,40 @@ eupnp_udp_datagram_free(Eupnp_UDP_Datagram *datagram)
    free(datagram);
 }
 
+/*
+ * Sets the receive or send buffer size, through the FORCE variant first so
+ * that privileged (CAP_NET_ADMIN) processes may go over
+ * net.core.[rw]mem_max.
+ */
+static Eina_Bool
+eupnp_udp_transport_buffer_set(Eupnp_UDP_Transport *s, Eina_Bool receive, int size)
+{
+   if (!size) return EINA_TRUE;
+
+#if defined(SO_RCVBUFFORCE) && defined(SO_SNDBUFFORCE)
+   if (!setsockopt(s->socket, SOL_SOCKET, receive ? SO_RCVBUFFORCE : SO_SNDBUFFORCE,
+		   &size, sizeof(int)))
+      return EINA_TRUE;
+#endif
+
+   // Capped to the sysctl maximum by the kernel, without error
+   if (setsockopt(s->socket, SOL_SOCKET, receive ? SO_RCVBUF : SO_SNDBUF,
+		  &size, sizeof(int)) < 0)
+     {
+	WARN("setsockopt %s failed. %s\n", receive ? "SO_RCVBUF" : "SO_SNDBUF",
+	     strerror(errno));
+	return EINA_FALSE;
+     }
+
+   return EINA_TRUE;
+}
+
 static Eina_Bool
 eupnp_udp_transport_prepare(Eupnp_UDP_Transport *s)
 {
+   Eupnp_UDP_Transport_Options options;
    int reuse_addr = 1; // yes
+   int enable = 1;
 
    if (fcntl(s->socket, F_SETFL, O_NONBLOCK) < 0)
      {
@@ -89,15 +151,23 @@ eupnp_udp_transport_prepare(Eupnp_UDP_Transport *s)
 	return EINA_FALSE;
      }
 
-   if (bind(s->socket, (struct sockaddr *) &s->in_addr, s->in_addr_len) < 0)
+   // Only taken into account by bind()
+   if (setsockopt(s->socket, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(int)) < 0)
      {
- 	ERROR("Error binding. %s\n", strerror(errno));
+	ERROR("setsockopt SO_REUSE_ADDR failed. %s\n", strerror(errno));
 	return EINA_FALSE;
      }
 
-   if (setsockopt(s->socket, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(int)) < 0)
+   // Before bind(), datagrams may queue as soon as it returns
+   options.rcvbuf = EUPNP_UDP_RCVBUF;
+   options.sndbuf = 0;
+   options.busy_poll = 0;
+   options.rxq_ovfl = EINA_TRUE;
+   eupnp_udp_transport_options_set(s, &options);
+
+   if (bind(s->socket, (struct sockaddr *) &s->in_addr, s->in_addr_len) < 0)
      {
-	ERROR("setsockopt SO_REUSE_ADDR failed. %s\n", strerror(errno));
+ 	ERROR("Error binding. %s\n", strerror(errno));
 	return EINA_FALSE;
      }
 
@@ -108,6 +178,262 @@ eupnp_udp_transport_prepare(Eupnp_UDP_Transport *s)
 	return EINA_FALSE;
      }
 
+#ifdef IP_PKTINFO
+   if (setsockopt(s->socket, IPPROTO_IP, IP_PKTINFO, &enable, sizeof(int)) < 0)
+      WARN("setsockopt IP_PKTINFO failed. %s\n", strerror(errno));
+#endif
+
+#ifdef SO_TIMESTAMPNS
+   // Not fatal, datagrams get stamped on userspace if the kernel can't do it.
+   if (setsockopt(s->socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+		  sizeof(int)) < 0)
+      WARN("setsockopt SO_TIMESTAMPNS failed. %s\n", strerror(errno));
+#endif
+
+   return EINA_TRUE;
+}
+
+/*
+ * Fills the receiving interface and the receive timestamp of a datagram from
+ * its control messages.
+ *
+ * The timestamp is the kernel's when SO_TIMESTAMPNS is available, otherwise
+ * it's taken now, right after the datagram was read. The kernel drop counter
+ * comes along when SO_RXQ_OVFL is enabled.
+ */
+static void
+eupnp_udp_datagram_control_parse(Eupnp_UDP_Datagram *d, struct msghdr *msg)
+{
+   struct cmsghdr *cmsg;
+   Eina_Bool stamped = EINA_FALSE;
+
+   d->ifindex = 0;
+   d->drops = 0;
+
+   for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+     {
+#ifdef IP_PKTINFO
+	if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+	  {
+	     struct in_pktinfo info;
+
+	     memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+	     d->ifindex = info.ipi_ifindex;
+	  }
+#endif
+#ifdef SCM_TIMESTAMPNS
+	if (cmsg->cmsg_level == SOL_SOCKET &&
+	    cmsg->cmsg_type == SCM_TIMESTAMPNS)
+	  {
+	     memcpy(&d->timestamp, CMSG_DATA(cmsg), sizeof(struct timespec));
+	     stamped = EINA_TRUE;
+	  }
+#endif
+#ifdef SO_RXQ_OVFL
+	if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+	   memcpy(&d->drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+#endif
+     }
+
+   if (!stamped)
+      clock_gettime(CLOCK_REALTIME, &d->timestamp);
+}
+
+static void
+eupnp_udp_transport_uring_cb(void *data, int res, Eina_Bool more, void *buf)
+{
+   Eupnp_UDP_Uring *u = data;
+   Eupnp_UDP_Datagram *d = u->target;
+   struct sockaddr *name;
+   struct msghdr control;
+   void *payload;
+   size_t len;
+
+   if (!more) u->armed = EINA_FALSE;
+
+   if (res < 0)
+     {
+	// Out of buffers, datagrams wait on the socket until re-armed
+	if (res != -ENOBUFS)
+	   ERROR("io_uring receive failed. %s\n", strerror(-res));
+	return;
+     }
+
+   if (!buf || !d) return;
+
+   payload = eupnp_uring_recvmsg_parse(buf, res, &u->msg, &len, &name, &control);
+
+   if (!payload)
+     {
+	ERROR("Malformed io_uring receive buffer.\n");
+	return;
+     }
+
+   if ((control.msg_flags & MSG_TRUNC) || len > u->target_len)
+     {
+	DEBUG("Discarding truncated datagram\n");
+	d->truncated++;
+	return;
+     }
+
+   memcpy(d->data, payload, len);
+   d->len = len;
+   d->data[len] = '\0';
+   d->host[0] = '\0';
+
+   if (name)
+      memcpy(&d->addr, name, sizeof(d->addr));
+
+   eupnp_udp_datagram_control_parse(d, &control);
+   u->received = EINA_TRUE;
+
+   EUPNP_PROBE3(datagram_receive, d->len, d->addr.sin_addr.s_addr, d->ifindex);
+}
+
+static Eina_Bool
+eupnp_udp_transport_uring_arm(Eupnp_UDP_Uring *u)
+{
+   u->armed = eupnp_uring_recvmsg_multishot(u->ring, &u->op, u->socket, &u->msg);
+   return u->armed;
+}
+
+static void
+eupnp_udp_transport_uring_free(Eupnp_UDP_Uring *u)
+{
+   eupnp_uring_free(u->ring);
+   free(u);
+}
+
+/*
+ * Sets up receiving through io_uring.
+ *
+ * @return receive state or NULL to keep using recvmsg(), e.g. when built
+ *         without io_uring or on older kernels.
+ */
+static Eupnp_UDP_Uring *
+eupnp_udp_transport_uring_new(Eupnp_UDP_Transport *s)
+{
+   Eupnp_UDP_Uring *u;
+
+   u = calloc(1, sizeof(Eupnp_UDP_Uring));
+
+   if (!u)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not allocate io_uring receive state.\n");
+	return NULL;
+     }
+
+   u->ring = eupnp_uring_new(EUPNP_URING_ENTRIES);
+
+   if (!u->ring)
+     {
+	free(u);
+	return NULL;
+     }
+
+   u->buffers = eupnp_uring_buffers_new(u->ring, EUPNP_UDP_URING_BUFFERS,
+					EUPNP_UDP_URING_BUFFER_SIZE);
+   u->socket = s->socket;
+   u->op.cb = eupnp_udp_transport_uring_cb;
+   u->op.data = u;
+   u->op.buffers = u->buffers;
+   u->msg.msg_namelen = sizeof(struct sockaddr_in);
+   u->msg.msg_controllen = EUPNP_UDP_CONTROL_LEN;
+
+   // Armed right away, callers wait on the ring before the first read
+   if (!u->buffers || !eupnp_udp_transport_uring_arm(u) ||
+       !eupnp_uring_submit(u->ring))
+     {
+	WARN("Could not receive through io_uring, using recvmsg().\n");
+	eupnp_udp_transport_uring_free(u);
+	return NULL;
+     }
+
+   INFO("Receiving datagrams through io_uring.\n");
+
+   return u;
+}
+
+/*
+ * Reads the next datagram queued on the ring into d
+ */
+static Eina_Bool
+eupnp_udp_transport_uring_read(Eupnp_UDP_Uring *u, Eupnp_UDP_Datagram *d, size_t data_len)
+{
+   if (!u->armed) eupnp_udp_transport_uring_arm(u);
+
+   u->target = d;
+   u->target_len = data_len;
+   u->received = EINA_FALSE;
+   d->truncated = 0;
+
+   while (eupnp_uring_process(u->ring, 1))
+      if (u->received) break;
+
+   u->target = NULL;
+
+   return u->received;
+}
+
+/*
+ * Reads the next datagram into d, filling the sender address (if addr is
+ * set), the receiving interface and the receive timestamp. Datagrams that do
+ * not fit in data_len are discarded and counted on d->truncated, rather than
+ * handed out cut.
+ */
+static Eina_Bool
+eupnp_udp_transport_datagram_read(Eupnp_UDP_Transport *s, Eupnp_UDP_Datagram *d, size_t data_len, Eina_Bool addr)
+{
+   char control[EUPNP_UDP_CONTROL_LEN];
+   struct msghdr msg;
+   struct iovec iov;
+   ssize_t cnt;
+
+   if (s->uring)
+      return eupnp_udp_transport_uring_read(s->uring, d, data_len);
+
+   d->truncated = 0;
+
+   while (1)
+     {
+	iov.iov_base = d->data;
+	iov.iov_len = data_len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+
+	if (addr)
+	  {
+	     msg.msg_name = &d->addr;
+	     msg.msg_namelen = sizeof(d->addr);
+	  }
+
+	cnt = recvmsg(s->socket, &msg, 0);
+
+	if (cnt < 0)
+	  {
+	     if (errno != EAGAIN && errno != EWOULDBLOCK)
+		ERROR("recvmsg failed. %s\n", strerror(errno));
+	     return EINA_FALSE;
+	  }
+
+	if (!(msg.msg_flags & MSG_TRUNC)) break;
+
+	DEBUG("Discarding truncated datagram\n");
+	d->truncated++;
+     }
+
+   d->len = cnt;
+   d->data[cnt] = '\0';
+   d->host[0] = '\0';
+   eupnp_udp_datagram_control_parse(d, &msg);
+
+   EUPNP_PROBE3(datagram_receive, d->len, d->addr.sin_addr.s_addr, d->ifindex);
+
    return EINA_TRUE;
 }
 
@@ -146,6 +472,8 @@ eupnp_udp_transport_new(const char *addr, int port, const char *iface_addr)
 	return NULL;
      }
 
+   s->uring = eupnp_udp_transport_uring_new(s);
+
    return s;
 }
 
@@ -159,86 +487,416 @@ eupnp_udp_transport_close(Eupnp_UDP_Transport *s)
 void
 eupnp_udp_transport_free(Eupnp_UDP_Transport *s)
 {
-   if (s) free(s);
+   if (!s) return;
+   if (s->uring) eupnp_udp_transport_uring_free(s->uring);
+   free(s);
 }
 
-Eupnp_UDP_Datagram *
-eupnp_udp_transport_recv(Eupnp_UDP_Transport *s)
+/*
+ * Sets socket options of the transport. Transports are created with
+ * EUPNP_UDP_RCVBUF bytes of receive buffer and SO_RXQ_OVFL enabled.
+ *
+ * Buffer sizes go over the net.core.rmem_max and wmem_max sysctls only for
+ * privileged (CAP_NET_ADMIN) processes, they are silently capped otherwise;
+ * see eupnp_udp_transport_options_get() for the sizes in effect. Busy polling
+ * spins up to busy_poll microseconds on the device queue on blocking reads,
+ * raising it over net.core.busy_read needs privileges as well.
+ *
+ * With rxq_ovfl, every datagram carries the number of datagrams the kernel
+ * dropped so far because the receive buffer was full, see
+ * Eupnp_UDP_Datagram.
+ *
+ * @param s transport
+ * @param options options to set, buffer sizes and busy_poll of 0 are left
+ *        untouched.
+ *
+ * @return EINA_TRUE if every option could be set, EINA_FALSE otherwise.
+ */
+Eina_Bool
+eupnp_udp_transport_options_set(Eupnp_UDP_Transport *s, const Eupnp_UDP_Transport_Options *options)
 {
-   Eupnp_UDP_Datagram *d;
-   int data_len;
+   Eina_Bool ret = EINA_TRUE;
+   int enable = options->rxq_ovfl;
+
+   if (!eupnp_udp_transport_buffer_set(s, EINA_TRUE, options->rcvbuf))
+      ret = EINA_FALSE;
 
-   if (!ioctl(s->socket, FIONREAD, &data_len))
-      DEBUG("Bytes available for reading: %d\n", data_len);
-   else
+   if (!eupnp_udp_transport_buffer_set(s, EINA_FALSE, options->sndbuf))
+      ret = EINA_FALSE;
+
+   if (options->busy_poll)
      {
-	// Don't know how many bytes are available, expect EUPNP_UDP_PACKET_LEN.
-	DEBUG("could not determine how many bytes available.\n");
-	data_len = EUPNP_UDP_PACKET_LEN;
+#ifdef SO_BUSY_POLL
+	if (setsockopt(s->socket, SOL_SOCKET, SO_BUSY_POLL, &options->busy_poll,
+		       sizeof(int)) < 0)
+	  {
+	     WARN("setsockopt SO_BUSY_POLL failed. %s\n", strerror(errno));
+	     ret = EINA_FALSE;
+	  }
+#else
+	WARN("Busy polling not supported.\n");
+	ret = EINA_FALSE;
+#endif
      }
 
-   d = eupnp_udp_datagram_new(NULL, 0, NULL, data_len);
+#ifdef SO_RXQ_OVFL
+   if (setsockopt(s->socket, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(int)) < 0)
+     {
+	WARN("setsockopt SO_RXQ_OVFL failed. %s\n", strerror(errno));
+	ret = EINA_FALSE;
+     }
+#else
+   if (enable)
+     {
+	WARN("Kernel drop counts not supported.\n");
+	ret = EINA_FALSE;
+     }
+#endif
 
-   if (!d) return NULL;
+   return ret;
+}
 
-   recv(s->socket, d->data, data_len, 0);
+/*
+ * Retrieves the socket options in effect. Buffer sizes are those the kernel
+ * accounts, which is twice the size set to make room for its bookkeeping.
+ */
+void
+eupnp_udp_transport_options_get(const Eupnp_UDP_Transport *s, Eupnp_UDP_Transport_Options *options)
+{
+   socklen_t len;
+   int value;
+
+   memset(options, 0, sizeof(Eupnp_UDP_Transport_Options));
+
+   len = sizeof(int);
+   if (!getsockopt(s->socket, SOL_SOCKET, SO_RCVBUF, &value, &len))
+      options->rcvbuf = value;
+
+   len = sizeof(int);
+   if (!getsockopt(s->socket, SOL_SOCKET, SO_SNDBUF, &value, &len))
+      options->sndbuf = value;
+
+#ifdef SO_BUSY_POLL
+   len = sizeof(int);
+   if (!getsockopt(s->socket, SOL_SOCKET, SO_BUSY_POLL, &value, &len))
+      options->busy_poll = value;
+#endif
+
+#ifdef SO_RXQ_OVFL
+   len = sizeof(int);
+   if (!getsockopt(s->socket, SOL_SOCKET, SO_RXQ_OVFL, &value, &len))
+      options->rxq_ovfl = !!value;
+#endif
+}
 
-   return d;
+/*
+ * Attaches a classic BPF program to the socket. Datagrams it rejects are
+ * dropped by the kernel before being queued, so they are never copied to
+ * user space nor wake up the caller. See eupnp_socket_filter_attach() for
+ * generating one.
+ *
+ * @param s transport
+ * @param insns program, replacing the one attached if any, or NULL to detach
+ * @param count number of instructions
+ *
+ * @return EINA_TRUE on success, EINA_FALSE otherwise.
+ */
+Eina_Bool
+eupnp_udp_transport_filter_set(Eupnp_UDP_Transport *s, const struct sock_filter *insns, unsigned short count)
+{
+   struct sock_fprog prog;
+   int unused = 0;
+
+   if (!insns)
+     {
+	if (setsockopt(s->socket, SOL_SOCKET, SO_DETACH_FILTER, &unused, sizeof(int)) < 0 &&
+	    errno != ENOENT)
+	  {
+	     ERROR("setsockopt SO_DETACH_FILTER failed. %s\n", strerror(errno));
+	     return EINA_FALSE;
+	  }
+	return EINA_TRUE;
+     }
+
+   prog.len = count;
+   prog.filter = (struct sock_filter *)insns;
+
+   if (setsockopt(s->socket, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+     {
+	ERROR("setsockopt SO_ATTACH_FILTER failed. %s\n", strerror(errno));
+	return EINA_FALSE;
+     }
+
+   return EINA_TRUE;
 }
 
+/*
+ * Retrieves the file descriptor to wait on for incoming datagrams: the
+ * io_uring instance when receiving through it, the socket otherwise.
+ */
+int
+eupnp_udp_transport_fd_get(const Eupnp_UDP_Transport *s)
+{
+   if (s->uring) return eupnp_uring_fd_get(s->uring->ring);
+   return s->socket;
+}
+
+/*
+ * Retrieves the io_uring instance datagrams are received through, e.g. for
+ * its statistics.
+ *
+ * @return ring or NULL when receiving with recvmsg().
+ */
+Eupnp_Uring *
+eupnp_udp_transport_uring_get(const Eupnp_UDP_Transport *s)
+{
+   return s->uring ? s->uring->ring : NULL;
+}
+
+/*
+ * Receives a datagram from the transport without retrieving the sender
+ * address.
+ *
+ * @param s transport to read from
+ *
+ * @return New datagram, which must be freed with
+ *         eupnp_udp_transport_datagram_free(), or NULL on error.
+ */
 Eupnp_UDP_Datagram *
-eupnp_udp_transport_recvfrom(Eupnp_UDP_Transport *s)
+eupnp_udp_transport_recv(Eupnp_UDP_Transport *s)
 {
    Eupnp_UDP_Datagram *d;
-   int data_len;
 
-   if (!ioctl(s->socket, FIONREAD, &data_len))
-      DEBUG("ioctl says %d bytes available for reading\n", data_len);
-   else
+   // Sizing the buffer with FIONREAD first would race with other threads
+   // receiving on the socket, always expect up to EUPNP_UDP_PACKET_LEN.
+   d = eupnp_udp_datagram_new(EUPNP_UDP_PACKET_LEN);
+
+   if (!d) return NULL;
+
+   if (!eupnp_udp_transport_datagram_read(s, d, EUPNP_UDP_PACKET_LEN, EINA_FALSE))
      {
-	// Don't know how many bytes are available, expect EUPNP_UDP_PACKET_LEN.
-	DEBUG("could not determine how many bytes available.\n");
-	data_len = EUPNP_UDP_PACKET_LEN;
+	eupnp_udp_datagram_free(d);
+	return NULL;
      }
 
-   d = eupnp_udp_datagram_new(NULL, 0, NULL, data_len);
+   return d;
+}
 
-   if (!d) return NULL;
+/*
+ * Receives a datagram from the transport along with the sender address.
+ *
+ * The sender address is stored on the datagram itself, so concurrent calls on
+ * the same transport are safe, unless it receives through io_uring.
+ *
+ * @param s transport to read from
+ *
+ * @return New datagram, which must be freed with
+ *         eupnp_udp_transport_datagram_free(), or NULL on error.
+ */
+Eupnp_UDP_Datagram *
+eupnp_udp_transport_recvfrom(Eupnp_UDP_Transport *s)
+{
+   Eupnp_UDP_Datagram *d;
 
-   recvfrom(s->socket, d->data, data_len, 0,
-	    (struct sockaddr *)&(s->in_addr), &(s->in_addr_len));
+   // See eupnp_udp_transport_recv()
+   d = eupnp_udp_datagram_new(EUPNP_UDP_PACKET_LEN);
+
+   if (!d) return NULL;
 
-   d->host = inet_ntoa(s->in_addr.sin_addr);
-   d->port = ntohs(s->in_addr.sin_port);
+   if (!eupnp_udp_transport_datagram_read(s, d, EUPNP_UDP_PACKET_LEN, EINA_TRUE))
+     {
+	eupnp_udp_datagram_free(d);
+	return NULL;
+     }
 
    return d;
 }
 
+/*
+ * Sends a NULL-terminated buffer to addr:port.
+ *
+ * The destination address is built on the stack, the transport is left
+ * untouched.
+ *
+ * @return Number of bytes sent or -1 on error.
+ */
 int
 eupnp_udp_transport_sendto(Eupnp_UDP_Transport *s, const void *buffer, const char *addr, int port)
 {
+   struct sockaddr_in dest;
    int cnt;
 
-   s->in_addr.sin_family = AF_INET;
-   s->in_addr.sin_port = htons(port);
+   memset(&dest, 0, sizeof(dest));
+   dest.sin_family = AF_INET;
+   dest.sin_port = htons(port);
 
-   if (inet_aton(addr, &(s->in_addr.sin_addr)) == 0)
+   if (inet_aton(addr, &dest.sin_addr) == 0)
      {
-	ERROR("could not convert address. %s\n", strerror(errno));
+	ERROR("could not convert address %s.\n", addr);
 	return -1;
      }
 
    cnt = sendto(s->socket, buffer,
 		strlen((char *)buffer)*sizeof(char), 0,
-		(struct sockaddr *)&(s->in_addr), s->in_addr_len);
+		(struct sockaddr *)&dest, sizeof(dest));
 
    return cnt;
 }
 
+/*
+ * Sends len bytes of buffer to a binary address, e.g. the source address of a
+ * received datagram
+ *
+ * @return number of bytes sent or -1 on error.
+ */
+int
+eupnp_udp_transport_sendto_addr(Eupnp_UDP_Transport *s, const void *buffer, size_t len, const struct sockaddr_in *dest)
+{
+   return sendto(s->socket, buffer, len, 0, (const struct sockaddr *)dest,
+		 sizeof(struct sockaddr_in));
+}
+
+/*
+ * Sends several datagrams to the same destination
+ *
+ * Uses a single sendmmsg() system call per EUPNP_UDP_BATCH_MAX datagrams where
+ * available, one sendto() per datagram otherwise.
+ *
+ * @param s transport
+ * @param packets datagrams, one buffer each
+ * @param count number of datagrams
+ * @param dest destination address
+ *
+ * @return number of datagrams sent, which is less than count on error. When
+ *         the socket send buffer is full errno is EAGAIN and the remaining
+ *         datagrams may be sent again later.
+ */
+unsigned int
+eupnp_udp_transport_sendto_batch(Eupnp_UDP_Transport *s, const struct iovec *packets, unsigned int count, const struct sockaddr_in *dest)
+{
+   unsigned int sent = 0;
+#ifdef HAVE_SENDMMSG
+   struct mmsghdr msgs[EUPNP_UDP_BATCH_MAX];
+   unsigned int i, n;
+   int ret;
+
+   while (sent < count)
+     {
+	n = count - sent;
+	if (n > EUPNP_UDP_BATCH_MAX) n = EUPNP_UDP_BATCH_MAX;
+
+	memset(msgs, 0, n * sizeof(struct mmsghdr));
+
+	for (i = 0; i < n; i++)
+	  {
+	     msgs[i].msg_hdr.msg_name = (void *)dest;
+	     msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	     msgs[i].msg_hdr.msg_iov = (struct iovec *)&packets[sent + i];
+	     msgs[i].msg_hdr.msg_iovlen = 1;
+	  }
+
+	ret = sendmmsg(s->socket, msgs, n, 0);
+
+	if (ret < 0 && errno == EINTR) continue;
+
+	if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	   break;
+
+	if (ret <= 0)
+	  {
+	     ERROR("Could not send datagrams: %s\n", strerror(errno));
+	     break;
+	  }
+
+	sent += ret;
+     }
+#else
+   for (; sent < count; sent++)
+      if (eupnp_udp_transport_sendto_addr(s, packets[sent].iov_base,
+					  packets[sent].iov_len, dest) < 0)
+	{
+	   if (errno != EAGAIN && errno != EWOULDBLOCK)
+	      ERROR("Could not send datagrams: %s\n", strerror(errno));
+	   break;
+	}
+#endif
+
+   return sent;
+}
+
+/*
+ * Receives a datagram into a previously created datagram, see
+ * eupnp_udp_transport_datagram_new().
+ *
+ * Lets callers reuse datagram buffers instead of allocating one for every
+ * datagram received. Datagrams longer than the buffer are discarded, see
+ * Eupnp_UDP_Datagram.
+ *
+ * @param s transport to read from
+ * @param d datagram to read into
+ *
+ * @return EINA_TRUE if a datagram was read, EINA_FALSE on error or if no
+ *         datagram was available.
+ */
+Eina_Bool
+eupnp_udp_transport_recvfrom_into(Eupnp_UDP_Transport *s, Eupnp_UDP_Datagram *d)
+{
+   return eupnp_udp_transport_datagram_read(s, d, d->size, EINA_TRUE);
+}
+
+/*
+ * Creates an empty datagram for use with eupnp_udp_transport_recvfrom_into()
+ *
+ * @param size maximum datagram length. EUPNP_UDP_PACKET_LEN is enough for
+ *        SSDP.
+ *
+ * @return New datagram, which must be freed with
+ *         eupnp_udp_transport_datagram_free(), or NULL on error.
+ */
+Eupnp_UDP_Datagram *
+eupnp_udp_transport_datagram_new(size_t size)
+{
+   return eupnp_udp_datagram_new(size);
+}
+
 void
 eupnp_udp_transport_datagram_free(Eupnp_UDP_Datagram *datagram)
 {
    eupnp_udp_datagram_free(datagram);
 }
 
+/*
+ * Retrieves the sender host of a datagram in dotted notation.
+ *
+ * The string is formatted on the first call and stored on the datagram, so it
+ * is valid for as long as the datagram is.
+ *
+ * @param d datagram received with eupnp_udp_transport_recvfrom()
+ *
+ * @return sender host or NULL on error.
+ */
+const char *
+eupnp_udp_datagram_host_get(Eupnp_UDP_Datagram *d)
+{
+   if (d->host[0]) return d->host;
+
+   if (!inet_ntop(AF_INET, &d->addr.sin_addr, d->host, sizeof(d->host)))
+     {
+	ERROR("could not format datagram host. %s\n", strerror(errno));
+	d->host[0] = '\0';
+	return NULL;
+     }
+
+   return d->host;
+}
+
+/*
+ * Retrieves the sender port of a datagram in host byte order.
+ */
+int
+eupnp_udp_datagram_port_get(const Eupnp_UDP_Datagram *d)
+{
+   return ntohs(d->addr.sin_port);
+}
+
 
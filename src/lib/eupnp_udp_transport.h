@@ -23,6 +23,12 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <eupnp_uring.h>
 
 #ifndef _EUPNP_UDP_TRANSPORT_H
 #define _EUPNP_UDP_TRANSPORT_H
@@ -30,10 +36,42 @@
 
 #define EUPNP_UDP_PACKET_LEN 5000
 
+/* Datagrams handed to the kernel per system call when sending in batches */
+#define EUPNP_UDP_BATCH_MAX 64
+
+/*
+ * Receive buffers of the io_uring backend, a power of two. Each holds a
+ * datagram along with its sender address and control messages.
+ */
+#define EUPNP_UDP_URING_BUFFERS 128
+#define EUPNP_UDP_URING_BUFFER_SIZE 8192
+
+/*
+ * Receive buffer transports are created with, in bytes. Large enough to hold
+ * a storm of announcements while the handler is busy.
+ */
+#define EUPNP_UDP_RCVBUF (1024 * 1024)
+
 typedef struct _Eupnp_UDP_Transport Eupnp_UDP_Transport;
+typedef struct _Eupnp_UDP_Transport_Options Eupnp_UDP_Transport_Options;
 typedef struct _Eupnp_UDP_Datagram Eupnp_UDP_Datagram;
+typedef struct _Eupnp_UDP_Uring Eupnp_UDP_Uring;
+
+struct sock_filter;
 
 
+/*
+ * A transport is never written to after eupnp_udp_transport_new() returns, so
+ * it may be shared by several threads receiving/sending on the same socket,
+ * except for receiving in io_uring mode (see below). in_addr is the bind
+ * address.
+ *
+ * uring is set when datagrams are received through io_uring (configure
+ * --enable-io-uring, Linux >= 6.3, EUPNP_IO_URING not set to 0). The ring is
+ * not thread safe, so receiving is then limited to a single thread, which
+ * must wait on eupnp_udp_transport_fd_get() instead of the socket. Sending
+ * may still be done from any thread.
+ */
 struct _Eupnp_UDP_Transport {
    int socket;
    struct sockaddr_in in_addr;
@@ -41,22 +79,71 @@ struct _Eupnp_UDP_Transport {
    socklen_t in_addr_len;
    socklen_t mreq_len;
    socklen_t host_len;
+   Eupnp_UDP_Uring *uring;
 };
 
 
+/*
+ * Socket options, see eupnp_udp_transport_options_set()
+ */
+struct _Eupnp_UDP_Transport_Options {
+   int rcvbuf;          /* receive buffer, in bytes */
+   int sndbuf;          /* send buffer, in bytes */
+   int busy_poll;       /* microseconds to busy poll on reads, 0 to disable */
+   Eina_Bool rxq_ovfl;  /* report kernel drop counts */
+};
+
+
+/*
+ * The sender address is kept in binary form. Use eupnp_udp_datagram_host_get()
+ * and eupnp_udp_datagram_port_get() for printable values; the host string is
+ * only formatted on demand and lives as long as the datagram.
+ *
+ * timestamp is the time (CLOCK_REALTIME) the datagram arrived on the socket,
+ * as reported by the kernel (SO_TIMESTAMPNS).
+ *
+ * size is the capacity of data (not counting the NULL terminator), len the
+ * length of the datagram it holds. ifindex is the interface the datagram
+ * arrived on, 0 if unknown.
+ *
+ * truncated is the number of datagrams longer than size the read discarded
+ * before this one. It is set even when the read finds no datagram.
+ *
+ * drops is the number of datagrams the kernel dropped on the socket for lack
+ * of buffer space before this one was queued. It wraps around and stays 0
+ * without SO_RXQ_OVFL, see eupnp_udp_transport_options_set().
+ */
 struct _Eupnp_UDP_Datagram {
    char *data;
-   const char *host;
-   int port;
+   size_t size;
+   size_t len;
+   struct sockaddr_in addr;
+   struct timespec timestamp;
+   unsigned int ifindex;
+   unsigned int truncated;
+   uint32_t drops;
+   char host[INET_ADDRSTRLEN];
 };
 
 
 Eupnp_UDP_Transport   *eupnp_udp_transport_new(const char *addr, int port, const char *iface_addr) EINA_ARG_NONNULL(1,2,3);
 int                    eupnp_udp_transport_close(Eupnp_UDP_Transport *s) EINA_ARG_NONNULL(1);
 void                   eupnp_udp_transport_free(Eupnp_UDP_Transport *s) EINA_ARG_NONNULL(1);
+int                    eupnp_udp_transport_fd_get(const Eupnp_UDP_Transport *s) EINA_ARG_NONNULL(1);
+Eina_Bool              eupnp_udp_transport_options_set(Eupnp_UDP_Transport *s, const Eupnp_UDP_Transport_Options *options) EINA_ARG_NONNULL(1,2);
+void                   eupnp_udp_transport_options_get(const Eupnp_UDP_Transport *s, Eupnp_UDP_Transport_Options *options) EINA_ARG_NONNULL(1,2);
+Eina_Bool              eupnp_udp_transport_filter_set(Eupnp_UDP_Transport *s, const struct sock_filter *insns, unsigned short count) EINA_ARG_NONNULL(1);
+Eupnp_Uring           *eupnp_udp_transport_uring_get(const Eupnp_UDP_Transport *s) EINA_ARG_NONNULL(1);
 Eupnp_UDP_Datagram    *eupnp_udp_transport_recv(Eupnp_UDP_Transport *s) EINA_ARG_NONNULL(1);
 Eupnp_UDP_Datagram    *eupnp_udp_transport_recvfrom(Eupnp_UDP_Transport *s) EINA_ARG_NONNULL(1);
 int                    eupnp_udp_transport_sendto(Eupnp_UDP_Transport *s, const void *buffer, const char *addr, int port) EINA_ARG_NONNULL(1,2,3,4);
+unsigned int           eupnp_udp_transport_sendto_batch(Eupnp_UDP_Transport *s, const struct iovec *packets, unsigned int count, const struct sockaddr_in *dest) EINA_ARG_NONNULL(1,2,4);
+int                    eupnp_udp_transport_sendto_addr(Eupnp_UDP_Transport *s, const void *buffer, size_t len, const struct sockaddr_in *dest) EINA_ARG_NONNULL(1,2,4);
+Eina_Bool              eupnp_udp_transport_recvfrom_into(Eupnp_UDP_Transport *s, Eupnp_UDP_Datagram *d) EINA_ARG_NONNULL(1,2);
+Eupnp_UDP_Datagram    *eupnp_udp_transport_datagram_new(size_t size);
 void                   eupnp_udp_transport_datagram_free(Eupnp_UDP_Datagram *datagram) EINA_ARG_NONNULL(1);
 
+const char            *eupnp_udp_datagram_host_get(Eupnp_UDP_Datagram *d) EINA_ARG_NONNULL(1);
+int                    eupnp_udp_datagram_port_get(const Eupnp_UDP_Datagram *d) EINA_ARG_NONNULL(1);
+
 #endif /* _Eupnp_UDP_Transport_H */
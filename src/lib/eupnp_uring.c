@@ -0,0 +1,651 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <Eina.h>
+
+#ifdef HAVE_LIBURING
+# include <liburing.h>
+
+/* Linux 6.3, missing from the kernel headers older liburing builds against */
+# ifndef IORING_FEAT_REG_REG_RING
+#  define IORING_FEAT_REG_REG_RING (1U << 13)
+# endif
+#endif
+
+#include "eupnp_error.h"
+#include "eupnp_uring.h"
+
+/*
+ * Completion based I/O on io_uring.
+ *
+ * Receives are multishot: one submission keeps delivering completions until
+ * it fails or is cancelled, each into a buffer the kernel picks from a
+ * provided buffer ring. Submissions made while handling completions are
+ * queued and handed to the kernel together, so a wakeup costs a single
+ * io_uring_enter() however many datagrams or connections it serves.
+ *
+ * Rings are not thread safe, each one is meant to be driven by one thread.
+ */
+
+#ifdef HAVE_LIBURING
+
+struct _Eupnp_Uring_Buffers {
+   Eupnp_Uring *u;
+   Eupnp_Uring_Buffers *next;
+   struct io_uring_buf_ring *br;
+   char *mem;
+   unsigned int count;
+   size_t size;
+   unsigned short bgid;
+};
+
+struct _Eupnp_Uring {
+   struct io_uring ring;
+   Eupnp_Uring_Buffers *buffers;
+   unsigned short next_bgid;
+   Eupnp_Uring_Stats stats;
+};
+
+
+/*
+ * Private API
+ */
+
+static struct io_uring_sqe *
+_eupnp_uring_sqe_get(Eupnp_Uring *u)
+{
+   struct io_uring_sqe *sqe;
+
+   sqe = io_uring_get_sqe(&u->ring);
+
+   if (!sqe)
+     {
+	// Submission queue full, make room
+	eupnp_uring_submit(u);
+	sqe = io_uring_get_sqe(&u->ring);
+     }
+
+   if (!sqe)
+      ERROR("io_uring submission queue full.\n");
+
+   return sqe;
+}
+
+static void
+_eupnp_uring_buffer_recycle(Eupnp_Uring_Buffers *b, unsigned short bid)
+{
+   io_uring_buf_ring_add(b->br, b->mem + bid * b->size, b->size, bid,
+			 io_uring_buf_ring_mask(b->count), 0);
+   io_uring_buf_ring_advance(b->br, 1);
+}
+
+
+/*
+ * Public API
+ */
+
+/*
+ * Constructor for the Eupnp_Uring structure
+ *
+ * Multishot receives need Linux 6.0; rings are only set up on kernels that
+ * have the 6.3 register ring feature, so older ones fall back to plain
+ * socket calls. Setting EUPNP_IO_URING=0 in the environment disables rings
+ * altogether.
+ *
+ * @param entries submission queue size, e.g. EUPNP_URING_ENTRIES
+ *
+ * @return Eupnp_Uring instance or NULL if io_uring is not usable.
+ */
+Eupnp_Uring *
+eupnp_uring_new(unsigned int entries)
+{
+   Eupnp_Uring *u;
+   const char *env;
+   int ret;
+
+   env = getenv("EUPNP_IO_URING");
+   if (env && !strcmp(env, "0")) return NULL;
+
+   u = calloc(1, sizeof(Eupnp_Uring));
+
+   if (!u)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not create io_uring.\n");
+	return NULL;
+     }
+
+   ret = io_uring_queue_init(entries, &u->ring, 0);
+
+   if (ret < 0)
+     {
+	INFO("io_uring not available: %s\n", strerror(-ret));
+	free(u);
+	return NULL;
+     }
+
+   if (!(u->ring.features & IORING_FEAT_REG_REG_RING))
+     {
+	INFO("Kernel io_uring too old for multishot receives.\n");
+	io_uring_queue_exit(&u->ring);
+	free(u);
+	return NULL;
+     }
+
+   return u;
+}
+
+/*
+ * Destroys a ring and frees its buffer groups. Operations in flight are
+ * cancelled by the kernel and no callback is called from here, not even the
+ * last -ECANCELED call of operations passed to eupnp_uring_cancel(): process
+ * the ring until those came back first if their owners rely on it.
+ */
+void
+eupnp_uring_free(Eupnp_Uring *u)
+{
+   if (!u) return;
+
+   while (u->buffers)
+      eupnp_uring_buffers_free(u->buffers);
+
+   io_uring_queue_exit(&u->ring);
+   free(u);
+}
+
+/*
+ * Retrieves a file descriptor that becomes readable when completions are
+ * ready, for adding to a main loop. Call eupnp_uring_process() then.
+ */
+int
+eupnp_uring_fd_get(const Eupnp_Uring *u)
+{
+   return u->ring.ring_fd;
+}
+
+void
+eupnp_uring_stats_get(const Eupnp_Uring *u, Eupnp_Uring_Stats *stats)
+{
+   *stats = u->stats;
+}
+
+/*
+ * Hands queued submissions to the kernel
+ *
+ * @return EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_uring_submit(Eupnp_Uring *u)
+{
+   int ret;
+
+   if (!io_uring_sq_ready(&u->ring))
+      return EINA_TRUE;
+
+   u->stats.enters++;
+   ret = io_uring_submit(&u->ring);
+
+   if (ret < 0)
+     {
+	ERROR("io_uring submission failed: %s\n", strerror(-ret));
+	return EINA_FALSE;
+     }
+
+   return EINA_TRUE;
+}
+
+/*
+ * Dispatches up to max completions to their callbacks, without blocking
+ *
+ * When no completion is ready, queued submissions are handed to the kernel
+ * and pending completion work is run in a single call first.
+ *
+ * @param u ring
+ * @param max maximum number of completions to dispatch
+ *
+ * @return number of completions dispatched.
+ */
+unsigned int
+eupnp_uring_process(Eupnp_Uring *u, unsigned int max)
+{
+   struct io_uring_cqe *cqe;
+   Eupnp_Uring_Buffers *buffers;
+   Eupnp_Uring_Op *op;
+   unsigned int n = 0;
+   unsigned int flags;
+   unsigned short bid = 0;
+   void *buf;
+   int res;
+
+   if (!io_uring_cq_ready(&u->ring))
+     {
+	u->stats.enters++;
+	io_uring_submit_and_get_events(&u->ring);
+     }
+
+   while (n < max && !io_uring_peek_cqe(&u->ring, &cqe))
+     {
+	op = io_uring_cqe_get_data(cqe);
+	res = cqe->res;
+	flags = cqe->flags;
+	io_uring_cqe_seen(&u->ring, cqe);
+	n++;
+
+	// Cancellations carry no operation
+	if (!op) continue;
+
+	// The callback may release the operation, keep what is needed after it
+	buffers = op->buffers;
+	buf = NULL;
+
+	if (buffers && (flags & IORING_CQE_F_BUFFER))
+	  {
+	     bid = flags >> IORING_CQE_BUFFER_SHIFT;
+	     buf = buffers->mem + bid * buffers->size;
+	  }
+
+	op->cb(op->data, res, !!(flags & IORING_CQE_F_MORE), buf);
+
+	if (buf) _eupnp_uring_buffer_recycle(buffers, bid);
+     }
+
+   u->stats.completions += n;
+
+   // Re-arms and new operations queued by the callbacks
+   eupnp_uring_submit(u);
+
+   return n;
+}
+
+/*
+ * Creates a group of buffers the kernel receives into, see
+ * eupnp_uring_recvmsg_multishot() and eupnp_uring_recv_multishot().
+ *
+ * @param u ring
+ * @param count number of buffers, a power of two
+ * @param size size of each buffer
+ *
+ * @return buffer group, freed along with the ring, or NULL on error.
+ */
+Eupnp_Uring_Buffers *
+eupnp_uring_buffers_new(Eupnp_Uring *u, unsigned int count, size_t size)
+{
+   Eupnp_Uring_Buffers *b;
+   unsigned int i;
+   int ret;
+
+   b = calloc(1, sizeof(Eupnp_Uring_Buffers));
+
+   if (b) b->mem = malloc(count * size);
+
+   if (!b || !b->mem)
+     {
+	eina_error_set(EINA_ERROR_OUT_OF_MEMORY);
+	ERROR("Could not allocate io_uring buffers.\n");
+	free(b);
+	return NULL;
+     }
+
+   b->u = u;
+   b->count = count;
+   b->size = size;
+   b->bgid = u->next_bgid;
+   b->br = io_uring_setup_buf_ring(&u->ring, count, b->bgid, 0, &ret);
+
+   if (!b->br)
+     {
+	ERROR("Could not register io_uring buffers: %s\n", strerror(-ret));
+	free(b->mem);
+	free(b);
+	return NULL;
+     }
+
+   for (i = 0; i < count; i++)
+      io_uring_buf_ring_add(b->br, b->mem + i * size, size, i,
+			    io_uring_buf_ring_mask(count), i);
+   io_uring_buf_ring_advance(b->br, count);
+
+   u->next_bgid++;
+   b->next = u->buffers;
+   u->buffers = b;
+
+   return b;
+}
+
+/*
+ * Releases a buffer group. No operation may be using it.
+ */
+void
+eupnp_uring_buffers_free(Eupnp_Uring_Buffers *b)
+{
+   Eupnp_Uring_Buffers **p;
+
+   for (p = &b->u->buffers; *p; p = &(*p)->next)
+      if (*p == b)
+	{
+	   *p = b->next;
+	   break;
+	}
+
+   io_uring_free_buf_ring(&b->u->ring, b->br, b->count, b->bgid);
+   free(b->mem);
+   free(b);
+}
+
+size_t
+eupnp_uring_buffers_size_get(const Eupnp_Uring_Buffers *b)
+{
+   return b->size;
+}
+
+/*
+ * Starts receiving datagrams on a socket. Every completion carries one
+ * datagram laid out as described by msg, see eupnp_uring_recvmsg_parse().
+ *
+ * @param u ring
+ * @param op operation, op->buffers set to the buffer group to receive into
+ * @param fd socket
+ * @param msg only msg_namelen and msg_controllen are used; must stay valid
+ *        while the operation is armed
+ *
+ * @return EINA_TRUE if queued, EINA_FALSE on error.
+ */
+Eina_Bool
+eupnp_uring_recvmsg_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd, struct msghdr *msg)
+{
+   struct io_uring_sqe *sqe;
+
+   if (!op->buffers || !(sqe = _eupnp_uring_sqe_get(u)))
+      return EINA_FALSE;
+
+   io_uring_prep_recvmsg_multishot(sqe, fd, msg, 0);
+   sqe->flags |= IOSQE_BUFFER_SELECT;
+   sqe->buf_group = op->buffers->bgid;
+   io_uring_sqe_set_data(sqe, op);
+
+   return EINA_TRUE;
+}
+
+/*
+ * Starts receiving on a stream socket into op->buffers. A completion with
+ * res 0 means the peer closed the connection.
+ */
+Eina_Bool
+eupnp_uring_recv_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd)
+{
+   struct io_uring_sqe *sqe;
+
+   if (!op->buffers || !(sqe = _eupnp_uring_sqe_get(u)))
+      return EINA_FALSE;
+
+   io_uring_prep_recv_multishot(sqe, fd, NULL, 0, 0);
+   sqe->flags |= IOSQE_BUFFER_SELECT;
+   sqe->buf_group = op->buffers->bgid;
+   io_uring_sqe_set_data(sqe, op);
+
+   return EINA_TRUE;
+}
+
+/*
+ * Starts accepting connections. res is the new, non-blocking, socket.
+ */
+Eina_Bool
+eupnp_uring_accept_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd)
+{
+   struct io_uring_sqe *sqe;
+
+   if (!(sqe = _eupnp_uring_sqe_get(u)))
+      return EINA_FALSE;
+
+   io_uring_prep_multishot_accept(sqe, fd, NULL, NULL,
+				  SOCK_NONBLOCK | SOCK_CLOEXEC);
+   io_uring_sqe_set_data(sqe, op);
+
+   return EINA_TRUE;
+}
+
+/*
+ * Waits once for poll events (POLLIN, POLLOUT) on a file descriptor
+ */
+Eina_Bool
+eupnp_uring_poll_add(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd, unsigned int mask)
+{
+   struct io_uring_sqe *sqe;
+
+   if (!(sqe = _eupnp_uring_sqe_get(u)))
+      return EINA_FALSE;
+
+   io_uring_prep_poll_add(sqe, fd, mask);
+   io_uring_sqe_set_data(sqe, op);
+
+   return EINA_TRUE;
+}
+
+/*
+ * Cancels an operation. Its callback is called a last time from
+ * eupnp_uring_process(), with -ECANCELED unless it completed meanwhile, but
+ * not if the ring is freed before that completion is processed.
+ */
+Eina_Bool
+eupnp_uring_cancel(Eupnp_Uring *u, Eupnp_Uring_Op *op)
+{
+   struct io_uring_sqe *sqe;
+
+   if (!(sqe = _eupnp_uring_sqe_get(u)))
+      return EINA_FALSE;
+
+   io_uring_prep_cancel64(sqe, (uintptr_t)op, 0);
+   io_uring_sqe_set_data(sqe, NULL);
+
+   return EINA_TRUE;
+}
+
+/*
+ * Locates the parts of a datagram received by eupnp_uring_recvmsg_multishot()
+ *
+ * @param buf buffer passed to the callback
+ * @param res result passed to the callback
+ * @param msg message header the operation was started with
+ * @param len where to store the payload length, truncated to the buffer
+ * @param name where to store the sender address, may be NULL
+ * @param control filled for walking the control messages with CMSG_FIRSTHDR()
+ *        and CMSG_NXTHDR(), may be NULL. Its msg_flags are those of the
+ *        datagram, MSG_TRUNC if it did not fit in the buffer.
+ *
+ * @return payload or NULL if the buffer is malformed.
+ */
+void *
+eupnp_uring_recvmsg_parse(void *buf, int res, const struct msghdr *msg, size_t *len, struct sockaddr **name, struct msghdr *control)
+{
+   struct io_uring_recvmsg_out *out;
+   struct msghdr *m = (struct msghdr *)msg;
+
+   out = io_uring_recvmsg_validate(buf, res, m);
+   if (!out) return NULL;
+
+   if (name)
+      *name = out->namelen ? io_uring_recvmsg_name(out) : NULL;
+
+   if (control)
+     {
+	memset(control, 0, sizeof(struct msghdr));
+	control->msg_control = (char *)io_uring_recvmsg_name(out) + msg->msg_namelen;
+	control->msg_controllen = out->controllen;
+	control->msg_flags = out->flags;
+     }
+
+   *len = io_uring_recvmsg_payload_length(out, res, m);
+
+   return io_uring_recvmsg_payload(out, m);
+}
+
+#else /* !HAVE_LIBURING */
+
+/*
+ * Built without io_uring: no ring is ever created, so the remaining calls are
+ * never reached with a valid ring.
+ */
+
+Eupnp_Uring *
+eupnp_uring_new(unsigned int entries)
+{
+   (void)entries;
+
+   return NULL;
+}
+
+void
+eupnp_uring_free(Eupnp_Uring *u)
+{
+   (void)u;
+}
+
+int
+eupnp_uring_fd_get(const Eupnp_Uring *u)
+{
+   (void)u;
+
+   return -1;
+}
+
+void
+eupnp_uring_stats_get(const Eupnp_Uring *u, Eupnp_Uring_Stats *stats)
+{
+   (void)u;
+
+   memset(stats, 0, sizeof(Eupnp_Uring_Stats));
+}
+
+Eina_Bool
+eupnp_uring_submit(Eupnp_Uring *u)
+{
+   (void)u;
+
+   return EINA_FALSE;
+}
+
+unsigned int
+eupnp_uring_process(Eupnp_Uring *u, unsigned int max)
+{
+   (void)u;
+   (void)max;
+
+   return 0;
+}
+
+Eupnp_Uring_Buffers *
+eupnp_uring_buffers_new(Eupnp_Uring *u, unsigned int count, size_t size)
+{
+   (void)u;
+   (void)count;
+   (void)size;
+
+   return NULL;
+}
+
+void
+eupnp_uring_buffers_free(Eupnp_Uring_Buffers *b)
+{
+   (void)b;
+}
+
+size_t
+eupnp_uring_buffers_size_get(const Eupnp_Uring_Buffers *b)
+{
+   (void)b;
+
+   return 0;
+}
+
+Eina_Bool
+eupnp_uring_recvmsg_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd, struct msghdr *msg)
+{
+   (void)u;
+   (void)op;
+   (void)fd;
+   (void)msg;
+
+   return EINA_FALSE;
+}
+
+Eina_Bool
+eupnp_uring_recv_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd)
+{
+   (void)u;
+   (void)op;
+   (void)fd;
+
+   return EINA_FALSE;
+}
+
+Eina_Bool
+eupnp_uring_accept_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd)
+{
+   (void)u;
+   (void)op;
+   (void)fd;
+
+   return EINA_FALSE;
+}
+
+Eina_Bool
+eupnp_uring_poll_add(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd, unsigned int mask)
+{
+   (void)u;
+   (void)op;
+   (void)fd;
+   (void)mask;
+
+   return EINA_FALSE;
+}
+
+Eina_Bool
+eupnp_uring_cancel(Eupnp_Uring *u, Eupnp_Uring_Op *op)
+{
+   (void)u;
+   (void)op;
+
+   return EINA_FALSE;
+}
+
+void *
+eupnp_uring_recvmsg_parse(void *buf, int res, const struct msghdr *msg, size_t *len, struct sockaddr **name, struct msghdr *control)
+{
+   (void)buf;
+   (void)res;
+   (void)msg;
+   (void)len;
+   (void)name;
+   (void)control;
+
+   return NULL;
+}
+
+#endif /* HAVE_LIBURING */
@@ -0,0 +1,88 @@
+/* Eupnp - UPnP library
+ *
+ * Copyright (C) 2009 Andre Dieb Martins <andre.dieb@gmail.com>
+ *
+ * This file is part of Eupnp.
+ *
+ * Eupnp is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Eupnp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with Eupnp.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _EUPNP_URING_H
+#define _EUPNP_URING_H
+
+#include <Eina.h>
+#include <sys/socket.h>
+
+/*
+ * Optional io_uring backend, compiled in with --enable-io-uring. When not
+ * compiled in, or when the kernel refuses to set up a ring,
+ * eupnp_uring_new() returns NULL and callers keep using plain socket calls.
+ */
+#define EUPNP_URING_ENTRIES 256
+
+typedef struct _Eupnp_Uring Eupnp_Uring;
+typedef struct _Eupnp_Uring_Op Eupnp_Uring_Op;
+typedef struct _Eupnp_Uring_Buffers Eupnp_Uring_Buffers;
+typedef struct _Eupnp_Uring_Stats Eupnp_Uring_Stats;
+
+/*
+ * Called for every completion of an operation. res is the operation result
+ * (negative errno on error), more tells whether a multishot operation stays
+ * armed and buf is the provided buffer the data was received into, NULL if
+ * none. buf is handed back to the kernel when the callback returns.
+ */
+typedef void (*Eupnp_Uring_Cb) (void *data, int res, Eina_Bool more, void *buf);
+
+/*
+ * An operation in flight. Owned by the caller, must stay valid until its
+ * last completion (one without more) has been delivered.
+ */
+struct _Eupnp_Uring_Op {
+   Eupnp_Uring_Cb cb;
+   void *data;
+   Eupnp_Uring_Buffers *buffers;
+};
+
+/*
+ * enters counts io_uring_enter() system calls, completions the completions
+ * reaped. Their ratio is what the backend saves over one call per datagram.
+ */
+struct _Eupnp_Uring_Stats {
+   unsigned long enters;
+   unsigned long completions;
+};
+
+
+Eupnp_Uring         *eupnp_uring_new(unsigned int entries);
+void                 eupnp_uring_free(Eupnp_Uring *u) EINA_ARG_NONNULL(1);
+int                  eupnp_uring_fd_get(const Eupnp_Uring *u) EINA_ARG_NONNULL(1);
+void                 eupnp_uring_stats_get(const Eupnp_Uring *u, Eupnp_Uring_Stats *stats) EINA_ARG_NONNULL(1,2);
+unsigned int         eupnp_uring_process(Eupnp_Uring *u, unsigned int max) EINA_ARG_NONNULL(1);
+Eina_Bool            eupnp_uring_submit(Eupnp_Uring *u) EINA_ARG_NONNULL(1);
+
+Eupnp_Uring_Buffers *eupnp_uring_buffers_new(Eupnp_Uring *u, unsigned int count, size_t size) EINA_ARG_NONNULL(1);
+void                 eupnp_uring_buffers_free(Eupnp_Uring_Buffers *b) EINA_ARG_NONNULL(1);
+size_t               eupnp_uring_buffers_size_get(const Eupnp_Uring_Buffers *b) EINA_ARG_NONNULL(1);
+
+Eina_Bool            eupnp_uring_recvmsg_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd, struct msghdr *msg) EINA_ARG_NONNULL(1,2,4);
+Eina_Bool            eupnp_uring_recv_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd) EINA_ARG_NONNULL(1,2);
+Eina_Bool            eupnp_uring_accept_multishot(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd) EINA_ARG_NONNULL(1,2);
+Eina_Bool            eupnp_uring_poll_add(Eupnp_Uring *u, Eupnp_Uring_Op *op, int fd, unsigned int mask) EINA_ARG_NONNULL(1,2);
+Eina_Bool            eupnp_uring_cancel(Eupnp_Uring *u, Eupnp_Uring_Op *op) EINA_ARG_NONNULL(1,2);
+
+void                *eupnp_uring_recvmsg_parse(void *buf, int res, const struct msghdr *msg, size_t *len, struct sockaddr **name, struct msghdr *control) EINA_ARG_NONNULL(1,3,4);
+
+
+#endif /* _EUPNP_URING_H */